@@ -93,6 +93,12 @@ inline DataValue make_value(view::string_view str) {
 	return DV;
 }
 
+inline DataValue make_value(std::string &&str) {
+	DataValue DV;
+	DV.value = std::move(str);
+	return DV;
+}
+
 inline DataValue make_value(const QString &str) {
 	DataValue DV;
 	DV.value = str.toStdString();
@@ -148,6 +154,11 @@ inline std::string to_string(const DataValue &dv) {
 	}
 }
 
+// the text of a string value, without copying it, only valid while "dv" is
+inline view::string_view to_string_view(const DataValue &dv) {
+	return boost::get<std::string>(dv.value);
+}
+
 inline int to_integer(const DataValue &dv) {
 	return boost::get<int>(dv.value);
 }
@@ -104,58 +104,84 @@ bool isQuantifier(char ch) noexcept {
 	return ch == '*' || ch == '+' || ch == '?' || ch == pContext.Brace_Char;
 }
 
+// Character class sets used by shortcut_escape()
+struct AnsiClasses {
+	char White_Space[WHITE_SPACE_SIZE];
+	char Word_Char[ALNUM_CHAR_SIZE];
+	char Letter_Char[ALNUM_CHAR_SIZE];
+	bool Valid = true;
+};
+
 /*--------------------------------------------------------------------*
- * init_ansi_classes
+ * make_ansi_classes
  *
  * Generate character class sets using locale aware ANSI C functions.
  *
  *--------------------------------------------------------------------*/
-bool init_ansi_classes() noexcept {
+AnsiClasses make_ansi_classes() noexcept {
 
-	static bool initialized = false;
+	constexpr int Underscore = '_';
+	constexpr int Newline    = '\n';
 
-	if (!initialized) {
-		initialized = true; // Only need to generate character sets once.
+	AnsiClasses classes;
 
-		constexpr int Underscore = '_';
-		constexpr int Newline    = '\n';
+	int word_count   = 0;
+	int letter_count = 0;
+	int space_count  = 0;
 
-		int word_count   = 0;
-		int letter_count = 0;
-		int space_count  = 0;
-
-		for (int i = 1; i < UINT8_MAX; i++) {
-			if (safe_ctype<isalnum>(i) || i == Underscore) {
-				pContext.Word_Char[word_count++] = static_cast<char>(i);
-			}
+	for (int i = 1; i < UINT8_MAX; i++) {
+		if (safe_ctype<isalnum>(i) || i == Underscore) {
+			classes.Word_Char[word_count++] = static_cast<char>(i);
+		}
 
-			if (safe_ctype<isalpha>(i)) {
-				pContext.Letter_Char[letter_count++] = static_cast<char>(i);
-			}
+		if (safe_ctype<isalpha>(i)) {
+			classes.Letter_Char[letter_count++] = static_cast<char>(i);
+		}
 
-			/* Note: Whether or not newline is considered to be whitespace is
-			   handled by switches within the original regex and is thus omitted
-			   here. */
+		/* Note: Whether or not newline is considered to be whitespace is
+		   handled by switches within the original regex and is thus omitted
+		   here. */
 
-			if (safe_ctype<isspace>(i) && (i != Newline)) {
-				pContext.White_Space[space_count++] = static_cast<char>(i);
-			}
+		if (safe_ctype<isspace>(i) && (i != Newline)) {
+			classes.White_Space[space_count++] = static_cast<char>(i);
+		}
 
-			/* Make sure arrays are big enough.  ("- 2" because of zero array
-			   origin and we need to leave room for the '\0' terminator.) */
+		/* Make sure arrays are big enough.  ("- 2" because of zero array
+		   origin and we need to leave room for the '\0' terminator.) */
 
-			if (word_count > (ALNUM_CHAR_SIZE - 2) || space_count > (WHITE_SPACE_SIZE - 2) || letter_count > (ALNUM_CHAR_SIZE - 2)) {
-				reg_error("internal error #9 'init_ansi_classes'");
-				return false;
-			}
+		if (word_count > (ALNUM_CHAR_SIZE - 2) || space_count > (WHITE_SPACE_SIZE - 2) || letter_count > (ALNUM_CHAR_SIZE - 2)) {
+			reg_error("internal error #9 'init_ansi_classes'");
+			classes.Valid = false;
+			return classes;
 		}
-
-		pContext.Word_Char[word_count]     = '\0';
-		pContext.Letter_Char[letter_count] = '\0';
-		pContext.White_Space[space_count]  = '\0';
 	}
 
-	return true;
+	classes.Word_Char[word_count]     = '\0';
+	classes.Letter_Char[letter_count] = '\0';
+	classes.White_Space[space_count]  = '\0';
+
+	return classes;
+}
+
+/*--------------------------------------------------------------------*
+ * ansi_classes
+ *
+ * The character class sets are the same for every thread compiling a
+ * regex, so they are generated once, by whichever gets here first, and
+ * only read after that.
+ *
+ *--------------------------------------------------------------------*/
+const AnsiClasses &ansi_classes() noexcept {
+	static const AnsiClasses classes = make_ansi_classes();
+	return classes;
+}
+
+/**
+ * @brief init_ansi_classes
+ * @return true if the character class sets could be generated
+ */
+bool init_ansi_classes() noexcept {
+	return ansi_classes().Valid;
 }
 
 /*----------------------------------------------------------------------*
@@ -421,7 +447,7 @@ uint8_t *shortcut_escape(Ch ch, int *flag_param) {
 	case 'l':
 	case 'L':
 		if (Flags == EMIT_CLASS_BYTES) {
-			clazz = pContext.Letter_Char;
+			clazz = ansi_classes().Letter_Char;
 		} else if (Flags == EMIT_NODE) {
 			ret_val = (safe_ctype<islower>(ch) ? emit_node(LETTER) : emit_node(NOT_LETTER));
 		}
@@ -433,7 +459,7 @@ uint8_t *shortcut_escape(Ch ch, int *flag_param) {
 				emit_byte('\n');
 			}
 
-			clazz = pContext.White_Space;
+			clazz = ansi_classes().White_Space;
 		} else if (Flags == EMIT_NODE) {
 			if (pContext.Match_Newline) {
 				ret_val = (safe_ctype<islower>(ch) ? emit_node(SPACE_NL) : emit_node(NOT_SPACE_NL));
@@ -445,7 +471,7 @@ uint8_t *shortcut_escape(Ch ch, int *flag_param) {
 	case 'w':
 	case 'W':
 		if (Flags == EMIT_CLASS_BYTES) {
-			clazz = pContext.Word_Char;
+			clazz = ansi_classes().Word_Char;
 		} else if (Flags == EMIT_NODE) {
 			ret_val = (safe_ctype<islower>(ch) ? emit_node(WORD_CHAR) : emit_node(NOT_WORD_CHAR));
 		}
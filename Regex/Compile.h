@@ -28,12 +28,9 @@ struct ParseContext {
 	bool                        Is_Case_Insensitive;
 	bool                        Match_Newline;
 	bool                        Enable_Counting_Quantifier = true;
-	char                        White_Space[WHITE_SPACE_SIZE];     // Arrays used by
-	char                        Word_Char[ALNUM_CHAR_SIZE];        // functions
-	char                        Letter_Char[ALNUM_CHAR_SIZE];      // init_ansi_classes () and shortcut_escape ().
 	char                        Brace_Char;
 };
 
-extern ParseContext pContext;
+extern thread_local ParseContext pContext;
 
 #endif
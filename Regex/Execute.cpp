@@ -1140,7 +1140,7 @@ bool Regex::ExecRE(const char *start, const char *end, bool reverse, int prev_ch
 	bool ret_val = false;
 
 	// If caller has supplied delimiters, make a delimiter table
-	eContext.Current_Delimiters = delimiters ? Regex::makeDelimiterTable(delimiters) : Regex::Default_Delimiters;
+	eContext.Current_Delimiters = delimiters ? Regex::makeDelimiterTable(delimiters) : Regex::DefaultWordDelimiters();
 
 	// Remember the logical and physical end of the string.
 	eContext.End_Of_String      = match_to;
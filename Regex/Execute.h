@@ -13,7 +13,7 @@
 
 class Regex;
 
-// Global work variables for 'ExecRE'.
+// Per-thread work variables for 'ExecRE'.
 
 template <size_t N>
 using array_iterator = typename std::array<const char *, N>::iterator;
@@ -47,6 +47,6 @@ struct ExecuteContext {
 };
 
 
-extern ExecuteContext eContext;
+extern thread_local ExecuteContext eContext;
 
 #endif
@@ -82,12 +82,19 @@
 #include "Execute.h"
 
 #include <cassert>
+#include <mutex>
 
-// Default table for determining whether a character is a word delimiter.
-std::bitset<256> Regex::Default_Delimiters;
+namespace {
 
-ExecuteContext eContext;
-ParseContext pContext;
+/* Default table for determining whether a character is a word delimiter.
+   Searches on other threads read it, so it's only touched under the lock */
+std::bitset<256> Default_Delimiters;
+std::mutex Default_Delimiters_Mutex;
+
+}
+
+thread_local ExecuteContext eContext;
+thread_local ParseContext pContext;
 
 
 /* The "internal use only" fields in `Regex.h' are present to pass info from
@@ -198,7 +205,21 @@ bool Regex::execute(view::string_view string, size_t offset, size_t end_offset,
  * Builds a default delimiter table that persists across 'ExecRE' calls.
  *----------------------------------------------------------------------*/
 void Regex::SetDefaultWordDelimiters(view::string_view delimiters) {
-	Default_Delimiters = makeDelimiterTable(delimiters);
+	const std::bitset<256> table = makeDelimiterTable(delimiters);
+
+	std::lock_guard<std::mutex> lock(Default_Delimiters_Mutex);
+	Default_Delimiters = table;
+}
+
+/*----------------------------------------------------------------------*
+ * DefaultWordDelimiters
+ *
+ * Returns a snapshot of the default delimiter table, which stays the same
+ * for the rest of a search even if the table is replaced meanwhile.
+ *----------------------------------------------------------------------*/
+std::bitset<256> Regex::DefaultWordDelimiters() {
+	std::lock_guard<std::mutex> lock(Default_Delimiters_Mutex);
+	return Default_Delimiters;
 }
 
 /*----------------------------------------------------------------------*
@@ -112,6 +112,7 @@ public:
 	/* Builds a default delimiter table that persists across 'ExecRE' calls that
 	   is identical to 'delimiters'.*/
 	static void SetDefaultWordDelimiters(view::string_view delimiters);
+	static std::bitset<256> DefaultWordDelimiters();
 
 public:
 	std::array<const char *, NSUBEXP> startp = {}; /* Captured text starting locations. */
@@ -124,7 +125,6 @@ public:
 	std::vector<uint8_t> program;
 
 public:
-	static std::bitset<256> Default_Delimiters;
 	static std::bitset<256> makeDelimiterTable(view::string_view delimiters);
 };
 
@@ -1,6 +1,7 @@
 
 #include "Regex.h"
 #include <iostream>
+#include <thread>
 
 namespace {
 
@@ -19,6 +20,23 @@ int test_regex_match(view::string_view regex, view::string_view input) {
 	return -1;
 }
 
+/* Regexes are also compiled and run by searches on worker threads, which
+   must see the same character classes as the thread which got there first */
+int test_regex_match_thread(view::string_view regex, view::string_view input) {
+	int result = -1;
+
+	std::thread thread([&]() {
+		try {
+			result = test_regex_match(regex, input);
+		} catch(...) {
+			result = -1;
+		}
+	});
+
+	thread.join();
+	return result;
+}
+
 }
 
 int main() {
@@ -772,5 +790,17 @@ int main() {
 		return -1;
 	}
 	
+	if(test_regex_match("[\\w]+", "hello") != 0 || test_regex_match_thread("[\\w]+", "hello") != 0) {
+		std::cerr << "ERROR    : Failed to match a class escape on a second thread" << std::endl;
+		return -1;
+	}
+
+	Regex::SetDefaultWordDelimiters(" \t\n.,;");
+
+	if(test_regex_match_thread("^[\\s\\l]+h", " \thello") != 0 || test_regex_match_thread("<hello>", "say hello now") != 0) {
+		std::cerr << "ERROR    : Failed to match class escapes or delimiters on a second thread" << std::endl;
+		return -1;
+	}
+
 	std::cout << "SUCCESS\n";
 }
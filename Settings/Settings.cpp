@@ -115,6 +115,8 @@ bool splitHorizontally;
 int truncateLongNamesInTabs;
 int autoScrollVPadding;
 int maxPrevOpenFiles;
+int mapFileThreshold;
+bool restoreSession;
 TruncSubstitution truncSubstitution;
 QString backlightCharTypes;
 QString tagFile;
@@ -152,6 +154,16 @@ QString historyFile() {
 	return configFile;
 }
 
+/**
+ * @brief sessionFile
+ * @return
+ */
+QString sessionFile() {
+	static const QString configDir = QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation);
+	static const auto configFile   = tr("%1/%2/%3").arg(configDir, tr("nedit-ng"), tr("session"));
+	return configFile;
+}
+
 /**
  * @brief autoLoadMacroFile
  * @return
@@ -242,6 +254,8 @@ void loadPreferences() {
 	includePaths                 = settings.value(tr("nedit.includePaths"), DEFAULT_INCLUDE_PATHS).toStringList();
 	serverName                   = settings.value(tr("nedit.serverName"), QString()).toString();
 	maxPrevOpenFiles             = settings.value(tr("nedit.maxPrevOpenFiles"), 30).toInt();
+	mapFileThreshold             = settings.value(tr("nedit.mapFileThreshold"), 256).toInt();
+	restoreSession               = settings.value(tr("nedit.restoreSession"), false).toBool();
 	smartTags                    = settings.value(tr("nedit.smartTags"), true).toBool();
 	typingHidesPointer           = settings.value(tr("nedit.typingHidesPointer"), false).toBool();
 	alwaysCheckRelativeTagsSpecs = settings.value(tr("nedit.alwaysCheckRelativeTagsSpecs"), true).toBool();
@@ -336,6 +350,8 @@ void importSettings(const QString &filename) {
 	includePaths                 = settings.value(tr("nedit.includePaths"), includePaths).toStringList();
 	serverName                   = settings.value(tr("nedit.serverName"), serverName).toString();
 	maxPrevOpenFiles             = settings.value(tr("nedit.maxPrevOpenFiles"), maxPrevOpenFiles).toInt();
+	mapFileThreshold             = settings.value(tr("nedit.mapFileThreshold"), mapFileThreshold).toInt();
+	restoreSession               = settings.value(tr("nedit.restoreSession"), restoreSession).toBool();
 	smartTags                    = settings.value(tr("nedit.smartTags"), smartTags).toBool();
 	typingHidesPointer           = settings.value(tr("nedit.typingHidesPointer"), typingHidesPointer).toBool();
 	alwaysCheckRelativeTagsSpecs = settings.value(tr("nedit.alwaysCheckRelativeTagsSpecs"), alwaysCheckRelativeTagsSpecs).toBool();
@@ -421,6 +437,8 @@ bool savePreferences() {
 	settings.setValue(tr("nedit.includePaths"), includePaths);
 	settings.setValue(tr("nedit.serverName"), serverName);
 	settings.setValue(tr("nedit.maxPrevOpenFiles"), maxPrevOpenFiles);
+	settings.setValue(tr("nedit.mapFileThreshold"), mapFileThreshold);
+	settings.setValue(tr("nedit.restoreSession"), restoreSession);
 	settings.setValue(tr("nedit.smartTags"), smartTags);
 	settings.setValue(tr("nedit.typingHidesPointer"), typingHidesPointer);
 	settings.setValue(tr("nedit.autoWrapPastedText"), autoWrapPastedText);
@@ -36,6 +36,7 @@ void importSettings(const QString &filename);
 // Paths
 QString configFile();
 QString historyFile();
+QString sessionFile();
 QString autoLoadMacroFile();
 QString styleFile();
 QString themeFile();
@@ -112,6 +113,8 @@ extern bool splitHorizontally;
 extern int truncateLongNamesInTabs;
 extern int autoScrollVPadding;
 extern int maxPrevOpenFiles;
+extern int mapFileThreshold;
+extern bool restoreSession;
 extern TruncSubstitution truncSubstitution;
 extern QString backlightCharTypes;
 extern QString tagFile;
@@ -0,0 +1,603 @@
+
+#include "Util/Compression.h"
+
+#include <QCoreApplication>
+
+#include <algorithm>
+#include <climits>
+
+#ifdef NEDIT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef NEDIT_HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#ifdef NEDIT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// how much output is made room for at a time
+constexpr size_t OutputStep = 256 * 1024;
+
+// the most input handed to a library at a time, their lengths may be 32 bits
+constexpr size_t InputStep = 64 * 1024 * 1024;
+
+/**
+ * @brief corruptData
+ * @return the error for input which isn't what it claims to be
+ */
+QString corruptData() {
+	return QCoreApplication::translate("Compression", "The compressed data is corrupt");
+}
+
+/**
+ * @brief truncatedData
+ * @return the error for input which ends part way through a stream
+ */
+QString truncatedData() {
+	return QCoreApplication::translate("Compression", "The compressed data is incomplete");
+}
+
+/**
+ * @brief outOfMemory
+ * @return the error for a library which ran out of memory
+ */
+QString outOfMemory() {
+	return QCoreApplication::translate("Compression", "Not enough memory to (de)compress the data");
+}
+
+/**
+ * @brief startsWith
+ * @param text
+ * @param prefix
+ * @return true if "text" starts with "prefix"
+ */
+bool startsWith(view::string_view text, view::string_view prefix) {
+	return text.size() >= prefix.size() && text.substr(0, prefix.size()) == prefix;
+}
+
+/*
+** Grow "output" by OutputStep for a library to write into, returning where it
+** may write. shrinkOutput gives back whatever it didn't use.
+*/
+char *growOutput(std::string *output) {
+	const size_t size = output->size();
+	output->resize(size + OutputStep);
+	return &(*output)[size];
+}
+
+void shrinkOutput(std::string *output, size_t unused) {
+	output->resize(output->size() - unused);
+}
+
+#ifdef NEDIT_HAVE_ZLIB
+/*
+** gzip, with zlib
+*/
+class GzipDecompressor final : public Decompressor {
+public:
+	GzipDecompressor() {
+		if (inflateInit2(&stream_, 15 + 16) != Z_OK) {
+			error_ = outOfMemory();
+			failed_ = true;
+		}
+	}
+
+	~GzipDecompressor() override {
+		inflateEnd(&stream_);
+	}
+
+public:
+	bool decompress(view::string_view input, std::string *output) override {
+
+		while (!failed_ && !input.empty()) {
+			const size_t length = std::min(input.size(), InputStep);
+			stream_.next_in     = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+			stream_.avail_in    = static_cast<uInt>(length);
+			input.remove_prefix(length);
+
+			// carry on until all of the input is used up and all of the output is out
+			do {
+				// another member follows the one which ended
+				if (ended_ && stream_.avail_in != 0) {
+					inflateReset(&stream_);
+					ended_ = false;
+				}
+
+				stream_.next_out  = reinterpret_cast<Bytef *>(growOutput(output));
+				stream_.avail_out = static_cast<uInt>(OutputStep);
+
+				const int r = inflate(&stream_, Z_NO_FLUSH);
+				shrinkOutput(output, stream_.avail_out);
+
+				if (r == Z_STREAM_END) {
+					ended_ = true;
+				} else if (r == Z_MEM_ERROR) {
+					error_  = outOfMemory();
+					failed_ = true;
+				} else if (r != Z_OK && r != Z_BUF_ERROR) {
+					error_  = corruptData();
+					failed_ = true;
+				}
+			} while (!failed_ && (stream_.avail_in != 0 || stream_.avail_out == 0));
+		}
+
+		return !failed_;
+	}
+
+	bool finish(std::string *output) override {
+		Q_UNUSED(output)
+
+		if (!failed_ && !ended_) {
+			error_  = truncatedData();
+			failed_ = true;
+		}
+
+		return !failed_;
+	}
+
+private:
+	z_stream stream_ = {};
+	bool ended_      = false;
+	bool failed_     = false;
+};
+
+class GzipCompressor final : public Compressor {
+public:
+	explicit GzipCompressor(int level) {
+		if (deflateInit2(&stream_, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			error_ = outOfMemory();
+			failed_ = true;
+		}
+	}
+
+	~GzipCompressor() override {
+		deflateEnd(&stream_);
+	}
+
+public:
+	bool compress(view::string_view input, std::string *output) override {
+
+		while (!failed_ && !input.empty()) {
+			const size_t length = std::min(input.size(), InputStep);
+			stream_.next_in     = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+			stream_.avail_in    = static_cast<uInt>(length);
+			input.remove_prefix(length);
+
+			do {
+				run(Z_NO_FLUSH, output);
+			} while (!failed_ && (stream_.avail_in != 0 || stream_.avail_out == 0));
+		}
+
+		return !failed_;
+	}
+
+	bool finish(std::string *output) override {
+
+		int r = Z_OK;
+		while (!failed_ && r != Z_STREAM_END) {
+			r = run(Z_FINISH, output);
+		}
+
+		return !failed_;
+	}
+
+private:
+	int run(int flush, std::string *output) {
+		stream_.next_out  = reinterpret_cast<Bytef *>(growOutput(output));
+		stream_.avail_out = static_cast<uInt>(OutputStep);
+
+		const int r = deflate(&stream_, flush);
+		shrinkOutput(output, stream_.avail_out);
+
+		if (r == Z_STREAM_ERROR) {
+			error_  = corruptData();
+			failed_ = true;
+		}
+
+		return r;
+	}
+
+private:
+	z_stream stream_ = {};
+	bool failed_     = false;
+};
+#endif
+
+#ifdef NEDIT_HAVE_LZMA
+/**
+ * @brief lzmaError
+ * @param r
+ * @return the error for the liblzma result "r"
+ */
+QString lzmaError(lzma_ret r) {
+	switch (r) {
+	case LZMA_MEM_ERROR:
+	case LZMA_MEMLIMIT_ERROR:
+		return outOfMemory();
+	case LZMA_BUF_ERROR:
+		return truncatedData();
+	default:
+		return corruptData();
+	}
+}
+
+/*
+** xz, with liblzma. It runs both ways, the action given to lzma_code being
+** all that differs between compressing and decompressing.
+*/
+class XzStream {
+public:
+	XzStream()                            = default;
+	XzStream(const XzStream &)            = delete;
+	XzStream &operator=(const XzStream &) = delete;
+
+	~XzStream() {
+		lzma_end(&stream_);
+	}
+
+public:
+	lzma_stream *get() {
+		return &stream_;
+	}
+
+	lzma_ret run(view::string_view input, lzma_action action, std::string *output) {
+
+		lzma_ret r = LZMA_OK;
+
+		for (;;) {
+			const size_t length = std::min(input.size(), InputStep);
+			stream_.next_in     = reinterpret_cast<const uint8_t *>(input.data());
+			stream_.avail_in    = length;
+			input.remove_prefix(length);
+
+			// the last piece is only finished with once all of the input is in
+			const lzma_action step = input.empty() ? action : LZMA_RUN;
+
+			do {
+				stream_.next_out  = reinterpret_cast<uint8_t *>(growOutput(output));
+				stream_.avail_out = OutputStep;
+
+				r = lzma_code(&stream_, step);
+				shrinkOutput(output, stream_.avail_out);
+			} while (r == LZMA_OK && (stream_.avail_in != 0 || stream_.avail_out == 0 || step == LZMA_FINISH));
+
+			if (r != LZMA_OK || input.empty()) {
+				return r;
+			}
+		}
+	}
+
+private:
+	lzma_stream stream_ = LZMA_STREAM_INIT;
+};
+
+class XzDecompressor final : public Decompressor {
+public:
+	XzDecompressor() {
+		const lzma_ret r = lzma_stream_decoder(stream_.get(), UINT64_MAX, LZMA_CONCATENATED);
+		if (r != LZMA_OK) {
+			error_  = lzmaError(r);
+			failed_ = true;
+		}
+	}
+
+public:
+	bool decompress(view::string_view input, std::string *output) override {
+		return !failed_ && check(stream_.run(input, LZMA_RUN, output));
+	}
+
+	bool finish(std::string *output) override {
+		return !failed_ && check(stream_.run(view::string_view(), LZMA_FINISH, output));
+	}
+
+private:
+	bool check(lzma_ret r) {
+		if (r != LZMA_OK && r != LZMA_STREAM_END) {
+			error_  = lzmaError(r);
+			failed_ = true;
+		}
+
+		return !failed_;
+	}
+
+private:
+	XzStream stream_;
+	bool failed_ = false;
+};
+
+class XzCompressor final : public Compressor {
+public:
+	explicit XzCompressor(int level) {
+		const lzma_ret r = lzma_easy_encoder(stream_.get(), level < 0 ? LZMA_PRESET_DEFAULT : static_cast<uint32_t>(level), LZMA_CHECK_CRC64);
+		if (r != LZMA_OK) {
+			error_  = lzmaError(r);
+			failed_ = true;
+		}
+	}
+
+public:
+	bool compress(view::string_view input, std::string *output) override {
+		return !failed_ && check(stream_.run(input, LZMA_RUN, output));
+	}
+
+	bool finish(std::string *output) override {
+		return !failed_ && check(stream_.run(view::string_view(), LZMA_FINISH, output));
+	}
+
+private:
+	bool check(lzma_ret r) {
+		if (r != LZMA_OK && r != LZMA_STREAM_END) {
+			error_  = lzmaError(r);
+			failed_ = true;
+		}
+
+		return !failed_;
+	}
+
+private:
+	XzStream stream_;
+	bool failed_ = false;
+};
+#endif
+
+#ifdef NEDIT_HAVE_ZSTD
+/*
+** zstd, with libzstd
+*/
+class ZstdDecompressor final : public Decompressor {
+public:
+	ZstdDecompressor() : stream_(ZSTD_createDStream()) {
+		if (!stream_) {
+			error_  = outOfMemory();
+			failed_ = true;
+		}
+	}
+
+	~ZstdDecompressor() override {
+		ZSTD_freeDStream(stream_);
+	}
+
+public:
+	bool decompress(view::string_view input, std::string *output) override {
+
+		ZSTD_inBuffer in = { input.data(), input.size(), 0 };
+
+		while (!failed_ && (in.pos != in.size || flushing_)) {
+			ZSTD_outBuffer out = { growOutput(output), OutputStep, 0 };
+
+			const size_t r = ZSTD_decompressStream(stream_, &out, &in);
+			shrinkOutput(output, OutputStep - out.pos);
+
+			if (ZSTD_isError(r)) {
+				error_  = corruptData();
+				failed_ = true;
+			}
+
+			// a frame which has been read may still have output to flush
+			ended_    = (r == 0);
+			flushing_ = (out.pos == out.size);
+		}
+
+		return !failed_;
+	}
+
+	bool finish(std::string *output) override {
+		Q_UNUSED(output)
+
+		if (!failed_ && !ended_) {
+			error_  = truncatedData();
+			failed_ = true;
+		}
+
+		return !failed_;
+	}
+
+private:
+	ZSTD_DStream *stream_;
+	bool ended_    = false;
+	bool flushing_ = false;
+	bool failed_   = false;
+};
+
+class ZstdCompressor final : public Compressor {
+public:
+	explicit ZstdCompressor(int level) : stream_(ZSTD_createCStream()) {
+		if (!stream_ || ZSTD_isError(ZSTD_initCStream(stream_, level < 0 ? ZSTD_CLEVEL_DEFAULT : level))) {
+			error_  = outOfMemory();
+			failed_ = true;
+		}
+	}
+
+	~ZstdCompressor() override {
+		ZSTD_freeCStream(stream_);
+	}
+
+public:
+	bool compress(view::string_view input, std::string *output) override {
+
+		ZSTD_inBuffer in = { input.data(), input.size(), 0 };
+
+		while (!failed_ && in.pos != in.size) {
+			ZSTD_outBuffer out = { growOutput(output), OutputStep, 0 };
+
+			const size_t r = ZSTD_compressStream(stream_, &out, &in);
+			shrinkOutput(output, OutputStep - out.pos);
+
+			if (ZSTD_isError(r)) {
+				error_  = corruptData();
+				failed_ = true;
+			}
+		}
+
+		return !failed_;
+	}
+
+	bool finish(std::string *output) override {
+
+		size_t remaining = 1;
+		while (!failed_ && remaining != 0) {
+			ZSTD_outBuffer out = { growOutput(output), OutputStep, 0 };
+
+			remaining = ZSTD_endStream(stream_, &out);
+			shrinkOutput(output, OutputStep - out.pos);
+
+			if (ZSTD_isError(remaining)) {
+				error_  = corruptData();
+				failed_ = true;
+			}
+		}
+
+		return !failed_;
+	}
+
+private:
+	ZSTD_CStream *stream_;
+	bool failed_ = false;
+};
+#endif
+
+}
+
+/**
+ * Tells how the file which starts with "header" is compressed, from the
+ * magic number of the format. At least the first 10 bytes of the file are
+ * needed to tell how hard a gzip file was compressed, the other formats
+ * don't record it, so their files are compressed again with the default.
+ *
+ * @brief DetectCompression
+ * @param header
+ * @return
+ */
+CompressionFormat DetectCompression(view::string_view header) {
+
+	CompressionFormat format;
+
+	if (startsWith(header, view::string_view("\x1f\x8b", 2))) {
+		format.type = Compression::Gzip;
+
+		// the XFL byte tells whether the fastest or the best compression was used
+		if (header.size() > 8) {
+			switch (header[8]) {
+			case 2:
+				format.level = 9;
+				break;
+			case 4:
+				format.level = 1;
+				break;
+			default:
+				break;
+			}
+		}
+	} else if (startsWith(header, view::string_view("\xfd" "7zXZ\0", 6))) {
+		format.type = Compression::Xz;
+	} else if (startsWith(header, view::string_view("\x28\xb5\x2f\xfd", 4))) {
+		format.type = Compression::Zstd;
+	}
+
+	return format;
+}
+
+/**
+ * @brief CompressionSuffix
+ * @param type
+ * @return the usual file name suffix of the format
+ */
+QLatin1String CompressionSuffix(Compression type) {
+	switch (type) {
+	case Compression::Gzip:
+		return QLatin1String(".gz");
+	case Compression::Xz:
+		return QLatin1String(".xz");
+	case Compression::Zstd:
+		return QLatin1String(".zst");
+	case Compression::None:
+		break;
+	}
+
+	return QLatin1String("");
+}
+
+/**
+ * @brief CompressionSupported
+ * @param type
+ * @return true if this build can read and write files compressed with "type"
+ */
+bool CompressionSupported(Compression type) {
+	switch (type) {
+	case Compression::None:
+		return true;
+	case Compression::Gzip:
+#ifdef NEDIT_HAVE_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	case Compression::Xz:
+#ifdef NEDIT_HAVE_LZMA
+		return true;
+#else
+		return false;
+#endif
+	case Compression::Zstd:
+#ifdef NEDIT_HAVE_ZSTD
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	return false;
+}
+
+/**
+ * @brief Decompressor::create
+ * @param type
+ * @return a decompressor for "type", or null if it isn't supported
+ */
+std::unique_ptr<Decompressor> Decompressor::create(Compression type) {
+	switch (type) {
+#ifdef NEDIT_HAVE_ZLIB
+	case Compression::Gzip:
+		return std::make_unique<GzipDecompressor>();
+#endif
+#ifdef NEDIT_HAVE_LZMA
+	case Compression::Xz:
+		return std::make_unique<XzDecompressor>();
+#endif
+#ifdef NEDIT_HAVE_ZSTD
+	case Compression::Zstd:
+		return std::make_unique<ZstdDecompressor>();
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+/**
+ * @brief Compressor::create
+ * @param format
+ * @return a compressor for "format", or null if it isn't supported
+ */
+std::unique_ptr<Compressor> Compressor::create(const CompressionFormat &format) {
+	switch (format.type) {
+#ifdef NEDIT_HAVE_ZLIB
+	case Compression::Gzip:
+		return std::make_unique<GzipCompressor>(format.level);
+#endif
+#ifdef NEDIT_HAVE_LZMA
+	case Compression::Xz:
+		return std::make_unique<XzCompressor>(format.level);
+#endif
+#ifdef NEDIT_HAVE_ZSTD
+	case Compression::Zstd:
+		return std::make_unique<ZstdCompressor>(format.level);
+#endif
+	default:
+		return nullptr;
+	}
+}
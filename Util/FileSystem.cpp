@@ -3,6 +3,8 @@
 #include "Util/ClearCase.h"
 #include "Util/FileFormats.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <iterator>
@@ -166,27 +168,16 @@ FileFormats FormatOfFile(view::string_view text) {
 */
 void ConvertToDos(std::string &text) {
 
-	// How long a string will we need?
-	size_t outLength = 0;
-	for (char ch : text) {
-		if (ch == '\n') {
-			outLength++;
-		}
-		outLength++;
-	}
-
-	std::string outString;
-	outString.reserve(outLength);
-	auto outPtr = std::back_inserter(outString);
-
-	for (char ch : text) {
-		if (ch == '\n') {
-			*outPtr++ = '\r';
-		}
-		*outPtr++ = ch;
+	const auto nNewlines = static_cast<size_t>(std::count(text.begin(), text.end(), '\n'));
+	if (nNewlines == 0) {
+		return;
 	}
 
-	text = std::move(outString);
+	/* the runs between newlines are copied whole into a string of the final
+	   size, which is much faster than expanding the text a byte at a time */
+	std::string out(text.size() + nNewlines, '\0');
+	ConvertToDos(text, &out[0]);
+	text = std::move(out);
 }
 
 /*
@@ -194,7 +185,65 @@ void ConvertToDos(std::string &text) {
 ** from Unix to Macintosh format.
 */
 void ConvertToMac(std::string &text) {
-	std::replace(text.begin(), text.end(), '\n', '\r');
+
+	char *it  = &text[0];
+	char *end = it + text.size();
+
+	while ((it = static_cast<char *>(std::memchr(it, '\n', static_cast<size_t>(end - it))))) {
+		*it++ = '\r';
+	}
+}
+
+/*
+** Copies "text" to "out", converting it from Unix to DOS format on the way.
+** Since every newline converts on its own, a text may be converted a piece
+** at a time. Returns the end of the output, which is at most twice as long
+** as the text.
+*/
+char *ConvertToDos(view::string_view text, char *out) {
+
+	const char *it  = text.data();
+	const char *end = it + text.size();
+
+	while (it != end) {
+		auto nl = static_cast<const char *>(std::memchr(it, '\n', static_cast<size_t>(end - it)));
+		if (!nl) {
+			nl = end;
+		}
+
+		std::memcpy(out, it, static_cast<size_t>(nl - it));
+		out += nl - it;
+
+		if (nl == end) {
+			break;
+		}
+
+		*out++ = '\r';
+		*out++ = '\n';
+		it     = nl + 1;
+	}
+
+	return out;
+}
+
+/**
+ * @brief ConvertToMac
+ * @param text
+ * @param out
+ * @return the end of the output, which is as long as the text
+ */
+char *ConvertToMac(view::string_view text, char *out) {
+
+	std::memcpy(out, text.data(), text.size());
+
+	char *it  = out;
+	char *end = out + text.size();
+
+	while ((it = static_cast<char *>(std::memchr(it, '\n', static_cast<size_t>(end - it))))) {
+		*it++ = '\r';
+	}
+
+	return end;
 }
 
 /**
@@ -202,7 +251,7 @@ void ConvertToMac(std::string &text) {
  * @param text
  */
 void ConvertFromMac(std::string &text) {
-	std::replace(text.begin(), text.end(), '\r', '\n');
+	ConvertFromMac(&text[0], text.size());
 }
 
 /**
@@ -220,31 +269,9 @@ void ConvertFromDos(std::string &text) {
  */
 void ConvertFromDos(std::string &text, char *pendingCR) {
 
-	if (pendingCR) {
-		*pendingCR = '\0';
-	}
-
-	auto out = text.begin();
-	auto it  = text.begin();
-
-	while (it != text.end()) {
-		if (*it == '\r') {
-			auto next = std::next(it);
-			if (next != text.end()) {
-				if (*next == '\n') {
-					++it;
-				}
-			} else {
-				if (pendingCR) {
-					*pendingCR = *it;
-					break;
-				}
-			}
-		}
-		*out++ = *it++;
-	}
-
-	text.erase(out, text.end());
+	size_t length = text.size();
+	ConvertFromDos(&text[0], &length, pendingCR);
+	text.resize(length);
 }
 
 /*
@@ -0,0 +1,199 @@
+
+#include "Util/Fingerprint.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t Prime3 = 0x165667B19E3779F9ull;
+constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+// size of the pieces a file is read in
+constexpr qint64 ReadSize = 256 * 1024;
+
+uint64_t rotateLeft(uint64_t x, int n) {
+	return (x << n) | (x >> (64 - n));
+}
+
+uint64_t read64(const char *p) {
+	uint64_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+uint32_t read32(const char *p) {
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+uint64_t round(uint64_t acc, uint64_t input) {
+	acc += input * Prime2;
+	acc = rotateLeft(acc, 31);
+	return acc * Prime1;
+}
+
+uint64_t mergeRound(uint64_t acc, uint64_t value) {
+	acc ^= round(0, value);
+	return acc * Prime1 + Prime4;
+}
+
+}
+
+/**
+ * @brief Fingerprint::Fingerprint
+ */
+Fingerprint::Fingerprint() {
+	acc_[0] = Prime1 + Prime2;
+	acc_[1] = Prime2;
+	acc_[2] = 0;
+	acc_[3] = 0 - Prime1;
+}
+
+/**
+ * Adds "data" to the bytes hashed so far. Hashing a text a piece at a time
+ * gives the same value as hashing it all at once.
+ *
+ * @brief Fingerprint::update
+ * @param data
+ */
+void Fingerprint::update(view::string_view data) {
+
+	const char *p   = data.data();
+	const char *end = p + data.size();
+
+	length_ += data.size();
+
+	if (pendingSize_ != 0) {
+		const size_t n = std::min(sizeof(pending_) - pendingSize_, data.size());
+		std::memcpy(pending_ + pendingSize_, p, n);
+		pendingSize_ += n;
+		p += n;
+
+		if (pendingSize_ < sizeof(pending_)) {
+			return;
+		}
+
+		consume(pending_);
+		pendingSize_ = 0;
+	}
+
+	while (end - p >= 32) {
+		consume(p);
+		p += 32;
+	}
+
+	std::memcpy(pending_, p, static_cast<size_t>(end - p));
+	pendingSize_ = static_cast<size_t>(end - p);
+}
+
+/**
+ * @brief Fingerprint::consume
+ * @param stripe 32 bytes of input
+ */
+void Fingerprint::consume(const char *stripe) {
+	acc_[0] = round(acc_[0], read64(stripe));
+	acc_[1] = round(acc_[1], read64(stripe + 8));
+	acc_[2] = round(acc_[2], read64(stripe + 16));
+	acc_[3] = round(acc_[3], read64(stripe + 24));
+}
+
+/**
+ * @brief Fingerprint::value
+ * @return the hash of the bytes added so far
+ */
+uint64_t Fingerprint::value() const {
+
+	uint64_t h;
+	if (length_ >= 32) {
+		h = rotateLeft(acc_[0], 1) + rotateLeft(acc_[1], 7) + rotateLeft(acc_[2], 12) + rotateLeft(acc_[3], 18);
+		h = mergeRound(h, acc_[0]);
+		h = mergeRound(h, acc_[1]);
+		h = mergeRound(h, acc_[2]);
+		h = mergeRound(h, acc_[3]);
+	} else {
+		h = acc_[2] + Prime5;
+	}
+
+	h += length_;
+
+	const char *p   = pending_;
+	const char *end = pending_ + pendingSize_;
+
+	for (; end - p >= 8; p += 8) {
+		h ^= round(0, read64(p));
+		h = rotateLeft(h, 27) * Prime1 + Prime4;
+	}
+
+	if (end - p >= 4) {
+		h ^= static_cast<uint64_t>(read32(p)) * Prime1;
+		h = rotateLeft(h, 23) * Prime2 + Prime3;
+		p += 4;
+	}
+
+	for (; p != end; ++p) {
+		h ^= static_cast<uint64_t>(static_cast<unsigned char>(*p)) * Prime5;
+		h = rotateLeft(h, 11) * Prime1;
+	}
+
+	h ^= h >> 33;
+	h *= Prime2;
+	h ^= h >> 29;
+	h *= Prime3;
+	h ^= h >> 32;
+	return h;
+}
+
+/**
+ * @brief FingerprintOf
+ * @param data
+ * @return the fingerprint of "data"
+ */
+uint64_t FingerprintOf(view::string_view data) {
+	Fingerprint fingerprint;
+	fingerprint.update(data);
+	return fingerprint.value();
+}
+
+/**
+ * @brief FingerprintOfFile
+ * @param fileName
+ * @param progress if given, called with the number of bytes read so far after
+ * each piece of the file, the reading stops if it returns false
+ * @return the fingerprint of the contents of the file "fileName", or nothing
+ * if it couldn't be read or the reading was stopped
+ */
+boost::optional<uint64_t> FingerprintOfFile(const QString &fileName, const std::function<bool(int64_t)> &progress) {
+
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return boost::none;
+	}
+
+	Fingerprint fingerprint;
+	std::vector<char> buffer(ReadSize);
+
+	int64_t done = 0;
+	qint64 n;
+	while ((n = file.read(buffer.data(), ReadSize)) > 0) {
+		fingerprint.update(view::string_view(buffer.data(), static_cast<size_t>(n)));
+
+		done += n;
+		if (progress && !progress(done)) {
+			return boost::none;
+		}
+	}
+
+	if (n < 0) {
+		return boost::none;
+	}
+
+	return fingerprint.value();
+}
@@ -0,0 +1,83 @@
+
+#ifndef UTIL_COMPRESSION_H_
+#define UTIL_COMPRESSION_H_
+
+#include "string_view.h"
+
+#include <QString>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+enum class Compression : uint8_t {
+	None,
+	Gzip,
+	Xz,
+	Zstd
+};
+
+// how a file is compressed, and how hard to compress it when it's written again
+struct CompressionFormat {
+	Compression type = Compression::None;
+	int level        = -1; // -1 for the default of the format
+};
+
+CompressionFormat DetectCompression(view::string_view header);
+QLatin1String CompressionSuffix(Compression type);
+bool CompressionSupported(Compression type);
+
+/*
+** Decompresses a stream a piece at a time. Concatenated streams, such as
+** the members of a gzip file, are decompressed one after the other.
+*/
+class Decompressor {
+public:
+	static std::unique_ptr<Decompressor> create(Compression type);
+
+public:
+	virtual ~Decompressor() = default;
+
+public:
+	// appends what "input" decompresses to to "output"
+	virtual bool decompress(view::string_view input, std::string *output) = 0;
+
+	// checks that the input ended where a stream did, after the last piece
+	virtual bool finish(std::string *output) = 0;
+
+public:
+	QString errorString() const {
+		return error_;
+	}
+
+protected:
+	QString error_;
+};
+
+/*
+** Compresses a stream a piece at a time.
+*/
+class Compressor {
+public:
+	static std::unique_ptr<Compressor> create(const CompressionFormat &format);
+
+public:
+	virtual ~Compressor() = default;
+
+public:
+	// appends what "input" compresses to so far to "output"
+	virtual bool compress(view::string_view input, std::string *output) = 0;
+
+	// appends the rest of the compressed stream to "output", after the last piece
+	virtual bool finish(std::string *output) = 0;
+
+public:
+	QString errorString() const {
+		return error_;
+	}
+
+protected:
+	QString error_;
+};
+
+#endif
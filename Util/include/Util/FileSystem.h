@@ -6,6 +6,7 @@
 #include <QString>
 #include <QtGlobal>
 #include <boost/optional.hpp>
+#include <cstring>
 #include <string>
 
 enum class FileFormats : int;
@@ -29,6 +30,10 @@ void ConvertFromMac(std::string &text);
 void ConvertFromDos(std::string &text);
 void ConvertFromDos(std::string &text, char *pendingCR);
 
+// chunk based conversions, "out" must have room for twice the text for DOS
+char *ConvertToDos(view::string_view text, char *out);
+char *ConvertToMac(view::string_view text, char *out);
+
 template <class Integer>
 using IsInteger = typename std::enable_if<std::is_integral<Integer>::value>::type;
 
@@ -47,7 +52,13 @@ template <class Length, class = IsInteger<Length>>
 void ConvertFromMac(char *text, Length length) {
 
 	Q_ASSERT(text);
-	std::replace(text, text + length, '\r', '\n');
+	char *it  = text;
+	char *end = text + length;
+
+	// memchr skips the text between line endings far faster than a byte loop
+	while ((it = static_cast<char *>(std::memchr(it, '\r', static_cast<size_t>(end - it))))) {
+		*it++ = '\n';
+	}
 }
 
 /**
@@ -68,20 +79,36 @@ void ConvertFromDos(char *text, Length *length, char *pendingCR) {
 		*pendingCR = '\0';
 	}
 
-	while (in < end) {
-		if (*in == '\r') {
-			if (in < end - 1) {
-				if (in[1] == '\n') {
-					++in;
-				}
-			} else {
-				if (pendingCR) {
-					*pendingCR = *in;
-					break;
-				}
+	// move the runs between carriage returns down over the ones dropped
+	while (in != end) {
+		auto cr = static_cast<const char *>(std::memchr(in, '\r', static_cast<size_t>(end - in)));
+		if (!cr) {
+			cr = end;
+		}
+
+		if (out != in) {
+			std::memmove(out, in, static_cast<size_t>(cr - in));
+		}
+
+		out += cr - in;
+		in = cr;
+
+		if (in == end) {
+			break;
+		}
+
+		if (in + 1 == end) {
+			if (pendingCR) {
+				*pendingCR = *in;
+				break;
 			}
+			*out++ = *in++;
+		} else if (in[1] == '\n') {
+			// the newline starts the next run
+			++in;
+		} else {
+			*out++ = *in++;
 		}
-		*out++ = *in++;
 	}
 
 	*length = static_cast<Length>(out - text);
@@ -0,0 +1,39 @@
+
+#ifndef UTIL_FINGERPRINT_H_
+#define UTIL_FINGERPRINT_H_
+
+#include "string_view.h"
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <functional>
+
+class QString;
+
+/*
+** A 64-bit hash of a stream of bytes, for telling cheaply whether two texts
+** differ without having both at hand. It uses the XXH64 algorithm, which
+** runs at about the speed memory can be read. Not suitable for anything
+** where collisions are made on purpose.
+*/
+class Fingerprint {
+public:
+	Fingerprint();
+
+public:
+	void update(view::string_view data);
+	uint64_t value() const;
+
+private:
+	void consume(const char *stripe);
+
+private:
+	uint64_t acc_[4];
+	uint64_t length_ = 0;
+	char pending_[32];
+	size_t pendingSize_ = 0;
+};
+
+uint64_t FingerprintOf(view::string_view data);
+boost::optional<uint64_t> FingerprintOfFile(const QString &fileName, const std::function<bool(int64_t)> &progress = {});
+
+#endif
@@ -0,0 +1,182 @@
+
+#include "Util/Compression.h"
+
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace {
+
+/*
+** Text which compresses like a source file does: runs of repeated lines,
+** broken up by random bytes so that some of it doesn't compress at all
+*/
+std::string makeText(size_t size, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::string text;
+	text.reserve(size);
+
+	while (text.size() < size) {
+		if (rng() % 4 == 0) {
+			for (int i = 0; i < 64 && text.size() < size; ++i) {
+				text.push_back(static_cast<char>(rng() & 0xff));
+			}
+		} else {
+			text.append("\tif (value != expected) {\n\t\treturn false;\n\t}\n");
+		}
+	}
+
+	text.resize(size);
+	return text;
+}
+
+// compresses "text", handing it to the compressor "step" bytes at a time
+bool compress(Compression type, const std::string &text, size_t step, std::string *output) {
+	CompressionFormat format;
+	format.type = type;
+
+	std::unique_ptr<Compressor> compressor = Compressor::create(format);
+	if (!compressor) {
+		return false;
+	}
+
+	for (size_t i = 0; i < text.size(); i += step) {
+		if (!compressor->compress(view::string_view(text).substr(i, step), output)) {
+			return false;
+		}
+	}
+
+	return compressor->finish(output);
+}
+
+// decompresses "data", handing it to the decompressor "step" bytes at a time
+bool decompress(Compression type, const std::string &data, size_t step, std::string *output) {
+	std::unique_ptr<Decompressor> decompressor = Decompressor::create(type);
+	if (!decompressor) {
+		return false;
+	}
+
+	for (size_t i = 0; i < data.size(); i += step) {
+		if (!decompressor->decompress(view::string_view(data).substr(i, step), output)) {
+			return false;
+		}
+	}
+
+	return decompressor->finish(output);
+}
+
+int testFormat(Compression type, const char *name) {
+
+	const std::string text = makeText(1024 * 1024 + 17, 1);
+
+	// whole, and in pieces which don't line up with anything
+	for (size_t step : {text.size(), size_t(65536), size_t(1000)}) {
+		std::string compressed;
+		if (!compress(type, text, step, &compressed)) {
+			std::cerr << "ERROR    : " << name << ": compressing failed" << std::endl;
+			return -1;
+		}
+
+		if (DetectCompression(compressed).type != type) {
+			std::cerr << "ERROR    : " << name << ": compressed data not detected" << std::endl;
+			return -1;
+		}
+
+		for (size_t inStep : {compressed.size(), size_t(4096)}) {
+			std::string decompressed;
+			if (!decompress(type, compressed, inStep, &decompressed) || decompressed != text) {
+				std::cerr << "ERROR    : " << name << ": round trip failed, step " << step << '/' << inStep << std::endl;
+				return -1;
+			}
+		}
+	}
+
+	// a byte at a time, splitting every header and frame
+	const std::string small = makeText(20000, 4);
+	std::string smallCompressed;
+	std::string smallOut;
+	if (!compress(type, small, 1, &smallCompressed) || !decompress(type, smallCompressed, 1, &smallOut) || smallOut != small) {
+		std::cerr << "ERROR    : " << name << ": byte at a time round trip failed" << std::endl;
+		return -1;
+	}
+
+	// empty input still makes a valid stream
+	std::string empty;
+	std::string emptyOut;
+	if (!compress(type, std::string(), 1, &empty) || !decompress(type, empty, empty.size(), &emptyOut) || !emptyOut.empty()) {
+		std::cerr << "ERROR    : " << name << ": empty round trip failed" << std::endl;
+		return -1;
+	}
+
+	// concatenated streams decompress one after the other
+	const std::string first  = makeText(100000, 2);
+	const std::string second = makeText(50000, 3);
+	std::string joined;
+	std::string secondCompressed;
+	compress(type, first, first.size(), &joined);
+	compress(type, second, second.size(), &secondCompressed);
+	joined += secondCompressed;
+
+	std::string both;
+	if (!decompress(type, joined, 1000, &both) || both != first + second) {
+		std::cerr << "ERROR    : " << name << ": concatenated streams failed" << std::endl;
+		return -1;
+	}
+
+	// a stream which stops part way through is an error
+	std::string truncated;
+	std::string truncatedOut;
+	compress(type, text, text.size(), &truncated);
+	truncated.resize(truncated.size() / 2);
+	if (decompress(type, truncated, 4096, &truncatedOut)) {
+		std::cerr << "ERROR    : " << name << ": truncated stream accepted" << std::endl;
+		return -1;
+	}
+
+	// and so is one which is damaged
+	std::string corrupt;
+	std::string corruptOut;
+	compress(type, text, text.size(), &corrupt);
+	for (size_t i = 64; i < corrupt.size(); i += 97) {
+		corrupt[i] = static_cast<char>(corrupt[i] ^ 0x5a);
+	}
+
+	if (decompress(type, corrupt, 4096, &corruptOut) && corruptOut == text) {
+		std::cerr << "ERROR    : " << name << ": corrupt stream accepted" << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+}
+
+int main() {
+
+	const struct {
+		Compression type;
+		const char *name;
+	} formats[] = {
+		{ Compression::Gzip, "gzip" },
+		{ Compression::Xz,   "xz"   },
+		{ Compression::Zstd, "zstd" },
+	};
+
+	for (const auto &format : formats) {
+		if (!CompressionSupported(format.type)) {
+			std::cout << "SKIPPED  : " << format.name << " is not supported by this build\n";
+			continue;
+		}
+
+		if (testFormat(format.type, format.name) != 0) {
+			return -1;
+		}
+	}
+
+	if (DetectCompression(view::string_view("plain text")).type != Compression::None) {
+		std::cerr << "ERROR    : plain text detected as compressed" << std::endl;
+		return -1;
+	}
+
+	std::cout << "SUCCESS\n";
+}
@@ -0,0 +1,67 @@
+
+#include "Util/Fingerprint.h"
+
+#include <iostream>
+#include <string>
+
+namespace {
+
+bool check(const std::string &text, uint64_t expected, const char *name) {
+
+	if (FingerprintOf(text) != expected) {
+		std::cerr << "ERROR    : wrong fingerprint of " << name << ", got 0x" << std::hex << FingerprintOf(text) << std::dec << std::endl;
+		return false;
+	}
+
+	// fed a byte at a time, and in pieces which don't line up with the 32 byte stripes
+	for (size_t step : {size_t(1), size_t(7), size_t(33)}) {
+		Fingerprint fingerprint;
+		for (size_t i = 0; i < text.size(); i += step) {
+			fingerprint.update(view::string_view(text).substr(i, step));
+		}
+
+		if (fingerprint.value() != expected) {
+			std::cerr << "ERROR    : wrong fingerprint of " << name << " hashed " << step << " bytes at a time" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+}
+
+int main() {
+
+	// XXH64 with a seed of 0, as given by the reference implementation
+	std::string bytes;
+	for (int i = 0; i < 4; ++i) {
+		for (int ch = 0; ch < 256; ++ch) {
+			bytes.push_back(static_cast<char>(ch));
+		}
+	}
+	bytes.append("0123456789abc");
+
+	const struct {
+		std::string text;
+		uint64_t expected;
+		const char *name;
+	} tests[] = {
+		{ "",                                        0xef46db3751d8e999ull, "the empty text" },
+		{ "a",                                       0xd24ec4f1a98c6e5bull, "one byte" },
+		{ "abc",                                     0x44bc2cf5ad770999ull, "three bytes" },
+		{ "message digest",                          0x066ed728fceeb3beull, "14 bytes" },
+		{ "1234567890123456789012345678901",         0x8f367cb873a5376eull, "31 bytes" },
+		{ "12345678901234567890123456789012",        0x40fd1aa52d98274cull, "32 bytes" },
+		{ "Nobody inspects the spammish repetition", 0xfbcea83c8a378bf1ull, "39 bytes" },
+		{ bytes,                                     0x6f479572bb81c7e6ull, "1037 bytes" },
+	};
+
+	for (const auto &test : tests) {
+		if (!check(test.text, test.expected, test.name)) {
+			return -1;
+		}
+	}
+
+	std::cout << "SUCCESS\n";
+}
@@ -0,0 +1,246 @@
+
+#include "Util/FileSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+/*
+** The conversions as they were before they were rewritten, a character at a
+** time, which the current ones must give the same results as
+*/
+std::string referenceToDos(const std::string &text) {
+	std::string out;
+	out.reserve(text.size() + static_cast<size_t>(std::count(text.begin(), text.end(), '\n')));
+	for (char ch : text) {
+		if (ch == '\n') {
+			out.push_back('\r');
+		}
+		out.push_back(ch);
+	}
+	return out;
+}
+
+std::string referenceToMac(std::string text) {
+	std::replace(text.begin(), text.end(), '\n', '\r');
+	return text;
+}
+
+std::string referenceFromMac(std::string text) {
+	std::replace(text.begin(), text.end(), '\r', '\n');
+	return text;
+}
+
+std::string referenceFromDos(const std::string &text, char *pendingCR) {
+
+	if (pendingCR) {
+		*pendingCR = '\0';
+	}
+
+	std::string out;
+	for (auto it = text.begin(); it != text.end(); ++it) {
+		if (*it == '\r') {
+			auto next = std::next(it);
+			if (next != text.end()) {
+				if (*next == '\n') {
+					continue;
+				}
+			} else if (pendingCR) {
+				*pendingCR = *it;
+				break;
+			}
+		}
+		out.push_back(*it);
+	}
+	return out;
+}
+
+// text made mostly of line endings, so that every combination of them turns up
+std::string makeText(size_t size, std::mt19937 &rng) {
+	static const char chars[] = { '\r', '\n', '\r', '\n', 'a', 'b' };
+
+	std::string text;
+	for (size_t i = 0; i < size; ++i) {
+		text.push_back(chars[rng() % sizeof(chars)]);
+	}
+	return text;
+}
+
+/*
+** Converts "text" from DOS format in chunks the way files are read, carrying
+** a trailing carriage return over to the start of the next chunk, and the
+** last chunk without holding it back
+*/
+std::string chunkedFromDos(const std::string &text, std::mt19937 &rng) {
+
+	std::string out;
+	char pendingCR = '\0';
+	size_t pos     = 0;
+
+	do {
+		const size_t n = std::min<size_t>(rng() % 8, text.size() - pos);
+		const bool last = (pos + n == text.size());
+
+		std::string chunk;
+		if (pendingCR) {
+			chunk.push_back(pendingCR);
+		}
+		chunk.append(text, pos, n);
+		pos += n;
+
+		size_t length = chunk.size();
+		ConvertFromDos(&chunk[0], &length, last ? nullptr : &pendingCR);
+		out.append(chunk, 0, length);
+
+		if (last) {
+			break;
+		}
+	} while (true);
+
+	return out;
+}
+
+bool check(bool ok, const char *what, const std::string &text) {
+	if (!ok) {
+		std::cerr << "ERROR    : " << what << " differs for a text of " << text.size() << " characters" << std::endl;
+	}
+	return ok;
+}
+
+bool testText(const std::string &text, std::mt19937 &rng) {
+
+	std::string s = text;
+	ConvertToDos(s);
+	if (!check(s == referenceToDos(text), "ConvertToDos", text)) {
+		return false;
+	}
+
+	s = text;
+	ConvertToMac(s);
+	if (!check(s == referenceToMac(text), "ConvertToMac", text)) {
+		return false;
+	}
+
+	s = text;
+	ConvertFromMac(s);
+	if (!check(s == referenceFromMac(text), "ConvertFromMac", text)) {
+		return false;
+	}
+
+	s = text;
+	ConvertFromDos(s);
+	if (!check(s == referenceFromDos(text, nullptr), "ConvertFromDos", text)) {
+		return false;
+	}
+
+	char pendingCR         = 'x';
+	char expectedPendingCR = 'y';
+	s                      = text;
+	ConvertFromDos(s, &pendingCR);
+	const std::string expected = referenceFromDos(text, &expectedPendingCR);
+	if (!check(s == expected && pendingCR == expectedPendingCR, "ConvertFromDos with a pending CR", text)) {
+		return false;
+	}
+
+	if (!check(chunkedFromDos(text, rng) == referenceFromDos(text, nullptr), "chunked ConvertFromDos", text)) {
+		return false;
+	}
+
+	// the chunk based conversions of FileWriter, split at random places
+	std::vector<char> buffer(text.size() * 2 + 1);
+	char *dos    = buffer.data();
+	size_t split = text.empty() ? 0 : rng() % text.size();
+	dos          = ConvertToDos(view::string_view(text).substr(0, split), dos);
+	dos          = ConvertToDos(view::string_view(text).substr(split), dos);
+	if (!check(std::string(buffer.data(), dos) == referenceToDos(text), "chunked ConvertToDos", text)) {
+		return false;
+	}
+
+	char *mac = buffer.data();
+	mac       = ConvertToMac(view::string_view(text).substr(0, split), mac);
+	mac       = ConvertToMac(view::string_view(text).substr(split), mac);
+	if (!check(std::string(buffer.data(), mac) == referenceToMac(text), "chunked ConvertToMac", text)) {
+		return false;
+	}
+
+	return true;
+}
+
+// times "convert" against "reference" on a large text, when asked to with --benchmark
+template <class Convert, class Reference>
+void benchmark(const char *name, const std::string &text, Convert convert, Reference reference) {
+
+	using Clock = std::chrono::steady_clock;
+
+	std::string s = text;
+	auto start    = Clock::now();
+	convert(s);
+	const auto current = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+
+	start = Clock::now();
+	const std::string r = reference(text);
+	const auto previous = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+
+	std::cout << name << ": " << current << "us, was " << previous << "us" << (s == r ? "" : " (MISMATCH)") << '\n';
+}
+
+void benchmarks() {
+
+	// source code like lines, between 0 and 120 characters long
+	std::mt19937 rng(1);
+	std::string text;
+	while (text.size() < 64 * 1024 * 1024) {
+		text.append(rng() % 121, 'x');
+		text.append("\r\n");
+	}
+
+	benchmark("ConvertFromDos", text, [](std::string &s) { ConvertFromDos(s); }, [](const std::string &s) { return referenceFromDos(s, nullptr); });
+	benchmark("ConvertFromMac", text, [](std::string &s) { ConvertFromMac(s); }, referenceFromMac);
+
+	std::string unix = text;
+	ConvertFromDos(unix);
+	benchmark("ConvertToDos", unix, [](std::string &s) { ConvertToDos(s); }, referenceToDos);
+	benchmark("ConvertToMac", unix, [](std::string &s) { ConvertToMac(s); }, referenceToMac);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+
+	std::mt19937 rng(42);
+
+	const char *const fixed[] = {
+		"",
+		"\r",
+		"\n",
+		"\r\n",
+		"\n\r",
+		"\r\r\n",
+		"a\r\nb\rc\n",
+		"\r\n\r\n\r",
+	};
+
+	for (const char *text : fixed) {
+		if (!testText(text, rng)) {
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < 20000; ++i) {
+		if (!testText(makeText(rng() % 64, rng), rng)) {
+			return -1;
+		}
+	}
+
+	if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+		benchmarks();
+	}
+
+	std::cout << "SUCCESS\n";
+}
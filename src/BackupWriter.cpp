@@ -0,0 +1,284 @@
+
+#include "BackupWriter.h"
+#include "FunctionTask.h"
+#include "TextBuffer.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <algorithm>
+
+#include <gsl/gsl_util>
+
+namespace {
+
+// how much text is copied from the buffer at a time
+constexpr int64_t ChunkSize = 4 * 1024 * 1024;
+
+// copying pauses while this much is waiting to be written
+constexpr int64_t MaxPending = 64 * 1024 * 1024;
+
+// how long to wait for the worker when it's behind, in milliseconds
+constexpr int PendingDelay = 10;
+
+}
+
+/**
+ * @brief BackupWriter::BackupWriter
+ * @param buffer
+ * @param parent
+ */
+BackupWriter::BackupWriter(TextBuffer *buffer, QObject *parent) : QObject(parent), buffer_(buffer), pool_(std::make_unique<QThreadPool>()) {
+
+	/* a single writer keeps the chunks in the order they were queued, and is
+	   kept alive between them since it owns the file of the pass */
+	pool_->setMaxThreadCount(1);
+	pool_->setExpiryTimeout(-1);
+
+	timer_ = new QTimer(this);
+	timer_->setSingleShot(true);
+	timer_->setInterval(0);
+	connect(timer_, &QTimer::timeout, this, &BackupWriter::writeChunk);
+
+	buffer_->BufAddModifyCB(bufModifiedCB, this);
+}
+
+/**
+ * @brief BackupWriter::~BackupWriter
+ */
+BackupWriter::~BackupWriter() {
+	buffer_->BufRemoveModifyCB(bufModifiedCB, this);
+	flush();
+
+	// an unfinished pass leaves the last complete backup as it was
+	pass_ = nullptr;
+}
+
+/**
+ * Brings the backup file "fileName" up to date with the buffer, adding a
+ * newline to the end of the text if "appendLF" is set and it doesn't
+ * already end with one. Returns right away, the copying and writing go on
+ * in the background.
+ *
+ * @brief BackupWriter::write
+ * @param fileName
+ * @param appendLF
+ */
+void BackupWriter::write(const QString &fileName, bool appendLF) {
+
+	if (fileName != fileName_) {
+		discard();
+		fileName_ = fileName;
+	}
+
+	if (appendLF != appendLF_) {
+		appendLF_ = appendLF;
+		complete_ = false;
+	}
+
+	// a failure of the last backup is reported by writeChunk
+	if ((failed_ || !complete_) && !timer_->isActive()) {
+		timer_->start(0);
+	}
+}
+
+/**
+ * Stops writing the backup and removes the file, once everything already
+ * queued is done.
+ *
+ * @brief BackupWriter::discard
+ */
+void BackupWriter::discard() {
+
+	timer_->stop();
+	flush();
+
+	pass_ = nullptr;
+	if (created_) {
+		QFile::remove(fileName_);
+	}
+
+	validEnd_ = {};
+	created_  = false;
+	writing_  = false;
+	complete_ = false;
+	failed_   = false;
+}
+
+/**
+ * @brief BackupWriter::flush
+ */
+void BackupWriter::flush() {
+	pool_->waitForDone();
+}
+
+/**
+ * Copies the next chunk of the text which isn't in the backup file yet and
+ * hands it to the worker. Once the whole text has been queued, the file is
+ * cut to the length of the text.
+ *
+ * @brief BackupWriter::writeChunk
+ */
+void BackupWriter::writeChunk() {
+
+	if (failed_) {
+		const QString error = error_;
+		discard();
+		Q_EMIT writeFailed(error);
+		return;
+	}
+
+	if (pending_ > MaxPending) {
+		timer_->start(PendingDelay);
+		return;
+	}
+
+	const TextCursor end = buffer_->BufEndOfBuffer();
+
+	if (validEnd_ < end) {
+		const TextCursor chunkEnd = std::min(end, validEnd_ + ChunkSize);
+		std::string text          = buffer_->BufGetRangeEx(validEnd_, chunkEnd);
+
+		queue(to_integer(validEnd_), std::move(text), -1);
+		validEnd_ = chunkEnd;
+		timer_->start(0);
+		return;
+	}
+
+	/* the trailing newline lies past the end of the buffer, so it is
+	   written again by the next backup */
+	std::string tail;
+	if (appendLF_ && !buffer_->BufIsEmpty() && buffer_->back() != '\n') {
+		tail = "\n";
+	}
+
+	const int64_t size = to_integer(end) + static_cast<int64_t>(tail.size());
+	queue(to_integer(end), std::move(tail), size);
+	complete_ = true;
+}
+
+/**
+ * Queues "data" to be written at "offset" in the backup file, then if
+ * "size" isn't negative, the file to be cut to that size and the pass to be
+ * finished. The first write of a pass starts it, at the point up to which
+ * the backup file already matches the buffer.
+ *
+ * @brief BackupWriter::queue
+ * @param offset
+ * @param data
+ * @param size
+ */
+void BackupWriter::queue(int64_t offset, std::string data, int64_t size) {
+
+	const bool begin = !writing_;
+	created_ = true;
+	writing_ = (size < 0);
+
+	pending_ += static_cast<int64_t>(data.size());
+
+	pool_->start(new FunctionTask([this, fileName = fileName_, offset, data = std::move(data), size, begin]() {
+
+		auto _ = gsl::finally([this, &data]() {
+			pending_ -= static_cast<int64_t>(data.size());
+		});
+
+		// once a write has failed, the rest are pointless
+		if (failed_) {
+			return;
+		}
+
+		if (begin && !beginPass(fileName, offset)) {
+			return;
+		}
+
+		if (!pass_->seek(offset) || pass_->write(data.data(), static_cast<qint64>(data.size())) != static_cast<qint64>(data.size())) {
+			fail(pass_->errorString());
+			return;
+		}
+
+		if (size >= 0) {
+			if (!pass_->resize(size) || !pass_->commit()) {
+				fail(pass_->errorString());
+				return;
+			}
+
+			pass_ = nullptr;
+		}
+	}));
+}
+
+/*
+** Start writing a new backup file, beginning with the first "prefix" bytes
+** of the current one, which still match the buffer. It is readable by its
+** owner only, rather than taking after the file being edited. Only called
+** by the worker.
+*/
+bool BackupWriter::beginPass(const QString &fileName, int64_t prefix) {
+
+	pass_ = std::make_unique<QSaveFile>(fileName);
+	if (!pass_->open(QIODevice::WriteOnly) || !pass_->setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner)) {
+		fail(pass_->errorString());
+		return false;
+	}
+
+	if (prefix == 0) {
+		return true;
+	}
+
+	QFile previous(fileName);
+	if (!previous.open(QIODevice::ReadOnly)) {
+		fail(previous.errorString());
+		return false;
+	}
+
+	for (int64_t copied = 0; copied < prefix;) {
+		const QByteArray chunk = previous.read(std::min(prefix - copied, ChunkSize));
+		if (chunk.isEmpty() || pass_->write(chunk) != chunk.size()) {
+			fail(chunk.isEmpty() ? previous.errorString() : pass_->errorString());
+			return false;
+		}
+
+		copied += chunk.size();
+	}
+
+	return true;
+}
+
+/**
+ * Gives up on the pass being written, which leaves the last complete backup
+ * file as it was. Only called by the worker.
+ *
+ * @brief BackupWriter::fail
+ * @param error
+ */
+void BackupWriter::fail(const QString &error) {
+	error_  = error;
+	failed_ = true;
+	pass_   = nullptr;
+}
+
+/**
+ * Moves the point up to which the backup file matches the buffer back to
+ * the start of a change.
+ *
+ * @brief BackupWriter::bufModifiedCB
+ * @param pos
+ * @param nInserted
+ * @param nDeleted
+ * @param nRestyled
+ * @param deletedText
+ * @param user
+ */
+void BackupWriter::bufModifiedCB(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled, view::string_view deletedText, void *user) {
+
+	Q_UNUSED(nRestyled)
+	Q_UNUSED(deletedText)
+
+	auto writer = static_cast<BackupWriter *>(user);
+	if (nInserted != 0 || nDeleted != 0) {
+		writer->validEnd_ = std::min(writer->validEnd_, pos);
+		writer->complete_ = false;
+	}
+}
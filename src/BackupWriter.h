@@ -0,0 +1,78 @@
+
+#ifndef BACKUP_WRITER_H_
+#define BACKUP_WRITER_H_
+
+#include "TextBufferFwd.h"
+#include "TextCursor.h"
+#include "Util/string_view.h"
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+class QSaveFile;
+class QThreadPool;
+class QTimer;
+
+/*
+** Keeps the backup file of a document up to date without holding up the
+** user. Rather than copying the whole buffer when a backup is due, the text
+** is copied a chunk at a time from a timer, so that the event loop keeps
+** running in between, and each chunk is written by a worker thread.
+**
+** The writer remembers how much of the start of the backup file already
+** matches the buffer. Only the text after that point is copied and written
+** again, an edit moves the point back to where it happened. Edits made
+** while a backup is being written are therefore simply picked up by it, and
+** a backup requested while one is in progress doesn't start another.
+**
+** Each pass is written to a new file, which starts as a copy of the part of
+** the old one which still matches, and only replaces it once it's complete.
+** A crash in the middle of a pass leaves the last complete backup behind.
+** The backup file stays an ordinary copy of the text, so recovering it is
+** still just a matter of opening it.
+*/
+class BackupWriter : public QObject {
+	Q_OBJECT
+
+public:
+	explicit BackupWriter(TextBuffer *buffer, QObject *parent = nullptr);
+	~BackupWriter() override;
+
+public:
+	void write(const QString &fileName, bool appendLF);
+	void discard();
+
+Q_SIGNALS:
+	void writeFailed(const QString &error);
+
+private Q_SLOTS:
+	void writeChunk();
+
+private:
+	static void bufModifiedCB(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled, view::string_view deletedText, void *user);
+	void queue(int64_t offset, std::string data, int64_t size);
+	bool beginPass(const QString &fileName, int64_t prefix);
+	void fail(const QString &error);
+	void flush();
+
+private:
+	TextBuffer *buffer_;
+	QTimer *timer_;
+	std::unique_ptr<QThreadPool> pool_;
+	QString fileName_;
+	QString error_;                      // set by the worker before it sets failed_
+	std::unique_ptr<QSaveFile> pass_;    // the new backup file being written, only used by the worker
+	TextCursor validEnd_;                // the backup file matches the buffer up to here, counting the writes queued
+	bool created_    = false;            // whether the current backup file has been written to
+	bool writing_    = false;            // whether a pass has been started and not yet finished
+	bool complete_   = false;            // whether the backup file matches the whole buffer
+	bool appendLF_   = false;
+	std::atomic<int64_t> pending_{0};    // bytes queued and not yet written
+	std::atomic<bool> failed_{false};
+};
+
+#endif
@@ -0,0 +1,371 @@
+
+#include "DialogFindInFiles.h"
+#include "DocumentWidget.h"
+#include "MainWindow.h"
+#include "Preferences.h"
+#include "Regex.h"
+#include "Search.h"
+#include "TextArea.h"
+#include "TextBuffer.h"
+#include "Util/FileSystem.h"
+#include "Util/regex.h"
+
+#include <QApplication>
+#include <QDir>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QMouseEvent>
+#include <QRegularExpression>
+
+namespace {
+
+/**
+ * @brief splitGlobs
+ * @param text
+ * @return
+ */
+QStringList splitGlobs(const QString &text) {
+	static const QRegularExpression separators(QLatin1String("[;\\s]+"));
+	return text.split(separators, QString::SkipEmptyParts);
+}
+
+}
+
+/**
+ * @brief DialogFindInFiles::DialogFindInFiles
+ * @param window
+ * @param document
+ * @param f
+ */
+DialogFindInFiles::DialogFindInFiles(MainWindow *window, DocumentWidget *document, Qt::WindowFlags f) : Dialog(window, f), window_(window), document_(document) {
+	ui.setupUi(this);
+
+	search_ = new FileSearch(this);
+	connectSlots();
+
+	setDocument(document);
+}
+
+/**
+ * @brief DialogFindInFiles::connectSlots
+ */
+void DialogFindInFiles::connectSlots() {
+	connect(ui.buttonFind,   &QPushButton::clicked, this, &DialogFindInFiles::buttonFind_clicked);
+	connect(ui.buttonStop,   &QPushButton::clicked, this, &DialogFindInFiles::buttonStop_clicked);
+	connect(ui.buttonBrowse, &QPushButton::clicked, this, &DialogFindInFiles::buttonBrowse_clicked);
+
+	connect(search_, &FileSearch::fileMatched, this, &DialogFindInFiles::searchFileMatched);
+	connect(search_, &FileSearch::progress,    this, &DialogFindInFiles::searchProgress);
+	connect(search_, &FileSearch::finished,    this, &DialogFindInFiles::searchFinished);
+}
+
+/**
+ * @brief DialogFindInFiles::showEvent
+ * @param event
+ */
+void DialogFindInFiles::showEvent(QShowEvent *event) {
+	Dialog::showEvent(event);
+	ui.textFind->setFocus();
+}
+
+/**
+ * @brief DialogFindInFiles::setDocument
+ * @param document
+ */
+void DialogFindInFiles::setDocument(DocumentWidget *document) {
+	document_ = document;
+
+	// default to searching the directory of the current document
+	if(ui.editDirectory->text().isEmpty()) {
+		const QString path = document_->path();
+		ui.editDirectory->setText(path.isEmpty() ? QDir::currentPath() : path);
+	}
+}
+
+/**
+ * @brief DialogFindInFiles::setTextFieldFromDocument
+ * @param document
+ */
+void DialogFindInFiles::setTextFieldFromDocument(DocumentWidget *document) {
+
+	QString initialText;
+
+	if (Preferences::GetPrefFindReplaceUsesSelection()) {
+		initialText = document->GetAnySelection();
+	}
+
+	ui.textFind->setText(initialText);
+}
+
+/**
+ * @brief DialogFindInFiles::initToggleButtons
+ * @param searchType
+ */
+void DialogFindInFiles::initToggleButtons(SearchType searchType) {
+
+	ui.checkRegex->setChecked(Search::isRegexType(searchType));
+	ui.checkCase->setChecked(searchType == SearchType::CaseSense || searchType == SearchType::CaseSenseWord || searchType == SearchType::Regex);
+	ui.checkWord->setChecked(searchType == SearchType::LiteralWord || searchType == SearchType::CaseSenseWord);
+	ui.checkWord->setEnabled(!Search::isRegexType(searchType));
+}
+
+/**
+ * @brief DialogFindInFiles::updateFindButton
+ */
+void DialogFindInFiles::updateFindButton() {
+	ui.buttonFind->setEnabled(!ui.textFind->text().isEmpty());
+}
+
+/**
+ * @brief DialogFindInFiles::on_textFind_textChanged
+ * @param text
+ */
+void DialogFindInFiles::on_textFind_textChanged(const QString &text) {
+	Q_UNUSED(text)
+	updateFindButton();
+}
+
+/**
+ * @brief DialogFindInFiles::on_checkRegex_toggled
+ * @param checked
+ */
+void DialogFindInFiles::on_checkRegex_toggled(bool checked) {
+	// make the Whole Word button insensitive for regex searches
+	ui.checkWord->setEnabled(!checked);
+}
+
+/**
+ * @brief DialogFindInFiles::buttonBrowse_clicked
+ */
+void DialogFindInFiles::buttonBrowse_clicked() {
+
+	const QString directory = QFileDialog::getExistingDirectory(this, tr("Directory to Search"), ui.editDirectory->text());
+	if(!directory.isEmpty()) {
+		ui.editDirectory->setText(directory);
+	}
+}
+
+/*
+** Fetch and verify (particularly regular expression) the search string, type
+** and file filters from the dialog.
+*/
+boost::optional<FileSearch::Options> DialogFindInFiles::readFields() {
+
+	FileSearch::Options options;
+	options.searchString = ui.textFind->text();
+	options.directory    = ui.editDirectory->text();
+	options.includes     = splitGlobs(ui.editInclude->text());
+	options.excludes     = splitGlobs(ui.editExclude->text());
+	options.delimiters   = Preferences::GetPrefDelimiters();
+
+	if (ui.checkRegex->isChecked()) {
+		int regexDefault;
+		if (ui.checkCase->isChecked()) {
+			options.searchType = SearchType::Regex;
+			regexDefault       = REDFLT_STANDARD;
+		} else {
+			options.searchType = SearchType::RegexNoCase;
+			regexDefault       = REDFLT_CASE_INSENSITIVE;
+		}
+
+		try {
+			auto compiledRE = make_regex(options.searchString, regexDefault);
+		} catch(const RegexError &e) {
+			QMessageBox::warning(
+			            this,
+			            tr("Regex Error"),
+			            tr("Please respecify the search string:\n%1").arg(QString::fromLatin1(e.what())));
+			return boost::none;
+		}
+	} else {
+		if (ui.checkCase->isChecked()) {
+			options.searchType = ui.checkWord->isChecked() ? SearchType::CaseSenseWord : SearchType::CaseSense;
+		} else {
+			options.searchType = ui.checkWord->isChecked() ? SearchType::LiteralWord : SearchType::Literal;
+		}
+	}
+
+	if(!QFileInfo(options.directory).isDir()) {
+		QMessageBox::warning(
+		            this,
+		            tr("Find in Files"),
+		            tr("%1 is not a directory").arg(options.directory));
+		return boost::none;
+	}
+
+	return options;
+}
+
+/**
+ * @brief DialogFindInFiles::buttonFind_clicked
+ */
+void DialogFindInFiles::buttonFind_clicked() {
+
+	boost::optional<FileSearch::Options> options = readFields();
+	if(!options) {
+		return;
+	}
+
+	Search::saveSearchHistory(options->searchString, QString(), options->searchType, /*isIncremental=*/false);
+
+	if(!search_->start(*options)) {
+		QApplication::beep();
+		return;
+	}
+
+	hitCount_ = 0;
+	if(DocumentWidget *results = resultsDocument(*options)) {
+		results->buffer()->BufSetAll(view::string_view());
+	}
+
+	ui.labelStatus->setText(tr("Searching..."));
+	ui.buttonStop->setEnabled(true);
+}
+
+/**
+ * @brief DialogFindInFiles::buttonStop_clicked
+ */
+void DialogFindInFiles::buttonStop_clicked() {
+	search_->cancel();
+}
+
+/**
+ * @brief DialogFindInFiles::searchFileMatched
+ * @param hits
+ */
+void DialogFindInFiles::searchFileMatched(const QList<FileSearch::Hit> &hits) {
+
+	hitCount_ += hits.size();
+
+	// the results document may have been closed while the search was running
+	if(!results_) {
+		return;
+	}
+
+	QString text;
+	for(const FileSearch::Hit &hit : hits) {
+		// columns are counted from 1, as compilers and grep report them
+		text += QString(QLatin1String("%1:%2:%3: %4\n")).arg(hit.path).arg(hit.line).arg(hit.column + 1).arg(hit.text);
+	}
+
+	results_->buffer()->BufAppendEx(text.toStdString());
+}
+
+/**
+ * @brief DialogFindInFiles::searchProgress
+ * @param filesSearched
+ * @param filesMatched
+ */
+void DialogFindInFiles::searchProgress(int filesSearched, int filesMatched) {
+	ui.labelStatus->setText(tr("Searching... %1 matches in %2 of %3 files").arg(hitCount_).arg(filesMatched).arg(filesSearched));
+}
+
+/**
+ * @brief DialogFindInFiles::searchFinished
+ * @param cancelled
+ */
+void DialogFindInFiles::searchFinished(bool cancelled) {
+
+	ui.buttonStop->setEnabled(false);
+
+	if(cancelled) {
+		ui.labelStatus->setText(tr("Search stopped, %1 matches").arg(hitCount_));
+	} else {
+		ui.labelStatus->setText(tr("%1 matches").arg(hitCount_));
+	}
+}
+
+/*
+** The document which the hits are written to, one line per hit the way grep
+** prints them. The one of the previous search is reused while it's open. Its
+** panes are watched for double clicks, which open the file of the hit clicked.
+*/
+DocumentWidget *DialogFindInFiles::resultsDocument(const FileSearch::Options &options) {
+
+	if(!results_) {
+		results_ = MainWindow::EditNewFile(
+		               Preferences::GetPrefOpenInTab() ? window_ : nullptr,
+		               QString(),
+		               /*iconic=*/false,
+		               QString(),
+		               options.directory);
+
+		MainWindow::CheckCloseEnableState();
+	}
+
+	if(results_) {
+		for(TextArea *area : results_->textPanes()) {
+			area->viewport()->installEventFilter(this);
+		}
+	}
+
+	return results_;
+}
+
+/**
+ * @brief DialogFindInFiles::eventFilter
+ * @param watched
+ * @param event
+ * @return
+ */
+bool DialogFindInFiles::eventFilter(QObject *watched, QEvent *event) {
+
+	if(event->type() != QEvent::MouseButtonDblClick || !results_) {
+		return Dialog::eventFilter(watched, event);
+	}
+
+	for(TextArea *area : results_->textPanes()) {
+		if(watched != area->viewport()) {
+			continue;
+		}
+
+		const TextCursor pos     = area->TextDXYToPosition(static_cast<QMouseEvent *>(event)->pos());
+		const TextBuffer *buffer = results_->buffer();
+		const QString line       = QString::fromStdString(buffer->BufGetRangeEx(buffer->BufStartOfLine(pos), buffer->BufEndOfLine(pos)));
+
+		// a hit as it was written by searchFileMatched, "file:line:column: text"
+		static const QRegularExpression hitPattern(QLatin1String("^(.+?):(\\d+):\\d+: "));
+
+		const QRegularExpressionMatch match = hitPattern.match(line);
+		if(match.hasMatch()) {
+			openHit(match.captured(1), match.captured(2).toLongLong());
+			return true;
+		}
+	}
+
+	return Dialog::eventFilter(watched, event);
+}
+
+/**
+ * Open the file containing a hit and select the matching line
+ *
+ * @brief DialogFindInFiles::openHit
+ * @param path
+ * @param line
+ */
+void DialogFindInFiles::openHit(const QString &path, int64_t line) {
+
+	const boost::optional<PathInfo> fi = parseFilename(path);
+	if (!fi) {
+		QApplication::beep();
+		return;
+	}
+
+	DocumentWidget *document = DocumentWidget::editExistingFile(
+	                               window_->currentDocument(),
+	                               fi->filename,
+	                               fi->pathname,
+	                               0,
+	                               QString(),
+	                               /*iconic=*/false,
+	                               QString(),
+	                               Preferences::GetPrefOpenInTab(),
+	                               /*bgOpen=*/false);
+
+	MainWindow::CheckCloseEnableState();
+
+	if(document) {
+		document->selectNumberedLine(document->firstPane(), line);
+	}
+}
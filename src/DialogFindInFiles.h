@@ -0,0 +1,62 @@
+
+#ifndef DIALOG_FIND_IN_FILES_H_
+#define DIALOG_FIND_IN_FILES_H_
+
+#include "Dialog.h"
+#include "FileSearch.h"
+#include "SearchType.h"
+
+#include <QPointer>
+
+#include <boost/optional.hpp>
+
+#include "ui_DialogFindInFiles.h"
+
+class DocumentWidget;
+class MainWindow;
+
+class DialogFindInFiles : public Dialog {
+	Q_OBJECT
+
+public:
+	DialogFindInFiles(MainWindow *window, DocumentWidget *document, Qt::WindowFlags f = Qt::WindowFlags());
+	~DialogFindInFiles() override = default;
+
+protected:
+	bool eventFilter(QObject *watched, QEvent *event) override;
+	void showEvent(QShowEvent *event) override;
+
+public:
+	void initToggleButtons(SearchType searchType);
+	void setDocument(DocumentWidget *document);
+	void setTextFieldFromDocument(DocumentWidget *document);
+	void updateFindButton();
+
+private:
+	DocumentWidget *resultsDocument(const FileSearch::Options &options);
+	boost::optional<FileSearch::Options> readFields();
+	void openHit(const QString &path, int64_t line);
+
+private Q_SLOTS:
+	void on_checkRegex_toggled(bool checked);
+	void on_textFind_textChanged(const QString &text);
+
+private:
+	void buttonBrowse_clicked();
+	void buttonFind_clicked();
+	void buttonStop_clicked();
+	void connectSlots();
+	void searchFileMatched(const QList<FileSearch::Hit> &hits);
+	void searchFinished(bool cancelled);
+	void searchProgress(int filesSearched, int filesMatched);
+
+private:
+	Ui::DialogFindInFiles ui;
+	MainWindow *window_;
+	DocumentWidget *document_;
+	FileSearch *search_;
+	QPointer<DocumentWidget> results_;
+	int hitCount_ = 0;
+};
+
+#endif
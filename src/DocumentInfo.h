@@ -3,17 +3,22 @@
 #define DOCUMENT_INFO_H_
 
 #include "UndoInfo.h"
+#include "UndoJournal.h"
 #include "TextBufferFwd.h"
 #include "ShowMatchingStyle.h"
 #include "IndentStyle.h"
 #include "WrapStyle.h"
 #include "SmartIndent.h"
 #include "LockReasons.h"
+#include "Util/Compression.h"
 #include "Util/FileFormats.h"
 #include <QString>
 #include <QtGlobal>
+#include <boost/optional.hpp>
+#include <cstdint>
 #include <deque>
 #include <memory>
+#include <string>
 
 #ifdef Q_OS_MACOS
 #include <unistd.h>
@@ -25,6 +30,7 @@ struct DocumentInfo {
 	QString path;                                      // path component of file being edited
 	std::deque<UndoInfo> redo;                         // info for redoing last undone op
 	std::deque<UndoInfo> undo;                         // info for undoing last operation
+	std::unique_ptr<UndoJournal> undoJournal = std::make_unique<UndoJournal>(); // undo records which have been moved out of memory
 	LockReasons lockReasons;                           // all ways a file can be locked
 	std::unique_ptr<SmartIndentData> smartIndentData;  // compiled macros for smart indent
 
@@ -40,12 +46,20 @@ struct DocumentInfo {
 #endif
 
 	FileFormats fileFormat  = FileFormats::Unix;        // whether to save the file straight (Unix format), or convert it to MS DOS style with \r\n line breaks
+	CompressionFormat compression;                      // how the file is compressed, it's written back the same way
 	time_t lastModTime      = 0;                        // time of last modification to file
 	dev_t dev               = 0;                        // device where the file resides
 	ino_t ino               = 0;                        // file's inode
+	boost::optional<uint64_t> fingerprint;              // of the contents of the file as last read or written
+	std::string fileTail;                               // the last few bytes of the file as last read or written, see DocumentWidget::followFile
+	int64_t fileSize        = 0;                        // size of the file as last read or written
 	TextBuffer *buffer      = nullptr;                  // holds the text being edited
 	int autoSaveCharCount   = 0;                        // count of single characters typed since last backup file generated
 	int autoSaveOpCount     = 0;                        // count of editing operations
+	uint64_t undoSerial     = 0;                        // serial number of the most recently created undo or redo record
+	uint64_t savedSerial    = 0;                        // serial number of the record which restores the file to its saved state, 0 if there is none
+	size_t redoMemory       = 0;                        // bytes held by the records of the redo list
+	size_t undoMemory       = 0;                        // bytes held by the records of the undo list
 	bool filenameSet        = false;                    // is the window still "Untitled"?
 	bool fileChanged        = false;                    // has window been modified?
 	bool autoSave           = false;                    // is autosave turned on?
@@ -55,6 +69,7 @@ struct DocumentInfo {
 	bool matchSyntaxBased   = false;                    // Use syntax info to show matching
 	bool wasSelected        = false;                    // last selection state (for dim/undim of selection related menu items
 	bool ignoreModify       = false;                    // ignore modifications to text area
+	bool follow             = false;                    // read what other programs append to the file as they do
 	WrapStyle wrapMode      = WrapStyle::Default;       // line wrap style: None, Newline or Continuous
 	IndentStyle indentStyle = IndentStyle::Default;     // whether/how to auto indent
 	ShowMatchingStyle showMatchingStyle = ShowMatchingStyle::None; // How to show matching parens: None, Delimeter, or Range
@@ -1,5 +1,6 @@
 
 #include "DocumentWidget.h"
+#include "BackupWriter.h"
 #include "CommandRecorder.h"
 #include "DialogDuplicateTags.h"
 #include "DialogMoveDocument.h"
@@ -8,6 +9,8 @@
 #include "DialogReplace.h"
 #include "DragEndEvent.h"
 #include "EditFlags.h"
+#include "FileWatcher.h"
+#include "FileWriter.h"
 #include "Font.h"
 #include "FontType.h"
 #include "Highlight.h"
@@ -16,7 +19,10 @@
 #include "MainWindow.h"
 #include "PatternSet.h"
 #include "Preferences.h"
+#include "ProgressTask.h"
+#include "RangesetTable.h"
 #include "Search.h"
+#include "Session.h"
 #include "Settings.h"
 #include "SignalBlocker.h"
 #include "SmartIndent.h"
@@ -25,6 +31,7 @@
 #include "Style.h"
 #include "TextArea.h"
 #include "TextBuffer.h"
+#include "TextFile.h"
 #include "WindowHighlightData.h"
 #include "WindowMenuEvent.h"
 #include "X11Colors.h"
@@ -34,6 +41,7 @@
 #include "userCmds.h"
 #include "Util/ClearCase.h"
 #include "Util/FileSystem.h"
+#include "Util/Fingerprint.h"
 #include "Util/Input.h"
 #include "Util/User.h"
 #include "Util/regex.h"
@@ -52,6 +60,13 @@
 #include <qplatformdefs.h>
 
 #include <chrono>
+#include <limits>
+#include <memory>
+
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
 
 // NOTE(eteran): generally, this class reaches out to MainWindow FAR too much
 // it would be better to create some fundamental signals that MainWindow could
@@ -83,6 +98,15 @@ constexpr int MAX_PANES = 6;
 // how long to wait (msec) before putting up Shell Command Executing... banner
 constexpr int BANNER_WAIT_TIME = 6000;
 
+// how much of the end of a file is kept, to tell whether it's still there when the file grows
+constexpr int64_t FILE_TAIL_SIZE = 64;
+
+// enough of the start of a file to recognize how it's compressed
+constexpr size_t COMPRESSION_HEADER_SIZE = 16;
+
+// compressed files are read and written in pieces of this size, so that the progress can be followed
+constexpr size_t COMPRESSION_CHUNK_SIZE = 1024 * 1024;
+
 // flags for issueCommand
 enum {
 	ACCUMULATE        = 1,
@@ -136,6 +160,65 @@ bool isAdministrator() {
 #endif
 }
 
+/**
+ * @brief tailOf
+ * @param text
+ * @return the last FILE_TAIL_SIZE characters of "text"
+ */
+std::string tailOf(view::string_view text) {
+	const size_t length = std::min(text.size(), static_cast<size_t>(FILE_TAIL_SIZE));
+	return text.substr(text.size() - length).to_string();
+}
+
+/**
+ * @brief readFileTail
+ * @param fileName
+ * @param size
+ * @return the last FILE_TAIL_SIZE bytes of the first "size" bytes of the file
+ * "fileName", or nothing if they can't be read
+ */
+std::string readFileTail(const QString &fileName, int64_t size) {
+
+	std::string tail(static_cast<size_t>(std::min(size, FILE_TAIL_SIZE)), '\0');
+	const auto length = static_cast<qint64>(tail.size());
+
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly) || !file.seek(size - length) || file.read(&tail[0], length) != length) {
+		return std::string();
+	}
+
+	return tail;
+}
+
+/**
+ * Maps the first "size" bytes of the file "fileName" into memory, read only.
+ * The mapping lasts for as long as the returned pointer, or a copy of it,
+ * does.
+ *
+ * @brief mapFile
+ * @param fileName
+ * @param size
+ * @param error set to the reason if the file couldn't be mapped
+ * @return the mapped file, or null
+ */
+std::shared_ptr<const char> mapFile(const QString &fileName, int64_t size, QString *error) {
+
+	// the file stays open along with the mapping, closing it would unmap it
+	auto file = std::make_unique<QFile>(fileName);
+
+	uchar *memory = file->open(QIODevice::ReadOnly) ? file->map(0, size) : nullptr;
+	if (!memory) {
+		*error = file->errorString();
+		return nullptr;
+	}
+
+	QFile *const owner = file.release();
+	return std::shared_ptr<const char>(reinterpret_cast<const char *>(memory), [owner, memory](const char *) {
+		owner->unmap(memory);
+		delete owner;
+	});
+}
+
 /**
  * @brief ErrorString
  * @param error
@@ -260,6 +343,22 @@ UndoTypes determineUndoType(int64_t nInserted, int64_t nDeleted) {
 	}
 }
 
+/*
+** Compress the text saved by an undo or redo record, keeping the memory count
+** of the list it belongs to up to date. Single character operations are left
+** alone while they can still be continued.
+*/
+void compressUndoItem(UndoInfo *undo, size_t *memory, bool finished) {
+
+	if (!finished && (undo->type == ONE_CHAR_INSERT || undo->type == ONE_CHAR_REPLACE || undo->type == ONE_CHAR_DELETE)) {
+		return;
+	}
+
+	const size_t previousUsage = undo->memoryUsage();
+	undo->compress();
+	*memory = *memory - previousUsage + undo->memoryUsage();
+}
+
 /**
  * @brief createRepeatMacro
  * @param how
@@ -409,6 +508,181 @@ DocumentWidget *DocumentWidget::editExistingFile(DocumentWidget *inDocument, con
 	return document;
 }
 
+/**
+ * Adds a tab to "window" for a document of the last session, without reading
+ * its file. It is read by loadDeferred, when the document is first shown or
+ * once it's the document's turn to be read in the background.
+ *
+ * @brief DocumentWidget::openDeferred
+ * @param window
+ * @param entry
+ * @return the new document, or null if the file is already open
+ */
+DocumentWidget *DocumentWidget::openDeferred(MainWindow *window, const SessionDocument &entry) {
+
+	const boost::optional<PathInfo> fi = parseFilename(entry.fileName);
+	if (!fi || MainWindow::FindWindowWithFile(fi->filename, fi->pathname)) {
+		return nullptr;
+	}
+
+	DocumentWidget *document = window->CreateDocument(fi->filename);
+	document->setPath(fi->pathname);
+	document->info_->filename    = fi->filename;
+	document->info_->filenameSet = true;
+	document->deferred_          = std::make_unique<SessionDocument>(entry);
+
+	/* the empty text stands in for the file until it's read, so it mustn't be
+	 * edited, or the changes would be lost to the file replacing it. doOpen
+	 * lifts the lock */
+	document->info_->lockReasons.setLoadLocked(true);
+	Q_EMIT document->updateWindowReadOnly(document);
+
+	document->RefreshTabState();
+	return document;
+}
+
+/**
+ * @brief DocumentWidget::isDeferred
+ * @return true if this is a document of the last session whose file hasn't been read yet
+ */
+bool DocumentWidget::isDeferred() const {
+	return deferred_ != nullptr;
+}
+
+/**
+ * Reads the file of a document created by openDeferred, and puts back the
+ * language mode, positions and rangesets it had in the session. A file which
+ * no longer exists, or can't be read, has its document closed.
+ *
+ * @brief DocumentWidget::loadDeferred
+ * @return true if the document is loaded
+ */
+bool DocumentWidget::loadDeferred() {
+
+	if (!deferred_) {
+		return true;
+	}
+
+	const std::unique_ptr<SessionDocument> entry = std::move(deferred_);
+
+	MainWindow *const win = MainWindow::fromDocument(this);
+	if (!win || !QFileInfo::exists(fullPath()) || !doOpen(info_->filename, info_->path, 0)) {
+		closeDocument();
+		return false;
+	}
+
+	win->forceShowLineNumbers();
+
+	SetLanguageMode(Preferences::FindLanguageMode(entry->languageMode), /*forceNewDefaults=*/true);
+
+	/* The positions and rangesets only mean the same text if the file hasn't
+	 * changed since. A different size tells so without anything else, then
+	 * the fingerprints are compared, the one of the file having been worked
+	 * out as it was read. Mapped files have none, and neither do the files of
+	 * older sessions, so for those the modification time has to do */
+	bool unchanged = (info_->fileSize == entry->fileSize);
+	if (unchanged) {
+		if (entry->fingerprint && info_->fingerprint) {
+			unchanged = (*entry->fingerprint == *info_->fingerprint);
+		} else {
+			unchanged = (info_->lastModTime == entry->modTime);
+		}
+	}
+
+	if (unchanged) {
+		TextArea *area = firstPane();
+		area->TextSetCursorPos(std::min(TextCursor(entry->cursor), info_->buffer->BufEndOfBuffer()));
+		area->verticalScrollBar()->setValue(entry->topLine);
+		area->horizontalScrollBar()->setValue(entry->horizontal);
+	}
+
+	if (unchanged && !entry->rangesets.empty()) {
+		if (!rangesetTable_) {
+			rangesetTable_ = std::make_shared<RangesetTable>(info_->buffer);
+		}
+
+		// each one is put in front of the others, so the last one goes first
+		for (auto it = entry->rangesets.rbegin(); it != entry->rangesets.rend(); ++it) {
+			Rangeset *rangeset = rangesetTable_->RangesetRestore(it->label);
+			if (!rangeset) {
+				continue;
+			}
+
+			for (const std::pair<int64_t, int64_t> &range : it->ranges) {
+				rangeset->RangesetAdd(TextRange{TextCursor(range.first), TextCursor(range.second)});
+			}
+
+			rangeset->setName(it->name);
+			if (!it->mode.isEmpty()) {
+				rangeset->setMode(it->mode);
+			}
+
+			if (!it->color.isEmpty()) {
+				rangeset->setColor(info_->buffer, it->color);
+			}
+		}
+	}
+
+	RefreshTabState();
+	win->sortTabBar();
+
+	Q_EMIT updateWindowTitle(this);
+	Q_EMIT updateWindowReadOnly(this);
+	Q_EMIT updateStatus(this, nullptr);
+
+	if (Preferences::GetPrefAlwaysCheckRelTagsSpecs()) {
+		Tags::addRelTagsFile(Preferences::GetPrefTagFile(), info_->path, Tags::SearchMode::TAG);
+	}
+
+	MainWindow::AddToPrevOpenMenu(fullPath());
+	return true;
+}
+
+/**
+ * @brief DocumentWidget::sessionState
+ * @return what the session is to remember of this document, or nothing for an Untitled one
+ */
+boost::optional<SessionDocument> DocumentWidget::sessionState() const {
+
+	if (deferred_) {
+		return *deferred_;
+	}
+
+	if (!info_->filenameSet) {
+		return boost::none;
+	}
+
+	SessionDocument entry;
+	entry.fileName     = fullPath();
+	entry.languageMode = Preferences::LanguageModeName(languageMode_);
+	entry.modTime      = info_->lastModTime;
+	entry.fileSize     = info_->fileSize;
+	entry.fingerprint  = info_->fingerprint;
+
+	TextArea *area = firstPane();
+	entry.cursor     = to_integer(area->TextGetCursorPos());
+	entry.topLine    = area->verticalScrollBar()->value();
+	entry.horizontal = area->horizontalScrollBar()->value();
+
+	if (rangesetTable_) {
+		for (const Rangeset &set : rangesetTable_->sets_) {
+			SessionRangeset rangeset;
+			rangeset.label = set.label_;
+			rangeset.name  = set.name_;
+			rangeset.color = set.color_name_;
+			rangeset.mode  = set.update_name_;
+
+			for (const TextRange &range : set.ranges_) {
+				rangeset.ranges.emplace_back(to_integer(range.start), to_integer(range.end));
+			}
+
+			entry.rangesets.push_back(std::move(rangeset));
+		}
+	}
+
+	return entry;
+}
+
 /**
  * Used for creating a clone of a document, not quite ready yet...
  *
@@ -475,6 +749,9 @@ DocumentWidget::DocumentWidget(std::shared_ptr<DocumentInfo> &info_ptr, QWidget
 
 	info_->buffer->BufAddModifyCB(modifiedCB, this);
 
+	backupWriter_ = std::make_unique<BackupWriter>(info_->buffer);
+	connect(backupWriter_.get(), &BackupWriter::writeFailed, this, &DocumentWidget::backupWriteFailed);
+
 	static int n = 0;
 	area->setObjectName(tr("TextArea_Clone_%1").arg(n++));
 	area->setBacklightCharTypes(backlightCharTypes_);
@@ -554,6 +831,9 @@ DocumentWidget::DocumentWidget(const QString &name, QWidget *parent, Qt::WindowF
 
 	info_->buffer->BufAddModifyCB(modifiedCB, this);
 
+	backupWriter_ = std::make_unique<BackupWriter>(info_->buffer);
+	connect(backupWriter_.get(), &BackupWriter::writeFailed, this, &DocumentWidget::backupWriteFailed);
+
 	// Set the requested hardware tab distance and useTabs in the text buffer
 	info_->buffer->BufSetTabDistance(Preferences::GetPrefTabDist(PLAIN_LANGUAGE_MODE), true);
 	info_->buffer->BufSetUseTabs(Preferences::GetPrefInsertTabs());
@@ -583,6 +863,12 @@ DocumentWidget::~DocumentWidget() {
 	info_->buffer->BufRemoveModifyCB(modifiedCB, this);
 	info_->buffer->BufRemoveModifyCB(SyntaxHighlightModifyCBEx, this);
 
+	closeUndoJournal();
+
+	backupWriter_ = nullptr;
+
+	FileWatcher::instance()->unwatch(this);
+
 	delete info_->buffer;
 }
 
@@ -1042,6 +1328,12 @@ void DocumentWidget::raiseDocumentWindow() {
  * @brief DocumentWidget::documentRaised
  */
 void DocumentWidget::documentRaised() {
+
+	// as is the file of a document restored from a session
+	if (deferred_ && !loadDeferred()) {
+		return;
+	}
+
 	// Turn on syntax highlight that might have been deferred.
 	if (highlightSyntax_ && !highlightData_) {
 		startHighlighting(/*warn=*/false);
@@ -1469,6 +1761,7 @@ void DocumentWidget::saveUndoInformation(TextCursor pos, int64_t nInserted, int6
 
 		// normal sequential character insertion
 		if (((oldType == ONE_CHAR_INSERT || oldType == ONE_CHAR_REPLACE) && newType == ONE_CHAR_INSERT) && (pos == currentUndo->endPos)) {
+			detachJournaledUndoItem();
 			++currentUndo->endPos;
 			++info_->autoSaveCharCount;
 			return;
@@ -1476,7 +1769,7 @@ void DocumentWidget::saveUndoInformation(TextCursor pos, int64_t nInserted, int6
 
 		// overstrike mode replacement
 		if ((oldType == ONE_CHAR_REPLACE && newType == ONE_CHAR_REPLACE) && (pos == currentUndo->endPos)) {
-			appendDeletedText(deletedText, nDeleted, Direction::Forward);
+			appendDeletedText(deletedText, Direction::Forward);
 			++currentUndo->endPos;
 			++info_->autoSaveCharCount;
 			return;
@@ -1484,13 +1777,13 @@ void DocumentWidget::saveUndoInformation(TextCursor pos, int64_t nInserted, int6
 
 		// forward delete
 		if ((oldType == ONE_CHAR_DELETE && newType == ONE_CHAR_DELETE) && (pos == currentUndo->startPos)) {
-			appendDeletedText(deletedText, nDeleted, Direction::Forward);
+			appendDeletedText(deletedText, Direction::Forward);
 			return;
 		}
 
 		// reverse delete
 		if ((oldType == ONE_CHAR_DELETE && newType == ONE_CHAR_DELETE) && (pos == currentUndo->startPos - 1)) {
-			appendDeletedText(deletedText, nDeleted, Direction::Backward);
+			appendDeletedText(deletedText, Direction::Backward);
 			--currentUndo->startPos;
 			--currentUndo->endPos;
 			return;
@@ -1502,32 +1795,20 @@ void DocumentWidget::saveUndoInformation(TextCursor pos, int64_t nInserted, int6
 	** and save the new undo data.
 	*/
 	UndoInfo undo(newType, pos, pos + nInserted);
+	undo.serial = ++info_->undoSerial;
 
 	// if text was deleted, save it
 	if (nDeleted > 0) {
-		undo.oldText = deletedText.to_string();
+		undo.setOldText(deletedText);
 	}
 
 	// increment the operation count for the autosave feature
 	++info_->autoSaveOpCount;
 
-	/* if the this is currently unmodified, remove the previous
-	   restoresToSaved marker, and set it on this record */
-
-	// TODO(eteran): there probably is some data structure we could use
-	// to avoid having to loop here.
-	// as we have more entries in the undo/redo lists, the longer these loops
-	// get
+	/* if the this is currently unmodified, this record becomes the one which
+	   restores the file to its saved state, replacing any previous one */
 	if (!info_->fileChanged) {
-		undo.restoresToSaved = true;
-
-		for(UndoInfo &u : info_->undo) {
-			u.restoresToSaved = false;
-		}
-
-		for(UndoInfo &u : info_->redo) {
-			u.restoresToSaved = false;
-		}
+		info_->savedSerial = undo.serial;
 	}
 
 	/* Add the new record to the undo list unless saveUndoInformation is
@@ -1549,12 +1830,15 @@ void DocumentWidget::saveUndoInformation(TextCursor pos, int64_t nInserted, int6
 void DocumentWidget::clearUndoList() {
 
 	info_->undo.clear();
-	Q_EMIT canUndoChanged(!info_->undo.empty());
+	info_->undoMemory = 0;
+	info_->undoJournal->clear();
+	Q_EMIT canUndoChanged(hasUndo());
 }
 
 void DocumentWidget::clearRedoList() {
 
 	info_->redo.clear();
+	info_->redoMemory = 0;
 	Q_EMIT canRedoChanged(!info_->redo.empty());
 }
 
@@ -1564,41 +1848,45 @@ void DocumentWidget::clearRedoList() {
 ** for continuing of a string of one character deletes or replaces, but will
 ** work with more than one character.
 */
-void DocumentWidget::appendDeletedText(view::string_view deletedText, int64_t deletedLen, Direction direction) {
+void DocumentWidget::appendDeletedText(view::string_view deletedText, Direction direction) {
+	detachJournaledUndoItem();
+
 	UndoInfo &undo = info_->undo.front();
 
-	// re-allocate, adding space for the new character(s)
-	std::string comboText;
-	comboText.reserve(undo.oldText.size() + static_cast<size_t>(deletedLen));
+	const size_t previousUsage = undo.memoryUsage();
 
-	// copy the new character and the already deleted text to the new memory
+	// copy the new character(s) to the appropriate end of the saved text
 	if (direction == Direction::Forward) {
-		comboText.append(undo.oldText);
-		comboText.append(deletedText.begin(), deletedText.end());
+		undo.appendOldText(deletedText);
 	} else {
-		comboText.append(deletedText.begin(), deletedText.end());
-		comboText.append(undo.oldText);
+		undo.prependOldText(deletedText);
 	}
 
-	// replace the old saved text and attach the new
-	undo.oldText = std::move(comboText);
+	info_->undoMemory = info_->undoMemory - previousUsage + undo.memoryUsage();
 }
 
 /*
 ** Add an undo record to the this's undo
-** list if the item pushes the undo operation or character counts past the
-** limits, trim the undo list to an acceptable length.
+** list if the item pushes the undo list past the memory limit, trim the
+** undo list to an acceptable size.
 */
 void DocumentWidget::addUndoItem(UndoInfo &&undo) {
 
+	// the previous record can no longer be continued
+	if (!info_->undo.empty()) {
+		compressUndoItem(&info_->undo.front(), &info_->undoMemory, /*finished=*/true);
+	}
+
 	info_->undo.emplace_front(std::move(undo));
+	info_->undoMemory += info_->undo.front().memoryUsage();
+	compressUndoItem(&info_->undo.front(), &info_->undoMemory, /*finished=*/false);
 
-	// Trim the list if it exceeds any of the limits
-	if (info_->undo.size() > UNDO_OP_LIMIT) {
-		trimUndoList(UNDO_OP_TRIMTO);
+	// Trim the list if it exceeds the limit
+	if (info_->undoMemory > UNDO_MEMORY_LIMIT) {
+		trimUndoList(UNDO_MEMORY_TRIMTO);
 	}
 
-	Q_EMIT canUndoChanged(!info_->undo.empty());
+	Q_EMIT canUndoChanged(hasUndo());
 }
 
 /*
@@ -1606,7 +1894,14 @@ void DocumentWidget::addUndoItem(UndoInfo &&undo) {
 */
 void DocumentWidget::addRedoItem(UndoInfo &&redo) {
 
+	if (!info_->redo.empty()) {
+		compressUndoItem(&info_->redo.front(), &info_->redoMemory, /*finished=*/true);
+	}
+
 	info_->redo.emplace_front(std::move(redo));
+	info_->redoMemory += info_->redo.front().memoryUsage();
+	compressUndoItem(&info_->redo.front(), &info_->redoMemory, /*finished=*/false);
+
 	Q_EMIT canRedoChanged(!info_->redo.empty());
 }
 
@@ -1619,8 +1914,11 @@ void DocumentWidget::removeUndoItem() {
 		return;
 	}
 
+	detachJournaledUndoItem();
+
+	info_->undoMemory -= info_->undo.front().memoryUsage();
 	info_->undo.pop_front();
-	Q_EMIT canUndoChanged(!info_->undo.empty());
+	Q_EMIT canUndoChanged(hasUndo());
 }
 
 /*
@@ -1632,32 +1930,100 @@ void DocumentWidget::removeRedoItem() {
 		return;
 	}
 
+	info_->redoMemory -= info_->redo.front().memoryUsage();
 	info_->redo.pop_front();
 	Q_EMIT canRedoChanged(!info_->redo.empty());
 }
 
 
 /*
-** Trim records off of the END of the undo list to reduce it to length
-** maxLength
+** If the most recent undo record is about to be changed or undone while the
+** undo journal holds a copy of it, drop that copy
+*/
+void DocumentWidget::detachJournaledUndoItem() {
+
+	if (!info_->undo.empty() && info_->undoJournal->mirrored() >= info_->undo.size()) {
+		info_->undoJournal->unmirror();
+	}
+}
+
+/*
+** Trim records off of the END of the undo list until the memory it holds is
+** no more than maxMemory, always keeping the most recent record. The records
+** trimmed are moved to the undo journal
 */
-void DocumentWidget::trimUndoList(size_t maxLength) {
+void DocumentWidget::trimUndoList(size_t maxMemory) {
 
-	if(info_->undo.size() <= maxLength) {
+	std::vector<UndoInfo> evicted;
+
+	while (info_->undo.size() > 1 && info_->undoMemory > maxMemory) {
+		info_->undoMemory -= info_->undo.back().memoryUsage();
+		evicted.push_back(std::move(info_->undo.back()));
+		info_->undo.pop_back();
+	}
+
+	// without a journal to move them to, the oldest records are dropped
+	if (!evicted.empty() && undoJournalEnabled()) {
+		info_->undoJournal->setFileName(undoJournalFileName());
+		info_->undoJournal->evict(std::move(evicted));
+	}
+}
+
+/*
+** Once the in-memory undo list is exhausted, bring the most recent records
+** back in from the undo journal
+*/
+void DocumentWidget::pageInUndoItems() {
+
+	if (!info_->undo.empty() || info_->undoJournal->empty()) {
 		return;
 	}
 
-	auto it = info_->undo.begin();
-	std::advance(it, maxLength);
+	std::vector<UndoInfo> records = info_->undoJournal->pageIn(UNDO_JOURNAL_PAGE_SIZE);
+	for (UndoInfo &undo : records) {
+		info_->undoMemory += undo.memoryUsage();
+		info_->undo.push_back(std::move(undo));
+	}
+}
+
+/**
+ * @brief DocumentWidget::hasUndo
+ * @return true if there is anything to undo, in memory or in the undo journal
+ */
+bool DocumentWidget::hasUndo() const {
+	return !info_->undo.empty() || !info_->undoJournal->empty();
+}
+
+/*
+** The undo journal is written next to the backup file, so it's only kept
+** for documents the user has asked to have backup files for
+*/
+bool DocumentWidget::undoJournalEnabled() const {
+	return info_->autoSave;
+}
+
+/*
+** Detach the undo journal from the document. The journal is only worth
+** keeping if the file can be opened again
+*/
+void DocumentWidget::closeUndoJournal() {
+	info_->undoJournal->close(info_->filenameSet && undoJournalEnabled());
+}
 
-	// Trim off all subsequent entries
-	info_->undo.erase(it, info_->undo.end());
+/**
+ * @brief DocumentWidget::undoMemoryUsage
+ * @return the number of bytes held by the undo and redo lists of the document
+ */
+size_t DocumentWidget::undoMemoryUsage() const {
+	return info_->undoMemory + info_->redoMemory;
 }
 
 void DocumentWidget::Undo() {
 
 	if(auto win = MainWindow::fromDocument(this)) {
 
+		pageInUndoItems();
+
 		if (info_->undo.empty()) {
 			return;
 		}
@@ -1672,9 +2038,10 @@ void DocumentWidget::Undo() {
 		undo.inUndo = true;
 
 		// use the saved undo information to reverse changes
-		info_->buffer->BufReplaceEx(undo.startPos, undo.endPos, undo.oldText);
+		const std::string oldText = undo.oldText();
+		info_->buffer->BufReplaceEx(undo.startPos, undo.endPos, oldText);
 
-		const auto restoredTextLength = static_cast<int64_t>(undo.oldText.size());
+		const auto restoredTextLength = static_cast<int64_t>(oldText.size());
 		if (!info_->buffer->primary.hasSelection() || Preferences::GetPrefUndoModifiesSelection()) {
 			/* position the cursor in the focus pane after the changed text
 			   to show the user where the undo was done */
@@ -1699,7 +2066,7 @@ void DocumentWidget::Undo() {
 		   when the change being undone was originally made.  Also, remove
 		   the backup file, since the text in the buffer is now identical to
 		   the original file */
-		if (undo.restoresToSaved) {
+		if (undo.serial == info_->savedSerial) {
 			SetWindowModified(false);
 			RemoveBackupFile();
 		}
@@ -1725,9 +2092,10 @@ void DocumentWidget::Redo() {
 		redo.inUndo = true;
 
 		// use the saved redo information to reverse changes
-		info_->buffer->BufReplaceEx(redo.startPos, redo.endPos, redo.oldText);
+		const std::string oldText = redo.oldText();
+		info_->buffer->BufReplaceEx(redo.startPos, redo.endPos, oldText);
 
-		const auto restoredTextLength = static_cast<int64_t>(redo.oldText.size());
+		const auto restoredTextLength = static_cast<int64_t>(oldText.size());
 		if (!info_->buffer->primary.hasSelection() || Preferences::GetPrefUndoModifiesSelection()) {
 			/* position the cursor in the focus pane after the changed text
 			   to show the user where the undo was done */
@@ -1753,7 +2121,7 @@ void DocumentWidget::Redo() {
 		   when the change being redone was originally made. Also, remove
 		   the backup file, since the text in the buffer is now identical to
 		   the original file */
-		if (redo.restoresToSaved) {
+		if (redo.serial == info_->savedSerial) {
 			SetWindowModified(/*modified=*/false);
 			RemoveBackupFile();
 		}
@@ -1802,6 +2170,7 @@ void DocumentWidget::RemoveBackupFile() const {
 		return;
 	}
 
+	backupWriter_->discard();
 	QFile::remove(backupFileNameEx());
 }
 
@@ -1818,34 +2187,48 @@ QString DocumentWidget::backupFileNameEx() const {
 	}
 }
 
+/*
+** Name of the file holding the undo journal, which lives next to the
+** backup file
+*/
+QString DocumentWidget::undoJournalFileName() const {
+	return backupFileNameEx() + QLatin1String(".undo");
+}
+
 /*
 ** Check if the file in the window was changed by an external source.
 ** and put up a warning dialog if it has.
 */
 void DocumentWidget::checkForChangesToFile() {
 
-	/* Maximum frequency of checking for external modifications. The periodic
-	 * check is only performed on buffer modification, and the check interval is
-	 * only to prevent checking on every keystroke in case of a file system which
-	 * is slow to process stat requests (which I'm not sure exists) */
+	/* Maximum frequency of asking for the file to be checked again. Changes
+	 * are normally reported by the file watcher as they happen, this only
+	 * catches the ones it missed, so there's no need to on every keystroke */
 	constexpr auto CheckInterval = std::chrono::milliseconds(3000);
 
-	// TODO(eteran): 2.0, this concept can probably be reworked in terms of QFileSystemWatcher
-	static QPointer<DocumentWidget> lastCheckWindow;
-	static std::chrono::high_resolution_clock::time_point lastCheckTime;
-
-	if (!info_->filenameSet) {
+	if (!info_->filenameSet || deferred_) {
 		return;
 	}
 
-	// If last check was very recent, don't impact performance
-	auto timestamp = std::chrono::high_resolution_clock::now();
-	if (this == lastCheckWindow && (timestamp - lastCheckTime) < CheckInterval) {
+	const QString fullname = fullPath();
+
+	FileWatcher *watcher = FileWatcher::instance();
+	watcher->watch(this, fullname);
+
+	auto timestamp = std::chrono::steady_clock::now();
+	if ((timestamp - lastCheckTime_) >= CheckInterval) {
+		lastCheckTime_ = timestamp;
+		watcher->refresh(fullname);
+	}
+
+	// not checked yet, the watcher calls again once it has been
+	const FileStatus *latest = watcher->status(fullname);
+	if (!latest) {
 		return;
 	}
 
-	lastCheckWindow = this;
-	lastCheckTime   = timestamp;
+	// a copy, the dialogs below let the watcher update it
+	const FileStatus status = *latest;
 
 	if(auto win = MainWindow::fromDocument(this)) {
 
@@ -1855,13 +2238,9 @@ void DocumentWidget::checkForChangesToFile() {
 		 */
 		const bool silent = (!isTopDocument() || !win->isVisible());
 
-		// Get the file mode and modification time
-		QString fullname = fullPath();
-
-		QT_STATBUF statbuf;
-		if (QT_STAT(fullname.toUtf8().data(), &statbuf) != 0) {
+		if (status.error != 0) {
 
-			const int error = errno;
+			const int error = status.error;
 
 			// Return if we've already warned the user or we can't warn him now
 			if (info_->fileMissing || silent) {
@@ -1937,16 +2316,15 @@ void DocumentWidget::checkForChangesToFile() {
 
 		/* Check that the file's read-only status is still correct (but
 		   only if the file can still be opened successfully in read mode) */
+		const QT_STATBUF &statbuf = status.stat;
 		if (info_->mode != statbuf.st_mode || info_->uid != statbuf.st_uid || info_->gid != statbuf.st_gid) {
 
 			info_->mode = statbuf.st_mode;
 			info_->uid  = statbuf.st_uid;
 			info_->gid  = statbuf.st_gid;
 
-			QFile fp(fullname);
-			if(fp.open(QIODevice::ReadWrite) || fp.open(QIODevice::ReadOnly)) {
-				const bool readOnly = !fp.isWritable();
-				fp.close();
+			if(status.readable) {
+				const bool readOnly = !status.writable;
 
 				if (info_->lockReasons.isPermLocked() != readOnly) {
 					info_->lockReasons.setPermLocked(readOnly);
@@ -1956,22 +2334,41 @@ void DocumentWidget::checkForChangesToFile() {
 			}
 		}
 
+		// a document following its file reads what was added to it, without asking
+		if (info_->follow && !info_->fileChanged && !info_->fileMissing && info_->lastModTime != 0) {
+			if (info_->lastModTime != statbuf.st_mtime || info_->fileSize != statbuf.st_size || info_->ino != statbuf.st_ino || info_->dev != statbuf.st_dev) {
+				followFile(status);
+			}
+			return;
+		}
+
 		/* Warn the user if the file has been modified, unless checking is
 		 * turned off or the user has already been warned. */
 		if (!silent && ((info_->lastModTime != 0 && info_->lastModTime != statbuf.st_mtime) || info_->fileMissing)) {
 
+			if (Preferences::GetPrefWarnFileMods() && Preferences::GetPrefWarnRealFileMods() && info_->fingerprint) {
+
+				/* the file is read by the watcher, which calls again when it's done.
+				 * One which can't be read is taken to have changed */
+				if (!status.fingerprint && !status.fingerprintFailed) {
+					watcher->fingerprint(fullname);
+					return;
+				}
+
+				if (status.fingerprint && *status.fingerprint == *info_->fingerprint) {
+					// Contents hasn't changed. Update the modification time.
+					info_->lastModTime = statbuf.st_mtime;
+					info_->fileMissing = false;
+					return;
+				}
+			}
+
 			info_->lastModTime = 0; // Inhibit further warnings
 			info_->fileMissing = false;
 			if (!Preferences::GetPrefWarnFileMods()) {
 				return;
 			}
 
-			if (Preferences::GetPrefWarnRealFileMods() && !compareDocumentToFile(fullname)) {
-				// Contents hasn't changed. Update the modification time.
-				info_->lastModTime = statbuf.st_mtime;
-				return;
-			}
-
 			QMessageBox messageBox(this);
 			messageBox.setIcon(QMessageBox::Warning);
 			messageBox.setWindowTitle(tr("File modified externally"));
@@ -1995,142 +2392,117 @@ void DocumentWidget::checkForChangesToFile() {
 }
 
 /**
- * @brief DocumentWidget::fullPath
- * @return
- */
-QString DocumentWidget::fullPath() const {
-
-	if(info_->path.isEmpty()) {
-		return QString();
-	}
-
-	Q_ASSERT(info_->path.endsWith(QLatin1Char('/')));
-	return tr("%1%2").arg(info_->path, info_->filename);
-}
-
-/**
- * @brief DocumentWidget::filename
- * @return
- */
-QString DocumentWidget::filename() const {
-	return info_->filename;
-}
-
-/**
- * @brief DocumentWidget::path
- * @return
- */
-QString DocumentWidget::path() const {
-	return info_->path;
-}
-
-/*
- * Check if the contents of the TextBuffer is equal
- * the contens of the file named fileName. The format of
- * the file (UNIX/DOS/MAC) is handled properly.
+ * Brings a document which follows its file up to date with it, see SetFollow.
+ * What was appended to the file since it was last read is appended to the
+ * buffer, so only that much is read, displayed and highlighted. A file which
+ * was cut short, rewritten or replaced by another one, as when a log is
+ * rotated, is read again from the start. Text areas which showed the end of
+ * the text keep showing it.
  *
- * Return values
- * false: no difference found
- * true : difference found or could not compare contents.
+ * @brief DocumentWidget::followFile
+ * @param status
  */
-bool DocumentWidget::compareDocumentToFile(const QString &fileName) const {
+void DocumentWidget::followFile(const FileStatus &status) {
 
-	// Number of bytes read at once
-	constexpr auto PREFERRED_CMPBUF_LEN = static_cast<int64_t>(0x8000);
+	const QT_STATBUF &statbuf = status.stat;
+	const QString fullname    = fullPath();
 
-	char pendingCR = '\0';
-
-	QFile file(fileName);
-	if(!file.open(QIODevice::ReadOnly)) {
-		return true;
+	// the areas whose cursor is at the end of the text, they stay at the end
+	std::vector<TextArea *> areasAtEnd;
+	for(TextArea *area : textPanes()) {
+		if (area->TextGetCursorPos() == info_->buffer->BufEndOfBuffer()) {
+			areasAtEnd.push_back(area);
+		}
 	}
 
-	int64_t fileLen = file.size();
-
-	// For UNIX/macOS files, we can do a quick check to see if the on disk file
-	// has a different length, but for DOS files, it's not that simple...
-	switch(info_->fileFormat) {
-	case FileFormats::Unix:
-	case FileFormats::Mac:
-		if (fileLen != info_->buffer->length()) {
-			return true;
-		}
-		break;
-	case FileFormats::Dos:
-		// However, if a DOS file is smaller on disk, it's certainly different
-		if (fileLen < info_->buffer->length()) {
-			return true;
+	auto _ = gsl::finally([this, &areasAtEnd]() {
+		for(TextArea *area : areasAtEnd) {
+			area->TextSetCursorPos(info_->buffer->BufEndOfBuffer());
 		}
-		break;
-	}
+	});
 
-	int64_t restLen = std::min(PREFERRED_CMPBUF_LEN, fileLen);
+	/* Read the end of what was read before along with what was appended, to
+	   tell whether the file really just grew. Mapped files are always mapped
+	   again, appending to them would read all of the file into memory, and
+	   compressed files are always read again, their bytes aren't the text */
+	const auto tailLength = static_cast<int64_t>(info_->fileTail.size());
+	const int64_t offset  = info_->fileSize - tailLength;
+	std::string text;
 
-	TextCursor bufPos = {};
-	int filePos       = 0;
-	char fileString[PREFERRED_CMPBUF_LEN + 2];
+	bool appended = statbuf.st_dev == info_->dev && statbuf.st_ino == info_->ino && statbuf.st_size >= info_->fileSize && !info_->buffer->BufIsMapped() && info_->compression.type == Compression::None;
+	if (appended) {
+		text.resize(static_cast<size_t>(statbuf.st_size - offset));
 
-	/* For large files, the comparison can take a while. If it takes too long,
-	   the user should be given a clue about what is happening. */
-	MainWindow::AllDocumentsBusy(tr("Comparing externally modified %1 ...").arg(info_->filename));
+		QFile file(fullname);
+		appended = file.open(QIODevice::ReadOnly) && file.seek(offset) && file.read(&text[0], static_cast<qint64>(text.size())) == static_cast<qint64>(text.size()) && text.compare(0, info_->fileTail.size(), info_->fileTail) == 0;
+	}
 
-	// make sure that we unbusy the windows when we're done
-	auto _ = gsl::finally([]() {
-		MainWindow::AllDocumentsUnbusy();
-	});
+	if (!appended) {
+		RevertToSaved();
+		return;
+	}
 
-	while (restLen > 0) {
+	text.erase(0, info_->fileTail.size());
 
-		size_t offset = 0;
-		if (pendingCR) {
-			fileString[offset++] = pendingCR;
-		}
+	// a carriage return may be the first half of a DOS line end, it waits for the other
+	if (info_->fileFormat == FileFormats::Dos && !text.empty() && text.back() == '\r') {
+		text.pop_back();
+	}
 
-		int64_t nRead = file.read(fileString + offset, restLen);
+	info_->lastModTime = statbuf.st_mtime;
+	info_->fingerprint = boost::none;
 
-		if (nRead != restLen) {
-			return true;
-		}
+	if (text.empty()) {
+		return;
+	}
 
-		filePos += nRead;
-		nRead   += offset;
+	info_->fileSize += static_cast<int64_t>(text.size());
+	info_->fileTail  = tailOf(info_->fileTail + text);
 
-		// check for on-disk file format changes, but only for the first chunk
-		if (bufPos == 0 && info_->fileFormat != FormatOfFile(view::string_view(fileString, static_cast<size_t>(nRead)))) {
-			return true;
-		}
+	switch (info_->fileFormat) {
+	case FileFormats::Dos:
+		ConvertFromDos(text);
+		break;
+	case FileFormats::Mac:
+		ConvertFromMac(text);
+		break;
+	case FileFormats::Unix:
+		break;
+	}
 
-		switch(info_->fileFormat) {
-		case FileFormats::Mac:
-			ConvertFromMac(fileString, nRead);
-			break;
-		case FileFormats::Dos:
-			ConvertFromDos(fileString, &nRead, &pendingCR);
-			break;
-		case FileFormats::Unix:
-			break;
-		}
+	info_->ignoreModify = true;
+	info_->buffer->BufAppendEx(text);
+	info_->ignoreModify = false;
+}
 
-		if (int rv = info_->buffer->compare(bufPos, fileString, nRead)) {
-			return rv;
-		}
+/**
+ * @brief DocumentWidget::fullPath
+ * @return
+ */
+QString DocumentWidget::fullPath() const {
 
-		bufPos += nRead;
-		restLen = std::min(fileLen - filePos, PREFERRED_CMPBUF_LEN);
+	if(info_->path.isEmpty()) {
+		return QString();
 	}
 
-	if (pendingCR) {
-		if (int rv = info_->buffer->compare(bufPos, pendingCR)) {
-			return rv;
-		}
-		bufPos += 1;
-	}
+	Q_ASSERT(info_->path.endsWith(QLatin1Char('/')));
+	return tr("%1%2").arg(info_->path, info_->filename);
+}
 
-	if (bufPos != info_->buffer->length()) {
-		return true;
-	}
+/**
+ * @brief DocumentWidget::filename
+ * @return
+ */
+QString DocumentWidget::filename() const {
+	return info_->filename;
+}
 
-	return false;
+/**
+ * @brief DocumentWidget::path
+ * @return
+ */
+QString DocumentWidget::path() const {
+	return info_->path;
 }
 
 void DocumentWidget::RevertToSaved() {
@@ -2204,66 +2576,27 @@ void DocumentWidget::RevertToSaved() {
 /*
 ** Create a backup file for the current document.  The name for the backup file
 ** is generated using the name and path stored in the window and adding a
-** tilde (~) on UNIX.
+** tilde (~) on UNIX. The file is written in the background, see BackupWriter.
 */
-bool DocumentWidget::WriteBackupFile() {
-	FILE *fp;
-
-	// Generate a name for the autoSave file
-	QString name = backupFileNameEx();
-
-	// remove the old backup file. Well, this might fail - we'll notice later however.
-	QFile::remove(name);
-
-	/* open the file, set more restrictive permissions (using default
-	   permissions was somewhat of a security hole, because permissions were
-	   independent of those of the original file being edited */
-#ifdef Q_OS_WIN
-	int fd = QT_OPEN(name.toUtf8().data(), QT_OPEN_CREAT | O_EXCL | QT_OPEN_WRONLY, _S_IREAD | _S_IWRITE);
-#else
-	int fd = QT_OPEN(name.toUtf8().data(), QT_OPEN_CREAT | O_EXCL | QT_OPEN_WRONLY, S_IRUSR | S_IWUSR);
-#endif
-	if (fd < 0 || (fp = fdopen(fd, "w")) == nullptr) {
-
-		QMessageBox::warning(
-					this,
-					tr("Error writing Backup"),
-		            tr("Unable to save backup for %1:\n%2\nAutomatic backup is now off").arg(info_->filename, ErrorString(errno)));
-
-		info_->autoSave = false;
-
-		if(auto win = MainWindow::fromDocument(this)) {
-			no_signals(win->ui.action_Incremental_Backup)->setChecked(false);
-		}
-		return false;
-	}
-
-	// get the text buffer contents
-	std::string fileString = info_->buffer->BufGetAllEx();
-
-	// add a terminating newline if the file doesn't already have one
-	if(Preferences::GetPrefAppendLF()) {
-		if (!fileString.empty() && fileString.back() != '\n') {
-			fileString.append("\n");
-		}
-	}
+void DocumentWidget::WriteBackupFile() {
+	backupWriter_->write(backupFileNameEx(), Preferences::GetPrefAppendLF());
+}
 
-	auto _ = gsl::finally([fp] { ::fclose(fp); });
+/*
+** Report a backup which couldn't be written, and stop making them
+*/
+void DocumentWidget::backupWriteFailed(const QString &error) {
 
-	// write out the file
-	::fwrite(fileString.data(), 1, fileString.size(), fp);
-	if (::ferror(fp)) {
-		QMessageBox::critical(
-					this,
-					tr("Error saving Backup"),
-		            tr("Error while saving backup for %1:\n%2\nAutomatic backup is now off").arg(info_->filename, ErrorString(errno)));
+	info_->autoSave = false;
 
-		QFile::remove(name);
-		info_->autoSave = false;
-		return false;
+	if(auto win = MainWindow::fromDocument(this)) {
+		no_signals(win->ui.action_Incremental_Backup)->setChecked(false);
 	}
 
-	return true;
+	QMessageBox::critical(
+				this,
+				tr("Error saving Backup"),
+				tr("Error while saving backup for %1:\n%2\nAutomatic backup is now off").arg(info_->filename, error));
 }
 
 /**
@@ -2272,6 +2605,11 @@ bool DocumentWidget::WriteBackupFile() {
  */
 bool DocumentWidget::saveDocument() {
 
+	// a document whose file isn't read yet is locked, so nothing can have changed
+	if (deferred_) {
+		return true;
+	}
+
 	// Try to ensure our information is up-to-date
 	checkForChangesToFile();
 
@@ -2358,9 +2696,11 @@ bool DocumentWidget::doSave() {
 		info_->buffer->BufAppendEx('\n');
 	}
 
-	// open the file
-	QFile file(fullname);
-	if(!file.open(QIODevice::WriteOnly)) {
+	/* open the file. The new version is written beside the old one and
+	   replaces it only once complete, see FileWriter */
+	FileWriter file(fullname);
+	file.setCompression(info_->compression);
+	if(!file.open()) {
 		QMessageBox messageBox(this);
 		messageBox.setWindowTitle(tr("Error saving File"));
 		messageBox.setIcon(QMessageBox::Warning);
@@ -2379,31 +2719,71 @@ bool DocumentWidget::doSave() {
 		return false;
 	}
 
-	// get the text buffer contents and its length
-	std::string text = info_->buffer->BufGetAllEx();
+	/* write the text straight from the buffer, converting it to DOS or
+	   Macintosh format on the way if needed */
+	const std::pair<view::string_view, view::string_view> text = info_->buffer->BufGetSegments();
+	const int64_t revision = info_->buffer->revision();
 
-	// If the file is to be saved in DOS or Macintosh format, reconvert
-	switch(info_->fileFormat) {
-	case FileFormats::Dos:
-		ConvertToDos(text);
-		break;
-	case FileFormats::Mac:
-		ConvertToMac(text);
-		break;
-	default:
-		break;
+	bool written;
+	if (info_->compression.type == Compression::None) {
+		written = file.write(text.first, text.second, info_->fileFormat) && file.commit();
+	} else {
+		/* compressing takes a while, so it's done on a worker thread where it
+		   can be followed and cancelled. Events are still processed meanwhile,
+		   and macros or server requests may change the buffer, so the worker
+		   is given a copy of the text rather than the buffer's own memory */
+		written = false;
+
+		info_->filenameSet = false; // Temp. prevent check for changes.
+		auto restore = gsl::finally([this] { info_->filenameSet = true; });
+
+		const std::string copy   = info_->buffer->BufGetAllEx();
+		const FileFormats format = info_->fileFormat;
+		const auto total         = static_cast<int64_t>(copy.size());
+
+		ProgressTask task(this, tr("Saving %1...").arg(info_->filename), total);
+		const bool finished = task.exec([&](ProgressTask &progress) {
+			int64_t done = 0;
+			view::string_view remaining = copy;
+			while (!remaining.empty()) {
+				if (progress.isCanceled()) {
+					return;
+				}
+
+				const view::string_view piece = remaining.substr(0, COMPRESSION_CHUNK_SIZE);
+				remaining.remove_prefix(piece.size());
+
+				if (!file.write(piece, view::string_view(), format)) {
+					return;
+				}
+
+				done += static_cast<int64_t>(piece.size());
+				progress.setDone(done);
+			}
+
+			written = file.commit();
+		});
+
+		// unless it was cancelled too late, after the file had been put in place
+		if (!finished && !written) {
+			file.cancel();
+			return false;
+		}
 	}
 
-	// write to the file
-	if(file.write(text.data(), static_cast<int64_t>(text.size())) == -1) {
+	if(!written) {
 		QMessageBox::critical(this, tr("Error saving File"), tr("%1 not saved:\n%2").arg(info_->filename, file.errorString()));
-		file.close();
-		file.remove();
+		file.cancel();
 		return false;
 	}
 
-	// success, file was written
-	SetWindowModified(false);
+	// success, file was written, though it may have been changed since
+	const bool unchanged = info_->buffer->revision() == revision;
+	if (unchanged) {
+		SetWindowModified(false);
+	}
+
+	info_->fingerprint = file.fingerprint();
 
 	// update the modification time
 	QT_STATBUF statbuf;
@@ -2412,6 +2792,17 @@ bool DocumentWidget::doSave() {
 		info_->fileMissing = false;
 		info_->dev         = statbuf.st_dev;
 		info_->ino         = statbuf.st_ino;
+		info_->fileSize    = statbuf.st_size;
+		info_->fileTail    = readFileTail(fullname, statbuf.st_size);
+
+		// whatever the watcher saw while the file was being written is out of date
+		FileWatcher::instance()->invalidate(fullname);
+
+		// record the history leading up to this version of the file
+		if (unchanged && undoJournalEnabled()) {
+			info_->undoJournal->setFileName(undoJournalFileName());
+			info_->undoJournal->checkpoint(info_->undo, statbuf.st_mtime, statbuf.st_size, info_->undoSerial);
+		}
 	} else {
 		// This needs to produce an error message -- the file can't be accessed!
 		info_->lastModTime = 0;
@@ -2431,6 +2822,10 @@ bool DocumentWidget::doSave() {
  */
 bool DocumentWidget::saveDocumentAs(const QString &newName, bool addWrap) {
 
+	if (!loadDeferred()) {
+		return false;
+	}
+
 	if(auto win = MainWindow::fromDocument(this)) {
 
 		QString fullname;
@@ -2498,6 +2893,11 @@ bool DocumentWidget::saveDocumentAs(const QString &newName, bool addWrap) {
 		info_->uid      = 0;
 		info_->gid      = 0;
 
+		// a copy of a compressed file is only compressed too if it's named like one
+		if (info_->compression.type != Compression::None && !info_->filename.endsWith(CompressionSuffix(info_->compression.type))) {
+			info_->compression = CompressionFormat();
+		}
+
 		info_->lockReasons.clear();
 		const int retVal = doSave();
 		Q_EMIT updateWindowReadOnly(this);
@@ -2636,6 +3036,16 @@ bool DocumentWidget::writeBckVersion() {
 		}
 #endif
 
+#ifdef FICLONE
+		/* Where the file system supports it, the backup simply shares the
+		   blocks of the original until either one is changed. Since saving
+		   replaces the original rather than rewriting it, they usually never
+		   are */
+		if (::ioctl(out_fd, FICLONE, inputFile.handle()) == 0) {
+			return false;
+		}
+#endif
+
 		// Allocate I/O buffer
 		constexpr size_t IO_BUFFER_SIZE = (1024 * 1024);
 		auto io_buffer = std::make_unique<char[]>(IO_BUFFER_SIZE);
@@ -2696,7 +3106,7 @@ bool DocumentWidget::writeBckVersion() {
 ** to nedit.  This should return false if the file has been deleted or is
 ** unavailable.
 */
-bool DocumentWidget::fileWasModifiedExternally() const {
+bool DocumentWidget::fileWasModifiedExternally() {
 
 	if (!info_->filenameSet) {
 		return false;
@@ -2713,8 +3123,27 @@ bool DocumentWidget::fileWasModifiedExternally() const {
 		return false;
 	}
 
-	if (Preferences::GetPrefWarnRealFileMods() && !compareDocumentToFile(fullname)) {
-		return false;
+	if (Preferences::GetPrefWarnRealFileMods() && info_->fingerprint) {
+
+		// the watcher may have read the file already
+		const FileStatus *status = FileWatcher::instance()->status(fullname);
+		if (status && status->fingerprint && status->error == 0 && status->stat.st_mtime == statbuf.st_mtime && status->stat.st_size == statbuf.st_size && status->stat.st_ino == statbuf.st_ino) {
+			return *status->fingerprint != *info_->fingerprint;
+		}
+
+		// otherwise it's read on a worker thread, a large file may take a while
+		boost::optional<uint64_t> fingerprint;
+
+		ProgressTask task(this, tr("Comparing externally modified %1...").arg(info_->filename), statbuf.st_size);
+		task.exec([&fullname, &fingerprint](ProgressTask &progress) {
+			fingerprint = FingerprintOfFile(fullname, [&progress](int64_t done) {
+				progress.setDone(done);
+				return !progress.isCanceled();
+			});
+		});
+
+		// a file which couldn't be read, or whose reading was cancelled, is taken to have changed
+		return fingerprint != info_->fingerprint;
 	}
 
 	return true;
@@ -2802,6 +3231,9 @@ void DocumentWidget::closeDocument() {
 
 	Q_EMIT documentClosed();
 
+	// keep the history of the file for the next time it is opened
+	closeUndoJournal();
+
 	auto win = MainWindow::fromDocument(this);
 	if(!win) {
 		return;
@@ -2924,6 +3356,69 @@ DocumentWidget *DocumentWidget::open(const QString &fullpath) {
 	return document;
 }
 
+/**
+ * Decompresses "data", the contents of a compressed file, into "text". It's
+ * done on a worker thread, a piece at a time, while the progress is shown.
+ *
+ * @brief DocumentWidget::decompressFile
+ * @param data
+ * @param type
+ * @param text
+ * @param error set to the reason if it failed, or left empty if it was cancelled
+ * @return true on success
+ */
+bool DocumentWidget::decompressFile(view::string_view data, Compression type, std::string *text, QString *error) {
+
+	std::unique_ptr<Decompressor> decompressor = Decompressor::create(type);
+	if (!decompressor) {
+		*error = tr("NEdit was built without support for files compressed like this one");
+		return false;
+	}
+
+	bool decompressed = false;
+	bool tooLarge     = false;
+
+	const auto total = static_cast<int64_t>(data.size());
+
+	ProgressTask task(this, tr("Reading %1...").arg(info_->filename), total);
+	const bool finished = task.exec([&](ProgressTask &progress) {
+		while (!data.empty()) {
+			if (progress.isCanceled()) {
+				return;
+			}
+
+			const view::string_view piece = data.substr(0, COMPRESSION_CHUNK_SIZE);
+			data.remove_prefix(piece.size());
+
+			if (!decompressor->decompress(piece, text)) {
+				return;
+			}
+
+			// positions in the buffer can't go past this
+			if (text->size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+				tooLarge = true;
+				return;
+			}
+
+			progress.setDone(total - static_cast<int64_t>(data.size()));
+		}
+
+		decompressed = decompressor->finish(text);
+	});
+
+	if (!finished) {
+		error->clear();
+		return false;
+	}
+
+	if (!decompressed) {
+		*error = tooLarge ? tr("File is too large to edit") : decompressor->errorString();
+		return false;
+	}
+
+	return true;
+}
+
 /**
  * @brief DocumentWidget::doOpen
  * @param name
@@ -3072,12 +3567,79 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 	}
 #endif
 
+	// positions in the buffer can't go past this
+	// positions in the text are 32 bits, which limits even mapped files
+	if (statbuf.st_size > std::numeric_limits<int32_t>::max()) {
+		info_->filenameSet = false; // Temp. prevent check for changes.
+		QMessageBox::critical(this, tr("Error while opening File"), tr("%1 is too large to open.\nFiles of up to 2 GB (%2 bytes) can be opened.").arg(name).arg(std::numeric_limits<int32_t>::max()));
+		info_->filenameSet = true;
+		return false;
+	}
+
+	// compressed files are recognized by their contents, whatever they're called
+	char header[COMPRESSION_HEADER_SIZE];
+	const size_t headerSize = ::fread(header, 1, sizeof(header), fp);
+	const CompressionFormat compression = DetectCompression(view::string_view(header, headerSize));
+
+	/* Files from a given size on are mapped into memory and shown as they
+	   are, rather than read, so that they open right away however large they
+	   are. They can't be edited until they have been loaded into memory, see
+	   loadIntoMemory */
+	const int64_t mapThreshold = Preferences::GetPrefMapFileThreshold();
+	if (compression.type == Compression::None && mapThreshold > 0 && statbuf.st_size >= mapThreshold * 1024 * 1024) {
+		QString error;
+		std::shared_ptr<const char> mapping = mapFile(fullname, statbuf.st_size, &error);
+		if (!mapping) {
+			info_->filenameSet = false; // Temp. prevent check for changes.
+			QMessageBox::critical(this, tr("Error while opening File"), tr("Error reading %1\n%2").arg(name, error));
+			info_->filenameSet = true;
+			return false;
+		}
+
+		info_->mode        = statbuf.st_mode;
+		info_->uid         = statbuf.st_uid;
+		info_->gid         = statbuf.st_gid;
+		info_->lastModTime = statbuf.st_mtime;
+		info_->dev         = statbuf.st_dev;
+		info_->ino         = statbuf.st_ino;
+		info_->fileMissing = false;
+		info_->fingerprint = boost::none;
+		info_->fileSize    = statbuf.st_size;
+		info_->fileTail    = tailOf(view::string_view(mapping.get(), static_cast<size_t>(statbuf.st_size)));
+		info_->fileFormat  = FileFormats::Unix;
+		info_->compression = compression;
+
+		FileWatcher::instance()->invalidate(fullname);
+
+		// both would have to read all of the file up front
+		stopHighlighting();
+		if (info_->wrapMode == WrapStyle::Continuous) {
+			setAutoWrap(WrapStyle::None);
+		}
+
+		info_->ignoreModify = true;
+		info_->buffer->BufSetMapped(std::move(mapping), statbuf.st_size);
+		info_->ignoreModify = false;
+
+		info_->lockReasons.setMapLocked(true);
+		if ((flags & EditFlags::PREF_READ_ONLY) != 0) {
+			info_->lockReasons.setUserLocked(true);
+		}
+
+		info_->fileChanged = false;
+		Q_EMIT updateWindowTitle(this);
+		Q_EMIT updateWindowReadOnly(this);
+		return true;
+	}
+
 	// Allocate space for the whole contents of the file (unfortunately)
 	try {
 		QFile file;
 		file.open(fp, QIODevice::ReadOnly);
 
 		std::string text;
+		uint64_t fingerprint = FingerprintOf(view::string_view());
+		std::string tail;
 
 		if(file.size() != 0) {
 			uchar *memory = file.map(0, file.size());
@@ -3088,8 +3650,29 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 				return false;
 			}
 
-			text = std::string{reinterpret_cast<char *>(memory), static_cast<size_t>(file.size())};
-			file.unmap(memory);
+			auto unmap = gsl::finally([&file, memory] { file.unmap(memory); });
+
+			const view::string_view contents(reinterpret_cast<char *>(memory), static_cast<size_t>(file.size()));
+
+			// the file is compared with what it was by its contents as they are on disk
+			fingerprint = FingerprintOf(contents);
+			tail        = tailOf(contents);
+
+			if (compression.type == Compression::None) {
+				text.assign(contents.data(), contents.size());
+			} else {
+				info_->filenameSet = false; // Temp. prevent check for changes.
+				auto restore = gsl::finally([this] { info_->filenameSet = true; });
+
+				QString error;
+				if (!decompressFile(contents, compression.type, &text, &error)) {
+					// nothing to say if it was cancelled
+					if (!error.isEmpty()) {
+						QMessageBox::critical(this, tr("Error while opening File"), tr("Error reading %1\n%2").arg(name, error));
+					}
+					return false;
+				}
+			}
 		}
 
 		/* Any errors that happen after this point leave the window in a
@@ -3103,6 +3686,14 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 		info_->ino         = statbuf.st_ino;
 		info_->fileMissing       = false;
 
+		info_->fingerprint       = fingerprint;
+		info_->fileSize          = statbuf.st_size;
+		info_->fileTail          = std::move(tail);
+		info_->compression       = compression;
+
+		// the file is known as of now, anything the watcher saw before isn't news
+		FileWatcher::instance()->invalidate(fullname);
+
 		// Detect and convert DOS and Macintosh format files
 		if (Preferences::GetPrefForceOSConversion()) {
 			info_->fileFormat = FormatOfFile(text);
@@ -3123,6 +3714,12 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 		info_->buffer->BufSetAll(text);
 		info_->ignoreModify = false;
 
+		// pick up the history left by a previous session, if it still applies
+		if (info_->undo.empty()) {
+			info_->undoJournal->restore(undoJournalFileName(), statbuf.st_mtime, statbuf.st_size, &info_->undoSerial);
+			Q_EMIT canUndoChanged(hasUndo());
+		}
+
 		// Set window title and file changed flag
 		if ((flags & EditFlags::PREF_READ_ONLY) != 0) {
 			info_->lockReasons.setUserLocked(true);
@@ -3148,6 +3745,39 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 	}
 }
 
+/*
+** Copy a file which was mapped into memory by doOpen into the buffer, so
+** that it can be edited. Syntax highlighting, if it's on, starts then.
+*/
+void DocumentWidget::loadIntoMemory() {
+
+	if (!info_->lockReasons.isMapLocked()) {
+		return;
+	}
+
+	try {
+		MainWindow::AllDocumentsBusy(tr("Loading %1 into memory...").arg(info_->filename));
+
+		auto _ = gsl::finally([]() {
+			MainWindow::AllDocumentsUnbusy();
+		});
+
+		info_->buffer->BufDetach();
+	} catch(const std::bad_alloc &) {
+		QMessageBox::critical(this, tr("Load Into Memory"), tr("File is too large to edit"));
+		return;
+	}
+
+	info_->lockReasons.setMapLocked(false);
+	Q_EMIT updateWindowTitle(this);
+	Q_EMIT updateWindowReadOnly(this);
+	Q_EMIT updateStatus(this, nullptr);
+
+	if (highlightSyntax_ && !highlightData_) {
+		startHighlighting(/*warn=*/false);
+	}
+}
+
 /*
 ** refresh window state for this document
 */
@@ -3223,7 +3853,7 @@ void DocumentWidget::RefreshMenuToggleStates() {
 		win->ui.action_Print_Selection->setEnabled(info_->wasSelected);
 
 		// Edit menu
-		win->ui.action_Undo->setEnabled(!info_->undo.empty());
+		win->ui.action_Undo->setEnabled(hasUndo());
 		win->ui.action_Redo->setEnabled(!info_->redo.empty());
 		win->ui.action_Cut->setEnabled(info_->wasSelected);
 		win->ui.action_Copy->setEnabled(info_->wasSelected);
@@ -3238,6 +3868,7 @@ void DocumentWidget::RefreshMenuToggleStates() {
 		no_signals(win->ui.action_Make_Backup_Copy)->setChecked(info_->saveOldVersion);
 		no_signals(win->ui.action_Incremental_Backup)->setChecked(info_->autoSave);
 		no_signals(win->ui.action_Overtype)->setChecked(info_->overstrike);
+		no_signals(win->ui.action_Follow_Tail)->setChecked(info_->follow);
 		no_signals(win->ui.action_Matching_Syntax)->setChecked(info_->matchSyntaxBased);
 		no_signals(win->ui.action_Read_Only)->setChecked(info_->lockReasons.isUserLocked());
 
@@ -3447,46 +4078,49 @@ bool DocumentWidget::includeFile(const QString &name) {
 		return false;
 	}
 
-	QFile file(name);
-	if(!file.open(QFile::ReadOnly)) {
+	TextFileReader file(name);
+	if(!file.open()) {
 		QMessageBox::critical(this, tr("Error opening File"), file.errorString());
 		return false;
 	}
 
-	if(file.size() != 0) {
-		uchar *memory = file.map(0, file.size());
-		if (!memory) {
-			QMessageBox::critical(this, tr("Error opening File"), file.errorString());
-			return false;
-		}
-
-		auto text = std::string{reinterpret_cast<char *>(memory), static_cast<size_t>(file.size())};
-		file.unmap(memory);
+	auto readFile = [&file](char *out, int64_t length) {
+		return file.read(out, length);
+	};
 
-		// Detect and convert DOS and Macintosh format files
-		switch (FormatOfFile(text)) {
-		case FileFormats::Dos:
-			ConvertFromDos(text);
-			break;
-		case FileFormats::Mac:
-			ConvertFromMac(text);
-			break;
-		case FileFormats::Unix:
-			//  Default is Unix, no conversion necessary.
-			break;
+	/* insert the contents of the file in the selection or at the insert
+	   position in the window if no selection exists. When the size of the
+	   file is known, it is read straight into the buffer */
+	const int64_t size                     = file.size();
+	const TextBuffer::Selection &selection = info_->buffer->primary;
+
+	bool success;
+	if (size >= 0 && selection.hasSelection() && !selection.isRectangular()) {
+		success = info_->buffer->BufReplaceFromEx(selection.start(), selection.end(), size, readFile);
+	} else if (size >= 0 && !selection.hasSelection()) {
+		auto win = MainWindow::fromDocument(this);
+		if(!win) {
+			return true;
 		}
 
-		/* insert the contents of the file in the selection or at the insert
-		   position in the window if no selection exists */
-		if (info_->buffer->primary.hasSelection()) {
-			info_->buffer->BufReplaceSelectedEx(text);
-		} else {
-			if(auto win = MainWindow::fromDocument(this)) {
+		success = info_->buffer->BufInsertFromEx(win->lastFocus()->TextGetCursorPos(), size, readFile);
+	} else {
+		std::string text;
+		success = file.readAll(&text);
+		if (success && !text.empty()) {
+			if (selection.hasSelection()) {
+				info_->buffer->BufReplaceSelectedEx(text);
+			} else if(auto win = MainWindow::fromDocument(this)) {
 				info_->buffer->BufInsertEx(win->lastFocus()->TextGetCursorPos(), text);
 			}
 		}
 	}
 
+	if (!success) {
+		QMessageBox::critical(this, tr("Error reading File"), file.errorString());
+		return false;
+	}
+
 	return true;
 }
 
@@ -4239,6 +4873,34 @@ bool DocumentWidget::GetOverstrike() const {
 	return info_->overstrike;
 }
 
+/**
+ * @brief DocumentWidget::GetFollow
+ * @return
+ */
+bool DocumentWidget::GetFollow() const {
+	return info_->follow;
+}
+
+/*
+** Set whether the document reads what other programs append to its file as
+** they do, rather than asking to reload it, see followFile. The document
+** catches up with the file right away.
+*/
+void DocumentWidget::SetFollow(bool follow) {
+
+	if(isTopDocument()) {
+		if(auto win = MainWindow::fromDocument(this)) {
+			no_signals(win->ui.action_Follow_Tail)->setChecked(follow);
+		}
+	}
+
+	info_->follow = follow;
+
+	if (follow) {
+		checkForChangesToFile();
+	}
+}
+
 /*
 ** Set insert/overstrike mode
 */
@@ -5778,6 +6440,20 @@ void DocumentWidget::startHighlighting(bool warn) {
 
 	int prevChar = -1;
 
+	// the style buffer of a mapped file would take as much memory as the file
+	if (info_->buffer->BufIsMapped()) {
+		if (warn) {
+			QMessageBox::warning(this,
+								 tr("Syntax Highlighting"),
+								 tr("Syntax highlighting is not available for files\n"
+									"which are too large to be read into memory when\n"
+									"they are opened.\n\n"
+									"To use it, first load the file with\n"
+									"Preferences -> Load Into Memory."));
+		}
+		return;
+	}
+
 	/* Find the pattern set matching the window's current
 	   language mode, tell the user if it can't be done */
 	PatternSet *patterns = findPatternsForWindow(warn);
@@ -27,6 +27,7 @@
 #include <QWidget>
 
 #include <array>
+#include <chrono>
 
 #include <gsl/span>
 
@@ -34,6 +35,7 @@
 
 #include <sys/stat.h>
 
+class BackupWriter;
 class HighlightPattern;
 class MainWindow;
 class PatternSet;
@@ -44,6 +46,8 @@ class StyleTableEntry;
 class TextArea;
 class UndoInfo;
 struct DragEndEvent;
+struct FileStatus;
+struct SessionDocument;
 struct MacroCommandData;
 struct Program;
 struct ShellCommandData;
@@ -94,6 +98,7 @@ public:
 public:
 	static DocumentWidget *fromArea(TextArea *area);
 	static DocumentWidget *editExistingFile(DocumentWidget *inDocument, const QString &name, const QString &path, int flags, const QString &geometry, bool iconic, const QString &languageMode, bool tabbed, bool background);
+	static DocumentWidget *openDeferred(MainWindow *window, const SessionDocument &entry);
 	static std::vector<DocumentWidget *> allDocuments();
 
 public:
@@ -123,7 +128,11 @@ public:
 	TextArea *firstPane() const;
 	TextBuffer *buffer() const;
 	WrapStyle wrapMode() const;
+	bool GetFollow() const;
 	bool GetHighlightSyntax() const;
+	bool isDeferred() const;
+	bool loadDeferred();
+	boost::optional<SessionDocument> sessionState() const;
 	bool GetIncrementalBackup() const;
 	bool GetMakeBackupCopy() const;
 	bool GetMatchSyntaxBased() const;
@@ -136,6 +145,7 @@ public:
 	bool ReadMacroString(const QString &string, const QString &errIn);
 	bool checkReadOnly() const;
 	bool fileChanged() const;
+	size_t undoMemoryUsage() const;
 	bool filenameSet() const;
 	bool isReadOnly() const;
 	bool isTopDocument() const;
@@ -161,6 +171,7 @@ public:
 	void selectNumberedLine(TextArea *area, int64_t lineNum);
 	void SelectToMatchingCharacter(TextArea *area);
 	void SetBacklightChars(const QString &applyBacklightTypes);
+	void SetFollow(bool follow);
 	void SetColors(const QColor &textFg, const QColor &textBg, const QColor &selectFg, const QColor &selectBg, const QColor &hiliteFg, const QColor &hiliteBg, const QColor &lineNoFg, const QColor &lineNoBg, const QColor &cursorFg);
 	void SetHighlightSyntax(bool value);
 	void SetIncrementalBackup(bool value);
@@ -189,6 +200,7 @@ public:
 	void gotoAP(TextArea *area, int lineNum, int column);
 	void gotoMark(TextArea *area, QChar label, bool extendSel);
 	void handleUnparsedRegion(const std::shared_ptr<TextBuffer> &styleBuf, TextCursor pos) const;
+	void loadIntoMemory();
 	void macroBannerTimeoutProc();
 	void moveDocument(MainWindow *fromWindow);
 	void printString(const std::string &string, const QString &jobname);
@@ -224,20 +236,23 @@ private:
 	MacroContinuationCode continueWorkProcEx();
 	PatternSet *findPatternsForWindow(bool warn);
 	QString backupFileNameEx() const;
+	QString undoJournalFileName() const;
+	bool hasUndo() const;
 	QString getWindowsMenuEntry() const;
 	Style getHighlightInfo(TextCursor pos);
 	StyleTableEntry *styleTableEntryOfCodeEx(size_t hCode) const;
 	TextArea *createTextArea(TextBuffer *buffer);
 	bool CloseFileAndWindow(CloseMode preResponse);
 	bool MacroWindowCloseActionsEx();
-	bool WriteBackupFile();
-	bool compareDocumentToFile(const QString &fileName) const;
+	void WriteBackupFile();
+	bool decompressFile(view::string_view data, Compression type, std::string *text, QString *error);
 	bool doOpen(const QString &name, const QString &path, int flags);
 	bool doSave();
-	bool fileWasModifiedExternally() const;
+	bool fileWasModifiedExternally();
 	bool includeFile(const QString &name);
 	bool saveDocument();
 	bool saveDocumentAs(const QString &newName, bool addWrap);
+	bool undoJournalEnabled() const;
 	bool writeBckVersion();
 	boost::optional<TextCursor> findMatchingCharEx(char toMatch, Style styleToMatch, TextCursor charPos, TextCursor startLimit, TextCursor endLimit);
 	int findAllMatchesEx(TextArea *area, const QString &string);
@@ -248,12 +263,14 @@ private:
 	void clearRedoList();
 	void clearUndoList();
 	void closeDocument();
+	void closeUndoJournal();
 	void DetermineLanguageMode(bool forceNewDefaults);
 	void doShellMenuCmd(MainWindow *inWindow, TextArea *area, const QString &command, InSrcs input, OutDests output, bool outputReplacesInput, bool saveFirst, bool loadAfter, CommandSource source);
 	void doShellMenuCmd(MainWindow *inWindow, TextArea *area, const MenuItem &item, CommandSource source);
 	void execCursorLine(TextArea *area, CommandSource source);
 	void finishLearning();
 	void flashMatchingChar(TextArea *area);
+	void followFile(const FileStatus &status);
 	void FreeHighlightingData();
 	void Redo();
 	void RefreshMenuToggleStates();
@@ -271,7 +288,7 @@ private:
 	void addRedoItem(UndoInfo &&redo);
 	void addUndoItem(UndoInfo &&undo);
 	void addWrapNewlines();
-	void appendDeletedText(view::string_view deletedText, int64_t deletedLen, Direction direction);
+	void appendDeletedText(view::string_view deletedText, Direction direction);
 	void cancelLearning();
 	void createSelectMenuEx(TextArea *area, const QStringList &args);
 	void documentRaised();
@@ -283,7 +300,10 @@ private:
 	void refreshMenuBar();
 	void removeRedoItem();
 	void removeUndoItem();
-	void trimUndoList(size_t maxLength);
+	void backupWriteFailed(const QString &error);
+	void detachJournaledUndoItem();
+	void pageInUndoItems();
+	void trimUndoList(size_t maxMemory);
 	void updateSelectionSensitiveMenu(QMenu *menu, const gsl::span<MenuData> &menuList, bool enabled);
 	void updateSelectionSensitiveMenus(bool enabled);
 
@@ -316,6 +336,9 @@ private:
 	bool backlightChars_;                               // is char backlighting turned on?
 	std::array<Bookmark, MAX_MARKS> markTable_;         // marked locations in window
 	std::unique_ptr<ShellCommandData> shellCmdData_;    // when a shell command is executing, info. about it, otherwise, nullptr	
+	std::unique_ptr<BackupWriter> backupWriter_;        // keeps the backup file up to date in the background
+	std::unique_ptr<SessionDocument> deferred_;         // for a document restored from a session whose file isn't read yet, how to restore it once it is
+	std::chrono::steady_clock::time_point lastCheckTime_; // when the file was last asked to be checked for changes
 	Ui::DocumentWidget ui;
 
 public:
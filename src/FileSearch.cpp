@@ -0,0 +1,383 @@
+
+#include "FileSearch.h"
+#include "FunctionTask.h"
+#include "Regex.h"
+#include "Search.h"
+#include "Util/string_view.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+
+#include <gsl/gsl_util>
+
+#include <algorithm>
+
+namespace {
+
+// number of files handed to a single search task
+constexpr int FilesPerTask = 64;
+
+// how much of a file is inspected when deciding if it is binary
+constexpr int64_t BinarySampleSize = 8192;
+
+// matching lines longer than this are truncated in the results
+constexpr int64_t MaxHitTextLength = 512;
+
+/**
+ * @brief matchesAny
+ * @param globs
+ * @param name
+ * @return
+ */
+bool matchesAny(const QStringList &globs, const QString &name) {
+	return QDir::match(globs, name);
+}
+
+}
+
+struct FileSearch::State {
+	Options options;
+	int generation = 0;
+	std::atomic<bool> cancelled{false};
+	std::atomic<int> pending{0};
+	std::atomic<int> filesSearched{0};
+	std::atomic<int> filesMatched{0};
+};
+
+/**
+ * @brief FileSearch::FileSearch
+ * @param parent
+ */
+FileSearch::FileSearch(QObject *parent) : QObject(parent) {
+
+	static const int hitListTypeId = qRegisterMetaType<QList<FileSearch::Hit>>("QList<FileSearch::Hit>");
+	Q_UNUSED(hitListTypeId)
+
+	pool_ = new QThreadPool(this);
+	pool_->setMaxThreadCount(std::max(2, QThread::idealThreadCount()));
+}
+
+/**
+ * @brief FileSearch::~FileSearch
+ */
+FileSearch::~FileSearch() {
+	cancel();
+	pool_->waitForDone();
+}
+
+/**
+ * @brief FileSearch::isRunning
+ * @return
+ */
+bool FileSearch::isRunning() const {
+	return state_ && state_->pending != 0;
+}
+
+/**
+ * @brief FileSearch::cancel
+ */
+void FileSearch::cancel() {
+	if(state_) {
+		state_->cancelled = true;
+	}
+}
+
+/**
+ * Begins a new search, cancelling any search which is currently in progress.
+ * Returns false if the search could not be started (an invalid regular
+ * expression or a directory which does not exist).
+ *
+ * @brief FileSearch::start
+ * @param options
+ * @return
+ */
+bool FileSearch::start(const Options &options) {
+
+	if(options.searchString.isEmpty() || !QFileInfo(options.directory).isDir()) {
+		return false;
+	}
+
+	// make sure the expression compiles before handing it to the workers
+	if(Search::isRegexType(options.searchType)) {
+		try {
+			Regex compiledRE(options.searchString.toStdString(), Search::defaultRegexFlags(options.searchType));
+		} catch(const RegexError &) {
+			return false;
+		}
+	}
+
+	/* the tasks of the previous search are not waited for, they stop at their
+	   next check of the cancelled flag and what they deliver until then is
+	   dropped, as it is for an older generation */
+	cancel();
+
+	auto state = std::make_shared<State>();
+	state->options    = options;
+	state->generation = ++generation_;
+	state_ = state;
+
+	state->pending = 1;
+	pool_->start(new FunctionTask([this, state]() {
+		walkDirectory(state);
+	}));
+
+	return true;
+}
+
+/**
+ * @brief FileSearch::taskFinished
+ * @param state
+ */
+void FileSearch::taskFinished(const std::shared_ptr<State> &state) {
+	if(--state->pending == 0) {
+		QMetaObject::invokeMethod(this, "deliverFinished", Qt::QueuedConnection,
+		                          Q_ARG(int, state->generation),
+		                          Q_ARG(bool, state->cancelled));
+	}
+}
+
+/*
+** The delivery slots run on the GUI thread and drop anything still queued by
+** the tasks of a search which has since been replaced by a newer one.
+*/
+void FileSearch::deliverHits(int generation, const QList<FileSearch::Hit> &hits) {
+	if(generation == generation_) {
+		Q_EMIT fileMatched(hits);
+	}
+}
+
+void FileSearch::deliverProgress(int generation, int filesSearched, int filesMatched) {
+	if(generation == generation_) {
+		Q_EMIT progress(filesSearched, filesMatched);
+	}
+}
+
+void FileSearch::deliverFinished(int generation, bool cancelled) {
+	if(generation == generation_) {
+		Q_EMIT finished(cancelled);
+	}
+}
+
+/**
+ * Walks the directory tree, skipping anything which matches an exclude glob,
+ * and schedules the files which match the include globs to be searched in
+ * groups of FilesPerTask.
+ *
+ * @brief FileSearch::walkDirectory
+ * @param state
+ */
+void FileSearch::walkDirectory(const std::shared_ptr<State> &state) {
+
+	auto _ = gsl::finally([this, state]() {
+		taskFinished(state);
+	});
+
+	const Options &options = state->options;
+
+	QStringList batch;
+	batch.reserve(FilesPerTask);
+
+	auto flush = [this, state, &batch]() {
+		if(batch.isEmpty()) {
+			return;
+		}
+
+		++state->pending;
+		pool_->start(new FunctionTask([this, state, files = std::move(batch)]() {
+			searchFiles(state, files);
+		}));
+
+		batch = QStringList();
+		batch.reserve(FilesPerTask);
+	};
+
+	std::vector<QString> directories;
+	directories.push_back(options.directory);
+
+	while(!directories.empty() && !state->cancelled) {
+
+		QString directory = std::move(directories.back());
+		directories.pop_back();
+
+		QDirIterator it(directory, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden);
+		while(it.hasNext() && !state->cancelled) {
+			const QString path = it.next();
+			const QFileInfo info = it.fileInfo();
+
+			if(matchesAny(options.excludes, info.fileName())) {
+				continue;
+			}
+
+			if(info.isDir()) {
+				// don't follow links to directories, they can form cycles
+				if(!info.isSymLink()) {
+					directories.push_back(path);
+				}
+				continue;
+			}
+
+			if(!info.isFile()) {
+				continue;
+			}
+
+			if(!options.includes.isEmpty() && !matchesAny(options.includes, info.fileName())) {
+				continue;
+			}
+
+			batch.push_back(path);
+			if(batch.size() >= FilesPerTask) {
+				flush();
+			}
+		}
+	}
+
+	flush();
+}
+
+/**
+ * @brief FileSearch::searchFiles
+ * @param state
+ * @param files
+ */
+void FileSearch::searchFiles(const std::shared_ptr<State> &state, const QStringList &files) {
+
+	auto _ = gsl::finally([this, state]() {
+		taskFinished(state);
+	});
+
+	for(const QString &path : files) {
+		if(state->cancelled) {
+			return;
+		}
+
+		QList<Hit> hits;
+		if(searchFile(state, path, &hits)) {
+			++state->filesMatched;
+			QMetaObject::invokeMethod(this, "deliverHits", Qt::QueuedConnection,
+			                          Q_ARG(int, state->generation),
+			                          Q_ARG(QList<FileSearch::Hit>, hits));
+		}
+
+		++state->filesSearched;
+	}
+
+	QMetaObject::invokeMethod(this, "deliverProgress", Qt::QueuedConnection,
+	                          Q_ARG(int, state->generation),
+	                          Q_ARG(int, state->filesSearched),
+	                          Q_ARG(int, state->filesMatched));
+}
+
+/**
+ * Searches a single memory mapped file, reporting at most one hit per line
+ * the way grep does. Returns true if anything was found.
+ *
+ * @brief FileSearch::searchFile
+ * @param state
+ * @param path
+ * @param hits
+ * @return
+ */
+bool FileSearch::searchFile(const std::shared_ptr<State> &state, const QString &path, QList<Hit> *hits) {
+
+	const Options &options = state->options;
+
+	QFile file(path);
+	if(!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	const int64_t size = file.size();
+	if(size == 0) {
+		return false;
+	}
+
+	uchar *memory = file.map(0, size);
+	if(!memory) {
+		return false;
+	}
+
+	auto _ = gsl::finally([&file, memory]() {
+		file.unmap(memory);
+	});
+
+	const auto text = view::string_view(reinterpret_cast<const char *>(memory), static_cast<size_t>(size));
+
+	if(isBinary(text.data(), std::min(size, BinarySampleSize))) {
+		return false;
+	}
+
+	const std::string searchString = options.searchString.toStdString();
+	const QByteArray delimiters    = options.delimiters.toLatin1();
+
+	std::unique_ptr<Regex> compiledRE;
+	if(Search::isRegexType(options.searchType)) {
+		try {
+			compiledRE = std::make_unique<Regex>(searchString, Search::defaultRegexFlags(options.searchType));
+		} catch(const RegexError &) {
+			return false;
+		}
+	}
+
+	int64_t pos       = 0;
+	int64_t line      = 1;
+	int64_t countedTo = 0;
+
+	while(pos < size && !state->cancelled) {
+
+		int64_t start;
+		if(compiledRE) {
+			if(!compiledRE->execute(text, static_cast<size_t>(pos), delimiters.data(), false)) {
+				break;
+			}
+
+			start = compiledRE->startp[0] - text.data();
+		} else {
+			boost::optional<Search::Result> result = Search::SearchString(text, searchString, Direction::Forward, options.searchType, WrapMode::NoWrap, pos, delimiters.data());
+			if(!result) {
+				break;
+			}
+
+			start = result->start;
+		}
+
+		line += std::count(text.begin() + countedTo, text.begin() + start, '\n');
+		countedTo = start;
+
+		const size_t lineStart = (start == 0) ? 0 : text.rfind('\n', static_cast<size_t>(start - 1)) + 1;
+		size_t lineEnd         = text.find('\n', static_cast<size_t>(start));
+		if(lineEnd == view::string_view::npos) {
+			lineEnd = text.size();
+		}
+
+		const size_t length = std::min(lineEnd - lineStart, static_cast<size_t>(MaxHitTextLength));
+
+		Hit hit;
+		hit.path   = path;
+		hit.line   = line;
+		hit.column = start - static_cast<int64_t>(lineStart);
+		hit.text   = QString::fromLocal8Bit(text.data() + lineStart, static_cast<int>(length));
+		hits->push_back(hit);
+
+		// continue with the line following the hit
+		pos = static_cast<int64_t>(lineEnd) + 1;
+	}
+
+	return !hits->isEmpty();
+}
+
+/**
+ * A file is considered binary if there are any NUL bytes in the sample
+ * provided.
+ *
+ * @brief FileSearch::isBinary
+ * @param data
+ * @param size
+ * @return
+ */
+bool FileSearch::isBinary(const char *data, int64_t size) {
+	return std::find(data, data + size, '\0') != data + size;
+}
@@ -0,0 +1,84 @@
+
+#ifndef FILE_SEARCH_H_
+#define FILE_SEARCH_H_
+
+#include "SearchType.h"
+
+#include <QList>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+class QThreadPool;
+
+/*
+** Searches all of the files below a directory for a string, using the same
+** literal and regular expression engines as the editor. The directory walk
+** and the searching itself run on a thread pool, results are delivered to the
+** GUI thread through queued signals as each file is completed.
+*/
+class FileSearch : public QObject {
+	Q_OBJECT
+
+public:
+	struct Options {
+		QString     directory;
+		QString     searchString;
+		QString     delimiters;
+		QStringList includes;     // file name globs to search, empty means all files
+		QStringList excludes;     // file and directory name globs to skip
+		SearchType  searchType = SearchType::Literal;
+	};
+
+	struct Hit {
+		QString path;
+		int64_t line   = 0;
+		int64_t column = 0; // offset of the match in the line
+		QString text;
+	};
+
+	// state shared between the searcher and its outstanding tasks
+	struct State;
+
+public:
+	explicit FileSearch(QObject *parent = nullptr);
+	~FileSearch() override;
+
+Q_SIGNALS:
+	void fileMatched(const QList<FileSearch::Hit> &hits);
+	void progress(int filesSearched, int filesMatched);
+	void finished(bool cancelled);
+
+public:
+	bool isRunning() const;
+	bool start(const Options &options);
+	void cancel();
+
+public:
+	static bool isBinary(const char *data, int64_t size);
+
+private Q_SLOTS:
+	void deliverHits(int generation, const QList<FileSearch::Hit> &hits);
+	void deliverProgress(int generation, int filesSearched, int filesMatched);
+	void deliverFinished(int generation, bool cancelled);
+
+private:
+	void taskFinished(const std::shared_ptr<State> &state);
+	void walkDirectory(const std::shared_ptr<State> &state);
+	void searchFiles(const std::shared_ptr<State> &state, const QStringList &files);
+	bool searchFile(const std::shared_ptr<State> &state, const QString &path, QList<Hit> *hits);
+
+private:
+	QThreadPool *pool_;
+	std::shared_ptr<State> state_;
+	int generation_ = 0;
+};
+
+Q_DECLARE_METATYPE(FileSearch::Hit)
+
+#endif
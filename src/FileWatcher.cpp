@@ -0,0 +1,555 @@
+
+#include "FileWatcher.h"
+#include "DocumentWidget.h"
+#include "FunctionTask.h"
+#include "Util/Fingerprint.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QPointer>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <cerrno>
+#include <vector>
+
+namespace {
+
+// the one handed out by FileWatcher::instance, until it's deleted
+FileWatcher *Instance = nullptr;
+
+// how long to wait for a burst of changes to a file to be over, in milliseconds
+constexpr int SettleDelay = 100;
+
+// how often files which can't be watched are polled, in milliseconds
+constexpr int PollInterval = 3000;
+
+// watched files are polled once every this many polls
+constexpr int WatchedPollRatio = 10;
+
+/**
+ * @brief sameFile
+ * @param lhs
+ * @param rhs
+ * @return true if the two statuses describe the same state of a file
+ */
+bool sameFile(const FileStatus &lhs, const FileStatus &rhs) {
+
+	if (lhs.error != 0 || rhs.error != 0) {
+		return lhs.error == rhs.error;
+	}
+
+	return lhs.stat.st_mtime == rhs.stat.st_mtime &&
+	       lhs.stat.st_size  == rhs.stat.st_size  &&
+	       lhs.stat.st_mode  == rhs.stat.st_mode  &&
+	       lhs.stat.st_uid   == rhs.stat.st_uid   &&
+	       lhs.stat.st_gid   == rhs.stat.st_gid   &&
+	       lhs.stat.st_dev   == rhs.stat.st_dev   &&
+	       lhs.stat.st_ino   == rhs.stat.st_ino;
+}
+
+}
+
+/*
+** The state of the worker thread. The file system watcher and the timers
+** are created by the thread, and only used by it.
+*/
+struct FileWatcher::Worker {
+	FileWatcher *owner;
+	QFileSystemWatcher *watcher = nullptr;
+	QTimer *settleTimer         = nullptr;
+	QTimer *pollTimer           = nullptr;
+	QSet<QString> paths;                 // every file being watched
+	QSet<QString> watched;               // the files the file system watcher has taken on
+	QSet<QString> pending;               // files to check once the burst is over
+	QSet<QString> forced;                // files whose status is to be reported even if it didn't change
+	QSet<QString> hashing;               // files whose fingerprint was asked for
+	QSet<QString> fingerprinting;        // files being read by the hash pool
+	QHash<QString, FileStatus> statuses; // as last reported
+	int polls = 0;
+
+	void start(QObject *context);
+	void stop();
+	void add(const QString &path);
+	void remove(const QString &path);
+	void request(const QString &path, bool force);
+	void requestFingerprint(const QString &path);
+	void fingerprintReady(const QString &path, const FileStatus &status);
+	void poll();
+	void checkPending();
+	FileStatus check(const QString &path) const;
+};
+
+/**
+ * @brief FileWatcher::Worker::start
+ * @param context
+ */
+void FileWatcher::Worker::start(QObject *context) {
+
+	watcher = new QFileSystemWatcher(context);
+	QObject::connect(watcher, &QFileSystemWatcher::fileChanged, context, [this](const QString &path) {
+		// the watcher lets go of files which are removed or replaced
+		if (!watcher->files().contains(path)) {
+			watched.remove(path);
+		}
+
+		request(path, /*force=*/false);
+	});
+
+	settleTimer = new QTimer(context);
+	settleTimer->setSingleShot(true);
+	settleTimer->setInterval(SettleDelay);
+	QObject::connect(settleTimer, &QTimer::timeout, context, [this]() {
+		checkPending();
+	});
+
+	pollTimer = new QTimer(context);
+	pollTimer->setInterval(PollInterval);
+	QObject::connect(pollTimer, &QTimer::timeout, context, [this]() {
+		poll();
+	});
+	pollTimer->start();
+}
+
+/**
+ * Deletes what start created. It has to be done by the thread, as timers and
+ * the notifiers of the file system watcher can't be stopped from another one.
+ *
+ * @brief FileWatcher::Worker::stop
+ */
+void FileWatcher::Worker::stop() {
+	delete watcher;
+	delete settleTimer;
+	delete pollTimer;
+
+	watcher     = nullptr;
+	settleTimer = nullptr;
+	pollTimer   = nullptr;
+	watched.clear();
+}
+
+/**
+ * @brief FileWatcher::Worker::add
+ * @param path
+ */
+void FileWatcher::Worker::add(const QString &path) {
+	paths.insert(path);
+
+	// fails if the file doesn't exist (yet), it is polled until it does
+	if (watcher->addPath(path)) {
+		watched.insert(path);
+	}
+
+	request(path, /*force=*/true);
+}
+
+/**
+ * @brief FileWatcher::Worker::remove
+ * @param path
+ */
+void FileWatcher::Worker::remove(const QString &path) {
+	paths.remove(path);
+	pending.remove(path);
+	forced.remove(path);
+	hashing.remove(path);
+	statuses.remove(path);
+
+	if (watched.remove(path)) {
+		watcher->removePath(path);
+	}
+}
+
+/*
+** Check "path" once the current burst of changes is over. The delay is not
+** extended by further changes, so a file which changes continuously is
+** still checked regularly.
+*/
+void FileWatcher::Worker::request(const QString &path, bool force) {
+
+	if (!paths.contains(path)) {
+		return;
+	}
+
+	pending.insert(path);
+	if (force) {
+		forced.insert(path);
+	}
+
+	if (!settleTimer->isActive()) {
+		settleTimer->start();
+	}
+}
+
+/**
+ * @brief FileWatcher::Worker::requestFingerprint
+ * @param path
+ */
+void FileWatcher::Worker::requestFingerprint(const QString &path) {
+
+	if (!paths.contains(path)) {
+		return;
+	}
+
+	hashing.insert(path);
+	request(path, /*force=*/true);
+}
+
+/**
+ * @brief FileWatcher::Worker::poll
+ */
+void FileWatcher::Worker::poll() {
+
+	const bool all = (++polls % WatchedPollRatio) == 0;
+
+	for (const QString &path : paths) {
+		if (all || !watched.contains(path)) {
+			pending.insert(path);
+		}
+	}
+
+	checkPending();
+}
+
+/**
+ * Checks the pending files, reporting those which changed.
+ *
+ * @brief FileWatcher::Worker::checkPending
+ */
+void FileWatcher::Worker::checkPending() {
+
+	const QSet<QString> checking = std::move(pending);
+	pending.clear();
+
+	for (const QString &path : checking) {
+
+		FileStatus status = check(path);
+
+		auto it = statuses.find(path);
+		if (it != statuses.end() && sameFile(*it, status)) {
+			if (!forced.contains(path)) {
+				continue;
+			}
+
+			// the contents can't have changed either
+			status.fingerprint       = it->fingerprint;
+			status.fingerprintFailed = it->fingerprintFailed;
+		}
+
+		// opening the file is only worth it when its permissions may have changed
+		if (status.error == 0) {
+			if (it != statuses.end() && it->error == 0 && it->stat.st_mode == status.stat.st_mode && it->stat.st_uid == status.stat.st_uid && it->stat.st_gid == status.stat.st_gid) {
+				status.readable = it->readable;
+				status.writable = it->writable;
+			} else {
+				QFile file(path);
+				status.writable = file.open(QIODevice::ReadWrite);
+				status.readable = status.writable || file.open(QIODevice::ReadOnly);
+			}
+
+			// a file which was replaced, rather than rewritten, needs to be watched again
+			if (!watched.contains(path) && watcher->addPath(path)) {
+				watched.insert(path);
+			}
+		}
+
+		forced.remove(path);
+		statuses.insert(path, status);
+
+		/* read the file after having stat'ed it, so that a change made while
+		   it's being read shows up as a change of the status. The status is
+		   reported once the fingerprint is ready */
+		if (status.error == 0 && !status.fingerprint && hashing.contains(path)) {
+			if (!fingerprinting.contains(path)) {
+				fingerprinting.insert(path);
+				hashing.remove(path);
+
+				FileWatcher *fileWatcher = owner;
+				fileWatcher->hashPool_->start(new FunctionTask([fileWatcher, path, status]() mutable {
+					status.fingerprint = FingerprintOfFile(path, [fileWatcher](int64_t) {
+						return !fileWatcher->stopping_;
+					});
+
+					status.fingerprintFailed = !status.fingerprint;
+					Q_EMIT fileWatcher->fingerprintReady(path, status);
+				}));
+			}
+			continue;
+		}
+
+		hashing.remove(path);
+		Q_EMIT owner->statusReady(path, status);
+	}
+}
+
+/**
+ * Adds a fingerprint read by the hash pool to the status of its file, unless
+ * the file changed while it was being read, in which case it's read again.
+ *
+ * @brief FileWatcher::Worker::fingerprintReady
+ * @param path
+ * @param status
+ */
+void FileWatcher::Worker::fingerprintReady(const QString &path, const FileStatus &status) {
+
+	fingerprinting.remove(path);
+
+	auto it = statuses.find(path);
+	if (it == statuses.end()) {
+		return;
+	}
+
+	if (!sameFile(*it, status)) {
+		if (hashing.contains(path)) {
+			request(path, /*force=*/true);
+		}
+		return;
+	}
+
+	it->fingerprint       = status.fingerprint;
+	it->fingerprintFailed = status.fingerprintFailed;
+
+	hashing.remove(path);
+	Q_EMIT owner->statusReady(path, *it);
+}
+
+/**
+ * @brief FileWatcher::Worker::check
+ * @param path
+ * @return
+ */
+FileStatus FileWatcher::Worker::check(const QString &path) const {
+
+	FileStatus status;
+	status.time = std::chrono::steady_clock::now();
+
+	if (QT_STAT(QFile::encodeName(path).constData(), &status.stat) != 0) {
+		status.error = errno;
+	}
+
+	return status;
+}
+
+/**
+ * @brief FileWatcher::instance
+ * @return global unique instance
+ */
+FileWatcher *FileWatcher::instance() {
+	// owned by the application, so that the thread is stopped before it goes away
+	if (!Instance) {
+		Instance = new FileWatcher(QCoreApplication::instance());
+	}
+
+	return Instance;
+}
+
+/**
+ * @brief FileWatcher::FileWatcher
+ * @param parent
+ */
+FileWatcher::FileWatcher(QObject *parent) : QObject(parent), worker_(std::make_unique<Worker>()) {
+
+	qRegisterMetaType<FileStatus>("FileStatus");
+
+	worker_->owner = this;
+
+	thread_  = new QThread(this);
+	context_ = new QObject();
+	context_->moveToThread(thread_);
+
+	hashPool_ = new QThreadPool(this);
+	hashPool_->setMaxThreadCount(2);
+
+	// each of these runs in the worker thread
+	connect(thread_, &QThread::started, context_, [this]() {
+		worker_->start(context_);
+	});
+
+	connect(thread_, &QThread::finished, context_, [this]() {
+		worker_->stop();
+	});
+
+	connect(this, &FileWatcher::pathAdded, context_, [this](const QString &path) {
+		worker_->add(path);
+	});
+
+	connect(this, &FileWatcher::pathRemoved, context_, [this](const QString &path) {
+		worker_->remove(path);
+	});
+
+	connect(this, &FileWatcher::refreshRequested, context_, [this](const QString &path) {
+		worker_->request(path, /*force=*/true);
+	});
+
+	connect(this, &FileWatcher::fingerprintRequested, context_, [this](const QString &path) {
+		worker_->requestFingerprint(path);
+	});
+
+	connect(this, &FileWatcher::fingerprintReady, context_, [this](const QString &path, const FileStatus &status) {
+		worker_->fingerprintReady(path, status);
+	});
+
+	// and this one in the GUI thread
+	connect(this, &FileWatcher::statusReady, this, &FileWatcher::updateStatus);
+
+	thread_->start();
+}
+
+/**
+ * @brief FileWatcher::~FileWatcher
+ */
+FileWatcher::~FileWatcher() {
+
+	// files still being read are given up on
+	stopping_ = true;
+	hashPool_->waitForDone();
+
+	thread_->quit();
+	thread_->wait();
+
+	// the thread is gone, so what's left of it is deleted from here
+	delete context_;
+
+	if (Instance == this) {
+		Instance = nullptr;
+	}
+}
+
+/**
+ * Starts watching the file "path" on behalf of "document", instead of the
+ * file it was watching before, if any. Its status is known once the worker
+ * has checked it.
+ *
+ * @brief FileWatcher::watch
+ * @param document
+ * @param path
+ */
+void FileWatcher::watch(DocumentWidget *document, const QString &path) {
+
+	auto it = documents_.find(document);
+	if (it != documents_.end() && *it == path) {
+		return;
+	}
+
+	unwatch(document);
+	documents_.insert(document, path);
+
+	Entry &entry = entries_[path];
+	if (entry.documents++ == 0) {
+		Q_EMIT pathAdded(path);
+	}
+}
+
+/**
+ * @brief FileWatcher::unwatch
+ * @param document
+ */
+void FileWatcher::unwatch(DocumentWidget *document) {
+
+	const QString path = documents_.take(document);
+	if (path.isNull()) {
+		return;
+	}
+
+	auto it = entries_.find(path);
+	if (it != entries_.end() && --it->documents == 0) {
+		entries_.erase(it);
+		Q_EMIT pathRemoved(path);
+	}
+}
+
+/**
+ * Asks for the file "path" to be checked again, for changes which may not
+ * have been noticed. The current status stays available meanwhile.
+ *
+ * @brief FileWatcher::refresh
+ * @param path
+ */
+void FileWatcher::refresh(const QString &path) {
+	if (entries_.contains(path)) {
+		Q_EMIT refreshRequested(path);
+	}
+}
+
+/**
+ * Forgets the status of the file "path" and has it checked again, for when
+ * a document has just read or written the file and knows better than any
+ * status taken before.
+ *
+ * @brief FileWatcher::invalidate
+ * @param path
+ */
+void FileWatcher::invalidate(const QString &path) {
+
+	auto it = entries_.find(path);
+	if (it == entries_.end()) {
+		return;
+	}
+
+	it->known       = false;
+	it->invalidated = std::chrono::steady_clock::now();
+	Q_EMIT refreshRequested(path);
+}
+
+/**
+ * Asks for the fingerprint of the contents of the file "path" to be added to
+ * its status. The documents of the file are called again once it has been.
+ *
+ * @brief FileWatcher::fingerprint
+ * @param path
+ */
+void FileWatcher::fingerprint(const QString &path) {
+	if (entries_.contains(path)) {
+		Q_EMIT fingerprintRequested(path);
+	}
+}
+
+/**
+ * @brief FileWatcher::status
+ * @param path
+ * @return the latest status of the file "path", or null if it isn't known yet
+ */
+const FileStatus *FileWatcher::status(const QString &path) const {
+
+	auto it = entries_.find(path);
+	if (it == entries_.end() || !it->known) {
+		return nullptr;
+	}
+
+	return &it->status;
+}
+
+/**
+ * Records a status reported by the worker, and has the documents of the
+ * file check it.
+ *
+ * @brief FileWatcher::updateStatus
+ * @param path
+ * @param status
+ */
+void FileWatcher::updateStatus(const QString &path, const FileStatus &status) {
+
+	auto it = entries_.find(path);
+	if (it == entries_.end() || status.time < it->invalidated) {
+		return;
+	}
+
+	it->status = status;
+	it->known  = true;
+
+	// checking may put up a dialog, during which documents can come and go
+	std::vector<QPointer<DocumentWidget>> documents;
+	for (auto doc = documents_.begin(); doc != documents_.end(); ++doc) {
+		if (*doc == path) {
+			documents.emplace_back(doc.key());
+		}
+	}
+
+	for (const QPointer<DocumentWidget> &document : documents) {
+		if (document && documents_.value(document) == path) {
+			document->checkForChangesToFile();
+		}
+	}
+}
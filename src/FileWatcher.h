@@ -0,0 +1,103 @@
+
+#ifndef FILE_WATCHER_H_
+#define FILE_WATCHER_H_
+
+#include <QHash>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <qplatformdefs.h>
+
+#include <boost/optional.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+class DocumentWidget;
+class QThread;
+class QThreadPool;
+
+// the result of checking on a file, see FileWatcher
+struct FileStatus {
+	QT_STATBUF stat        = {};                // valid if error is 0
+	int error              = 0;                 // errno of the stat, 0 if it succeeded
+	bool readable          = false;             // whether the file could be opened at all
+	bool writable          = false;             // whether the file could be opened for writing
+	boost::optional<uint64_t> fingerprint;      // of the contents, once asked for
+	bool fingerprintFailed = false;             // whether the contents couldn't be read when they were
+	std::chrono::steady_clock::time_point time; // when the file was checked
+};
+
+Q_DECLARE_METATYPE(FileStatus)
+
+/*
+** Watches the files of the open documents for changes made by other
+** programs, so that documents don't have to stat their files themselves.
+**
+** The files are checked by a worker thread, never by the GUI thread. It
+** relies on QFileSystemWatcher to hear of changes, and checks files which
+** can't be watched that way by polling them. Since changes made by other
+** hosts to files on network file systems aren't always noticed by the
+** watcher, the watched files are polled as well, just less often. Bursts of
+** changes to a file are checked once, after a short delay.
+**
+** Documents are told of a change by having their checkForChangesToFile
+** called, which reads the latest status from here. When a document needs to
+** know whether the contents of its file really changed, it can ask for the
+** file's fingerprint. That is computed off the GUI thread as well, but by a
+** thread pool of its own, so that reading a large file doesn't hold up the
+** checks of the others. It is kept for as long as the file doesn't change.
+*/
+class FileWatcher : public QObject {
+	Q_OBJECT
+
+public:
+	static FileWatcher *instance();
+
+private:
+	explicit FileWatcher(QObject *parent = nullptr);
+	~FileWatcher() override;
+
+public:
+	const FileStatus *status(const QString &path) const;
+	void fingerprint(const QString &path);
+	void invalidate(const QString &path);
+	void refresh(const QString &path);
+	void unwatch(DocumentWidget *document);
+	void watch(DocumentWidget *document, const QString &path);
+
+Q_SIGNALS:
+	// requests to the worker, and its replies
+	void fingerprintReady(const QString &path, const FileStatus &status);
+	void fingerprintRequested(const QString &path);
+	void pathAdded(const QString &path);
+	void pathRemoved(const QString &path);
+	void refreshRequested(const QString &path);
+	void statusReady(const QString &path, const FileStatus &status);
+
+private:
+	void updateStatus(const QString &path, const FileStatus &status);
+
+private:
+	struct Worker;
+
+	struct Entry {
+		FileStatus status;
+		std::chrono::steady_clock::time_point invalidated; // statuses taken before this are out of date
+		int documents = 0;
+		bool known    = false;
+	};
+
+private:
+	QThread *thread_;
+	QThreadPool *hashPool_;          // reads the files whose fingerprint is asked for
+	QObject *context_;               // lives in the worker thread
+	std::unique_ptr<Worker> worker_; // only used in the worker thread
+	std::atomic<bool> stopping_{false};
+	QHash<QString, Entry> entries_;
+	QHash<DocumentWidget *, QString> documents_;
+};
+
+#endif
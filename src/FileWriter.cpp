@@ -0,0 +1,388 @@
+
+#include "FileWriter.h"
+#include "Util/FileFormats.h"
+#include "Util/FileSystem.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <qplatformdefs.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// size of the pieces the text is converted in
+constexpr size_t ChunkSize = 256 * 1024;
+
+/**
+ * @brief systemError
+ * @return the description of the last system error
+ */
+QString systemError() {
+	return QString::fromLatin1(strerror(errno));
+}
+
+#ifdef Q_OS_UNIX
+/*
+** Make a rename in "path" durable, the new directory entry is only safely
+** on disk once the directory itself is synced. Errors are ignored, the file
+** has been written either way.
+*/
+void syncDirectory(const QString &path) {
+	const int fd = QT_OPEN(QFile::encodeName(path).constData(), O_RDONLY);
+	if (fd >= 0) {
+		::fsync(fd);
+		QT_CLOSE(fd);
+	}
+}
+#endif
+
+}
+
+/**
+ * @brief FileWriter::FileWriter
+ * @param fileName
+ */
+FileWriter::FileWriter(const QString &fileName) : fileName_(fileName) {
+}
+
+/**
+ * Discards the temporary file, if the new version wasn't committed.
+ *
+ * @brief FileWriter::~FileWriter
+ */
+FileWriter::~FileWriter() = default;
+
+/**
+ * Has the text compressed in "format" on the way to the file, or written as
+ * it is if that is Compression::None. Must be set before anything is written.
+ *
+ * @brief FileWriter::setCompression
+ * @param format
+ */
+void FileWriter::setCompression(const CompressionFormat &format) {
+	compressor_ = Compressor::create(format);
+}
+
+/**
+ * @brief FileWriter::open
+ * @return true on success
+ */
+bool FileWriter::open() {
+
+	// replace the file a symbolic link points to, not the link
+	QString target = fileName_;
+	QFileInfo info(fileName_);
+	if (info.isSymLink() && !info.canonicalFilePath().isEmpty()) {
+		target = info.canonicalFilePath();
+	}
+
+	QT_STATBUF statbuf;
+	const bool exists = QT_STAT(QFile::encodeName(target).constData(), &statbuf) == 0;
+
+#ifdef Q_OS_UNIX
+	inPlace_ = exists && statbuf.st_nlink > 1;
+#else
+	inPlace_ = false;
+#endif
+
+	if (inPlace_) {
+		file_ = std::make_unique<QFile>(target);
+	} else {
+		auto saveFile = std::make_unique<QSaveFile>(target);
+		saveFile->setDirectWriteFallback(true);
+		file_ = std::move(saveFile);
+	}
+
+	if (!file_->open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+		error_ = file_->errorString();
+		return false;
+	}
+
+#ifdef Q_OS_UNIX
+	if (exists && !inPlace_) {
+		/* Only root may give a file away, other users can at best keep the
+		   group. Failing to is not an error, it's what happens to the owner
+		   of any file which is saved by someone else. The mode is set after
+		   the owner, since changing the owner clears the set-id bits */
+		if (::fchown(file_->handle(), statbuf.st_uid, statbuf.st_gid) != 0) {
+			if (::fchown(file_->handle(), static_cast<uid_t>(-1), statbuf.st_gid) != 0) {
+				// keep our own group
+			}
+		}
+
+		::fchmod(file_->handle(), statbuf.st_mode & 07777);
+	}
+#else
+	Q_UNUSED(exists)
+#endif
+
+	return true;
+}
+
+/**
+ * Writes the text made up of "first" followed by "second", such as the two
+ * segments of a text buffer, converting its line endings to "format".
+ *
+ * @brief FileWriter::write
+ * @param first
+ * @param second
+ * @param format
+ * @return true on success
+ */
+bool FileWriter::write(view::string_view first, view::string_view second, FileFormats format) {
+
+	if (format == FileFormats::Unix) {
+		if (compressor_) {
+			return writeText(first) && writeText(second);
+		}
+
+		fingerprint_.update(first);
+		fingerprint_.update(second);
+		return writeSegments(first, second);
+	}
+
+	return writeConverted(first, format) && writeConverted(second, format);
+}
+
+/**
+ * @brief FileWriter::writeSegments
+ * @param first
+ * @param second
+ * @return true on success
+ */
+bool FileWriter::writeSegments(view::string_view first, view::string_view second) {
+
+#ifdef Q_OS_UNIX
+	// both pieces in one system call, the file is unbuffered so nothing is waiting ahead of them
+	struct iovec iov[2];
+	iov[0].iov_base = const_cast<char *>(first.data());
+	iov[0].iov_len  = first.size();
+	iov[1].iov_base = const_cast<char *>(second.data());
+	iov[1].iov_len  = second.size();
+
+	struct iovec *vec = iov;
+	int count         = 2;
+
+	while (count != 0) {
+		if (vec->iov_len == 0) {
+			++vec;
+			--count;
+			continue;
+		}
+
+		const ssize_t n = ::writev(file_->handle(), vec, count);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			error_ = systemError();
+			return false;
+		}
+
+		// skip what was written, a write may stop part way through
+		auto written = static_cast<size_t>(n);
+		while (count != 0 && written >= vec->iov_len) {
+			written -= vec->iov_len;
+			++vec;
+			--count;
+		}
+
+		if (count != 0) {
+			vec->iov_base = static_cast<char *>(vec->iov_base) + written;
+			vec->iov_len -= written;
+		}
+	}
+
+	return true;
+#else
+	return writeData(first.data(), static_cast<int64_t>(first.size())) && writeData(second.data(), static_cast<int64_t>(second.size()));
+#endif
+}
+
+/*
+** Write "text" with its newlines converted for "format", a piece at a time.
+** Since every newline converts on its own, the text may be split anywhere.
+*/
+bool FileWriter::writeConverted(view::string_view text, FileFormats format) {
+
+	// a piece may double in size, if it is all newlines
+	chunk_.resize(ChunkSize * 2);
+
+	const char *it  = text.data();
+	const char *end = text.data() + text.size();
+
+	while (it != end) {
+		const char *pieceEnd = it + std::min(static_cast<size_t>(end - it), ChunkSize);
+		char *out            = chunk_.data();
+
+		const view::string_view piece(it, static_cast<size_t>(pieceEnd - it));
+
+		switch (format) {
+		case FileFormats::Dos:
+			out = ConvertToDos(piece, out);
+			break;
+		case FileFormats::Mac:
+			out = ConvertToMac(piece, out);
+			break;
+		case FileFormats::Unix:
+			out = std::copy(piece.begin(), piece.end(), out);
+			break;
+		}
+
+		it = pieceEnd;
+
+		if (!writeText(view::string_view(chunk_.data(), static_cast<size_t>(out - chunk_.data())))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+** Write "text", whose line endings are already as they are to be in the
+** file, compressing it first if the file is compressed. Compressed text is
+** handed over a piece at a time, so that what it compresses to never takes
+** up much more memory than a piece.
+*/
+bool FileWriter::writeText(view::string_view text) {
+
+	if (!compressor_) {
+		fingerprint_.update(text);
+		return writeData(text.data(), static_cast<int64_t>(text.size()));
+	}
+
+	while (!text.empty()) {
+		const view::string_view piece = text.substr(0, ChunkSize);
+		text.remove_prefix(piece.size());
+
+		compressed_.clear();
+		if (!compressor_->compress(piece, &compressed_)) {
+			error_ = compressor_->errorString();
+			return false;
+		}
+
+		fingerprint_.update(compressed_);
+		if (!writeData(compressed_.data(), static_cast<int64_t>(compressed_.size()))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief FileWriter::writeData
+ * @param data
+ * @param size
+ * @return true on success
+ */
+bool FileWriter::writeData(const char *data, int64_t size) {
+
+	while (size > 0) {
+		const qint64 n = file_->write(data, size);
+		if (n <= 0) {
+			error_ = file_->errorString();
+			return false;
+		}
+
+		data += n;
+		size -= n;
+	}
+
+	return true;
+}
+
+/**
+ * Syncs the new version to disk and puts it in place of the original.
+ *
+ * @brief FileWriter::commit
+ * @return true on success
+ */
+bool FileWriter::commit() {
+
+	// the end of the compressed stream, which the compressor may have held on to
+	if (compressor_) {
+		compressed_.clear();
+		if (!compressor_->finish(&compressed_)) {
+			error_ = compressor_->errorString();
+			return false;
+		}
+
+		fingerprint_.update(compressed_);
+		if (!writeData(compressed_.data(), static_cast<int64_t>(compressed_.size()))) {
+			return false;
+		}
+	}
+
+#ifdef Q_OS_UNIX
+	if (::fsync(file_->handle()) != 0) {
+		error_ = systemError();
+		return false;
+	}
+#endif
+
+	if (inPlace_) {
+		file_->close();
+		return true;
+	}
+
+	auto saveFile = static_cast<QSaveFile *>(file_.get());
+	if (!saveFile->commit()) {
+		error_ = saveFile->errorString();
+		return false;
+	}
+
+#ifdef Q_OS_UNIX
+	syncDirectory(QFileInfo(saveFile->fileName()).absolutePath());
+#endif
+
+	return true;
+}
+
+/**
+ * Abandons the new version. The original is untouched unless the file was
+ * being written in place, in which case the partial file is removed.
+ *
+ * @brief FileWriter::cancel
+ */
+void FileWriter::cancel() {
+
+	if (!file_) {
+		return;
+	}
+
+	if (inPlace_) {
+		file_->close();
+		static_cast<QFile *>(file_.get())->remove();
+	} else {
+		static_cast<QSaveFile *>(file_.get())->cancelWriting();
+	}
+}
+
+/**
+ * @brief FileWriter::errorString
+ * @return a description of the last error
+ */
+QString FileWriter::errorString() const {
+	return error_;
+}
+
+/**
+ * @brief FileWriter::fingerprint
+ * @return the fingerprint of the text written so far, as it is in the file
+ */
+uint64_t FileWriter::fingerprint() const {
+	return fingerprint_.value();
+}
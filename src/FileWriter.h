@@ -0,0 +1,71 @@
+
+#ifndef FILE_WRITER_H_
+#define FILE_WRITER_H_
+
+#include "Util/Compression.h"
+#include "Util/Fingerprint.h"
+#include "Util/string_view.h"
+
+#include <QString>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class FileFormats : int;
+class QFileDevice;
+
+/*
+** Writes a new version of a file. The text goes to a temporary file beside
+** the original, which is synced to disk and then renamed over it, so that
+** the original is left as it was if anything fails before the new version
+** is complete. The new file is given the mode, owner and group of the one
+** it replaces, as far as we're allowed to.
+**
+** Files with more than one hard link are written in place, since renaming
+** over them would separate them from their other names. So are files in a
+** directory we can't create the temporary file in.
+**
+** Text is written straight from the caller's memory, converting the line
+** endings in small chunks when the format requires it, rather than making
+** a converted copy of all of it first. The fingerprint of what was written
+** is worked out on the way.
+**
+** When a compression format is set, the text is compressed as it goes, and
+** the fingerprint is that of the compressed file.
+*/
+class FileWriter {
+public:
+	explicit FileWriter(const QString &fileName);
+	FileWriter(const FileWriter &)            = delete;
+	FileWriter &operator=(const FileWriter &) = delete;
+	~FileWriter();
+
+public:
+	void setCompression(const CompressionFormat &format);
+	bool open();
+	bool write(view::string_view first, view::string_view second, FileFormats format);
+	bool commit();
+	void cancel();
+	QString errorString() const;
+	uint64_t fingerprint() const;
+
+private:
+	bool writeData(const char *data, int64_t size);
+	bool writeConverted(view::string_view text, FileFormats format);
+	bool writeSegments(view::string_view first, view::string_view second);
+	bool writeText(view::string_view text);
+
+private:
+	QString fileName_;
+	QString error_;
+	std::unique_ptr<QFileDevice> file_;
+	std::unique_ptr<Compressor> compressor_;
+	std::vector<char> chunk_;  // line ending conversion of the text being written
+	std::string compressed_;   // compressed text, waiting to be written
+	Fingerprint fingerprint_; // of everything written
+	bool inPlace_ = false;
+};
+
+#endif
@@ -0,0 +1,29 @@
+
+#ifndef FUNCTION_TASK_H_
+#define FUNCTION_TASK_H_
+
+#include <QRunnable>
+
+#include <functional>
+
+/**
+ * Adapts a function object so that it can be handed to a QThreadPool.
+ *
+ * @brief The FunctionTask class
+ */
+class FunctionTask final : public QRunnable {
+public:
+	explicit FunctionTask(std::function<void()> function) : function_(std::move(function)) {
+		setAutoDelete(true);
+	}
+
+public:
+	void run() override {
+		function_();
+	}
+
+private:
+	std::function<void()> function_;
+};
+
+#endif
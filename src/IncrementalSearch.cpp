@@ -0,0 +1,542 @@
+
+#include "IncrementalSearch.h"
+#include "FunctionTask.h"
+#include "Preferences.h"
+#include "TextBuffer.h"
+#include "Util/utils.h"
+
+#include <QByteArray>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+
+namespace {
+
+// buffers at least this large are scanned on the worker thread
+constexpr int64_t AsyncThreshold = 1024 * 1024;
+
+// positions are not remembered for strings which match more often than this
+constexpr size_t MaxCandidates = 1024 * 1024;
+
+// how many positions a scan examines between checks for cancellation
+constexpr int64_t CancelCheckInterval = 65536;
+
+/*
+** A literal search string prepared for matching at arbitrary positions, the
+** whole word rules are the same as those of searchLiteralWord in Search.cpp.
+*/
+struct Pattern {
+	std::string ucString;
+	std::string lcString;
+	std::string delimiters;
+	bool wholeWord   = false;
+	bool ignoreLeft  = false;
+	bool ignoreRight = false;
+};
+
+/**
+ * @brief caseSensitivityOf
+ * @param searchType
+ * @return
+ */
+Qt::CaseSensitivity caseSensitivityOf(SearchType searchType) {
+	switch(searchType) {
+	case SearchType::CaseSense:
+	case SearchType::CaseSenseWord:
+	case SearchType::Regex:
+		return Qt::CaseSensitive;
+	default:
+		return Qt::CaseInsensitive;
+	}
+}
+
+/**
+ * @brief isDelimiter
+ * @param ch
+ * @param delimiters
+ * @return
+ */
+bool isDelimiter(char ch, const std::string &delimiters) {
+	return safe_ctype<isspace>(ch) || delimiters.find(ch) != std::string::npos;
+}
+
+/**
+ * @brief makePattern
+ * @param searchString
+ * @param searchType
+ * @param delimiters
+ * @return
+ */
+Pattern makePattern(const std::string &searchString, SearchType searchType, const QString &delimiters) {
+
+	Pattern pattern;
+	pattern.delimiters = delimiters.toStdString();
+	pattern.wholeWord  = (searchType == SearchType::LiteralWord || searchType == SearchType::CaseSenseWord);
+
+	if(caseSensitivityOf(searchType) == Qt::CaseSensitive) {
+		pattern.ucString = searchString;
+		pattern.lcString = searchString;
+	} else {
+		pattern.ucString.reserve(searchString.size());
+		pattern.lcString.reserve(searchString.size());
+		for(char ch : searchString) {
+			pattern.ucString.push_back(static_cast<char>(safe_ctype<toupper>(ch)));
+			pattern.lcString.push_back(static_cast<char>(safe_ctype<tolower>(ch)));
+		}
+	}
+
+	if(!searchString.empty()) {
+		pattern.ignoreLeft  = isDelimiter(searchString.front(), pattern.delimiters);
+		pattern.ignoreRight = isDelimiter(searchString.back(),  pattern.delimiters);
+	}
+
+	return pattern;
+}
+
+/**
+ * @brief matchesAt
+ * @param text
+ * @param pos
+ * @param pattern
+ * @return
+ */
+bool matchesAt(view::string_view text, int64_t pos, const Pattern &pattern) {
+
+	const size_t length = pattern.ucString.size();
+	if(static_cast<size_t>(pos) + length > text.size()) {
+		return false;
+	}
+
+	for(size_t i = 0; i < length; ++i) {
+		const char ch = text[static_cast<size_t>(pos) + i];
+		if(ch != pattern.ucString[i] && ch != pattern.lcString[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief isWordAt
+ * @param text
+ * @param pos
+ * @param pattern
+ * @return
+ */
+bool isWordAt(view::string_view text, int64_t pos, const Pattern &pattern) {
+
+	if(!pattern.wholeWord) {
+		return true;
+	}
+
+	const size_t end = static_cast<size_t>(pos) + pattern.ucString.size();
+
+	const bool right = pattern.ignoreRight || end == text.size() || isDelimiter(text[end], pattern.delimiters);
+	const bool left  = pattern.ignoreLeft  || pos == 0 || isDelimiter(text[static_cast<size_t>(pos - 1)], pattern.delimiters);
+	return left && right;
+}
+
+/**
+ * Finds every position in the text where the pattern matches (ignoring the
+ * whole word rules, which are applied when a position is picked). Returns
+ * false if the scan was cancelled or there were too many positions to keep.
+ *
+ * @brief collectCandidates
+ * @param text
+ * @param pattern
+ * @param cancelled
+ * @param positions
+ * @return
+ */
+bool collectCandidates(view::string_view text, const Pattern &pattern, const std::atomic<bool> *cancelled, std::vector<int64_t> *positions) {
+
+	const auto length = static_cast<int64_t>(pattern.ucString.size());
+	const auto last   = static_cast<int64_t>(text.size()) - length;
+
+	for(int64_t pos = 0; pos <= last; ++pos) {
+		if(cancelled && (pos % CancelCheckInterval) == 0 && *cancelled) {
+			return false;
+		}
+
+		if(matchesAt(text, pos, pattern)) {
+			if(positions->size() == MaxCandidates) {
+				return false;
+			}
+
+			positions->push_back(pos);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Picks the match nearest to beginPos in the given direction from a sorted
+ * list of positions, following the same wrapping rules as Search::SearchString
+ *
+ * @brief pickCandidate
+ * @param text
+ * @param positions
+ * @param pattern
+ * @param direction
+ * @param wrap
+ * @param beginPos
+ * @return
+ */
+boost::optional<Search::Result> pickCandidate(view::string_view text, const std::vector<int64_t> &positions, const Pattern &pattern, Direction direction, WrapMode wrap, int64_t beginPos) {
+
+	auto resultAt = [&pattern](int64_t pos) {
+		Search::Result result;
+		result.start    = pos;
+		result.end      = pos + static_cast<int64_t>(pattern.ucString.size());
+		result.extentBW = result.start;
+		result.extentFW = result.end;
+		return result;
+	};
+
+	if(direction == Direction::Forward) {
+		const auto mid = std::lower_bound(positions.begin(), positions.end(), beginPos);
+
+		for(auto it = mid; it != positions.end(); ++it) {
+			if(isWordAt(text, *it, pattern)) {
+				return resultAt(*it);
+			}
+		}
+
+		if(wrap == WrapMode::NoWrap) {
+			return boost::none;
+		}
+
+		for(auto it = positions.begin(); it != mid; ++it) {
+			if(isWordAt(text, *it, pattern)) {
+				return resultAt(*it);
+			}
+		}
+	} else {
+		// positions before mid start at or before beginPos
+		const auto mid = std::upper_bound(positions.begin(), positions.end(), beginPos);
+
+		for(auto it = std::make_reverse_iterator(mid); it != positions.rend(); ++it) {
+			if(isWordAt(text, *it, pattern)) {
+				return resultAt(*it);
+			}
+		}
+
+		if(wrap == WrapMode::NoWrap) {
+			return boost::none;
+		}
+
+		for(auto it = positions.rbegin(); it != std::make_reverse_iterator(mid); ++it) {
+			if(isWordAt(text, *it, pattern)) {
+				return resultAt(*it);
+			}
+		}
+	}
+
+	return boost::none;
+}
+
+/**
+ * @brief searchDirect
+ * @param text
+ * @param searchString
+ * @param request
+ * @param delimiters
+ * @return
+ */
+boost::optional<Search::Result> searchDirect(view::string_view text, const std::string &searchString, const IncrementalSearch::Request &request, const QByteArray &delimiters) {
+	return Search::SearchString(
+				text,
+				searchString,
+				request.direction,
+				request.searchType,
+				request.wrap,
+				request.beginPos,
+				delimiters.isNull() ? nullptr : delimiters.data());
+}
+
+}
+
+struct IncrementalSearch::Job {
+	Request request;
+	std::shared_ptr<const std::string> text;
+	std::string searchString;
+	QByteArray delimiters;
+	int generation = 0;
+	std::atomic<bool> cancelled{false};
+
+	// written by the worker, only read once it has finished
+	bool complete = false;
+	std::vector<int64_t> positions;
+	boost::optional<Search::Result> result;
+};
+
+/**
+ * @brief IncrementalSearch::IncrementalSearch
+ * @param parent
+ */
+IncrementalSearch::IncrementalSearch(QObject *parent) : QObject(parent) {
+	pool_ = new QThreadPool(this);
+
+	// a scan which has gone stale can't always be interrupted, so leave room
+	// for the scan started by the next keystroke to run next to it
+	pool_->setMaxThreadCount(2);
+}
+
+/**
+ * @brief IncrementalSearch::~IncrementalSearch
+ */
+IncrementalSearch::~IncrementalSearch() {
+	cancel();
+	pool_->waitForDone();
+}
+
+/**
+ * @brief IncrementalSearch::buffer
+ * @return the buffer which the cached results belong to
+ */
+TextBuffer *IncrementalSearch::buffer() const {
+	return buffer_;
+}
+
+/**
+ * @brief IncrementalSearch::revision
+ * @return the revision of the buffer which the cached results belong to
+ */
+int64_t IncrementalSearch::revision() const {
+	return revision_;
+}
+
+/**
+ * Abandons the scan in progress, if any. Its result will not be delivered.
+ *
+ * @brief IncrementalSearch::cancel
+ */
+void IncrementalSearch::cancel() {
+	if(job_) {
+		job_->cancelled = true;
+		job_ = nullptr;
+	}
+}
+
+/**
+ * Abandons the scan in progress and forgets everything remembered about the
+ * current buffer.
+ *
+ * @brief IncrementalSearch::reset
+ */
+void IncrementalSearch::reset() {
+	cancel();
+	cache_.clear();
+	snapshot_ = nullptr;
+	buffer_   = nullptr;
+	revision_ = -1;
+}
+
+/**
+ * Searches the buffer for the request. When allowAsync is true and the answer
+ * requires scanning a large buffer, the scan is started on the worker and
+ * Pending is returned; searchFinished is emitted with the outcome unless a
+ * later call to find, cancel or reset has made it stale first.
+ *
+ * A search which starts outside the buffer and wraps really starts at its
+ * other end, and the start of "request" is moved there, so that the caller
+ * can tell whether the match it gets wrapped around.
+ *
+ * @brief IncrementalSearch::find
+ * @param buffer
+ * @param request
+ * @param allowAsync
+ * @param result
+ * @return
+ */
+IncrementalSearch::Status IncrementalSearch::find(TextBuffer *buffer, Request *request, bool allowAsync, Search::Result *result) {
+
+	cancel();
+
+	if(buffer != buffer_ || buffer->revision() != revision_) {
+		reset();
+		buffer_   = buffer;
+		revision_ = buffer->revision();
+	}
+
+	if(request->searchString.isEmpty()) {
+		return Status::NotFound;
+	}
+
+	const view::string_view text = buffer->BufAsStringEx();
+	const auto fileEnd           = static_cast<int64_t>(text.size()) - 1;
+
+	/* If we're already outside the boundaries, we must consider wrapping
+	   immediately (Note: fileEnd+1 is a valid starting position. Consider
+	   searching for $ at the end of a file ending with \n.) */
+	if ((request->direction == Direction::Forward && request->beginPos > fileEnd + 1) || (request->direction == Direction::Backward && request->beginPos < 0)) {
+		if(request->wrap == WrapMode::NoWrap) {
+			return Status::NotFound;
+		}
+
+		request->beginPos = (request->direction == Direction::Forward) ? 0 : fileEnd + 1;
+	}
+
+	Request effective = *request;
+
+	// whole word literal searches use the default delimiters when there is no language mode
+	if(!Search::isRegexType(effective.searchType) && effective.delimiters.isNull()) {
+		effective.delimiters = Preferences::GetPrefDelimiters();
+	}
+
+	const std::string searchString = effective.searchString.toStdString();
+	const bool large               = static_cast<int64_t>(text.size()) >= AsyncThreshold;
+
+	auto report = [result](const boost::optional<Search::Result> &found) {
+		if(found) {
+			*result = *found;
+			return Status::Found;
+		}
+
+		return Status::NotFound;
+	};
+
+	if(!Search::isRegexType(effective.searchType)) {
+		const Qt::CaseSensitivity caseSensitivity = caseSensitivityOf(effective.searchType);
+		const Pattern pattern = makePattern(searchString, effective.searchType, effective.delimiters);
+
+		if(const Candidates *candidates = cachedCandidates(text, searchString, caseSensitivity)) {
+			return report(pickCandidate(text, candidates->positions, pattern, effective.direction, effective.wrap, effective.beginPos));
+		}
+
+		if(allowAsync) {
+			if(large) {
+				startJob(buffer, effective);
+				return Status::Pending;
+			}
+
+			std::vector<int64_t> positions;
+			if(collectCandidates(text, pattern, nullptr, &positions)) {
+				cache_.push_back(Candidates{searchString, caseSensitivity, std::move(positions)});
+				return report(pickCandidate(text, cache_.back().positions, pattern, effective.direction, effective.wrap, effective.beginPos));
+			}
+		}
+	} else if(allowAsync && large) {
+		startJob(buffer, effective);
+		return Status::Pending;
+	}
+
+	return report(searchDirect(text, searchString, effective, effective.delimiters.toLatin1()));
+}
+
+/**
+ * Returns the positions where searchString occurs if they can be derived from
+ * those remembered for a prefix of it, by re-verifying only the prefix's
+ * positions. Entries which are not prefixes of searchString are discarded.
+ *
+ * @brief IncrementalSearch::cachedCandidates
+ * @param text
+ * @param searchString
+ * @param caseSensitivity
+ * @return
+ */
+const IncrementalSearch::Candidates *IncrementalSearch::cachedCandidates(view::string_view text, const std::string &searchString, Qt::CaseSensitivity caseSensitivity) {
+
+	auto isPrefix = [&searchString, caseSensitivity](const Candidates &candidates) {
+		return candidates.caseSensitivity == caseSensitivity &&
+		       candidates.searchString.size() <= searchString.size() &&
+		       std::equal(candidates.searchString.begin(), candidates.searchString.end(), searchString.begin());
+	};
+
+	// each entry extends the one before it, so the prefixes are all at the front
+	auto it = std::find_if_not(cache_.begin(), cache_.end(), isPrefix);
+	cache_.erase(it, cache_.end());
+
+	if(cache_.empty()) {
+		return nullptr;
+	}
+
+	const Candidates &previous = cache_.back();
+	if(previous.searchString.size() == searchString.size()) {
+		return &previous;
+	}
+
+	const Pattern pattern = makePattern(searchString, caseSensitivity == Qt::CaseSensitive ? SearchType::CaseSense : SearchType::Literal, QString());
+
+	std::vector<int64_t> positions;
+	std::copy_if(previous.positions.begin(), previous.positions.end(), std::back_inserter(positions), [text, &pattern](int64_t pos) {
+		return matchesAt(text, pos, pattern);
+	});
+
+	cache_.push_back(Candidates{searchString, caseSensitivity, std::move(positions)});
+	return &cache_.back();
+}
+
+/**
+ * @brief IncrementalSearch::startJob
+ * @param buffer
+ * @param request
+ */
+void IncrementalSearch::startJob(TextBuffer *buffer, const Request &request) {
+
+	// the snapshot is shared by every scan until the text changes
+	if(!snapshot_) {
+		snapshot_ = std::make_shared<const std::string>(buffer->BufGetAllEx());
+	}
+
+	auto job = std::make_shared<Job>();
+	job->request      = request;
+	job->text         = snapshot_;
+	job->searchString = request.searchString.toStdString();
+	job->delimiters   = request.delimiters.toLatin1();
+	job->generation   = ++generation_;
+	job_ = job;
+
+	pool_->start(new FunctionTask([this, job]() {
+		if(job->cancelled) {
+			return;
+		}
+
+		const view::string_view text(*job->text);
+
+		if(Search::isRegexType(job->request.searchType)) {
+			job->result = searchDirect(text, job->searchString, job->request, job->delimiters);
+		} else {
+			const Pattern pattern = makePattern(job->searchString, job->request.searchType, job->request.delimiters);
+
+			if(collectCandidates(text, pattern, &job->cancelled, &job->positions)) {
+				job->complete = true;
+				job->result   = pickCandidate(text, job->positions, pattern, job->request.direction, job->request.wrap, job->request.beginPos);
+			} else if(!job->cancelled) {
+				// too many matches to remember, just find the next one
+				job->positions.clear();
+				job->result = searchDirect(text, job->searchString, job->request, job->delimiters);
+			}
+		}
+
+		QMetaObject::invokeMethod(this, "jobFinished", Qt::QueuedConnection, Q_ARG(int, job->generation));
+	}));
+}
+
+/**
+ * Runs on the GUI thread once a scan is done, anything still queued by a scan
+ * which has since been replaced is dropped.
+ *
+ * @brief IncrementalSearch::jobFinished
+ * @param generation
+ */
+void IncrementalSearch::jobFinished(int generation) {
+
+	if(!job_ || job_->generation != generation) {
+		return;
+	}
+
+	std::shared_ptr<Job> job = std::move(job_);
+	job_ = nullptr;
+
+	if(job->complete) {
+		cache_.clear();
+		cache_.push_back(Candidates{job->searchString, caseSensitivityOf(job->request.searchType), std::move(job->positions)});
+	}
+
+	Q_EMIT searchFinished(job->request, job->result);
+}
@@ -0,0 +1,93 @@
+
+#ifndef INCREMENTAL_SEARCH_H_
+#define INCREMENTAL_SEARCH_H_
+
+#include "Direction.h"
+#include "Search.h"
+#include "SearchType.h"
+#include "TextBufferFwd.h"
+#include "WrapMode.h"
+#include "Util/string_view.h"
+
+#include <QObject>
+#include <QString>
+
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class QThreadPool;
+
+/*
+** Search engine behind the incremental search bar. As a literal search string
+** grows one keystroke at a time, every match of the new string must also be a
+** match of the previous one, so the positions found for the previous string
+** are kept and only those are re-verified instead of rescanning the buffer.
+** Scans of large buffers which can't be answered from those positions run on
+** a worker thread against a snapshot of the text, a newer keystroke makes any
+** scan still in progress stale.
+*/
+class IncrementalSearch : public QObject {
+	Q_OBJECT
+
+public:
+	struct Request {
+		QString    searchString;
+		QString    delimiters;
+		SearchType searchType = SearchType::Literal;
+		Direction  direction  = Direction::Forward;
+		WrapMode   wrap       = WrapMode::NoWrap;
+		int64_t    beginPos   = 0;
+	};
+
+	enum class Status {
+		Found,
+		NotFound,
+		Pending
+	};
+
+	// state shared between the engine and a scan running on the worker
+	struct Job;
+
+public:
+	explicit IncrementalSearch(QObject *parent = nullptr);
+	~IncrementalSearch() override;
+
+Q_SIGNALS:
+	void searchFinished(const IncrementalSearch::Request &request, const boost::optional<Search::Result> &result);
+
+public:
+	Status find(TextBuffer *buffer, Request *request, bool allowAsync, Search::Result *result);
+	TextBuffer *buffer() const;
+	int64_t revision() const;
+	void cancel();
+	void reset();
+
+private Q_SLOTS:
+	void jobFinished(int generation);
+
+private:
+	struct Candidates {
+		std::string          searchString;
+		Qt::CaseSensitivity  caseSensitivity;
+		std::vector<int64_t> positions;
+	};
+
+private:
+	const Candidates *cachedCandidates(view::string_view text, const std::string &searchString, Qt::CaseSensitivity caseSensitivity);
+	void startJob(TextBuffer *buffer, const Request &request);
+
+private:
+	QThreadPool *pool_;
+	TextBuffer *buffer_ = nullptr;
+	int64_t revision_   = -1;
+	std::vector<Candidates> cache_; // each entry's search string is a prefix of the next one's
+	std::shared_ptr<const std::string> snapshot_;
+	std::shared_ptr<Job> job_;
+	int generation_ = 0;
+};
+
+#endif
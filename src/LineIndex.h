@@ -0,0 +1,116 @@
+
+#ifndef LINE_INDEX_H_
+#define LINE_INDEX_H_
+
+#include "FunctionTask.h"
+
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/*
+** A sparse index of the lines of a text which doesn't change, such as a
+** file mapped into memory: the number of newlines before the start of each
+** block of BlockSize characters. It is built by a worker thread, a block at
+** a time from the start of the text, and the blocks counted so far may be
+** used while it's being built. Counting the lines between two positions
+** then only has to look at the text of the blocks they fall in.
+*/
+template <class Ch>
+class LineIndex : public std::enable_shared_from_this<LineIndex<Ch>> {
+public:
+	static constexpr int64_t BlockSize = 1024 * 1024;
+
+public:
+	LineIndex(std::shared_ptr<const Ch> text, int64_t length) : text_(std::move(text)), length_(length), blocks_((length + BlockSize - 1) / BlockSize) {
+		counts_    = std::make_unique<int64_t[]>(static_cast<size_t>(blocks_ + 1));
+		counts_[0] = 0;
+	}
+
+	LineIndex(const LineIndex &)            = delete;
+	LineIndex &operator=(const LineIndex &) = delete;
+
+public:
+	/*
+	** Start counting in the background. The worker keeps the index, and so
+	** the text, alive until it's done or cancelled.
+	*/
+	void start() {
+		std::shared_ptr<LineIndex> self = this->shared_from_this();
+		QThreadPool::globalInstance()->start(new FunctionTask([self]() {
+			self->build();
+		}));
+	}
+
+	void cancel() noexcept {
+		cancelled_ = true;
+	}
+
+	bool complete() const noexcept {
+		return ready_.load(std::memory_order_acquire) == blocks_;
+	}
+
+	/*
+	** The number of blocks counted so far. The number of lines before the
+	** start of every block up to and including the next one is known.
+	*/
+	int64_t blocksReady() const noexcept {
+		return ready_.load(std::memory_order_acquire);
+	}
+
+	// the number of newlines before the start of "block", which must be ready
+	int64_t linesBefore(int64_t block) const noexcept {
+		return counts_[static_cast<size_t>(block)];
+	}
+
+	/*
+	** The last ready block which starts with no more than "lines" newlines
+	** before it.
+	*/
+	int64_t findBlock(int64_t lines) const noexcept {
+		const int64_t *first = &counts_[0];
+		const int64_t *last  = first + std::min(blocksReady() + 1, blocks_);
+		return (std::upper_bound(first, last, lines) - first) - 1;
+	}
+
+	// the number of newlines in the text, extrapolated from those counted so far
+	int64_t estimateLines() const noexcept {
+		const int64_t ready = blocksReady();
+		if (ready == blocks_) {
+			return counts_[static_cast<size_t>(blocks_)];
+		}
+
+		if (ready == 0) {
+			return length_ / 80;
+		}
+
+		return static_cast<int64_t>(static_cast<double>(counts_[static_cast<size_t>(ready)]) * length_ / (ready * BlockSize));
+	}
+
+private:
+	void build() noexcept {
+
+		const Ch *text = text_.get();
+
+		for (int64_t block = 0; block < blocks_ && !cancelled_; ++block) {
+			const Ch *first = text + block * BlockSize;
+			const Ch *last  = text + std::min(length_, (block + 1) * BlockSize);
+
+			counts_[static_cast<size_t>(block + 1)] = counts_[static_cast<size_t>(block)] + std::count(first, last, Ch('\n'));
+			ready_.store(block + 1, std::memory_order_release);
+		}
+	}
+
+private:
+	std::shared_ptr<const Ch> text_;
+	int64_t length_;
+	int64_t blocks_;
+	std::unique_ptr<int64_t[]> counts_; // newlines before the start of each block, and the total
+	std::atomic<int64_t> ready_{0};     // blocks counted so far
+	std::atomic<bool> cancelled_{false};
+};
+
+#endif
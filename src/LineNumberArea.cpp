@@ -1,9 +1,14 @@
 
 #include "LineNumberArea.h"
+#include "PaintStatistics.h"
 #include "TextArea.h"
 #include "TextBuffer.h"
+#include <QFontMetrics>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QtMath>
+
+#include <algorithm>
 
 /**
  * @brief LineNumberArea::LineNumberArea
@@ -27,22 +32,26 @@ QSize LineNumberArea::sizeHint() const {
  */
 void LineNumberArea::paintEvent(QPaintEvent *event) {
 
+	PaintStatistics::Timer timer(area_->paintStatistics_.get(), PaintStatistics::LineNumbers);
+
 	const int lineHeight = area_->fixedFontHeight_;
+	const QRect rect     = event->rect();
 
 	QPainter painter(this);
 
-	painter.fillRect(event->rect(), area_->lineNumBGColor_);
-	painter.setPen(area_->lineNumFGColor_);
-	painter.setFont(area_->font_);
+	painter.fillRect(rect, area_->lineNumBGColor_);
+	updateDigits(lineHeight);
 
-	// Draw the line numbers, aligned to the text
+	/* Draw the line numbers, aligned to the text. When the text is scrolled,
+	 * the numbers which are still visible are moved along with it, and only
+	 * the rows which were uncovered are drawn here */
 	int y = area_->viewport()->contentsRect().top();
 	int64_t line = area_->getAbsTopLineNum();
 
 #if 0
 	const TextCursor cursor = area_->cursorPos_;
 #endif
-	for (int visLine = 0; visLine < area_->nVisibleLines_; visLine++) {
+	for (int visLine = 0; visLine < area_->nVisibleLines_ && y <= rect.bottom(); visLine++) {
 
 		const TextCursor lineStart = area_->lineStarts_[visLine];
 #if 0
@@ -51,9 +60,9 @@ void LineNumberArea::paintEvent(QPaintEvent *event) {
 		}
 #endif
 		if (lineStart != -1 && (lineStart == 0 || area_->buffer_->BufGetCharacter(lineStart - 1) == '\n')) {
-			const auto number = QString::number(line);
-			QRect rect(Padding, y, width() - (Padding * 2), lineHeight);
-			painter.drawText(rect, Qt::TextSingleLine | Qt::AlignVCenter | Qt::AlignRight, number);
+			if (y + lineHeight > rect.top()) {
+				drawNumber(&painter, line, y);
+			}
 			++line;
 		} else {
 			if (visLine == 0) {
@@ -65,6 +74,73 @@ void LineNumberArea::paintEvent(QPaintEvent *event) {
 	}
 }
 
+/*
+** Draw "number" right aligned in the row at "y", a digit at a time from the
+** strip of digits.
+*/
+void LineNumberArea::drawNumber(QPainter *painter, int64_t number, int y) {
+
+	const qreal ratio = digitsRatio_;
+	int x = width() - Padding;
+
+	do {
+		const auto digit = static_cast<size_t>(number % 10);
+		const int digitWidth = digitWidths_[digit];
+
+		x -= digitWidth;
+		if (x < Padding) {
+			break;
+		}
+
+		painter->drawPixmap(QRectF(x, y, digitWidth, digitsHeight_),
+		                    digits_,
+		                    QRectF(digitOffsets_[digit] * ratio, 0, digitWidth * ratio, digitsHeight_ * ratio));
+		number /= 10;
+	} while (number > 0);
+}
+
+/*
+** Draw the strip of digits again if the font, the colors, the height of the
+** rows or the resolution of the screen changed since it was last drawn.
+*/
+void LineNumberArea::updateDigits(int lineHeight) {
+
+	// fractional on screens scaled by, say, 150%
+	const qreal ratio = devicePixelRatioF();
+
+	if (!digits_.isNull() && digitsFont_ == area_->font_ && digitsFGColor_ == area_->lineNumFGColor_ && digitsBGColor_ == area_->lineNumBGColor_ && digitsHeight_ == lineHeight && digitsRatio_ == ratio) {
+		return;
+	}
+
+	digitsFont_    = area_->font_;
+	digitsFGColor_ = area_->lineNumFGColor_;
+	digitsBGColor_ = area_->lineNumBGColor_;
+	digitsHeight_  = lineHeight;
+	digitsRatio_   = ratio;
+
+	const QFontMetrics fm(digitsFont_);
+
+	int stripWidth = 0;
+	for (size_t i = 0; i < digitWidths_.size(); ++i) {
+		digitOffsets_[i] = stripWidth;
+		digitWidths_[i]  = fm.width(QLatin1Char(static_cast<char>('0' + i)));
+		stripWidth += digitWidths_[i];
+	}
+
+	digits_ = QPixmap(qCeil(std::max(stripWidth, 1) * ratio), qCeil(std::max(lineHeight, 1) * ratio));
+	digits_.setDevicePixelRatio(ratio);
+	digits_.fill(digitsBGColor_);
+
+	QPainter painter(&digits_);
+	painter.setPen(digitsFGColor_);
+	painter.setFont(digitsFont_);
+
+	for (size_t i = 0; i < digitWidths_.size(); ++i) {
+		const QRect rect(digitOffsets_[i], 0, digitWidths_[i], lineHeight);
+		painter.drawText(rect, Qt::TextSingleLine | Qt::AlignVCenter | Qt::AlignLeft, QString(QLatin1Char(static_cast<char>('0' + i))));
+	}
+}
+
 /**
  * @brief LineNumberArea::contextMenuEvent
  * @param event
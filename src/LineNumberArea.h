@@ -2,8 +2,15 @@
 #ifndef LINE_NUMBER_AREA_H_
 #define LINE_NUMBER_AREA_H_
 
+#include <QColor>
+#include <QFont>
+#include <QPixmap>
 #include <QWidget>
 
+#include <array>
+#include <cstdint>
+
+class QPainter;
 class TextArea;
 
 class LineNumberArea : public QWidget {
@@ -26,8 +33,23 @@ protected:
 	void mousePressEvent(QMouseEvent *event) override;
 	void mouseReleaseEvent(QMouseEvent *event) override;
 
+private:
+	void drawNumber(QPainter *painter, int64_t number, int y);
+	void updateDigits(int lineHeight);
+
 private:
 	TextArea *area_;
+
+	/* The digits 0 to 9 drawn side by side in the font and colors of the line
+	 * numbers, numbers are painted by copying their digits from it */
+	QPixmap digits_;
+	std::array<int, 10> digitOffsets_ = {};
+	std::array<int, 10> digitWidths_  = {};
+	QFont digitsFont_;
+	QColor digitsFGColor_;
+	QColor digitsBGColor_;
+	int digitsHeight_  = 0;
+	qreal digitsRatio_ = 0;
 };
 
 #endif
@@ -9,6 +9,8 @@ private:
 	enum Reason : uint32_t {
 		USER_LOCKED_BIT = 1,
 		PERM_LOCKED_BIT = 2,
+		MAP_LOCKED_BIT  = 4,
+		LOAD_LOCKED_BIT = 8,
 	};
 
 public:
@@ -20,6 +22,14 @@ public:
 		return (reasons_ & PERM_LOCKED_BIT) != 0;
 	}
 
+	bool isMapLocked() const {
+		return (reasons_ & MAP_LOCKED_BIT) != 0;
+	}
+
+	bool isLoadLocked() const {
+		return (reasons_ & LOAD_LOCKED_BIT) != 0;
+	}
+
 	bool isAnyLockedIgnoringUser() const {
 		return (reasons_ & ~USER_LOCKED_BIT) != 0;
 	}
@@ -44,6 +54,14 @@ public:
 		setLockedByReason(enabled, PERM_LOCKED_BIT);
 	}
 
+	void setMapLocked(bool enabled) {
+		setLockedByReason(enabled, MAP_LOCKED_BIT);
+	}
+
+	void setLoadLocked(bool enabled) {
+		setLockedByReason(enabled, LOAD_LOCKED_BIT);
+	}
+
 private:
 	void setLockedByReason(bool enabled, Reason reason) {
 		if(enabled) {
@@ -8,6 +8,7 @@
 #include "NeditServer.h"
 #include "Preferences.h"
 #include "Regex.h"
+#include "Session.h"
 #include "Settings.h"
 #include "interpret.h"
 #include "macro.h"
@@ -344,9 +345,20 @@ Main::Main(const QStringList &args) {
 
 	MainWindow::CheckCloseEnableState();
 
-	// If no file to edit was specified, open a window to edit "Untitled"
+	/* If no file to edit was specified, pick up where the last session left
+	   off, or open a window to edit "Untitled" */
 	if (!fileSpecified) {
-		DocumentWidget *document = MainWindow::EditNewFile(nullptr, geometry, iconic, langMode, QString());
+		DocumentWidget *document = nullptr;
+
+		if (Preferences::GetPrefRestoreSession() && Session::restore()) {
+			if(MainWindow *window = MainWindow::firstWindow()) {
+				document = window->currentDocument();
+			}
+		}
+
+		if (!document) {
+			document = MainWindow::EditNewFile(nullptr, geometry, iconic, langMode, QString());
+		}
 
 		document->readMacroInitFile();
 		MainWindow::CheckCloseEnableState();
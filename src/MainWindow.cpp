@@ -7,6 +7,7 @@
 #include "DialogExecuteCommand.h"
 #include "DialogFilter.h"
 #include "DialogFind.h"
+#include "DialogFindInFiles.h"
 #include "DialogFonts.h"
 #include "DialogLanguageModes.h"
 #include "DialogMacros.h"
@@ -23,11 +24,13 @@
 #include "DocumentWidget.h"
 #include "Help.h"
 #include "Highlight.h"
+#include "IncrementalSearch.h"
 #include "LanguageMode.h"
 #include "PatternSet.h"
 #include "Preferences.h"
 #include "Regex.h"
 #include "Search.h"
+#include "Session.h"
 #include "Settings.h"
 #include "SignalBlocker.h"
 #include "SmartIndent.h"
@@ -121,6 +124,20 @@ boost::optional<CharacterLocation> StringToLineAndCol(const QString &text) {
 	return boost::none;
 }
 
+/*
+** Format a number of bytes for the statistics line
+*/
+QString formatByteCount(size_t bytes) {
+
+	if (bytes < 1024) {
+		return MainWindow::tr("%1 bytes").arg(static_cast<qulonglong>(bytes));
+	} else if (bytes < 1024 * 1024) {
+		return MainWindow::tr("%1 KB").arg(static_cast<double>(bytes) / 1024.0, 0, 'f', 1);
+	} else {
+		return MainWindow::tr("%1 MB").arg(static_cast<double>(bytes) / (1024.0 * 1024.0), 0, 'f', 1);
+	}
+}
+
 /**
  * @brief addToGroup
  * @param group
@@ -215,6 +232,9 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags) : QMainWindow(par
 	ui.setupUi(this);
 	connectSlots();
 
+	incrementalSearch_ = new IncrementalSearch(this);
+	connect(incrementalSearch_, &IncrementalSearch::searchFinished, this, &MainWindow::iSearchFinished);
+
 	connect(qApp, &QApplication::focusChanged, this, &MainWindow::focusChanged);
 
 	ui.menu_Windows->setStyleSheet(QLatin1String("QMenu { menu-scrollable: 1; }"));
@@ -2642,17 +2662,22 @@ void MainWindow::on_editIFind_textChanged(const QString &text) {
 	}
 
 	/* Call the incremental search handler to do the searching and
-	   selecting (this allows it to be recorded for learn/replay).  If
-	   there's an incremental search already in progress, mark the operation
-	   as "continued" so the search routine knows to re-start the search
-	   from the original starting position */
+	   selecting.  If there's an incremental search already in progress, mark
+	   the operation as "continued" so the search routine knows to re-start
+	   the search from the original starting position. Unlike searches made
+	   by macros, long scans may finish after this returns, which keeps the
+	   search bar responsive while typing into a large file */
 	if(DocumentWidget *document = currentDocument()) {
-		action_Find_Incremental(document,
-								text,
-								direction,
-								searchType,
-								Preferences::GetPrefSearchWraps(),
-								iSearchStartPos_ != -1);
+		if(QPointer<TextArea> area = lastFocus()) {
+			SearchAndSelectIncrementalEx(document,
+										 area,
+										 text,
+										 direction,
+										 searchType,
+										 Preferences::GetPrefSearchWraps(),
+										 iSearchStartPos_ != -1,
+										 /*allowAsync=*/true);
+		}
 	}
 }
 
@@ -2663,6 +2688,42 @@ void MainWindow::on_action_Find_Incremental_triggered() {
 	BeginISearchEx(Direction::Forward);
 }
 
+/**
+ * @brief MainWindow::action_Find_In_Files_Dialog
+ * @param document
+ */
+void MainWindow::action_Find_In_Files_Dialog(DocumentWidget *document) {
+
+	if(!dialogFindInFiles_) {
+		dialogFindInFiles_ = new DialogFindInFiles(this, document);
+		dialogFindInFiles_->initToggleButtons(Preferences::GetPrefSearch());
+	}
+
+	dialogFindInFiles_->setDocument(document);
+
+	if(dialogFindInFiles_->isVisible()) {
+		dialogFindInFiles_->raise();
+		dialogFindInFiles_->activateWindow();
+		return;
+	}
+
+	dialogFindInFiles_->setTextFieldFromDocument(document);
+	dialogFindInFiles_->updateFindButton();
+
+	dialogFindInFiles_->show();
+	dialogFindInFiles_->raise();
+	dialogFindInFiles_->activateWindow();
+}
+
+/**
+ * @brief MainWindow::on_action_Find_In_Files_triggered
+ */
+void MainWindow::on_action_Find_In_Files_triggered() {
+	if(DocumentWidget *document = currentDocument()) {
+		action_Find_In_Files_Dialog(document);
+	}
+}
+
 /**
  * @brief MainWindow::action_Shift_Find_Incremental
  */
@@ -2688,7 +2749,8 @@ void MainWindow::action_Find_Incremental(DocumentWidget *document, const QString
 									 direction,
 									 searchType,
 									 searchWraps,
-									 isContinue);
+									 isContinue,
+									 /*allowAsync=*/false);
 	}
 }
 
@@ -2949,6 +3011,9 @@ void MainWindow::EndISearchEx() {
 	// Forget the starting position used for the current run of searches
 	iSearchStartPos_ = TextCursor(-1);
 
+	// along with anything remembered from them
+	incrementalSearch_->reset();
+
 	// Mark the end of incremental search history overwriting
 	Search::saveSearchHistory(QString(), QString(), SearchType::Literal, /*isIncremental=*/false);
 
@@ -3845,6 +3910,15 @@ void MainWindow::on_action_Read_Only_toggled(bool state) {
 	}
 }
 
+/**
+ * @brief MainWindow::on_action_Load_Into_Memory_triggered
+ */
+void MainWindow::on_action_Load_Into_Memory_triggered() {
+	if(DocumentWidget *document = currentDocument()) {
+		document->loadIntoMemory();
+	}
+}
+
 /**
  * @brief MainWindow::on_action_Save_Defaults_triggered
  */
@@ -4985,6 +5059,16 @@ void MainWindow::on_action_Revert_to_Saved_triggered() {
 	}
 }
 
+/**
+ * @brief MainWindow::on_action_Follow_Tail_toggled
+ * @param state
+ */
+void MainWindow::on_action_Follow_Tail_toggled(bool state) {
+	if(DocumentWidget *document = currentDocument()) {
+		document->SetFollow(state);
+	}
+}
+
 /**
  * @brief MainWindow::action_New_Window
  * @param document
@@ -5066,6 +5150,11 @@ void MainWindow::action_Exit(DocumentWidget *document) {
 		}
 	}
 
+	// remember what is open for next time, before it's closed
+	if (Preferences::GetPrefRestoreSession()) {
+		Session::save();
+	}
+
 	// Close all files and exit when the last one is closed
 	if (MainWindow::CloseAllFilesAndWindows()) {
 		QApplication::quit();
@@ -6221,10 +6310,7 @@ bool MainWindow::SearchAndSelectEx(DocumentWidget *document, TextArea *area, con
 ** recorded, search from that original position, otherwise, search from the
 ** current cursor position.
 */
-bool MainWindow::SearchAndSelectIncrementalEx(DocumentWidget *document, TextArea *area, const QString &searchString, Direction direction, SearchType searchType, WrapMode searchWrap, bool continued) {
-
-	TextCursor startPos;
-	TextCursor endPos;
+bool MainWindow::SearchAndSelectIncrementalEx(DocumentWidget *document, TextArea *area, const QString &searchString, Direction direction, SearchType searchType, WrapMode searchWrap, bool continued, bool allowAsync) {
 
 	/* If there's a search in progress, start the search from the original
 	   starting position, otherwise search from the cursor position. */
@@ -6240,6 +6326,8 @@ bool MainWindow::SearchAndSelectIncrementalEx(DocumentWidget *document, TextArea
 	   clear the selection, set the cursor back to what would be the
 	   beginning of the search, and return. */
 	if (searchString.isEmpty()) {
+		incrementalSearch_->cancel();
+
 		TextCursor beepBeginPos = (direction == Direction::Backward) ? beginPos - 1 : beginPos;
 		iSearchTryBeepOnWrapEx(direction, beepBeginPos, beepBeginPos);
 		iSearchRecordLastBeginPosEx(direction, iSearchStartPos_);
@@ -6264,24 +6352,50 @@ bool MainWindow::SearchAndSelectIncrementalEx(DocumentWidget *document, TextArea
 		--beginPos;
 	}
 
+	IncrementalSearch::Request request;
+	request.searchString = searchString;
+	request.delimiters   = document->GetWindowDelimitersEx();
+	request.searchType   = searchType;
+	request.direction    = direction;
+	request.wrap         = searchWrap;
+	request.beginPos     = to_integer(beginPos);
+
 	Search::Result searchResult;
 
-	// do the search.  SearchWindow does appropriate dialogs and beeps
-	if (!SearchWindowEx(document, searchString, direction, searchType, searchWrap, to_integer(beginPos), &searchResult)) {
+	switch(incrementalSearch_->find(document->buffer(), &request, allowAsync, &searchResult)) {
+	case IncrementalSearch::Status::Pending:
+		// iSearchFinished makes the selection once the scan is done
+		return true;
+	case IncrementalSearch::Status::NotFound:
+		QApplication::beep();
 		return false;
+	case IncrementalSearch::Status::Found:
+		break;
 	}
 
-	startPos = TextCursor(searchResult.start);
-	endPos   = TextCursor(searchResult.end);
+	return iSearchSelectResultEx(document, area, request, searchResult);
+}
 
+/*
+** Select the match found by an incremental search and move the cursor to
+** its end.
+*/
+bool MainWindow::iSearchSelectResultEx(DocumentWidget *document, TextArea *area, const IncrementalSearch::Request &request, Search::Result searchResult) {
+
+	const TextCursor beginPos = TextCursor(request.beginPos);
+
+	TextCursor startPos = TextCursor(searchResult.start);
+	TextCursor endPos   = TextCursor(searchResult.end);
+
+	iSearchTryBeepOnWrapEx(request.direction, beginPos, startPos);
 
 	iSearchLastBeginPos_ = startPos;
 
 	/* if the search matched an empty string (possible with regular exps)
 	   beginning at the start of the search, go to the next occurrence,
 	   otherwise repeated finds will get "stuck" at zero-length matches */
-	if (direction == Direction::Forward && beginPos == startPos && beginPos == endPos) {
-		if (!SearchWindowEx(document, searchString, direction, searchType, searchWrap, to_integer(beginPos + 1), &searchResult)) {
+	if (request.direction == Direction::Forward && beginPos == startPos && beginPos == endPos) {
+		if (!SearchWindowEx(document, request.searchString, request.direction, request.searchType, request.wrap, to_integer(beginPos + 1), &searchResult)) {
 			return false;
 		}
 
@@ -6299,6 +6413,36 @@ bool MainWindow::SearchAndSelectIncrementalEx(DocumentWidget *document, TextArea
 	return true;
 }
 
+/*
+** Called when an incremental search which was handed off to a worker thread
+** completes. The result is only used if the search is still in progress and
+** the text hasn't changed in the meantime.
+*/
+void MainWindow::iSearchFinished(const IncrementalSearch::Request &request, const boost::optional<Search::Result> &result) {
+
+	DocumentWidget *document = currentDocument();
+	if (!document || iSearchStartPos_ == -1) {
+		return;
+	}
+
+	TextBuffer *buffer = document->buffer();
+	if (buffer != incrementalSearch_->buffer() || buffer->revision() != incrementalSearch_->revision()) {
+		return;
+	}
+
+	QPointer<TextArea> area = lastFocus();
+	if (!area) {
+		return;
+	}
+
+	if (!result) {
+		QApplication::beep();
+		return;
+	}
+
+	iSearchSelectResultEx(document, area, request, *result);
+}
+
 /*
 ** Replace selection with "replaceString" and search for string "searchString"
 ** in window "window", using algorithm "searchType" and direction "direction"
@@ -7217,6 +7361,16 @@ void MainWindow::updateStatus(DocumentWidget *document, TextArea *area) {
 		}
 	}
 
+	// what a mapped file goes without until it's loaded into memory, see DocumentWidget::doOpen
+	if (document->lockReasons().isMapLocked()) {
+		string += tr(", mapped: no highlighting or continuous wrap until loaded into memory");
+	}
+
+	// Include the memory held by the undo history once there is any
+	if (const size_t undoMemory = document->undoMemoryUsage()) {
+		string += tr(", undo %1").arg(formatByteCount(undoMemory));
+	}
+
 	// Update the line/column number
 	document->ui.labelStats->setText(slinecol);
 
@@ -7241,6 +7395,7 @@ void MainWindow::updateWindowReadOnly(DocumentWidget *document) {
 	if(document->isTopDocument()) {
 		no_signals(ui.action_Read_Only)->setChecked(state);
 		ui.action_Read_Only->setEnabled(!document->lockReasons().isAnyLockedIgnoringUser());
+		ui.action_Load_Into_Memory->setEnabled(document->lockReasons().isMapLocked());
 	}
 }
 
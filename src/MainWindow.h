@@ -5,6 +5,7 @@
 #include "CloseMode.h"
 #include "CommandSource.h"
 #include "Direction.h"
+#include "IncrementalSearch.h"
 #include "IndentStyle.h"
 #include "NewMode.h"
 #include "SearchType.h"
@@ -29,6 +30,7 @@ class TextArea;
 class DocumentWidget;
 class DialogReplace;
 class DialogFind;
+class DialogFindInFiles;
 struct MenuData;
 struct TextRange;
 
@@ -67,13 +69,14 @@ public:
 	bool DoNamedShellMenuCmd(DocumentWidget *document, TextArea *area, const QString &name, CommandSource source);
 	bool GetIncrementalSearchLineMS() const;
 	bool GetShowLineNumbers() const;
+	bool iSearchSelectResultEx(DocumentWidget *document, TextArea *area, const IncrementalSearch::Request &request, Search::Result searchResult);
 	bool prefOrUserCancelsSubstEx(DocumentWidget *document);
 	bool ReplaceAllEx(DocumentWidget *document, TextArea *area, const QString &searchString, const QString &replaceString, SearchType searchType);
 	bool ReplaceAndSearchEx(DocumentWidget *document, TextArea *area, const QString &searchString, const QString &replaceString, Direction direction, SearchType searchType, WrapMode searchWrap);
 	bool ReplaceSameEx(DocumentWidget *document, TextArea *area, Direction direction, WrapMode searchWrap);
 	bool SearchAndReplaceEx(DocumentWidget *document, TextArea *area, const QString &searchString, const QString &replaceString, Direction direction, SearchType searchType, WrapMode searchWrap);
 	bool SearchAndSelectEx(DocumentWidget *document, TextArea *area, const QString &searchString, Direction direction, SearchType searchType, WrapMode searchWrap);
-	bool SearchAndSelectIncrementalEx(DocumentWidget *document, TextArea *area, const QString &searchString, Direction direction, SearchType searchType, WrapMode searchWrap, bool continued);
+	bool SearchAndSelectIncrementalEx(DocumentWidget *document, TextArea *area, const QString &searchString, Direction direction, SearchType searchType, WrapMode searchWrap, bool continued, bool allowAsync);
 	bool SearchAndSelectSameEx(DocumentWidget *document, TextArea *area, Direction direction, WrapMode searchWrap);
 	bool searchMatchesSelectionEx(DocumentWidget *document, const QString &searchString, SearchType searchType, TextRange *textRange, TextCursor *extentBW, TextCursor *extentFW);
 	bool SearchWindowEx(DocumentWidget *document, const QString &searchString, Direction direction, SearchType searchType, WrapMode searchWrap, int64_t beginPos, Search::Result *searchResult);
@@ -170,6 +173,7 @@ public Q_SLOTS:
 	void action_Find_Dialog(DocumentWidget *document, Direction direction, SearchType type, bool keepDialog);
 	void action_Find(DocumentWidget *document, const QString &string, Direction direction, SearchType type, WrapMode searchWrap);
 	void action_Find_Incremental(DocumentWidget *document, const QString &searchString, Direction direction, SearchType searchType, WrapMode searchWraps, bool isContinue);
+	void action_Find_In_Files_Dialog(DocumentWidget *document);
 	void action_Find_Selection(DocumentWidget *document, Direction direction, SearchType type, WrapMode wrap);
 	void action_Goto_Line_Number(DocumentWidget *document);
 	void action_Goto_Line_Number(DocumentWidget *document, const QString &s);
@@ -299,6 +303,7 @@ public Q_SLOTS:
 	void on_action_Save_triggered();
 	void on_action_Save_As_triggered();
 	void on_action_Revert_to_Saved_triggered();
+	void on_action_Follow_Tail_toggled(bool state);
 	void on_action_Exit_triggered();
 
 	// Edit Menu
@@ -323,6 +328,7 @@ public Q_SLOTS:
 	void on_action_Find_Again_triggered();
 	void on_action_Find_Selection_triggered();
 	void on_action_Find_Incremental_triggered();
+	void on_action_Find_In_Files_triggered();
 	void on_action_Replace_triggered();
 	void on_action_Replace_Find_Again_triggered();
 	void on_action_Replace_Again_triggered();
@@ -354,6 +360,7 @@ public Q_SLOTS:
 	void on_action_Matching_Syntax_toggled(bool state);
 	void on_action_Overtype_toggled(bool state);
 	void on_action_Read_Only_toggled(bool state);
+	void on_action_Load_Into_Memory_triggered();
 	void on_action_Save_Defaults_triggered();
 
 	// Preferences Defaults
@@ -406,6 +413,7 @@ public Q_SLOTS:
 
 private Q_SLOTS:
 	void focusChanged(QWidget *from, QWidget *to);
+	void iSearchFinished(const IncrementalSearch::Request &request, const boost::optional<Search::Result> &result);
 
 public Q_SLOTS:
 	void selectionChanged(bool selected);
@@ -423,9 +431,11 @@ public:
 
 private:
 	QList<QAction *>        previousOpenFilesList_;
-	QPointer<DialogFind>    dialogFind_;
-	QPointer<DialogReplace> dialogReplace_;
-	QPointer<TextArea>      lastFocus_;
+	QPointer<DialogFind>        dialogFind_;
+	QPointer<DialogFindInFiles> dialogFindInFiles_;
+	QPointer<DialogReplace>     dialogReplace_;
+	QPointer<TextArea>          lastFocus_;
+	IncrementalSearch          *incrementalSearch_;
 
 private:
 	bool iSearchLastLiteralCase_    = false;          // idem, for literal mode
@@ -337,6 +337,12 @@ void NeditServer::newConnection() {
 		}
 
 		DocumentWidget *document = MainWindow::FindWindowWithFile(fi->filename, fi->pathname);
+
+		// a document of the last session has its file read now, rather than when its turn comes
+		if (document && !document->loadDeferred()) {
+			document = nullptr;
+		}
+
 		if (!document) {
 			/* Files are opened in background to improve opening speed
 			   by defering certain time  consuiming task such as syntax
@@ -0,0 +1,207 @@
+
+#include "PaintStatistics.h"
+
+#include <algorithm>
+
+namespace {
+
+const char *const PhaseNames[] = {
+	"line starts",
+	"styles",
+	"drawString",
+	"line numbers",
+	"frame"
+};
+
+const char *const CounterNames[] = {
+	"lines redrawn",
+	"lines laid out",
+	"bytes copied"
+};
+
+/**
+ * @brief formatMsecs
+ * @param nsecs
+ * @return
+ */
+QString formatMsecs(int64_t nsecs) {
+	return QString::number(static_cast<double>(nsecs) / 1000000.0, 'f', 2);
+}
+
+}
+
+/**
+ * @brief PaintStatistics::Timer::Timer
+ * @param stats
+ * @param phase
+ */
+PaintStatistics::Timer::Timer(PaintStatistics *stats, Phase phase) : stats_(stats), phase_(phase) {
+
+	if (stats_ && stats_->timing_[phase_]) {
+		stats_ = nullptr;
+	}
+
+	if (stats_) {
+		stats_->timing_[phase_] = true;
+		timer_.start();
+	}
+}
+
+/**
+ * @brief PaintStatistics::Timer::~Timer
+ */
+PaintStatistics::Timer::~Timer() {
+	if (stats_) {
+		stats_->timing_[phase_] = false;
+		stats_->addTime(phase_, timer_.nsecsElapsed());
+	}
+}
+
+/**
+ * @brief PaintStatistics::add
+ * @param counter
+ * @param n
+ */
+void PaintStatistics::add(Counter counter, int64_t n) {
+	pendingCounts_[counter] += n;
+}
+
+/**
+ * Adds to the time spent in "phase" during the current frame, the time of
+ * the Frame phase completes it.
+ *
+ * @brief PaintStatistics::addTime
+ * @param phase
+ * @param nsecs
+ */
+void PaintStatistics::addTime(Phase phase, int64_t nsecs) {
+	pendingTimes_[phase] += nsecs;
+
+	if (phase == Frame) {
+		endFrame();
+	}
+}
+
+/**
+ * @brief PaintStatistics::endFrame
+ */
+void PaintStatistics::endFrame() {
+
+	for (int i = 0; i < PhaseCount; ++i) {
+		timeHistograms_[i].add(pendingTimes_[i] / 1000);
+	}
+
+	for (int i = 0; i < CounterCount; ++i) {
+		countHistograms_[i].add(pendingCounts_[i]);
+	}
+
+	lastTimes_  = pendingTimes_;
+	lastCounts_ = pendingCounts_;
+	pendingTimes_.fill(0);
+	pendingCounts_.fill(0);
+}
+
+/**
+ * @brief PaintStatistics::reset
+ */
+void PaintStatistics::reset() {
+	pendingTimes_.fill(0);
+	pendingCounts_.fill(0);
+	lastTimes_.fill(0);
+	lastCounts_.fill(0);
+	timeHistograms_.fill(Histogram());
+	countHistograms_.fill(Histogram());
+}
+
+/**
+ * @brief PaintStatistics::frames
+ * @return the number of frames recorded
+ */
+int64_t PaintStatistics::frames() const {
+	return timeHistograms_[Frame].samples;
+}
+
+/**
+ * @brief PaintStatistics::summary
+ * @return a short description of the last frame
+ */
+QString PaintStatistics::summary() const {
+	return QString(QLatin1String("frame %1 ms: starts %2, styles %3, draw %4, numbers %5\n%6 lines redrawn, %7 laid out, %8 bytes copied"))
+	        .arg(formatMsecs(lastTimes_[Frame]),
+	             formatMsecs(lastTimes_[LineStarts]),
+	             formatMsecs(lastTimes_[Styles]),
+	             formatMsecs(lastTimes_[Drawing]),
+	             formatMsecs(lastTimes_[LineNumbers]),
+	             QString::number(lastCounts_[LinesRedrawn]),
+	             QString::number(lastCounts_[LinesLaidOut]),
+	             QString::number(lastCounts_[BytesCopied]));
+}
+
+/**
+ * @brief PaintStatistics::report
+ * @return the histograms of all the frames recorded
+ */
+QString PaintStatistics::report() const {
+
+	QString report = QString(QLatin1String("%1 frames\n")).arg(frames());
+
+	for (int i = 0; i < PhaseCount; ++i) {
+		report += timeHistograms_[i].format(QLatin1String(PhaseNames[i]), QLatin1String("us"));
+	}
+
+	for (int i = 0; i < CounterCount; ++i) {
+		report += countHistograms_[i].format(QLatin1String(CounterNames[i]), QLatin1String("count"));
+	}
+
+	return report;
+}
+
+/**
+ * Records a value in the bucket of values which have the same number of
+ * significant bits, zero has a bucket of its own.
+ *
+ * @brief PaintStatistics::Histogram::add
+ * @param value
+ */
+void PaintStatistics::Histogram::add(int64_t value) {
+
+	int bucket = 0;
+	for (int64_t n = value; n > 0 && bucket < Buckets - 1; n >>= 1) {
+		++bucket;
+	}
+
+	++counts[static_cast<size_t>(bucket)];
+	++samples;
+	total += value;
+	max = std::max(max, value);
+}
+
+/**
+ * @brief PaintStatistics::Histogram::format
+ * @param name
+ * @param unit
+ * @return
+ */
+QString PaintStatistics::Histogram::format(const QString &name, const QString &unit) const {
+
+	QString text = QString(QLatin1String("\n%1 (%2): mean %3, max %4\n"))
+	        .arg(name,
+	             unit,
+	             QString::number(samples ? total / samples : 0),
+	             QString::number(max));
+
+	for (int i = 0; i < Buckets; ++i) {
+		if (counts[static_cast<size_t>(i)] == 0) {
+			continue;
+		}
+
+		QString range = QLatin1String("0");
+		if (i != 0) {
+			range = QString(QLatin1String("%1-%2")).arg(int64_t(1) << (i - 1)).arg((int64_t(1) << i) - 1);
+		}
+
+		text += QString(QLatin1String("  %1 %2\n")).arg(range, 12).arg(counts[static_cast<size_t>(i)]);
+	}
+
+	return text;
+}
@@ -0,0 +1,93 @@
+
+#ifndef PAINT_STATISTICS_H_
+#define PAINT_STATISTICS_H_
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include <array>
+#include <cstdint>
+
+/*
+** Timings and counts of the work done to repaint a text area, recorded while
+** its paint instrumentation is enabled. The time spent in each phase, and the
+** number of lines and bytes handled, are added up for every frame (one paint
+** of the text) and kept in histograms with power of two buckets, so that the
+** occasional slow frame stands out rather than being averaged away.
+**
+** Work done outside of a paint, such as computing the line starts when the
+** view scrolls, or painting the line numbers, is charged to the next frame.
+*/
+class PaintStatistics {
+public:
+	enum Phase {
+		LineStarts,  // computing the starts of the displayed lines
+		Styles,      // resolving (and highlighting) the styles of the text
+		Drawing,     // drawString
+		LineNumbers, // LineNumberArea::paintEvent
+		Frame,       // TextArea::paintEvent, completes the frame
+		PhaseCount
+	};
+
+	enum Counter {
+		LinesRedrawn,
+		LinesLaidOut,
+		BytesCopied,
+		CounterCount
+	};
+
+	/*
+	** Times a phase for as long as it is in scope. Nested timers of a phase
+	** which is already being timed are ignored, so that it isn't counted
+	** twice. Does nothing if "stats" is null.
+	*/
+	class Timer {
+	public:
+		Timer(PaintStatistics *stats, Phase phase);
+		Timer(const Timer &)            = delete;
+		Timer &operator=(const Timer &) = delete;
+		~Timer();
+
+	private:
+		PaintStatistics *stats_;
+		Phase phase_;
+		QElapsedTimer timer_;
+	};
+
+public:
+	void add(Counter counter, int64_t n);
+	void addTime(Phase phase, int64_t nsecs);
+	void reset();
+
+public:
+	int64_t frames() const;
+	QString summary() const;
+	QString report() const;
+
+private:
+	static constexpr int Buckets = 32;
+
+	struct Histogram {
+		std::array<int64_t, Buckets> counts = {};
+		int64_t samples = 0;
+		int64_t total   = 0;
+		int64_t max     = 0;
+
+		void add(int64_t value);
+		QString format(const QString &name, const QString &unit) const;
+	};
+
+private:
+	void endFrame();
+
+private:
+	std::array<int64_t, PhaseCount> pendingTimes_        = {}; // nanoseconds, of the frame being painted
+	std::array<int64_t, CounterCount> pendingCounts_     = {};
+	std::array<int64_t, PhaseCount> lastTimes_           = {}; // of the last complete frame
+	std::array<int64_t, CounterCount> lastCounts_        = {};
+	std::array<Histogram, PhaseCount> timeHistograms_    = {}; // microseconds per frame
+	std::array<Histogram, CounterCount> countHistograms_ = {};
+	std::array<bool, PhaseCount> timing_                 = {};
+};
+
+#endif
@@ -1008,6 +1008,14 @@ int GetPrefMaxPrevOpenFiles() {
 	return Settings::maxPrevOpenFiles;
 }
 
+int GetPrefMapFileThreshold() {
+	return Settings::mapFileThreshold;
+}
+
+bool GetPrefRestoreSession() {
+	return Settings::restoreSession;
+}
+
 bool GetPrefTypingHidesPointer() {
 	return Settings::typingHidesPointer;
 }
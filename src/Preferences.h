@@ -61,6 +61,8 @@ namespace Preferences  {
 	int GetPrefLineNums();
 	bool GetPrefMatchSyntaxBased();
 	int GetPrefMaxPrevOpenFiles();
+	int GetPrefMapFileThreshold();
+	bool GetPrefRestoreSession();
 	int GetPrefRows();
 	int GetPrefShowPathInWindowsMenu();
 	int GetPrefSmartTags();
@@ -0,0 +1,95 @@
+
+#include "ProgressTask.h"
+#include "FunctionTask.h"
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QProgressDialog>
+#include <QThreadPool>
+#include <QTimer>
+
+namespace {
+
+// how often the GUI thread looks at how the operation is doing, in milliseconds
+constexpr int PollInterval = 50;
+
+// operations which are over sooner than this, in milliseconds, show no dialog
+constexpr int MinimumDuration = 500;
+
+// the resolution of the progress bar, totals may not fit in an int
+constexpr int Steps = 1000;
+
+}
+
+/**
+ * @brief ProgressTask::ProgressTask
+ * @param parent
+ * @param label what the dialog says is going on
+ * @param total the amount of work, in whatever unit the operation reports it
+ */
+ProgressTask::ProgressTask(QWidget *parent, const QString &label, int64_t total) : parent_(parent), label_(label), total_(total) {
+}
+
+/**
+ * Runs "work" on a worker thread and waits for it to finish, even if it was
+ * cancelled, since it may refer to the caller's data. An exception thrown by
+ * "work" is thrown again here.
+ *
+ * @brief ProgressTask::exec
+ * @param work
+ * @return false if the operation was cancelled
+ */
+bool ProgressTask::exec(const std::function<void(ProgressTask &)> &work) {
+
+	QProgressDialog dialog(label_, QCoreApplication::translate("ProgressTask", "Cancel"), 0, Steps, parent_);
+	dialog.setWindowModality(Qt::ApplicationModal);
+	dialog.setMinimumDuration(MinimumDuration);
+	dialog.setAutoReset(false);
+	dialog.setAutoClose(false);
+
+	QObject::connect(&dialog, &QProgressDialog::canceled, [this, &dialog]() {
+		canceled_ = true;
+		dialog.setLabelText(QCoreApplication::translate("ProgressTask", "Cancelling..."));
+	});
+
+	QEventLoop loop;
+	bool modal = false;
+	QTimer timer;
+	timer.setInterval(PollInterval);
+	QObject::connect(&timer, &QTimer::timeout, &loop, [this, &dialog, &loop, &modal]() {
+		if (finished_.load(std::memory_order_acquire) || (dialog.isVisible() && !modal)) {
+			loop.quit();
+			return;
+		}
+
+		if (total_ > 0 && !canceled_) {
+			dialog.setValue(static_cast<int>(static_cast<double>(done_.load(std::memory_order_relaxed)) * Steps / total_));
+		}
+	});
+
+	QThreadPool::globalInstance()->start(new FunctionTask([this, &work]() {
+		try {
+			work(*this);
+		} catch (...) {
+			exception_ = std::current_exception();
+		}
+
+		finished_.store(true, std::memory_order_release);
+	}));
+
+	/* until the dialog shows up, nothing stops the user from interacting
+	   with the windows the operation works on, so input waits till then */
+	timer.start();
+	loop.exec(QEventLoop::ExcludeUserInputEvents);
+
+	if (!finished_.load(std::memory_order_acquire)) {
+		modal = true;
+		loop.exec();
+	}
+
+	if (exception_) {
+		std::rethrow_exception(exception_);
+	}
+
+	return !canceled_;
+}
@@ -0,0 +1,50 @@
+
+#ifndef PROGRESS_TASK_H_
+#define PROGRESS_TASK_H_
+
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+
+class QWidget;
+
+/*
+** Runs a long operation, such as reading or writing a large compressed
+** file, on a worker thread. Meanwhile the GUI thread keeps processing
+** events, and shows how far the operation got in an application modal
+** progress dialog, from which it can be cancelled. The operation reports
+** its progress and checks for cancellation through the task it is given.
+*/
+class ProgressTask {
+public:
+	ProgressTask(QWidget *parent, const QString &label, int64_t total);
+	ProgressTask(const ProgressTask &)            = delete;
+	ProgressTask &operator=(const ProgressTask &) = delete;
+
+public:
+	bool exec(const std::function<void(ProgressTask &)> &work);
+
+public:
+	// for the operation, on the worker thread
+	void setDone(int64_t done) noexcept {
+		done_.store(done, std::memory_order_relaxed);
+	}
+
+	bool isCanceled() const noexcept {
+		return canceled_.load(std::memory_order_relaxed);
+	}
+
+private:
+	QWidget *parent_;
+	QString label_;
+	int64_t total_;
+	std::exception_ptr exception_;
+	std::atomic<int64_t> done_{0};
+	std::atomic<bool> canceled_{false};
+	std::atomic<bool> finished_{false};
+};
+
+#endif
@@ -4,6 +4,8 @@
 #include <gsl/gsl_util>
 #include <string>
 #include <array>
+#include <algorithm>
+#include <iterator>
 
 namespace {
 
@@ -22,15 +24,24 @@ constexpr std::array<uint8_t, N_RANGESETS> rangeset_labels = {
 // --------------------------------------------------------------------------
 
 void RangesetBufModifiedCB(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled, view::string_view deletedText, void *user) {
-	Q_UNUSED(nRestyled)
 
 	if(auto *table = static_cast<RangesetTable *>(user)) {
 		if ((nInserted != nDeleted) || table->buffer_->compare(pos, deletedText) != 0) {
 			table->updatePos(pos, nInserted, nDeleted);
+		} else if (nRestyled != 0) {
+			// changed rangesets are redisplayed (see RangesetRefreshRange)
+			table->invalidateColorRuns(pos, pos + nRestyled);
 		}
 	}
 }
 
+/*
+** Does the rangeset take part in coloring the text?
+*/
+bool isColored(const Rangeset &set) {
+	return set.color_set_ >= 0 && !set.color_name_.isNull();
+}
+
 }
 
 /**
@@ -76,6 +87,7 @@ void RangesetTable::forgetLabel(int label) {
 
 	if(it != sets_.end()) {
 		sets_.erase(it);
+		colorRunsValid_ = false;
 	}
 }
 
@@ -97,13 +109,18 @@ QString RangesetTable::getColorName(size_t index) const {
 */
 size_t RangesetTable::index1ofPos(TextCursor pos, bool needs_color) {
 
-	for(size_t i = 0; i < sets_.size(); ++i) {
-		Rangeset &set = sets_[i];
-		if (set.RangesetCheckRangeOfPos(pos) >= 0) {
-			if (needs_color && set.color_set_ >= 0 && !set.color_name_.isNull()) {
-				return i + 1;
-			}
-		}
+	if (!needs_color) {
+		return 0;
+	}
+
+	updateColorRuns();
+
+	auto it = std::upper_bound(colorRuns_.begin(), colorRuns_.end(), pos, [](TextCursor p, const ColorRun &run) {
+		return p < run.end;
+	});
+
+	if (it != colorRuns_.end() && it->start <= pos) {
+		return it->index;
 	}
 
 	return 0;
@@ -118,8 +135,14 @@ void RangesetTable::assignColor(size_t index, const QColor &color) {
 
 	Rangeset &set = sets_[index];
 
+	const bool wasColored = isColored(set);
+
 	set.color_set_ = color.isValid() ? 1 : -1;
 	set.color_     = color;
+
+	if (isColored(set) != wasColored) {
+		colorRunsValid_ = false;
+	}
 }
 
 /*
@@ -153,15 +176,213 @@ std::vector<uint8_t> RangesetTable::labels() const {
 	return list;
 }
 
+/*
+** Adjust the rangesets, and the index of the text they color, for the
+** insertion of "ins" characters and the deletion of "del" characters at
+** "pos".
+**
+** Whatever their update mode, the rangesets only change within the text
+** which was inserted, the rest of their ranges are kept or moved along with
+** the text. So the runs of the index are moved likewise, and only the runs
+** covering the inserted text are built again.
+*/
 void RangesetTable::updatePos(TextCursor pos, int64_t ins, int64_t del) {
 
 	if (ins == 0 && del == 0) {
 		return;
 	}
 
+	// pending changes refer to the rangesets as they are before this one
+	updateColorRuns();
+
 	for(Rangeset &set : sets_)  {
 		set.update_(&set, pos, ins, del);
 	}
+
+	if (!colorRunsValid_) {
+		return;
+	}
+
+	const TextCursor delEnd = pos + del;
+	const int64_t delta     = ins - del;
+
+	std::vector<ColorRun> runs;
+	runs.reserve(colorRuns_.size() + 1);
+
+	for (const ColorRun &run : colorRuns_) {
+		if (run.end <= pos) {
+			runs.push_back(run);
+			continue;
+		}
+
+		// the part before the change stays, the part after it moves
+		if (run.start < pos) {
+			runs.push_back({run.start, pos, run.index});
+		}
+
+		if (run.end > delEnd) {
+			runs.push_back({std::max(run.start, delEnd) + delta, run.end + delta, run.index});
+		}
+	}
+
+	colorRuns_ = std::move(runs);
+
+	if (ins != 0) {
+		rebuildColorRuns(pos, pos + ins);
+	}
+}
+
+/*
+** Return in "runs" the runs of colored text overlapping [start, end), clipped
+** to that range.
+*/
+void RangesetTable::colorRuns(TextCursor start, TextCursor end, std::vector<ColorRun> *runs) {
+
+	runs->clear();
+	updateColorRuns();
+
+	auto it = std::upper_bound(colorRuns_.begin(), colorRuns_.end(), start, [](TextCursor pos, const ColorRun &run) {
+		return pos < run.end;
+	});
+
+	for (; it != colorRuns_.end() && it->start < end; ++it) {
+		runs->push_back({std::max(it->start, start), std::min(it->end, end), it->index});
+	}
+}
+
+/*
+** Mark the runs of colored text overlapping [start, end) to be built again
+** before they are next used.
+*/
+void RangesetTable::invalidateColorRuns(TextCursor start, TextCursor end) {
+
+	if (!colorRunsValid_) {
+		return;
+	}
+
+	if (dirtyStart_ < dirtyEnd_) {
+		dirtyStart_ = std::min(dirtyStart_, start);
+		dirtyEnd_   = std::max(dirtyEnd_, end);
+	} else {
+		dirtyStart_ = start;
+		dirtyEnd_   = end;
+	}
+}
+
+/*
+** Build the parts of the index which were marked as out of date.
+*/
+void RangesetTable::updateColorRuns() {
+
+	if (!colorRunsValid_) {
+		colorRuns_.clear();
+		buildColorRuns(TextCursor(), buffer_->BufEndOfBuffer(), &colorRuns_);
+		colorRunsValid_ = true;
+		dirtyStart_     = TextCursor();
+		dirtyEnd_       = TextCursor();
+	} else if (dirtyStart_ < dirtyEnd_) {
+		rebuildColorRuns(dirtyStart_, dirtyEnd_);
+		dirtyStart_ = TextCursor();
+		dirtyEnd_   = TextCursor();
+	}
+}
+
+/*
+** Replace the runs of the index within [start, end) with ones built from the
+** rangesets.
+*/
+void RangesetTable::rebuildColorRuns(TextCursor start, TextCursor end) {
+
+	std::vector<ColorRun> runs;
+
+	auto first = std::upper_bound(colorRuns_.begin(), colorRuns_.end(), start, [](TextCursor pos, const ColorRun &run) {
+		return pos < run.end;
+	});
+
+	auto last = std::lower_bound(first, colorRuns_.end(), end, [](const ColorRun &run, TextCursor pos) {
+		return run.start < pos;
+	});
+
+	// keep the parts of the runs at either end which lie outside of the range
+	if (first != last && first->start < start) {
+		runs.push_back({first->start, start, first->index});
+	}
+
+	buildColorRuns(start, end, &runs);
+
+	if (first != last && std::prev(last)->end > end) {
+		runs.push_back({end, std::prev(last)->end, std::prev(last)->index});
+	}
+
+	const auto index = first - colorRuns_.begin();
+	colorRuns_.erase(first, last);
+	colorRuns_.insert(colorRuns_.begin() + index, runs.begin(), runs.end());
+}
+
+/*
+** Append to "runs" the runs of text within [start, end) colored by the
+** rangesets. Where rangesets overlap, the one earliest in the table colors
+** the text.
+*/
+void RangesetTable::buildColorRuns(TextCursor start, TextCursor end, std::vector<ColorRun> *runs) const {
+
+	struct Boundary {
+		TextCursor pos;
+		size_t     set;
+	};
+
+	std::vector<Boundary> boundaries;
+
+	for (size_t i = 0; i < sets_.size(); ++i) {
+		const Rangeset &set = sets_[i];
+		if (!isColored(set)) {
+			continue;
+		}
+
+		auto it = std::upper_bound(set.ranges_.begin(), set.ranges_.end(), start, [](TextCursor pos, const TextRange &range) {
+			return pos < range.end;
+		});
+
+		for (; it != set.ranges_.end() && it->start < end; ++it) {
+			boundaries.push_back({std::max(it->start, start), i});
+			boundaries.push_back({std::min(it->end, end), i});
+		}
+	}
+
+	std::sort(boundaries.begin(), boundaries.end(), [](const Boundary &lhs, const Boundary &rhs) {
+		return lhs.pos < rhs.pos;
+	});
+
+	/* Sweep across the boundaries, keeping track of which rangesets cover the
+	 * text between them. The ranges of a rangeset don't overlap, so each
+	 * boundary toggles whether its rangeset covers the text which follows */
+	static_assert(N_RANGESETS <= 64, "rangesets must fit in a 64 bit mask");
+
+	uint64_t covering = 0;
+	TextCursor runStart;
+
+	for (size_t i = 0; i < boundaries.size(); ) {
+		const TextCursor pos = boundaries[i].pos;
+
+		if (covering != 0 && runStart < pos) {
+			size_t index = 0;
+			while (!(covering & (uint64_t(1) << index))) {
+				++index;
+			}
+
+			if (!runs->empty() && runs->back().end == runStart && runs->back().index == index + 1) {
+				runs->back().end = pos;
+			} else {
+				runs->push_back({runStart, pos, index + 1});
+			}
+		}
+
+		for (; i < boundaries.size() && boundaries[i].pos == pos; ++i) {
+			covering ^= (uint64_t(1) << boundaries[i].set);
+		}
+
+		runStart = pos;
+	}
 }
 
 /*
@@ -184,9 +405,26 @@ int RangesetTable::RangesetCreate() {
 	const uint8_t label  = rangeset_labels[labelIndex];
 
 	sets_.insert(sets_.begin(), Rangeset(buffer_, label));
+	colorRunsValid_ = false;
 	return label;
 }
 
+/*
+** Create a rangeset with a given label, such as one which was saved along
+** with a session, ahead of those which exist already. Returns null if the
+** label isn't valid or is in use.
+*/
+Rangeset *RangesetTable::RangesetRestore(uint8_t label) {
+
+	if(!LabelOK(label) || RangesetFetch(label)) {
+		return nullptr;
+	}
+
+	sets_.insert(sets_.begin(), Rangeset(buffer_, label));
+	colorRunsValid_ = false;
+	return &sets_.front();
+}
+
 /*
 ** Return true if label is a valid identifier for a range set.
 */
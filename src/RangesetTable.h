@@ -6,7 +6,27 @@
 #include "TextCursor.h"
 #include <vector>
 
+/*
+** The rangesets of a document. Besides the sets themselves, the table keeps
+** a merged index of the text they color: a sorted list of runs, each of
+** which is covered by the same first colored rangeset, so the painter can
+** find which rangeset colors each character of a line in a single lookup
+** rather than searching every rangeset in turn.
+**
+** The index is moved along with the rangesets as the text is modified (see
+** updatePos). Any other change to a rangeset is followed by a request to
+** redisplay the range it affected, which marks that range of the index to be
+** built again before it is next used.
+*/
 class RangesetTable {
+public:
+	// text colored by the rangeset at "index - 1" in the table
+	struct ColorRun {
+		TextCursor start;
+		TextCursor end;
+		size_t     index;
+	};
+
 public:
 	explicit RangesetTable(TextBuffer *buffer);
 	RangesetTable(const RangesetTable &)            = delete;
@@ -16,6 +36,7 @@ public:
 public:
 	QString getColorName(size_t index) const;
 	Rangeset *RangesetFetch(int label);
+	Rangeset *RangesetRestore(uint8_t label);
 	int RangesetCreate();
 	int getColorValid(size_t index, QColor *color) const;
 	int rangesetsAvailable() const;
@@ -24,13 +45,26 @@ public:
 	void forgetLabel(int label);
 	void assignColor(size_t index, const QColor &color);
 	void updatePos(TextCursor pos, int64_t ins, int64_t del);
+	void colorRuns(TextCursor start, TextCursor end, std::vector<ColorRun> *runs);
+	void invalidateColorRuns(TextCursor start, TextCursor end);
 
 public:
 	static bool LabelOK(int label);
 
+private:
+	void buildColorRuns(TextCursor start, TextCursor end, std::vector<ColorRun> *runs) const;
+	void rebuildColorRuns(TextCursor start, TextCursor end);
+	void updateColorRuns();
+
 public:
 	TextBuffer *buffer_;
 	std::vector<Rangeset> sets_;
+
+private:
+	std::vector<ColorRun> colorRuns_;  // sorted, non-overlapping
+	bool colorRunsValid_ = false;      // if not, the whole index is to be built again
+	TextCursor dirtyStart_;            // the range of the index to be built again
+	TextCursor dirtyEnd_;
 };
 
 #endif
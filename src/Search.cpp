@@ -643,6 +643,21 @@ bool Search::SearchString(view::string_view string, const QString &searchString,
 
 }
 
+/**
+ * @brief Search::SearchString
+ * @param string
+ * @param searchString
+ * @param direction
+ * @param searchType
+ * @param wrap
+ * @param beginPos
+ * @param delimiters
+ * @return
+ */
+boost::optional<Search::Result> Search::SearchString(view::string_view string, view::string_view searchString, Direction direction, SearchType searchType, WrapMode wrap, int64_t beginPos, const char *delimiters) {
+	return SearchStringEx(string, searchString, direction, searchType, wrap, beginPos, delimiters);
+}
+
 bool Search::replaceUsingRE(const QString &searchStr, const QString &replaceStr, view::string_view sourceStr, int64_t beginPos, std::string &dest, int prevChar, const QString &delimiters, int defaultFlags) {
 	return replaceUsingRegex(
 				searchStr.toStdString(),
@@ -0,0 +1,332 @@
+
+#include "Session.h"
+#include "DocumentWidget.h"
+#include "MainWindow.h"
+#include "Settings.h"
+
+#include <QApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPointer>
+#include <QSaveFile>
+#include <QTimer>
+#include <QtDebug>
+
+#include <deque>
+#include <memory>
+
+namespace {
+
+/* The session file is a small header followed by each window, with the
+   documents open in it. All numbers are stored big endian (QDataStream) */
+constexpr quint32 SessionMagic   = 0x4e535331; // "NSS1"
+constexpr quint32 SessionVersion = 2;
+
+// sessions of this version on have the fingerprints of the files
+constexpr quint32 FingerprintVersion = 2;
+
+// how long to hold off reading files in the background while a dialog is up, in milliseconds
+constexpr int ModalRetryInterval = 250;
+
+struct SessionWindow {
+	QByteArray geometry;
+	quint32 current = 0; // the document which was shown
+	std::vector<SessionDocument> documents;
+};
+
+using PendingDocuments = std::shared_ptr<std::deque<QPointer<DocumentWidget>>>;
+
+/**
+ * @brief writeDocument
+ * @param stream
+ * @param document
+ */
+void writeDocument(QDataStream &stream, const SessionDocument &document) {
+
+	stream << document.fileName
+	       << document.languageMode
+	       << static_cast<qint64>(document.modTime)
+	       << static_cast<qint64>(document.fileSize)
+	       << static_cast<bool>(document.fingerprint)
+	       << static_cast<quint64>(document.fingerprint ? *document.fingerprint : 0)
+	       << static_cast<qint64>(document.cursor)
+	       << static_cast<qint32>(document.topLine)
+	       << static_cast<qint32>(document.horizontal)
+	       << static_cast<quint32>(document.rangesets.size());
+
+	for(const SessionRangeset &rangeset : document.rangesets) {
+		stream << static_cast<quint8>(rangeset.label)
+		       << rangeset.name
+		       << rangeset.color
+		       << rangeset.mode
+		       << static_cast<quint32>(rangeset.ranges.size());
+
+		for(const std::pair<int64_t, int64_t> &range : rangeset.ranges) {
+			stream << static_cast<qint64>(range.first) << static_cast<qint64>(range.second);
+		}
+	}
+}
+
+/**
+ * @brief readDocument
+ * @param stream
+ * @param version of the session
+ * @param document
+ * @return true on success
+ */
+bool readDocument(QDataStream &stream, quint32 version, SessionDocument *document) {
+
+	qint64 modTime;
+	qint64 fileSize;
+	bool hasFingerprint = false;
+	quint64 fingerprint = 0;
+	qint64 cursor;
+	qint32 topLine;
+	qint32 horizontal;
+	quint32 rangesets;
+
+	stream >> document->fileName >> document->languageMode >> modTime >> fileSize;
+	if(version >= FingerprintVersion) {
+		stream >> hasFingerprint >> fingerprint;
+	}
+
+	stream >> cursor >> topLine >> horizontal >> rangesets;
+	if(stream.status() != QDataStream::Ok) {
+		return false;
+	}
+
+	document->modTime    = modTime;
+	document->fileSize   = fileSize;
+	if(hasFingerprint) {
+		document->fingerprint = fingerprint;
+	}
+
+	document->cursor     = cursor;
+	document->topLine    = topLine;
+	document->horizontal = horizontal;
+
+	for(quint32 i = 0; i < rangesets; ++i) {
+		SessionRangeset rangeset;
+
+		quint8 label;
+		quint32 ranges;
+		stream >> label >> rangeset.name >> rangeset.color >> rangeset.mode >> ranges;
+		if(stream.status() != QDataStream::Ok) {
+			return false;
+		}
+
+		rangeset.label = label;
+
+		for(quint32 j = 0; j < ranges; ++j) {
+			qint64 start;
+			qint64 end;
+			stream >> start >> end;
+			if(stream.status() != QDataStream::Ok) {
+				return false;
+			}
+
+			rangeset.ranges.emplace_back(start, end);
+		}
+
+		document->rangesets.push_back(std::move(rangeset));
+	}
+
+	return true;
+}
+
+/**
+ * @brief readSession
+ * @param fileName
+ * @param windows
+ * @return true if the file holds a session
+ */
+bool readSession(const QString &fileName, std::vector<SessionWindow> *windows) {
+
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	QDataStream stream(&file);
+
+	quint32 magic;
+	quint32 version;
+	quint32 count;
+	stream >> magic >> version >> count;
+	if(stream.status() != QDataStream::Ok || magic != SessionMagic || version == 0 || version > SessionVersion) {
+		return false;
+	}
+
+	for(quint32 i = 0; i < count; ++i) {
+		SessionWindow window;
+
+		quint32 documents;
+		stream >> window.geometry >> window.current >> documents;
+		if(stream.status() != QDataStream::Ok) {
+			return false;
+		}
+
+		for(quint32 j = 0; j < documents; ++j) {
+			SessionDocument document;
+			if(!readDocument(stream, version, &document)) {
+				return false;
+			}
+
+			window.documents.push_back(std::move(document));
+		}
+
+		windows->push_back(std::move(window));
+	}
+
+	return true;
+}
+
+/*
+** Read the files of the documents in "pending" which haven't been yet, one
+** per pass through the event loop so that the windows stay responsive.
+*/
+void loadInBackground(const PendingDocuments &pending) {
+
+	QTimer::singleShot(0, [pending]() {
+
+		// a file which can't be read puts up a message, which can wait for any dialog already up
+		if(QApplication::activeModalWidget()) {
+			QTimer::singleShot(ModalRetryInterval, [pending]() {
+				loadInBackground(pending);
+			});
+			return;
+		}
+
+		while(!pending->empty()) {
+			QPointer<DocumentWidget> document = pending->front();
+			pending->pop_front();
+
+			if(document && document->isDeferred()) {
+				document->loadDeferred();
+				break;
+			}
+		}
+
+		if(!pending->empty()) {
+			loadInBackground(pending);
+		}
+	});
+}
+
+}
+
+namespace Session {
+
+/**
+ * Writes the documents open in each window to the session file, replacing
+ * the last session. Untitled documents are left out.
+ *
+ * @brief save
+ * @return true on success
+ */
+bool save() {
+
+	const QString fileName = Settings::sessionFile();
+	QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+	QSaveFile file(fileName);
+	if(!file.open(QIODevice::WriteOnly)) {
+		qWarning("NEdit: unable to save session file %s", qPrintable(fileName));
+		return false;
+	}
+
+	std::vector<SessionWindow> windows;
+	for(MainWindow *window : MainWindow::allWindows()) {
+		SessionWindow entry;
+		entry.geometry = window->saveGeometry();
+
+		DocumentWidget *current = window->currentDocument();
+		for(DocumentWidget *document : window->openDocuments()) {
+			if(boost::optional<SessionDocument> state = document->sessionState()) {
+				if(document == current) {
+					entry.current = static_cast<quint32>(entry.documents.size());
+				}
+
+				entry.documents.push_back(std::move(*state));
+			}
+		}
+
+		if(!entry.documents.empty()) {
+			windows.push_back(std::move(entry));
+		}
+	}
+
+	QDataStream stream(&file);
+	stream << SessionMagic << SessionVersion << static_cast<quint32>(windows.size());
+
+	for(const SessionWindow &window : windows) {
+		stream << window.geometry << window.current << static_cast<quint32>(window.documents.size());
+		for(const SessionDocument &document : window.documents) {
+			writeDocument(stream, document);
+		}
+	}
+
+	if(stream.status() != QDataStream::Ok || !file.commit()) {
+		qWarning("NEdit: unable to save session file %s", qPrintable(fileName));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Opens the windows and documents of the last session. Files which are
+ * already open, or which no longer exist, are skipped.
+ *
+ * @brief restore
+ * @return true if any document was restored
+ */
+bool restore() {
+
+	std::vector<SessionWindow> windows;
+	if(!readSession(Settings::sessionFile(), &windows)) {
+		return false;
+	}
+
+	auto pending  = std::make_shared<std::deque<QPointer<DocumentWidget>>>();
+	bool restored = false;
+
+	for(const SessionWindow &entry : windows) {
+
+		auto window = new MainWindow();
+
+		QPointer<DocumentWidget> current;
+		for(size_t i = 0; i < entry.documents.size(); ++i) {
+			if(DocumentWidget *document = DocumentWidget::openDeferred(window, entry.documents[i])) {
+				if(i == entry.current || !current) {
+					current = document;
+				}
+
+				pending->push_back(document);
+			}
+		}
+
+		if(!current) {
+			window->deleteLater();
+			continue;
+		}
+
+		window->restoreGeometry(entry.geometry);
+		window->show();
+
+		// the document on display is read right away, raising it may already have
+		current->raiseDocument();
+		if(current && current->isDeferred()) {
+			current->loadDeferred();
+		}
+
+		restored = true;
+	}
+
+	loadInBackground(pending);
+	return restored;
+}
+
+}
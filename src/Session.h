@@ -0,0 +1,54 @@
+
+#ifndef SESSION_H_
+#define SESSION_H_
+
+#include <QString>
+
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct SessionRangeset {
+	uint8_t label = 0;
+	QString name;
+	QString color;
+	QString mode;
+	std::vector<std::pair<int64_t, int64_t>> ranges;
+};
+
+/*
+** What a session remembers of a document: the file, how it was being looked
+** at, and the rangesets marked in it. The rangesets and positions are only
+** restored if the file still has the contents it had when the session was
+** saved, as told by its size and fingerprint, since they wouldn't mark the
+** same text otherwise.
+*/
+struct SessionDocument {
+	QString fileName;     // full path of the file
+	QString languageMode; // empty for plain text
+	int64_t modTime  = 0;
+	int64_t fileSize = 0;
+	boost::optional<uint64_t> fingerprint; // of the file, none if it was mapped
+	int64_t cursor   = 0;
+	int topLine      = 1;
+	int horizontal   = 0;
+	std::vector<SessionRangeset> rangesets;
+};
+
+/*
+** The documents open in each window when NEdit exits, so that they can be
+** opened again the next time it starts. Restoring creates all of the windows
+** and tabs right away, but only reads the file of the document shown in each
+** window. The others are read in the background afterwards, one at a time
+** between events, or as soon as they're shown.
+*/
+namespace Session {
+
+bool save();
+bool restore();
+
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include "Highlight.h"
 #include "LanguageMode.h"
 #include "LineNumberArea.h"
+#include "PaintStatistics.h"
 #include "Preferences.h"
 #include "RangesetTable.h"
 #include "SmartIndentEvent.h"
@@ -20,8 +21,10 @@
 #include <QApplication>
 #include <QClipboard>
 #include <QDesktopWidget>
+#include <QElapsedTimer>
 #include <QFocusEvent>
 #include <QFontDatabase>
+#include <QLabel>
 #include <QMenu>
 #include <QMessageBox>
 #include <QMimeData>
@@ -36,6 +39,9 @@
 #include <QtDebug>
 #include <QtGlobal>
 
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 #include <memory>
 #include <gsl/gsl_util>
 
@@ -85,6 +91,9 @@ constexpr int DefaultCursorWidth = 2;
 
 constexpr int SIZE_HINT_DURATION = 1000;
 
+// How often the paint statistics overlay is updated, in milliseconds
+constexpr int PAINT_STATISTICS_INTERVAL = 250;
+
 constexpr int CALLTIP_EDGE_GUARD = 5;
 
 // Length of delay in milliseconds for vertical autoscrolling
@@ -130,6 +139,25 @@ constexpr uint32_t RANGESET_MASK     = (0x3f << RANGESET_SHIFT);
    stack in the redisplayLine routine for drawing strings */
 constexpr int MAX_DISP_LINE_LEN = 1000;
 
+/* Displayed lines at least this long are handled as long lines: only the part
+   of them which is horizontally visible is fetched and styled when they are
+   drawn, and display columns are found from checkpoints rather than by
+   counting from the start of the line */
+constexpr int LONG_LINE_LENGTH = 64 * 1024;
+
+// number of characters between the column checkpoints of a long line
+constexpr int64_t LONG_LINE_STEP = 4096;
+
+// how many long lines have their column checkpoints kept
+constexpr size_t LONG_LINE_CACHE_SIZE = 8;
+
+/* How many characters of text are measured for the wrapped line index each
+   time the application is idle */
+constexpr int64_t WRAP_INDEX_SLICE = 256 * 1024;
+
+// how often to check whether the lines of a mapped file have been counted, in milliseconds
+constexpr int LINE_COUNT_INTERVAL = 250;
+
 /**
  * @brief offscreenV
  * @param desktop
@@ -259,6 +287,40 @@ int countNewlines(view::string_view string) {
 	return static_cast<int>(std::count(string.begin(), string.end(), '\n'));
 }
 
+/**
+ * Removes the entries of a cache of displayed lines which overlap the buffer
+ * positions "start" to "end" inclusive.
+ *
+ * @brief dropLines
+ * @param lines
+ * @param start
+ * @param end
+ */
+template <class Line>
+void dropLines(std::vector<Line> *lines, TextCursor start, TextCursor end) {
+	lines->erase(std::remove_if(lines->begin(), lines->end(), [start, end](const Line &entry) {
+		return entry.lineStart <= end && entry.lineStart + entry.length >= start;
+	}), lines->end());
+}
+
+/**
+ * Moves the entries of a cache of displayed lines which start after "pos" by
+ * "delta" characters.
+ *
+ * @brief shiftLines
+ * @param lines
+ * @param pos
+ * @param delta
+ */
+template <class Line>
+void shiftLines(std::vector<Line> *lines, TextCursor pos, int64_t delta) {
+	for (Line &entry : *lines) {
+		if (entry.lineStart > pos) {
+			entry.lineStart += delta;
+		}
+	}
+}
+
 void ringIfNecessary(bool silent) {
 	if (!silent) {
 		QApplication::beep();
@@ -493,11 +555,21 @@ TextArea::TextArea(DocumentWidget *document, TextBuffer *buffer, const QFont &fo
 	autoScrollTimer_  = new QTimer(this);
 	cursorBlinkTimer_ = new QTimer(this);
 	clickTimer_       = new QTimer(this);
+	wrapIndexTimer_   = new QTimer(this);
+	lineCountTimer_   = new QTimer(this);
+	redisplayTimer_   = new QTimer(this);
 	lineNumberArea_   = new LineNumberArea(this);
 
 	autoScrollTimer_->setSingleShot(true);
 	connect(autoScrollTimer_,  &QTimer::timeout, this, &TextArea::autoScrollTimerTimeout);
 	connect(cursorBlinkTimer_, &QTimer::timeout, this, &TextArea::cursorBlinkTimerTimeout);
+	connect(wrapIndexTimer_,   &QTimer::timeout, this, &TextArea::wrapIndexTimerTimeout);
+
+	lineCountTimer_->setInterval(LINE_COUNT_INTERVAL);
+	connect(lineCountTimer_,   &QTimer::timeout, this, &TextArea::lineCountTimerTimeout);
+
+	redisplayTimer_->setSingleShot(true);
+	connect(redisplayTimer_,   &QTimer::timeout, this, &TextArea::flushRedisplay);
 
 	clickTimer_->setSingleShot(true);
 	connect(clickTimer_, &QTimer::timeout, this, [this]() {
@@ -535,6 +607,7 @@ TextArea::TextArea(DocumentWidget *document, TextBuffer *buffer, const QFont &fo
 	if (buffer) {
 		buffer->BufAddModifyCB(bufModifiedCB, this);
 		buffer->BufAddPreDeleteCB(bufPreDeleteCB, this);
+		updateSelectionStates();
 	}
 
 	// Update the display to reflect the contents of the buffer
@@ -884,6 +957,9 @@ TextArea::~TextArea() {
  */
 void TextArea::verticalScrollBar_valueChanged(int value) {
 
+	// rows waiting to be repainted must be marked before they are moved
+	flushRedisplay();
+
 	// Limit the requested scroll position to allowable values
 	if(continuousWrap_) {
 		if ((value > topLineNum_) && (value > (nBufferLines_ + 2 + cursorVPadding_ - nVisibleLines_))) {
@@ -892,6 +968,7 @@ void TextArea::verticalScrollBar_valueChanged(int value) {
 	}
 
 	const int lineDelta = topLineNum_ - value;
+	const int hOffset   = horizontalScrollBar()->value();
 
 	/* If the vertical scroll position has changed, update the line
 	   starts array and related counters in the text display */
@@ -903,15 +980,24 @@ void TextArea::verticalScrollBar_valueChanged(int value) {
 	updateVScrollBarRange();
 	updateHScrollBarRange();
 
-	// NOTE(eteran): the original code seemed to do some cleverness
-	//               involving copying the parts that were "moved"
-	//               to avoid doing some work. For now, we'll just repaint
-	//               the whole thing. It's not as fast/clever, but it'll work
-	viewport()->update();
+	/* When scrolling by less than a screen, shift the text which is already
+	 * displayed (and the line numbers along with it) and only paint the lines
+	 * which were uncovered. offsetLineStarts has salvaged the line starts of
+	 * the lines which are still visible, so only the new ones were counted */
+	if (blitScrolling_ && lineDelta != 0 && std::abs(lineDelta) < nVisibleLines_ && hOffset == horizontalScrollBar()->value()) {
+		const int dy = lineDelta * fixedFontHeight_;
+		viewport()->scroll(0, dy, viewport()->contentsRect());
+		lineNumberArea_->scroll(0, dy);
+		cursor_.ry() += dy;
+	} else {
+		viewport()->update();
+		if (lineDelta != 0) {
+			repaintLineNumbers();
+		}
+	}
 
-	// Refresh line number/calltip display if its up and we've scrolled vertically
+	// Refresh calltip display if its up and we've scrolled vertically
 	if (lineDelta != 0) {
-		repaintLineNumbers();
 		updateCalltip(0);
 	}
 }
@@ -921,13 +1007,22 @@ void TextArea::verticalScrollBar_valueChanged(int value) {
  * @param value
  */
 void TextArea::horizontalScrollBar_valueChanged(int value) {
-	Q_UNUSED(value)
 
-	// NOTE(eteran): the original code seemed to do some cleverness
-	//               involving copying the parts that were "moved"
-	//               to avoid doing some work. For now, we'll just repaint
-	//               the whole thing. It's not as fast/clever, but it'll work
-	viewport()->update();
+	// rows waiting to be repainted must be marked before they are moved
+	flushRedisplay();
+
+	const QRect viewRect = viewport()->contentsRect();
+	const int dx         = hScrollOffset_ - value;
+
+	hScrollOffset_ = value;
+
+	// as with vertical scrolling, shift the existing text and paint the uncovered strip
+	if (blitScrolling_ && dx != 0 && std::abs(dx) < viewRect.width()) {
+		viewport()->scroll(dx, 0, viewRect);
+		cursor_.rx() += dx;
+	} else {
+		viewport()->update();
+	}
 }
 
 /**
@@ -948,6 +1043,8 @@ void TextArea::cursorBlinkTimerTimeout() {
  */
 void TextArea::autoScrollTimerTimeout() {
 
+	flushRedisplay();
+
 	const QRect viewRect    = viewport()->contentsRect();
 	const int fontWidth     = fixedFontWidth_;
 	const int fontHeight    = fixedFontHeight_;
@@ -1309,6 +1406,11 @@ void TextArea::mouseReleaseEvent(QMouseEvent *event) {
  */
 void TextArea::paintEvent(QPaintEvent *event) {
 
+	PaintStatistics::Timer frameTimer(paintStatistics_.get(), PaintStatistics::Frame);
+	if (paintStatistics_ && !paintStatisticsTimer_->isActive()) {
+		paintStatisticsTimer_->start();
+	}
+
 	const QRect viewRect = viewport()->contentsRect();
 	const QRect rect = event->rect();
 	const int top    = rect.top();
@@ -1349,6 +1451,10 @@ void TextArea::resizeEvent(QResizeEvent *event) {
 
 	const QRect cr = contentsRect();
 	lineNumberArea_->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
+
+	if (paintStatistics_) {
+		showPaintStatistics();
+	}
 }
 
 /**
@@ -1397,12 +1503,32 @@ void TextArea::bufModifiedCallback(TextCursor pos, int64_t nInserted, int64_t nD
 		cursorPreferredCol_ = -1;
 	}
 
+	const std::array<SelectionState, 3> oldSelections = selections_;
+	updateSelectionStates();
+
+	// drop or move the rendered lines that the modification affects
+	updateLineCache(pos, nInserted, nDeleted, nRestyled);
+
+	// a rectangular selection which only moved its edges needs just the changed columns repainted
+	if (nInserted == 0 && nDeleted == 0 && redisplayRectSelection(oldSelections, pos, nRestyled)) {
+		return;
+	}
+
+	// keep the display rows of the logical lines up to date before counting lines below
+	updateWrapIndex(pos, nInserted, nDeleted, deletedText);
+
 	/* Count the number of lines inserted and deleted, and in the case
 	   of continuous wrap mode, how much has changed */
 	if (continuousWrap_) {
 		findWrapRangeEx(deletedText, pos, nInserted, nDeleted, &wrapModStart, &wrapModEnd, &linesInserted, &linesDeleted);
 	} else {
-		linesInserted = (nInserted == 0) ? 0 : buffer_->BufCountLines(pos, pos + nInserted);
+		/* only a whole file is ever inserted while its lines are still being
+		   counted, see TextBuffer::BufSetMapped */
+		if (nInserted != 0 && !buffer_->BufLinesCounted()) {
+			linesInserted = countBufferLines();
+		} else {
+			linesInserted = (nInserted == 0) ? 0 : buffer_->BufCountLines(pos, pos + nInserted);
+		}
 		linesDeleted  = (nDeleted  == 0) ? 0 : countNewlines(deletedText);
 	}
 
@@ -1432,12 +1558,14 @@ void TextArea::bufModifiedCallback(TextCursor pos, int64_t nInserted, int64_t nD
 
 	/* Update the scroll bar ranges (and value if the value changed).  Note
 	   that updating the horizontal scroll bar range requires scanning the
-	   entire displayed text, however, it doesn't seem to hurt performance
-	   much.  Note also, that the horizontal scroll bar update routine is
-	   allowed to re-adjust horizOffset if there is blank space to the right
-	   of all lines of text. */
+	   entire displayed text, so it is put off until the burst of changes
+	   this one may be part of is over (see flushRedisplay). The horizontal
+	   scroll bar update routine is allowed to re-adjust horizOffset if there
+	   is blank space to the right of all lines of text, which is repainted
+	   by horizontalScrollBar_valueChanged. */
 	updateVScrollBarRange();
-	scrolled |= updateHScrollBarRange();
+	hScrollRangeDirty_ = true;
+	scheduleRedisplay();
 
 	// Update the cursor position
 	if (cursorToHint_ != NO_HINT) {
@@ -1483,11 +1611,11 @@ void TextArea::bufModifiedCallback(TextCursor pos, int64_t nInserted, int64_t nD
 		   be affected (the insertion or removal of a line break always
 		   results in at least two lines being redrawn). */
 		if (linesInserted > 1) {
-			repaintLineNumbers();
+			repaintLineNumbers(startDispPos);
 		}
 	} else { // linesInserted != linesDeleted
 		endDispPos = lastChar_ + 1;
-		repaintLineNumbers();
+		repaintLineNumbers(startDispPos);
 	}
 
 	/* If there is a style buffer, check if the modification caused additional
@@ -2151,6 +2279,8 @@ bool TextArea::updateLineStarts(TextCursor pos, int64_t charsInserted, int64_t c
 */
 void TextArea::calcLineStarts(int startLine, int endLine) {
 
+	PaintStatistics::Timer timer(paintStatistics_.get(), PaintStatistics::LineStarts);
+
 	const TextCursor bufEnd = buffer_->BufEndOfBuffer();
 	TextCursor lineEnd;
 	TextCursor nextLineStart;
@@ -2341,7 +2471,11 @@ TextCursor TextArea::TextDCountForwardNLines(TextCursor startPos, int nLines, bo
 */
 void TextArea::offsetAbsLineNum(TextCursor oldFirstChar) {
 	if (maintainingAbsTopLineNum()) {
-		if (firstChar_ < oldFirstChar) {
+		if (wrapIndexCovers(firstChar_)) {
+			int64_t lineStart;
+			int64_t rowsBefore;
+			absTopLineNum_ = static_cast<int>(wrapIndex_.findLineByPos(to_integer(firstChar_), &lineStart, &rowsBefore)) + 1;
+		} else if (firstChar_ < oldFirstChar) {
 			absTopLineNum_ -= buffer_->BufCountLines(firstChar_, oldFirstChar);
 		} else {
 			absTopLineNum_ += buffer_->BufCountLines(oldFirstChar, firstChar_);
@@ -2349,6 +2483,202 @@ void TextArea::offsetAbsLineNum(TextCursor oldFirstChar) {
 	}
 }
 
+/*
+** Forget the wrapped line index, because something which affects how every
+** line wraps has changed. The index is rebuilt a slice at a time while the
+** application is idle, or as far as needed when a position beyond what has
+** been measured is asked for.
+*/
+void TextArea::resetWrapIndex() {
+	wrapIndex_.clear();
+	wrapIndexComplete_ = false;
+
+	if (continuousWrap_) {
+		wrapIndexTimer_->start();
+	} else {
+		wrapIndexTimer_->stop();
+	}
+}
+
+/*
+** Measure the logical lines following the end of the wrapped line index until
+** it covers buffer position "pos" and display row "row", or until "budget"
+** characters have been measured.
+*/
+void TextArea::extendWrapIndex(TextCursor pos, int64_t row, int64_t budget) {
+
+	const TextCursor end = buffer_->BufEndOfBuffer();
+	auto lineStart       = TextCursor(wrapIndex_.length());
+	int64_t measured     = 0;
+
+	while (!wrapIndexComplete_ && (lineStart <= pos || wrapIndex_.rows() <= row) && measured < budget) {
+		const TextCursor lineEnd = buffer_->BufEndOfLine(lineStart);
+
+		int retLines;
+		TextCursor retPos;
+		TextCursor retLineStart;
+		TextCursor retLineEnd;
+		wrappedLineCounter(buffer_, lineStart, lineEnd, INT_MAX, true, &retPos, &retLines, &retLineStart, &retLineEnd);
+
+		wrapIndexComplete_   = (lineEnd == end);
+		const int64_t length = (lineEnd - lineStart) + (wrapIndexComplete_ ? 0 : 1);
+
+		wrapIndex_.append({length, retLines + 1});
+		measured += length;
+		lineStart = lineEnd + 1;
+	}
+}
+
+/*
+** Return true if the wrapped line index has measured the logical line
+** holding buffer position "pos".
+*/
+bool TextArea::wrapIndexCovers(TextCursor pos) const {
+	return wrapIndexComplete_ || pos < wrapIndex_.length();
+}
+
+/*
+** Return the display row, counting from zero, of the line holding buffer
+** position "pos" in continuous wrap mode.
+*/
+int64_t TextArea::wrappedRowOfPos(TextCursor pos) {
+
+	extendWrapIndex(pos, -1, std::numeric_limits<int64_t>::max());
+
+	int64_t lineStart;
+	int64_t rowsBefore;
+	if (wrapIndex_.findLineByPos(to_integer(pos), &lineStart, &rowsBefore) == -1) {
+		return 0;
+	}
+
+	return rowsBefore + TextDCountLines(TextCursor(lineStart), pos, /*startPosIsLineStart=*/true);
+}
+
+/*
+** Return the buffer position of the start of display row "row", counting
+** from zero, in continuous wrap mode.
+*/
+TextCursor TextArea::wrappedRowStart(int64_t row) {
+
+	extendWrapIndex(TextCursor(-1), row, std::numeric_limits<int64_t>::max());
+
+	int64_t lineStart;
+	int64_t rowsBefore;
+	if (wrapIndex_.findLineByRow(row, &lineStart, &rowsBefore) == -1) {
+		return buffer_->BufStartOfBuffer();
+	}
+
+	return TextDCountForwardNLines(TextCursor(lineStart), static_cast<int>(row - rowsBefore), /*startPosIsLineStart=*/true);
+}
+
+/*
+** Bring the wrapped line index up to date with a buffer modification. Since
+** logical lines wrap independently of each other, only the lines which the
+** modification touched are measured again. A modification reaching past the
+** end of an incomplete index cuts it back to the line where the modification
+** starts instead, the rest is measured when the application is idle.
+*/
+void TextArea::updateWrapIndex(TextCursor pos, int64_t nInserted, int64_t nDeleted, view::string_view deletedText) {
+
+	if (!continuousWrap_ || (nInserted == 0 && nDeleted == 0)) {
+		return;
+	}
+
+	int64_t lineStart;
+	int64_t rowsBefore;
+
+	if (!wrapIndexComplete_ && pos + nDeleted >= wrapIndex_.length()) {
+		if (pos < wrapIndex_.length()) {
+			wrapIndex_.truncate(wrapIndex_.findLineByPos(to_integer(pos), &lineStart, &rowsBefore));
+		}
+
+		wrapIndexTimer_->start();
+		return;
+	}
+
+	const int64_t first = wrapIndex_.findLineByPos(to_integer(pos), &lineStart, &rowsBefore);
+	if (first == -1) {
+		return;
+	}
+
+	const int64_t oldLines = countNewlines(deletedText) + 1;
+	const int64_t newLines = buffer_->BufCountLines(pos, pos + nInserted) + 1;
+	const TextCursor end   = buffer_->BufEndOfBuffer();
+
+	std::vector<WrapIndex::Line> lines;
+	lines.reserve(static_cast<size_t>(newLines));
+
+	auto start = TextCursor(lineStart);
+	for (int64_t i = 0; i < newLines; ++i) {
+		const TextCursor lineEnd = buffer_->BufEndOfLine(start);
+
+		int retLines;
+		TextCursor retPos;
+		TextCursor retLineStart;
+		TextCursor retLineEnd;
+		wrappedLineCounter(buffer_, start, lineEnd, INT_MAX, true, &retPos, &retLines, &retLineStart, &retLineEnd);
+
+		const int64_t length = (lineEnd - start) + (lineEnd == end ? 0 : 1);
+		lines.push_back({length, retLines + 1});
+		start = lineEnd + 1;
+	}
+
+	wrapIndex_.replace(first, oldLines, lines);
+}
+
+/**
+ * Measures another slice of the wrapped line index while the application
+ * is idle.
+ *
+ * @brief TextArea::wrapIndexTimerTimeout
+ */
+void TextArea::wrapIndexTimerTimeout() {
+
+	if (continuousWrap_) {
+		extendWrapIndex(TextCursor(-1), -1, WRAP_INDEX_SLICE);
+	}
+
+	if (!continuousWrap_ || wrapIndexComplete_) {
+		wrapIndexTimer_->stop();
+	}
+}
+
+/**
+ * Replaces the estimated number of lines in the buffer with the real one,
+ * once the buffer has finished counting them.
+ *
+ * @brief TextArea::lineCountTimerTimeout
+ */
+void TextArea::lineCountTimerTimeout() {
+
+	if (!buffer_->BufLinesCounted()) {
+		return;
+	}
+
+	lineCountTimer_->stop();
+
+	if (!continuousWrap_) {
+		nBufferLines_ = countBufferLines();
+		updateVScrollBarRange();
+	}
+}
+
+/*
+** Count the lines in the whole buffer when not in continuous wrap mode. The
+** lines of a file which was just mapped into the buffer are counted in the
+** background, meanwhile this returns an estimate, which is corrected by
+** lineCountTimerTimeout once they have been.
+*/
+int TextArea::countBufferLines() {
+
+	if (!buffer_->BufLinesCounted()) {
+		lineCountTimer_->start();
+		return static_cast<int>(buffer_->BufEstimateLines());
+	}
+
+	return static_cast<int>(buffer_->BufCountLines(buffer_->BufStartOfBuffer(), buffer_->BufEndOfBuffer()));
+}
+
 /*
 ** Finds both the end of the current line and the start of the next line.  Why?
 ** In continuous wrap mode, if you need to know both, figuring out one from the
@@ -2407,7 +2737,8 @@ bool TextArea::updateHScrollBarRange() {
 	const QRect viewRect  = viewport()->contentsRect();
 	const int origHOffset = horizontalScrollBar()->value();
 
-	// Scan all the displayed lines to find the width of the longest line
+	/* Scan all the displayed lines to find the width of the longest line, only
+	 * lines whose text changed since they were last measured are measured */
 	int maxWidth = 0;
 	for (int i = 0; i < nVisibleLines_ && lineStarts_[i] != -1; i++) {
 		maxWidth = std::max(measureVisLine(i), maxWidth);
@@ -2474,27 +2805,130 @@ bool TextArea::posToVisibleLineNum(TextCursor pos, int *lineNum) const {
 }
 
 /**
- * Return the width in pixels of the displayed line pointed to by "visLineNum"
+ * Return the width in pixels of the displayed line pointed to by "visLineNum".
+ * Widths are remembered until the text of the line changes, so that finding
+ * the longest displayed line doesn't measure every line again.
  *
  * @brief TextArea::measureVisLine
  * @param visLineNum
  * @return
  */
-int TextArea::measureVisLine(int visLineNum) const {
+int TextArea::measureVisLine(int visLineNum) {
 
-	int width                     = 0;
-	int charCount                 = 0;
 	const int lineLen             = visLineLength(visLineNum);
 	const TextCursor lineStartPos = lineStarts_[visLineNum];
 
-	for (int i = 0; i < lineLen; i++) {
-		char expandedChar[TextBuffer::MAX_EXP_CHAR_LEN];
-		const int len = buffer_->BufGetExpandedChar(lineStartPos + i, charCount, expandedChar);
-		width += (fixedFontWidth_ * len);
-		charCount += len;
+	auto it = std::find_if(lineWidths_.begin(), lineWidths_.end(), [lineStartPos, lineLen](const MeasuredLine &entry) {
+		return entry.lineStart == lineStartPos && entry.length == lineLen;
+	});
+
+	if (it == lineWidths_.end()) {
+		if (lineWidths_.size() >= static_cast<size_t>(nVisibleLines_) * 2 + 2) {
+			lineWidths_.erase(lineWidths_.begin());
+		}
+
+		it = lineWidths_.insert(lineWidths_.end(), MeasuredLine{lineStartPos, lineLen, lineColumn(lineStartPos, lineLen, lineLen)});
+	}
+
+	return lengthToWidth(static_cast<int>(it->columns));
+}
+
+/*
+** Return the display column of the character "index" characters into the
+** displayed line starting at "lineStartPos", which is "lineLength"
+** characters long.
+*/
+int64_t TextArea::lineColumn(TextCursor lineStartPos, int lineLength, int64_t index) {
+
+	if (lineLength < LONG_LINE_LENGTH) {
+		return buffer_->BufCountDispChars(lineStartPos, lineStartPos + index);
+	}
+
+	const LongLine &line   = longLine(lineStartPos, lineLength);
+	const int64_t step     = std::min<int64_t>(index / LONG_LINE_STEP, static_cast<int64_t>(line.columns.size()) - 1);
+	const TextCursor from  = lineStartPos + step * LONG_LINE_STEP;
+	const int tabDist      = buffer_->BufGetTabDistance();
+
+	int64_t column = line.columns[static_cast<size_t>(step)];
+	for (TextCursor pos = from; pos < lineStartPos + index; ++pos) {
+		column += TextBuffer::BufCharWidth(buffer_->BufGetCharacter(pos), column, tabDist);
 	}
 
-	return width;
+	return column;
+}
+
+/*
+** Return the column checkpoints of the long displayed line starting at
+** "lineStartPos", measuring the line if it isn't one of the few long lines
+** which were measured recently. Entries are dropped or moved along with the
+** text by updateLineCache.
+*/
+const TextArea::LongLine &TextArea::longLine(TextCursor lineStartPos, int lineLength) {
+
+	auto it = std::find_if(longLines_.begin(), longLines_.end(), [lineStartPos, lineLength](const LongLine &entry) {
+		return entry.lineStart == lineStartPos && entry.length == lineLength;
+	});
+
+	if (it != longLines_.end()) {
+		return *it;
+	}
+
+	if (longLines_.size() >= LONG_LINE_CACHE_SIZE) {
+		longLines_.erase(longLines_.begin());
+	}
+
+	LongLine line;
+	line.lineStart = lineStartPos;
+	line.length    = lineLength;
+	line.columns.reserve(static_cast<size_t>(lineLength / LONG_LINE_STEP + 1));
+
+	const int tabDist = buffer_->BufGetTabDistance();
+	int64_t column    = 0;
+
+	for (int64_t i = 0; i < lineLength; ++i) {
+		if (i % LONG_LINE_STEP == 0) {
+			line.columns.push_back(column);
+		}
+
+		column += TextBuffer::BufCharWidth(buffer_->BufGetCharacter(lineStartPos + i), column, tabDist);
+	}
+
+	if (line.columns.empty()) {
+		line.columns.push_back(0);
+	}
+
+	longLines_.push_back(std::move(line));
+	return longLines_.back();
+}
+
+/*
+** Return the index of the character of a long line which is displayed at
+** "column", along with the display column where that character starts.
+** Columns past the end of the line give the length of the line.
+*/
+int64_t TextArea::longLineIndexOfColumn(const LongLine &line, int64_t column, int64_t *charColumn) const {
+
+	// the last checkpoint at or before the column
+	auto it = std::upper_bound(line.columns.begin(), line.columns.end(), column);
+	if (it != line.columns.begin()) {
+		--it;
+	}
+
+	const int tabDist = buffer_->BufGetTabDistance();
+	int64_t index     = (it - line.columns.begin()) * LONG_LINE_STEP;
+	int64_t current   = *it;
+
+	for (; index < line.length; ++index) {
+		const int width = TextBuffer::BufCharWidth(buffer_->BufGetCharacter(line.lineStart + index), current, tabDist);
+		if (current + width > column) {
+			break;
+		}
+
+		current += width;
+	}
+
+	*charColumn = current;
+	return index;
 }
 
 /**
@@ -2659,37 +3093,306 @@ void TextArea::redisplayRange(TextCursor start, TextCursor end) {
 	redisplayLineEx(lastLine, 0, endIndex);
 }
 
-/**
- * @brief TextArea::repaintLineNumbers
- */
-void TextArea::repaintLineNumbers() {
-	lineNumberArea_->update();
+/**
+ * @brief TextArea::repaintLineNumbers
+ */
+void TextArea::repaintLineNumbers() {
+	lineNumberArea_->update();
+}
+
+/*
+** Repaint the line numbers from the row displaying "pos" down, a change at
+** "pos" doesn't affect the numbers of the rows above it.
+*/
+void TextArea::repaintLineNumbers(TextCursor pos) {
+
+	int visLineNum;
+	if (!posToVisibleLineNum(pos, &visLineNum)) {
+		repaintLineNumbers();
+		return;
+	}
+
+	const int y = viewport()->contentsRect().top() + visLineNum * fixedFontHeight_;
+	lineNumberArea_->update(0, y, lineNumberArea_->width(), lineNumberArea_->height() - y);
+}
+
+/*
+ * A replacement for redisplayLine. Instead of directly painting, it will
+ * calculate the rect that would be repainted and trigger an update of that
+ * region. We will then repaint that region during the paint event
+ */
+void TextArea::redisplayLineEx(int visLineNum, int leftCharIndex, int rightCharIndex) {
+
+	// NOTE(eteran): the original code would only update **exactly** what was
+	// needed. I haven't been able to get this quite right in the Qt port.
+	// So we update the whole line (the visible portion).
+	Q_UNUSED(leftCharIndex)
+	Q_UNUSED(rightCharIndex)
+
+	// If line is not displayed, skip it
+	if (visLineNum < 0 || visLineNum >= nVisibleLines_) {
+		return;
+	}
+
+	if (dirtyRows_.size() < static_cast<size_t>(nVisibleLines_)) {
+		dirtyRows_.resize(static_cast<size_t>(nVisibleLines_), false);
+	}
+
+	dirtyRows_[static_cast<size_t>(visLineNum)] = true;
+	scheduleRedisplay();
+}
+
+/*
+** Mark the display columns "startColumn" up to "endColumn" of the displayed
+** rows "firstRow" to "lastRow" inclusive for repainting, like
+** redisplayLineEx does with whole rows.
+*/
+void TextArea::redisplayColumns(int firstRow, int lastRow, int64_t startColumn, int64_t endColumn) {
+
+	firstRow = std::max(firstRow, 0);
+	lastRow  = std::min(lastRow, nVisibleLines_ - 1);
+
+	if (firstRow > lastRow || startColumn >= endColumn) {
+		return;
+	}
+
+	dirtySpans_.push_back(DirtySpan{firstRow, lastRow, startColumn, endColumn});
+	scheduleRedisplay();
+}
+
+/*
+** Repaint the change of a rectangular selection whose left or right edge
+** moved, such as when one is dragged out with the mouse, by the display
+** columns which changed on each row. The buffer reports such a change as a
+** restyle of every line the selection covers before or after it, which
+** would otherwise repaint all of those lines at their full width. Returns
+** false if the modification isn't such a change, and the usual redisplay is
+** needed.
+**
+** The rows of a rectangular selection only line up with display columns
+** when lines aren't wrapped, continuous wrap mode always takes the usual
+** path.
+*/
+bool TextArea::redisplayRectSelection(const std::array<SelectionState, 3> &oldSelections, TextCursor pos, int64_t nRestyled) {
+
+	if (continuousWrap_ || cursorToHint_ != NO_HINT) {
+		return false;
+	}
+
+	// pending changes to the syntax highlighting need the usual path, see extendRangeForStyleMods
+	if (styleBuffer_ && styleBuffer_->primary.hasSelection()) {
+		return false;
+	}
+
+	// exactly one selection must have changed
+	size_t changed = selections_.size();
+	for (size_t i = 0; i < selections_.size(); ++i) {
+		if (oldSelections[i] != selections_[i]) {
+			if (changed != selections_.size()) {
+				return false;
+			}
+			changed = i;
+		}
+	}
+
+	if (changed == selections_.size()) {
+		return false;
+	}
+
+	const SelectionState &before = oldSelections[changed];
+	const SelectionState &after  = selections_[changed];
+
+	if (!before.selected || !after.selected || !before.rectangular || !after.rectangular) {
+		return false;
+	}
+
+	/* With the same columns, the buffer already limits the restyle to the
+	   lines which entered or left the selection */
+	if (before.rectStart == after.rectStart && before.rectEnd == after.rectEnd) {
+		return false;
+	}
+
+	// the restyle must be the one reporting this change, see BasicTextBuffer::redisplaySelection
+	const TextCursor start = std::min(before.start, after.start);
+	const TextCursor end   = std::max(before.end, after.end) + 1;
+	if (pos != start || pos + nRestyled != end) {
+		return false;
+	}
+
+	int beforeFirst;
+	int beforeLast;
+	int afterFirst;
+	int afterLast;
+	const bool beforeShown = selectionRows(before, &beforeFirst, &beforeLast);
+	const bool afterShown  = selectionRows(after, &afterFirst, &afterLast);
+
+	// rows in both selections, only the edges which moved changed
+	if (beforeShown && afterShown) {
+		const int first = std::max(beforeFirst, afterFirst);
+		const int last  = std::min(beforeLast, afterLast);
+
+		if (before.rectStart != after.rectStart) {
+			redisplayColumns(first, last, std::min(before.rectStart, after.rectStart), std::max(before.rectStart, after.rectStart));
+		}
+
+		if (before.rectEnd != after.rectEnd) {
+			redisplayColumns(first, last, std::min(before.rectEnd, after.rectEnd), std::max(before.rectEnd, after.rectEnd));
+		}
+	}
+
+	// rows in just one of them, all of its columns on those rows changed
+	auto redisplayOnly = [this](bool shown, int first, int last, const SelectionState &selection, bool otherShown, int otherFirst, int otherLast) {
+		if (!shown) {
+			return;
+		}
+
+		if (!otherShown) {
+			redisplayColumns(first, last, selection.rectStart, selection.rectEnd);
+			return;
+		}
+
+		redisplayColumns(first, std::min(last, otherFirst - 1), selection.rectStart, selection.rectEnd);
+		redisplayColumns(std::max(first, otherLast + 1), last, selection.rectStart, selection.rectEnd);
+	};
+
+	redisplayOnly(beforeShown, beforeFirst, beforeLast, before, afterShown, afterFirst, afterLast);
+	redisplayOnly(afterShown, afterFirst, afterLast, after, beforeShown, beforeFirst, beforeLast);
+	return true;
+}
+
+/*
+** Find the displayed rows covered by a rectangular selection, returns false
+** if none of them are displayed.
+*/
+bool TextArea::selectionRows(const SelectionState &selection, int *firstRow, int *lastRow) const {
+
+	if (selection.end < firstChar_ || selection.start > lastChar_) {
+		return false;
+	}
+
+	if (!posToVisibleLineNum(std::max(selection.start, firstChar_), firstRow)) {
+		return false;
+	}
+
+	if (selection.end >= lastChar_ || !posToVisibleLineNum(selection.end, lastRow)) {
+		*lastRow = nVisibleLines_ - 1;
+	}
+
+	return true;
+}
+
+/*
+** Record the current state of the buffer's selections, which the next
+** modification is compared against.
+*/
+void TextArea::updateSelectionStates() {
+
+	auto stateOf = [](const TextBuffer::Selection &selection) {
+		SelectionState state;
+		state.selected    = selection.hasSelection();
+		state.rectangular = selection.isRectangular();
+		state.start       = selection.start();
+		state.end         = selection.end();
+		state.rectStart   = selection.rectStart();
+		state.rectEnd     = selection.rectEnd();
+		return state;
+	};
+
+	selections_[0] = stateOf(buffer_->primary);
+	selections_[1] = stateOf(buffer_->secondary);
+	selections_[2] = stateOf(buffer_->highlight);
+}
+
+/**
+ * @brief TextArea::SelectionState::operator==
+ * @param other
+ * @return
+ */
+bool TextArea::SelectionState::operator==(const SelectionState &other) const {
+	return selected == other.selected && rectangular == other.rectangular && start == other.start && end == other.end && rectStart == other.rectStart && rectEnd == other.rectEnd;
+}
+
+/**
+ * @brief TextArea::SelectionState::operator!=
+ * @param other
+ * @return
+ */
+bool TextArea::SelectionState::operator!=(const SelectionState &other) const {
+	return !(*this == other);
+}
+
+/*
+** Arrange for flushRedisplay to be called once control returns to the event
+** loop.
+*/
+void TextArea::scheduleRedisplay() {
+	if (!redisplayTimer_->isActive()) {
+		redisplayTimer_->start();
+	}
 }
 
 /*
- * A replacement for redisplayLine. Instead of directly painting, it will
- * calculate the rect that would be repainted and trigger an update of that
- * region. We will then repaint that region during the paint event
- */
-void TextArea::redisplayLineEx(int visLineNum, int leftCharIndex, int rightCharIndex) {
+** Request the repaint of the rows marked by redisplayLineEx, and update the
+** range of the horizontal scroll bar if the text changed.
+**
+** A burst of changes, such as a macro making thousands of replacements, a
+** shell filter or a replace all, would otherwise request a repaint and scan
+** every displayed line for its width once for every change. Instead these
+** are only noted as the changes happen, and done once the burst is over.
+** The line starts, the cursor position and the vertical scroll bar are
+** still kept current after every change, since the code handling the next
+** one relies on them.
+**
+** Anything which scrolls the display calls this first, so the marked rows
+** and the scroll range refer to what is displayed.
+*/
+void TextArea::flushRedisplay() {
 
-	// NOTE(eteran): the original code would only update **exactly** what was
-	// needed. I haven't been able to get this quite right in the Qt port.
-	// So we update the whole line (the visible portion).
-	Q_UNUSED(leftCharIndex)
-	Q_UNUSED(rightCharIndex)
+	redisplayTimer_->stop();
 
 	const QRect viewRect = viewport()->contentsRect();
+	const int nRows      = std::min(static_cast<int>(dirtyRows_.size()), nVisibleLines_);
 
-	// If line is not displayed, skip it
-	if (visLineNum < 0 || visLineNum >= nVisibleLines_) {
-		return;
+	// one update per run of consecutive rows
+	for (int row = 0; row < nRows; ) {
+		if (!dirtyRows_[static_cast<size_t>(row)]) {
+			++row;
+			continue;
+		}
+
+		const int first = row;
+		while (row < nRows && dirtyRows_[static_cast<size_t>(row)]) {
+			++row;
+		}
+
+		const int y = viewRect.top() + first * fixedFontHeight_;
+		viewport()->update(QRect(viewRect.left(), y, viewRect.width(), (row - first) * fixedFontHeight_));
 	}
 
-	// Calculate y coordinate of the string to draw
-	const int y = viewRect.top() + visLineNum * fixedFontHeight_;
+	std::fill(dirtyRows_.begin(), dirtyRows_.end(), false);
+
+	/* Spans are padded by a column on either side, for the cursor and for
+	   glyphs which overhang their cell. They are placed where the text is
+	   displayed now, which lags the scroll bar while it's being moved */
+	const int hOffset = hScrollOffset_;
+	for (const DirtySpan &span : dirtySpans_) {
+		const int x      = viewRect.left() - hOffset + lengthToWidth(static_cast<int>(span.startColumn - 1));
+		const int y      = viewRect.top() + span.firstRow * fixedFontHeight_;
+		const int width  = lengthToWidth(static_cast<int>(span.endColumn - span.startColumn + 2));
+		const int height = (span.lastRow - span.firstRow + 1) * fixedFontHeight_;
 
-	viewport()->update(QRect(viewRect.left(), y, viewRect.width(), fixedFontHeight_));
+		const QRect rect = QRect(x, y, width, height).intersected(viewRect);
+		if (!rect.isEmpty()) {
+			viewport()->update(rect);
+		}
+	}
+
+	dirtySpans_.clear();
+
+	if (hScrollRangeDirty_) {
+		hScrollRangeDirty_ = false;
+		updateHScrollBarRange();
+	}
 }
 
 /*
@@ -2697,6 +3400,12 @@ void TextArea::redisplayLineEx(int visLineNum, int leftCharIndex, int rightCharI
 ** number of lines down from the top of the display), limited by
 ** "leftClip" and "rightClip" window coordinates.
 **
+** Lines are painted from the cache of rendered lines whenever possible, so
+** exposing or scrolling back over text that hasn't changed doesn't fetch,
+** style or lay out the text again. Lines which touch a rectangular selection
+** are laid out on every paint, their styles depend on the display column
+** rather than on the buffer position.
+**
 ** The cursor is also drawn if it appears on the line.
 */
 void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, int rightClip) {
@@ -2726,6 +3435,10 @@ void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, in
 		return;
 	}
 
+	if (paintStatistics_) {
+		paintStatistics_->add(PaintStatistics::LinesRedrawn, 1);
+	}
+
 	// Remember where the cursor was drawn
 	const int y_orig = cursor_.y();
 
@@ -2734,56 +3447,155 @@ void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, in
 
 	// get buffer position of the line to display
 	const TextCursor lineStartPos = lineStarts_[visLineNum];
+	const int lineLength          = (lineStartPos != -1) ? visLineLength(visLineNum) : 0;
 
-	// get a copy of the current line (or an empty string)
-	const std::string currentLine = [&]() {
-		std::string ret;
-		if(lineStartPos != -1) {
-			const int length = visLineLength(visLineNum);
-			ret = buffer_->BufGetRangeEx(lineStartPos, lineStartPos + length);
+	const std::vector<LineRun> *runs;
+	if (lineStartPos != -1 && !rangeTouchesRectSel(lineStartPos, lineStartPos + lineLength)) {
+		runs = &renderedLine(lineStartPos, lineLength);
+	} else {
+		layoutLine(lineStartPos, lineLength, leftClip, rightClip, &lineRuns_);
+		runs = &lineRuns_;
+	}
+
+	for (const LineRun &run : *runs) {
+		if (run.toX >= leftClip && run.x <= rightClip) {
+			drawString(painter, run.style, run.x, y, run.toX, run.text);
 		}
-		return ret;
-	}();
+	}
+
+	// Draw the cursor if it appears on the redisplayed part of this line
+	boost::optional<int> cursorX;
+	if (lineStartPos != -1) {
+		cursorX = cursorXOnLine(lineStartPos, lineLength);
+	}
+
+	if (cursorOn_ && cursorX && *cursorX + 1 + fixedFontWidth_ > leftClip && *cursorX < rightClip) {
+		drawCursor(painter, *cursorX, y);
+	}
+
+	// If the y position of the cursor has changed, update the calltip location
+	if (cursorX && (y_orig != cursor_.y() || y_orig != y)) {
+		updateCalltip(0);
+	}
+}
+
+/*
+** Return the x coordinate at which the cursor is drawn if it is on the
+** displayed line starting at "lineStartPos". When the cursor is at the end
+** of the line, it belongs to this line only if this is the end of the
+** buffer, or if the line ends with a character rather than being wrapped.
+*/
+boost::optional<int> TextArea::cursorXOnLine(TextCursor lineStartPos, int lineLength) {
+
+	if (cursorPos_ < lineStartPos || cursorPos_ > lineStartPos + lineLength) {
+		return boost::none;
+	}
+
+	if (cursorPos_ == lineStartPos + lineLength && cursorPos_ < buffer_->BufEndOfBuffer() && !wrapUsesCharacter(cursorPos_)) {
+		return boost::none;
+	}
+
+	const QRect viewRect = viewport()->contentsRect();
+	const auto dispChars = static_cast<int>(lineColumn(lineStartPos, lineLength, cursorPos_ - lineStartPos));
+	return viewRect.left() - horizontalScrollBar()->value() + lengthToWidth(dispChars) - 1;
+}
+
+/*
+** Return true if the range of buffer positions touches any of the
+** rectangular selections.
+*/
+bool TextArea::rangeTouchesRectSel(TextCursor rangeStart, TextCursor rangeEnd) const {
+	return buffer_->primary.rangeTouchesRectSel  (rangeStart, rangeEnd) ||
+	       buffer_->secondary.rangeTouchesRectSel(rangeStart, rangeEnd) ||
+	       buffer_->highlight.rangeTouchesRectSel(rangeStart, rangeEnd);
+}
+
+/*
+** Break the text of a displayed line into runs of a single style covering
+** the window coordinates "leftClip" to "rightClip". "lineStartPos" is the
+** buffer position of the line (or -1 for a line past the end of the buffer)
+** and "lineLength" is its length.
+**
+** Of a long line, only the characters which fall between the clipping
+** coordinates are fetched from the buffer and styled.
+*/
+void TextArea::layoutLine(TextCursor lineStartPos, int lineLength, int leftClip, int rightClip, std::vector<LineRun> *runs) {
+
+	const QRect viewRect = viewport()->contentsRect();
+	const int hOffset    = horizontalScrollBar()->value();
+
+	runs->clear();
+
+	// the characters [first, last) of the line are laid out, starting at display column firstColumn
+	int64_t first       = 0;
+	int64_t firstColumn = 0;
+	int64_t last        = lineLength;
 
-	const auto nLineSize = static_cast<int>(currentLine.size());
+	if (lineStartPos != -1 && lineLength >= LONG_LINE_LENGTH) {
+		const LongLine &line = longLine(lineStartPos, lineLength);
+
+		int64_t lastColumn;
+		first = longLineIndexOfColumn(line, (leftClip - viewRect.left() + hOffset) / fixedFontWidth_, &firstColumn);
+		last  = longLineIndexOfColumn(line, (rightClip - viewRect.left() + hOffset) / fixedFontWidth_ + 1, &lastColumn);
+		last  = std::min<int64_t>(last + TextBuffer::MAX_EXP_CHAR_LEN, lineLength);
+	}
+
+	const TextCursor segmentStart = lineStartPos + first;
+
+	std::string segment;
+	if (lineStartPos != -1) {
+		segment = buffer_->BufGetRangeEx(segmentStart, lineStartPos + last);
+	}
+
+	if (paintStatistics_) {
+		paintStatistics_->add(PaintStatistics::LinesLaidOut, 1);
+		paintStatistics_->add(PaintStatistics::BytesCopied, static_cast<int64_t>(segment.size()));
+	}
+
+	const auto nLineSize = static_cast<int>(segment.size());
 
 	/* Rectangular selections are based on "real" line starts (after a newline
 	   or start of buffer).  Calculate the difference between the last newline
 	   position and the line start we're using.  Since scanning back to find a
 	   newline is expensive, only do so if there's actually a rectangular
 	   selection which needs it */
-	int64_t dispIndexOffset = 0;
-
-	// a helper lambda for this calculation
-	auto rangeTouchesRectSel = [this](TextCursor rangeStart, TextCursor rangeEnd) {
-		return buffer_->primary.rangeTouchesRectSel  (rangeStart, rangeEnd) ||
-		       buffer_->secondary.rangeTouchesRectSel(rangeStart, rangeEnd) ||
-		       buffer_->highlight.rangeTouchesRectSel(rangeStart, rangeEnd);
-	};
+	const bool hasRectSel = (lineStartPos != -1) && rangeTouchesRectSel(segmentStart, segmentStart + nLineSize);
 
-	if (continuousWrap_ && rangeTouchesRectSel(lineStartPos, lineStartPos + currentLine.size())) {
+	int64_t dispIndexOffset = 0;
+	if (continuousWrap_ && hasRectSel) {
 		dispIndexOffset = buffer_->BufCountDispChars(buffer_->BufStartOfLine(lineStartPos), lineStartPos);
 	}
 
+	/* Resolve the styles of the laid out characters, and of the blank area
+	 * past the end of the line, in a single pass. Only rectangular selections
+	 * depend on the display column, those are added as the line is laid out,
+	 * and only if there is one on this line */
+	resolveLineStyles(segmentStart, segment, &lineStyles_);
+
+	auto styleAt = [&](int index, int64_t dispIndex) {
+		const int lineIndex = std::min(index, nLineSize);
+		uint32_t charStyle  = lineStyles_[static_cast<size_t>(lineIndex)];
+		if (hasRectSel) {
+			charStyle |= rectSelectionStyle(segmentStart + lineIndex, lineStartPos, dispIndex);
+		}
+		return charStyle;
+	};
+
 	/* Step through character positions from the beginning of the line (even if
 	 * that's off the left edge of the displayed area) to find the first
 	 * character position that's not clipped, and the x coordinate for drawing
 	 * that character */
 	const int tabDist = buffer_->BufGetTabDistance();
-	int startX     = viewRect.left() - horizontalScrollBar()->value();
-	int outIndex   = 0;
+	int startX     = viewRect.left() - hOffset + lengthToWidth(static_cast<int>(firstColumn));
+	int outIndex   = static_cast<int>(firstColumn);
 	int startIndex = 0;
-	uint32_t style;
 
 	for (;;) {
-		int  charLen  = 1;
-		char baseChar = '\0';
+		int charLen = 1;
 		if(startIndex < nLineSize) {
-			baseChar = currentLine[static_cast<size_t>(startIndex)];
-			charLen  = TextBuffer::BufCharWidth(baseChar, outIndex, tabDist);
+			charLen = TextBuffer::BufCharWidth(segment[static_cast<size_t>(startIndex)], outIndex, tabDist);
 		}
 
-		style = styleOfPos(lineStartPos, nLineSize, startIndex, dispIndexOffset + outIndex, baseChar);
 		const int charWidth = (startIndex >= nLineSize) ? fixedFontWidth_ : lengthToWidth(charLen);
 
 		if (startX + charWidth >= leftClip) {
@@ -2795,50 +3607,52 @@ void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, in
 		++startIndex;
 	}
 
+	uint32_t style = styleAt(startIndex, dispIndexOffset + outIndex);
+
 	/* Scan character positions from the beginning of the clipping range, and
-	 * draw parts whenever the style changes (also note if the cursor is on
-	 * this line, and where it should be drawn to take advantage of the x
-	 * position which we've gone to so much trouble to calculate) */
+	 * start a new run whenever the style changes */
 	char outStr[MAX_DISP_LINE_LEN];
 	char *outPtr = outStr;
 	int x        = startX;
-	int charIndex;
-	boost::optional<int> cursorX;
 
-	for (charIndex = startIndex; ; ++charIndex) {
+	auto addRun = [&]() {
+		if (x == startX) {
+			return;
+		}
 
-		// take note of where the cursor is if it's on this line...
-		if (lineStartPos + charIndex == cursorPos_) {
-			if (charIndex < nLineSize || (charIndex == nLineSize && cursorPos_ >= buffer_->BufEndOfBuffer())) {
-				cursorX = x - 1;
-			} else if (charIndex == nLineSize) {
-				if (wrapUsesCharacter(cursorPos_)) {
-					cursorX = x - 1;
-				}
-			}
+		LineRun run;
+		run.x     = startX;
+		run.toX   = x;
+		run.style = style;
+		if (!(style & FILL_MASK)) {
+			run.text.setTextFormat(Qt::PlainText);
+			run.text.setText(asciiToUnicode(outStr, static_cast<int>(outPtr - outStr)));
 		}
 
+		runs->push_back(std::move(run));
+	};
+
+	for (int charIndex = startIndex; ; ++charIndex) {
+
 		char expandedChar[TextBuffer::MAX_EXP_CHAR_LEN];
-		char baseChar = '\0';
 		int  charLen  = 1;
 		if (charIndex < nLineSize) {
-			baseChar = currentLine[static_cast<size_t>(charIndex)];
-			charLen  = TextBuffer::BufExpandCharacter(baseChar, outIndex, expandedChar, tabDist);
+			charLen = TextBuffer::BufExpandCharacter(segment[static_cast<size_t>(charIndex)], outIndex, expandedChar, tabDist);
 		}
 
-		uint32_t charStyle = styleOfPos(lineStartPos, nLineSize, charIndex, dispIndexOffset + outIndex, baseChar);
+		uint32_t charStyle = styleAt(charIndex, dispIndexOffset + outIndex);
 
 		for (int i = 0; i < charLen; ++i) {
 
 			/* NOTE(eteran): this double check of the style is necessary to make
 			 * certain types of selections work correctly
 			 */
-			if (i != 0 && charIndex < nLineSize && currentLine[static_cast<size_t>(charIndex)] == '\t') {
-				charStyle = styleOfPos(lineStartPos, nLineSize, charIndex, dispIndexOffset + outIndex, '\t');
+			if (i != 0 && hasRectSel && charIndex < nLineSize && segment[static_cast<size_t>(charIndex)] == '\t') {
+				charStyle = styleAt(charIndex, dispIndexOffset + outIndex);
 			}
 
 			if (charStyle != style) {
-				drawString(painter, style, startX, y, x, outStr, outPtr - outStr);
+				addRun();
 				outPtr = outStr;
 				startX = x;
 				style = charStyle;
@@ -2856,94 +3670,228 @@ void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, in
 		if (outPtr - outStr + TextBuffer::MAX_EXP_CHAR_LEN >= MAX_DISP_LINE_LEN || x >= rightClip) {
 			break;
 		}
+	}
+
+	// the remaining style segment
+	addRun();
+}
+
+/*
+** Return the runs of the displayed line starting at "lineStartPos", laid out
+** across the whole width of the view. They are taken from the cache of
+** rendered lines if the line was drawn before and hasn't changed since,
+** otherwise they are laid out and added to the cache, replacing the line
+** which was used least recently once the cache holds a couple of screens.
+**
+** Entries are keyed by the buffer range of the line, they are dropped or
+** moved by bufModifiedCallback as the text, its styles or the selections
+** change (see updateLineCache), so a matching entry is always current.
+*/
+const std::vector<TextArea::LineRun> &TextArea::renderedLine(TextCursor lineStartPos, int lineLength) {
+
+	const QRect viewRect = viewport()->contentsRect();
+	const int offset     = horizontalScrollBar()->value();
 
+	// runs are positioned relative to the view, they must be laid out again if it moved
+	if (viewRect != lineCacheRect_ || offset != lineCacheOffset_) {
+		clearLineCache();
+		lineCacheRect_   = viewRect;
+		lineCacheOffset_ = offset;
 	}
 
-	// Draw the remaining style segment
-	drawString(painter, style, startX, y, x, outStr, outPtr - outStr);
+	++lineCacheClock_;
 
-	/* Draw the cursor if part of it appeared on the redisplayed part of
-	   this line.  Also check for the cases which are not caught as the
-	   line is scanned above: when the cursor appears at the very end
-	   of the redisplayed section. */	
-	if (cursorOn_) {
-		if (cursorX) {
-			drawCursor(painter, *cursorX, y);
-		} else if (charIndex < nLineSize && (lineStartPos + charIndex + 1 == cursorPos_) && x == rightClip) {
-			if (cursorPos_ >= buffer_->length()) {
-				drawCursor(painter, x - 1, y);
-			} else {
-				if (wrapUsesCharacter(cursorPos_)) {
-					drawCursor(painter, x - 1, y);
-				}
-			}
-		}
+	auto it = std::find_if(lineCache_.begin(), lineCache_.end(), [lineStartPos, lineLength](const RenderedLine &entry) {
+		return entry.lineStart == lineStartPos && entry.length == lineLength;
+	});
+
+	if (it != lineCache_.end()) {
+		it->lastUsed = lineCacheClock_;
+		return it->runs;
 	}
 
-	// If the y position of the cursor has changed, update the calltip location
-	if (cursorX && (y_orig != cursor_.y() || y_orig != y)) {
-		updateCalltip(0);
+	const size_t maxLines = static_cast<size_t>(nVisibleLines_) * 2 + 2;
+	if (lineCache_.size() >= maxLines) {
+		it = std::min_element(lineCache_.begin(), lineCache_.end(), [](const RenderedLine &lhs, const RenderedLine &rhs) {
+			return lhs.lastUsed < rhs.lastUsed;
+		});
+	} else {
+		it = lineCache_.insert(lineCache_.end(), RenderedLine());
+	}
+
+	it->lineStart = lineStartPos;
+	it->length    = lineLength;
+	it->lastUsed  = lineCacheClock_;
+
+	layoutLine(lineStartPos, lineLength, viewRect.left(), viewRect.right(), &it->runs);
+	return it->runs;
+}
+
+/*
+** Forget all of the rendered lines, for changes which affect the look of
+** every line, such as fonts and colors.
+*/
+void TextArea::clearLineCache() {
+	lineCache_.clear();
+}
+
+/*
+** Forget the rendered lines which overlap the buffer positions "start" to
+** "end" inclusive. The position just past the end of a line is included,
+** because it decides the style of the blank area after the line's text.
+*/
+void TextArea::invalidateLineCache(TextCursor start, TextCursor end) {
+	dropLines(&lineCache_, start, end);
+}
+
+/*
+** Bring the rendered lines up to date with a buffer modification: lines
+** which overlap the modified or restyled text are dropped, lines after it
+** are moved along with their text. The measurements of lines are kept the
+** same way, except that they only depend on the text itself. Changes in syntax highlighting are
+** reported through the style buffer's primary selection, see
+** extendRangeForStyleMods.
+**
+** Re-parsing "unfinished" regions while drawing never invalidates anything,
+** a rendered line can't contain such a region since they are parsed before
+** the line is laid out.
+*/
+void TextArea::updateLineCache(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled) {
+
+	if (nInserted != 0 || nDeleted != 0) {
+		dropLines(&lineCache_, pos, pos + nDeleted);
+		dropLines(&lineWidths_, pos, pos + nDeleted);
+		dropLines(&longLines_, pos, pos + nDeleted);
+
+		shiftLines(&lineCache_, pos + nDeleted, nInserted - nDeleted);
+		shiftLines(&lineWidths_, pos + nDeleted, nInserted - nDeleted);
+		shiftLines(&longLines_, pos + nDeleted, nInserted - nDeleted);
+	}
+
+	if (nRestyled != 0) {
+		invalidateLineCache(pos, pos + nRestyled);
+	}
+
+	if (styleBuffer_ && styleBuffer_->primary.hasSelection()) {
+		invalidateLineCache(styleBuffer_->primary.start(), styleBuffer_->primary.end());
 	}
 }
 
 /*
-** Determine the drawing method to use to draw a specific character from "buf".
-** "lineStartPos" gives the character index where the line begins, "lineIndex",
-** the number of characters past the beginning of the line, and "dispIndex",
-** the number of displayed characters past the beginning of the line.  Passing
-** lineStartPos of -1 returns the drawing style for "no text".
+** Determine the drawing method to use for each character of a displayed line
+** in a single pass, "lineStartPos" gives the character index where the line
+** begins and "line" is its text. On return "styles" holds one entry for each
+** character, followed by the style of the blank area beyond the end of the
+** line. Passing lineStartPos of -1 gives the drawing style for "no text".
 **
-** Why not just: styleOfPos(pos)?  Because style applies to blank areas
-** of the window beyond the text boundaries, and because this routine must also
-** decide whether a position is inside of a rectangular selection, and do so
-** efficiently, without re-counting character positions from the start of the
-** line.
+** Everything except rectangular selections is resolved here: the syntax
+** highlighting style, the other kinds of selections, rangesets and the
+** backlighting class. Whether a position is inside of a rectangular selection
+** depends on its display column rather than its buffer position, see
+** rectSelectionStyle.
 **
 ** Note that style is a somewhat incorrect name, drawing method would
 ** be more appropriate.
 */
-uint32_t TextArea::styleOfPos(TextCursor lineStartPos, int64_t lineLen, int64_t lineIndex, int64_t dispIndex, int thisChar) const {
+void TextArea::resolveLineStyles(TextCursor lineStartPos, const std::string &line, std::vector<uint32_t> *styles) const {
+
+	PaintStatistics::Timer timer(paintStatistics_.get(), PaintStatistics::Styles);
+
+	const auto lineLen = static_cast<int64_t>(line.size());
+
+	styles->clear();
 
 	if (lineStartPos == -1 || !buffer_) {
-		return FILL_MASK;
+		styles->push_back(FILL_MASK);
+		return;
 	}
 
-	TextCursor pos = lineStartPos + std::min(lineIndex, lineLen);
-	uint32_t style = 0;
+	styles->resize(static_cast<size_t>(lineLen + 1), 0);
+	uint32_t *const style = styles->data();
+	style[lineLen] = FILL_MASK;
 
-	if (lineIndex >= lineLen) {
-		style = FILL_MASK;
-	} else if (styleBuffer_) {
-		style = static_cast<uint8_t>(styleBuffer_->BufGetCharacter(pos));
-		if (style == unfinishedStyle_) {
-			// encountered "unfinished" style, trigger parsing
-			(unfinishedHighlightCB_)(this, pos, highlightCBArg_);
-			style = static_cast<uint8_t>(styleBuffer_->BufGetCharacter(pos));
+	// syntax highlighting, parsing any "unfinished" regions as they are found
+	if (styleBuffer_) {
+		std::string lineStyle = styleBuffer_->BufGetRangeEx(lineStartPos, lineStartPos + lineLen);
+		if (paintStatistics_) {
+			paintStatistics_->add(PaintStatistics::BytesCopied, lineLen);
 		}
-	}
 
-	if (buffer_->primary.inSelection(pos, lineStartPos, dispIndex)) {
-		style |= PRIMARY_MASK;
-	}
+		for (int64_t i = 0; i < lineLen; ++i) {
+			if (static_cast<uint8_t>(lineStyle[static_cast<size_t>(i)]) == unfinishedStyle_) {
+				(unfinishedHighlightCB_)(this, lineStartPos + i, highlightCBArg_);
+				lineStyle.replace(static_cast<size_t>(i), std::string::npos, styleBuffer_->BufGetRangeEx(lineStartPos + i, lineStartPos + lineLen));
+			}
 
-	if (buffer_->highlight.inSelection(pos, lineStartPos, dispIndex)) {
-		style |= HIGHLIGHT_MASK;
+			style[i] = static_cast<uint8_t>(lineStyle[static_cast<size_t>(i)]);
+		}
 	}
 
-	if (buffer_->secondary.inSelection(pos, lineStartPos, dispIndex)) {
-		style |= SECONDARY_MASK;
-	}
+	// positions [first, last) of the line, including the position past its end
+	auto markRange = [&](TextCursor first, TextCursor last, uint32_t mask) {
+		const int64_t from = std::max<int64_t>(first - lineStartPos, 0);
+		const int64_t to   = std::min<int64_t>(last - lineStartPos, lineLen + 1);
+		for (int64_t i = from; i < to; ++i) {
+			style[i] |= mask;
+		}
+	};
+
+	auto markSelection = [&](const TextBuffer::Selection &sel, uint32_t mask) {
+		if (sel.hasSelection() && !sel.isRectangular()) {
+			markRange(sel.start(), sel.end(), mask);
+		}
+	};
+
+	markSelection(buffer_->primary,   PRIMARY_MASK);
+	markSelection(buffer_->highlight, HIGHLIGHT_MASK);
+	markSelection(buffer_->secondary, SECONDARY_MASK);
 
-	/* store in the RANGESET_MASK portion of style the rangeset index for pos */
+	/* store in the RANGESET_MASK portion of style the index (plus one) of the
+	   first colored rangeset containing each position, as found in the
+	   table's merged index of the colored text */
 	if (document_->rangesetTable_) {
-		size_t rangesetIndex = document_->rangesetTable_->index1ofPos(pos, true);
-		style |= ((rangesetIndex << RANGESET_SHIFT) & RANGESET_MASK);
+		std::vector<RangesetTable::ColorRun> runs;
+		document_->rangesetTable_->colorRuns(lineStartPos, lineStartPos + lineLen + 1, &runs);
+
+		for (const RangesetTable::ColorRun &run : runs) {
+			const uint32_t mask = ((static_cast<uint32_t>(run.index) << RANGESET_SHIFT) & RANGESET_MASK);
+			for (int64_t j = run.start - lineStartPos; j < run.end - lineStartPos; ++j) {
+				style[j] = (style[j] & ~RANGESET_MASK) | mask;
+			}
+		}
 	}
 
 	/* store in the BACKLIGHT_MASK portion of style the background color class
-	   of the character thisChar */
+	   of each character */
 	if (!bgClass_.empty()) {
-		style |= (bgClass_[static_cast<uint8_t>(thisChar)] << BACKLIGHT_SHIFT);
+		for (int64_t i = 0; i < lineLen; ++i) {
+			style[i] |= (bgClass_[static_cast<uint8_t>(line[static_cast<size_t>(i)])] << BACKLIGHT_SHIFT);
+		}
+
+		style[lineLen] |= (bgClass_[0] << BACKLIGHT_SHIFT);
+	}
+}
+
+/*
+** Return the selection bits of the style of a position in any rectangular
+** selections. "lineStartPos" is the start of the displayed line containing
+** "pos", and "dispIndex" the number of displayed characters past the
+** beginning of the line.
+*/
+uint32_t TextArea::rectSelectionStyle(TextCursor pos, TextCursor lineStartPos, int64_t dispIndex) const {
+
+	uint32_t style = 0;
+
+	if (buffer_->primary.isRectangular() && buffer_->primary.inSelection(pos, lineStartPos, dispIndex)) {
+		style |= PRIMARY_MASK;
+	}
+
+	if (buffer_->highlight.isRectangular() && buffer_->highlight.inSelection(pos, lineStartPos, dispIndex)) {
+		style |= HIGHLIGHT_MASK;
+	}
+
+	if (buffer_->secondary.isRectangular() && buffer_->secondary.inSelection(pos, lineStartPos, dispIndex)) {
+		style |= SECONDARY_MASK;
 	}
 
 	return style;
@@ -2952,12 +3900,14 @@ uint32_t TextArea::styleOfPos(TextCursor lineStartPos, int64_t lineLen, int64_t
 /*
 ** Draw a string or blank area according to parameter "style", using the
 ** appropriate colors and drawing method for that style, with top left
-** corner at x, y.  If style says to draw text, use "string" as source of
-** characters, and draw "nChars", if style is FILL, erase
+** corner at x, y.  If style says to draw text, draw "text", if style is
+** FILL, erase
 ** rectangle where text would have drawn from x to toX and from y to
 ** the maximum y extent of the current font(s).
 */
-void TextArea::drawString(QPainter *painter, uint32_t style, int x, int y, int toX, const char *string, int nChars) {
+void TextArea::drawString(QPainter *painter, uint32_t style, int x, int y, int toX, const QStaticText &text) {
+
+	PaintStatistics::Timer timer(paintStatistics_.get(), PaintStatistics::Drawing);
 
 	const QRect viewRect = viewport()->contentsRect();
 	const QPalette &pal  = palette();
@@ -3077,7 +4027,6 @@ void TextArea::drawString(QPainter *painter, uint32_t style, int x, int y, int t
 		renderFont.setUnderline(true);
 	}
 
-	const auto s = asciiToUnicode(string, nChars);
 	const QRect rect(x, y, toX - x, fixedFontHeight_);
 
 	painter->save();
@@ -3089,8 +4038,11 @@ void TextArea::drawString(QPainter *painter, uint32_t style, int x, int y, int t
 	 * rendering to here. This is because this code actually clears the
 	 * background behind the rendered text */
 
+	// centered vertically in the line, the way Qt::AlignVCenter would
+	const qreal top = y + (fixedFontHeight_ - painter->fontMetrics().height()) / 2.0;
+
 	painter->setPen(fground);
-	painter->drawText(rect, Qt::TextSingleLine | Qt::TextDontClip | Qt::AlignVCenter | Qt::AlignLeft, s);
+	painter->drawStaticText(QPointF(x, top), text);
 	painter->restore();
 }
 
@@ -3209,12 +4161,13 @@ void TextArea::TextDResize(bool widthChanged) {
 	   the top character no longer pointing at a valid line start */
 	if (continuousWrap_ && wrapMargin_ == 0 && widthChanged) {
 		const TextCursor oldFirstChar = firstChar_;
-		const TextCursor start = buffer_->BufStartOfBuffer();
-		const TextCursor end   = buffer_->BufEndOfBuffer();
 
-		nBufferLines_ = TextDCountLines(start, end, /*startPosIsLineStart=*/true);
+		resetWrapIndex();
+		extendWrapIndex(buffer_->BufEndOfBuffer(), -1, std::numeric_limits<int64_t>::max());
+
+		nBufferLines_ = static_cast<int>(wrapIndex_.rows() - 1);
 		firstChar_    = TextDStartOfLine(firstChar_);
-		topLineNum_   = TextDCountLines(start, firstChar_, /*startPosIsLineStart=*/true) + 1;
+		topLineNum_   = static_cast<int>(wrappedRowOfPos(firstChar_)) + 1;
 		offsetAbsLineNum(oldFirstChar);
 	}
 
@@ -3317,6 +4270,8 @@ void TextArea::TextDUnblankCursor() {
 */
 void TextArea::offsetLineStarts(int newTopLineNum) {
 
+	PaintStatistics::Timer timer(paintStatistics_.get(), PaintStatistics::LineStarts);
+
 	const TextCursor oldFirstChar = firstChar_;
 	const int oldTopLineNum       = topLineNum_;
 	const int lineDelta           = newTopLineNum - oldTopLineNum;
@@ -3329,10 +4284,14 @@ void TextArea::offsetLineStarts(int newTopLineNum) {
 
 	/* Find the new value for firstChar by counting lines from the nearest
 	   known line start (start or end of buffer, or the closest value in the
-	   lineStarts array) */
+	   lineStarts array). In continuous wrap mode, counting wrapped lines
+	   over a long distance is slow, so far jumps look up the line in the
+	   wrapped line index instead */
 	const int lastLineNum = oldTopLineNum + nVisLines - 1;
 
-	if (newTopLineNum < oldTopLineNum && newTopLineNum < -lineDelta) {
+	if (continuousWrap_ && std::abs(lineDelta) >= nVisLines) {
+		firstChar_ = wrappedRowStart(newTopLineNum - 1);
+	} else if (newTopLineNum < oldTopLineNum && newTopLineNum < -lineDelta) {
 		firstChar_ = TextDCountForwardNLines(buffer_->BufStartOfBuffer(), newTopLineNum - 1, true);
 	} else if (newTopLineNum < oldTopLineNum) {
 		firstChar_ = TextDCountBackwardNLines(firstChar_, -lineDelta);
@@ -3591,6 +4550,7 @@ void TextArea::setupBGClasses(const QString &str) {
 
 	bgClass_       = std::move(backgroundClass);
 	bgClassColors_ = std::move(backgroundColor);
+	clearLineCache();
 
 }
 
@@ -3692,6 +4652,7 @@ void TextArea::setColors(const QColor &textFG, const QColor &textBG, const QColo
 	cursorFGColor_  = cursorFG;
 
 	// Redisplay
+	clearLineCache();
 	TextDRedisplayRect(viewRect);
 	repaintLineNumbers();
 }
@@ -3766,6 +4727,8 @@ void TextArea::checkAutoShowInsertPos() {
 */
 void TextArea::TextDMakeInsertPosVisible() {
 
+	flushRedisplay();
+
 	const QRect viewRect = viewport()->contentsRect();
 	const TextCursor cursorPos = cursorPos_;
 	const int cursorVPadding   = cursorVPadding_;	
@@ -6438,13 +7401,23 @@ void TextArea::TextDSetWrapMode(bool wrap, int wrapMargin) {
 	wrapMargin_     = wrapMargin;
 
 	// wrapping can change change the total number of lines, re-count
-	nBufferLines_ = TextDCountLines(buffer_->BufStartOfBuffer(), buffer_->BufEndOfBuffer(), /*startPosIsLineStart=*/true);
+	resetWrapIndex();
+	if (continuousWrap_) {
+		extendWrapIndex(buffer_->BufEndOfBuffer(), -1, std::numeric_limits<int64_t>::max());
+		nBufferLines_ = static_cast<int>(wrapIndex_.rows() - 1);
+	} else {
+		nBufferLines_ = countBufferLines();
+	}
 
 	/* changing wrap margins wrap or changing from wrapped mode to non-wrapped
 	 * can leave the character at the top no longer at a line start, and/or
 	 * change the line number */
-	firstChar_  = TextDStartOfLine(firstChar_);
-	topLineNum_ = TextDCountLines(buffer_->BufStartOfBuffer(), firstChar_, /*startPosIsLineStart=*/true) + 1;
+	firstChar_ = TextDStartOfLine(firstChar_);
+	if (continuousWrap_) {
+		topLineNum_ = static_cast<int>(wrappedRowOfPos(firstChar_)) + 1;
+	} else {
+		topLineNum_ = TextDCountLines(buffer_->BufStartOfBuffer(), firstChar_, /*startPosIsLineStart=*/true) + 1;
+	}
 	resetAbsLineNum();
 
 	// update the line starts array
@@ -6761,9 +7734,11 @@ void TextArea::setFont(const QFont &font) {
 
 	font_ = font;
 	updateFontMetrics(font);
+	clearLineCache();
 
-	// force recalculation of font related parameters
-	TextDResize(/*widthChanged=*/false);
+	/* force recalculation of font related parameters, the width of the
+	   characters changed, so in continuous wrap mode lines wrap differently */
+	TextDResize(/*widthChanged=*/true);
 
 	// force a recalc of the line numbers
 	setLineNumCols(getLineNumCols());
@@ -7210,6 +8185,7 @@ void TextArea::TextDAttachHighlightData(const std::shared_ptr<TextBuffer> &style
 	unfinishedStyle_       = unfinishedStyle;
 	unfinishedHighlightCB_ = unfinishedHighlightCB;
 	highlightCBArg_        = user;
+	clearLineCache();
 	viewport()->update();
 }
 
@@ -7303,6 +8279,7 @@ std::string TextArea::TextGetWrapped(TextCursor startPos, TextCursor endPos) {
 
 void TextArea::setStyleBuffer(const std::shared_ptr<TextBuffer> &buffer) {
 	styleBuffer_ = buffer;
+	clearLineCache();
 }
 
 int TextArea::getWrapMargin() const {
@@ -7656,11 +8633,13 @@ void TextArea::scrollDownAP(int count, ScrollUnits units, EventFlags flags) {
 
 void TextArea::scrollLeftAP(int pixels, EventFlags flags) {
 	EMIT_EVENT_0("scroll_left");
+	flushRedisplay();
 	horizontalScrollBar()->setValue(horizontalScrollBar()->value() - pixels);
 }
 
 void TextArea::scrollRightAP(int pixels, EventFlags flags) {
 	EMIT_EVENT_0("scroll_right");
+	flushRedisplay();
 	horizontalScrollBar()->setValue(horizontalScrollBar()->value() + pixels);
 }
 
@@ -7686,6 +8665,135 @@ void TextArea::RemoveWidgetHighlightEx() {
 	TextDAttachHighlightData(nullptr, {}, UNFINISHED_STYLE, nullptr, nullptr);
 }
 
+/*
+** Show the figures of the last frame painted in the top right corner of the
+** text area.
+*/
+void TextArea::showPaintStatistics() {
+
+	paintStatisticsWidget_->setText(paintStatistics_->summary());
+	paintStatisticsWidget_->adjustSize();
+
+	const QRect viewRect = viewport()->geometry();
+	paintStatisticsWidget_->move(viewRect.right() - paintStatisticsWidget_->width() - CALLTIP_EDGE_GUARD, viewRect.top() + CALLTIP_EDGE_GUARD);
+}
+
+/**
+ * @brief TextArea::paintStatisticsTimerTimeout
+ */
+void TextArea::paintStatisticsTimerTimeout() {
+	if (paintStatistics_) {
+		showPaintStatistics();
+	}
+}
+
+/**
+ * @brief TextArea::paintStatistics
+ * @return the timings of the repaints of this text area, or nullptr if they
+ * aren't being recorded
+ */
+PaintStatistics *TextArea::paintStatistics() const {
+	return paintStatistics_.get();
+}
+
+/*
+** Turn the paint instrumentation on or off. While it is on, the time spent
+** in each phase of a repaint is recorded along with how much text was drawn,
+** and the figures of the last frame are shown in the corner of the text.
+*/
+void TextArea::setPaintStatisticsEnabled(bool enabled) {
+
+	if (enabled == (paintStatistics_ != nullptr)) {
+		return;
+	}
+
+	if (enabled) {
+		paintStatistics_ = std::make_unique<PaintStatistics>();
+
+		if (paintStatisticsWidget_ == nullptr) {
+			paintStatisticsWidget_ = new QLabel(this);
+			paintStatisticsWidget_->setAttribute(Qt::WA_TransparentForMouseEvents);
+			paintStatisticsWidget_->setFrameStyle(QFrame::Box | QFrame::Plain);
+			paintStatisticsWidget_->setMargin(2);
+
+			/* an opaque label is updated without repainting the text beneath
+			 * it, which would be recorded as another frame */
+			paintStatisticsWidget_->setAutoFillBackground(true);
+
+			paintStatisticsTimer_ = new QTimer(this);
+			paintStatisticsTimer_->setInterval(PAINT_STATISTICS_INTERVAL);
+			paintStatisticsTimer_->setSingleShot(true);
+			connect(paintStatisticsTimer_, &QTimer::timeout, this, &TextArea::paintStatisticsTimerTimeout);
+		}
+
+		showPaintStatistics();
+		paintStatisticsWidget_->show();
+	} else {
+		paintStatistics_ = nullptr;
+		paintStatisticsTimer_->stop();
+		paintStatisticsWidget_->hide();
+	}
+
+	viewport()->update();
+	lineNumberArea_->update();
+}
+
+/*
+** Scroll down through the text a line at a time for up to "lines" lines,
+** painting each step before taking the next, first by shifting the text which
+** is already displayed and then by repainting all of it. Returns the time per
+** line of both, along with their paint statistics. The view is put back where
+** it was afterwards, and any statistics which were being recorded are kept.
+*/
+QString TextArea::measureScrolling(int lines) {
+
+	const bool recording = (paintStatistics_ != nullptr);
+	setPaintStatisticsEnabled(true);
+	std::unique_ptr<PaintStatistics> recorded = std::move(paintStatistics_);
+
+	QScrollBar *scrollBar = verticalScrollBar();
+	const int topLine     = scrollBar->value();
+
+	QString report;
+	for (bool blit : {true, false}) {
+		blitScrolling_ = blit;
+
+		scrollBar->setValue(topLine);
+		QApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+
+		paintStatistics_ = std::make_unique<PaintStatistics>();
+
+		QElapsedTimer timer;
+		timer.start();
+
+		int steps = 0;
+		while (steps < lines && scrollBar->value() < scrollBar->maximum()) {
+			scrollBar->setValue(scrollBar->value() + 1);
+			QApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+			++steps;
+		}
+
+		const qint64 elapsed = timer.nsecsElapsed();
+
+		report += QString(QLatin1String("%1: %2 lines, %3 us per line\n%4\n"))
+		        .arg(blit ? QLatin1String("shifting the text") : QLatin1String("repainting all of it"))
+		        .arg(steps)
+		        .arg(steps != 0 ? elapsed / 1000 / steps : 0)
+		        .arg(paintStatistics_->report());
+	}
+
+	blitScrolling_ = true;
+	scrollBar->setValue(topLine);
+
+	if (recording) {
+		paintStatistics_ = std::move(recorded);
+	} else {
+		setPaintStatisticsEnabled(false);
+	}
+
+	return report;
+}
+
 /**
  * @brief TextArea::showResizeNotification
  * Shows the size of the widget in rows/columns.
@@ -7726,6 +8834,9 @@ void TextArea::showResizeNotification() {
 */
 void TextArea::makeSelectionVisible() {
 
+	// the horizontal scroll range must account for recent changes
+	flushRedisplay();
+
 	const QRect viewRect = viewport()->contentsRect();
 	bool isRect;	
 	TextCursor left;
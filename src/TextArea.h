@@ -9,6 +9,7 @@
 #include "StyleTableEntry.h"
 #include "TextBufferFwd.h"
 #include "TextCursor.h"
+#include "WrapIndex.h"
 #include "Util/string_view.h"
 
 #include <QAbstractScrollArea>
@@ -17,9 +18,11 @@
 #include <QFont>
 #include <QPointer>
 #include <QRect>
+#include <QStaticText>
 #include <QTime>
 #include <QVector>
 
+#include <array>
 #include <memory>
 #include <vector>
 
@@ -28,6 +31,7 @@
 class CallTipWidget;
 class TextArea;
 class DocumentWidget;
+class PaintStatistics;
 struct DragEndEvent;
 struct SmartIndentEvent;
 
@@ -118,6 +122,10 @@ private Q_SLOTS:
 	void autoScrollTimerTimeout();
 	void verticalScrollBar_valueChanged(int value);
 	void horizontalScrollBar_valueChanged(int value);
+	void wrapIndexTimerTimeout();
+	void lineCountTimerTimeout();
+	void paintStatisticsTimerTimeout();
+	void flushRedisplay();
 
 private:
 	bool clickTracker(QMouseEvent *event, bool inDoubleClickHandler);
@@ -217,6 +225,8 @@ public:
 	QMargins getMargins() const;
 	int64_t TextFirstVisibleLine() const;
 	int64_t getBufferLinesCount() const;
+	PaintStatistics *paintStatistics() const;
+	QString measureScrolling(int lines);
 	std::string TextGetWrapped(TextCursor startPos, TextCursor endPos);
 	void RemoveWidgetHighlightEx();
 	void TextDAttachHighlightData(const std::shared_ptr<TextBuffer> &styleBuffer, const std::vector<StyleTableEntry> &styleTable, uint32_t unfinishedStyle, unfinishedStyleCBProcEx unfinishedHighlightCB, void *user);	
@@ -236,6 +246,7 @@ public:
 	void setLineNumCols(int value);
 	void setModifyingTabDist(bool modifying);
 	void setOverstrike(bool value);
+	void setPaintStatisticsEnabled(bool enabled);
 	void setReadOnly(bool value);
 	void setSmartIndent(bool value);
 	void setStyleBuffer(const std::shared_ptr<TextBuffer> &buffer);
@@ -247,6 +258,58 @@ public:
 	void bufPreDeleteCallback(TextCursor pos, int64_t nDeleted);
 	void bufModifiedCallback(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled, view::string_view deletedText);
 
+private:
+	// a span of a displayed line drawn in a single style
+	struct LineRun {
+		int x;
+		int toX;
+		uint32_t style;
+		QStaticText text;
+	};
+
+	// the runs making up a displayed line, see renderedLine
+	struct RenderedLine {
+		TextCursor lineStart;
+		int length;
+		uint64_t lastUsed;
+		std::vector<LineRun> runs;
+	};
+
+	// the width of a displayed line, in display columns
+	struct MeasuredLine {
+		TextCursor lineStart;
+		int length;
+		int64_t columns;
+	};
+
+	// the display columns of a long line at regular intervals, see longLine
+	struct LongLine {
+		TextCursor lineStart;
+		int length;
+		std::vector<int64_t> columns;
+	};
+
+	// the state of one of the buffer's selections, see redisplayRectSelection
+	struct SelectionState {
+		bool selected      = false;
+		bool rectangular   = false;
+		TextCursor start   = {};
+		TextCursor end     = {};
+		int64_t rectStart  = 0;
+		int64_t rectEnd    = 0;
+
+		bool operator==(const SelectionState &other) const;
+		bool operator!=(const SelectionState &other) const;
+	};
+
+	// display columns of a range of rows waiting to be repainted, see flushRedisplay
+	struct DirtySpan {
+		int firstRow;
+		int lastRow;
+		int64_t startColumn;
+		int64_t endColumn;
+	};
+
 private:
 	QColor getRangesetColor(size_t ind, QColor bground) const;
 	QShortcut *createShortcut(const QString &name, const QKeySequence &keySequence, const char *member);
@@ -255,6 +318,13 @@ private:
 	TextCursor TextDEndOfLine(TextCursor pos, bool startPosIsLineStart) const;
 	TextCursor TextDPosOfPreferredCol(int column, TextCursor lineStartPos);
 	TextCursor TextDStartOfLine(TextCursor pos) const;
+	TextCursor wrappedRowStart(int64_t row);
+	int64_t wrappedRowOfPos(TextCursor pos);
+	bool wrapIndexCovers(TextCursor pos) const;
+	void extendWrapIndex(TextCursor pos, int64_t row, int64_t budget);
+	void resetWrapIndex();
+	int countBufferLines();
+	void updateWrapIndex(TextCursor pos, int64_t nInserted, int64_t nDeleted, view::string_view deletedText);
 	TextCursor TextDXYToPosition(const QPoint &coord) const;
 	TextCursor endOfWord(TextCursor pos) const;
 	TextCursor startOfWord(TextCursor pos) const;
@@ -288,12 +358,18 @@ private:
 	int TextDOffsetWrappedRow(int row) const;
 	int TextDPreferredColumn(int *visLineNum, TextCursor *lineStartPos);
 	int getAbsTopLineNum() const;
-	int measureVisLine(int visLineNum) const;
+	int measureVisLine(int visLineNum);
 	int visLineLength(int visLineNum) const;
 	int widthInPixels(char ch, int column) const;
 	std::string createIndentStringEx(TextBuffer *buf, int64_t bufOffset, TextCursor lineStartPos, TextCursor lineEndPos, int *column);
 	std::string wrapTextEx(view::string_view startLine, view::string_view text, int64_t bufOffset, int wrapMargin, int64_t *breakBefore);
-	uint32_t styleOfPos(TextCursor lineStartPos, int64_t lineLen, int64_t lineIndex, int64_t dispIndex, int thisChar) const;
+	bool rangeTouchesRectSel(TextCursor rangeStart, TextCursor rangeEnd) const;
+	boost::optional<int> cursorXOnLine(TextCursor lineStartPos, int lineLength);
+	const LongLine &longLine(TextCursor lineStartPos, int lineLength);
+	int64_t lineColumn(TextCursor lineStartPos, int lineLength, int64_t index);
+	int64_t longLineIndexOfColumn(const LongLine &line, int64_t column, int64_t *charColumn) const;
+	uint32_t rectSelectionStyle(TextCursor pos, TextCursor lineStartPos, int64_t dispIndex) const;
+	void resolveLineStyles(TextCursor lineStartPos, const std::string &line, std::vector<uint32_t> *styles) const;
 	void BeginBlockDrag();
 	void BlockDragSelection(const QPoint &pos, BlockDragTypes dragType);
 	void cancelBlockDrag();
@@ -332,26 +408,38 @@ private:
 	void checkAutoShowInsertPos();
 	void checkMoveSelectionChange(EventFlags flags, TextCursor startPos);
 	void drawCursor(QPainter *painter, int x, int y);
-	void drawString(QPainter *painter, uint32_t style, int x, int y, int toX, const char *string, int nChars);
+	void drawString(QPainter *painter, uint32_t style, int x, int y, int toX, const QStaticText &text);
 	void endDrag();
 	void extendRangeForStyleMods(TextCursor *start, TextCursor *end);
 	void findLineEnd(TextCursor startPos, bool startPosIsLineStart, TextCursor *lineEnd, TextCursor *nextLineStart);
 	void findWrapRangeEx(view::string_view deletedText, TextCursor pos, int64_t nInserted, int64_t nDeleted, TextCursor *modRangeStart, TextCursor *modRangeEnd, int64_t *linesInserted, int64_t *linesDeleted);
 	void hideOrShowHScrollBar();
 	void keyMoveExtendSelection(TextCursor origPos, bool rectangular);
+	void clearLineCache();
+	void invalidateLineCache(TextCursor start, TextCursor end);
+	void updateLineCache(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled);
 	void measureDeletedLines(TextCursor pos, int64_t nDeleted);
 	void offsetAbsLineNum(TextCursor oldFirstChar);
 	void offsetLineStarts(int newTopLineNum);
 	void redisplayLine(QPainter *painter, int visLineNum, int leftClip, int rightClip);
+	void layoutLine(TextCursor lineStartPos, int lineLength, int leftClip, int rightClip, std::vector<LineRun> *runs);
+	const std::vector<LineRun> &renderedLine(TextCursor lineStartPos, int lineLength);
 	void redisplayLineEx(int visLineNum, int leftCharIndex, int rightCharIndex);
+	void redisplayColumns(int firstRow, int lastRow, int64_t startColumn, int64_t endColumn);
+	bool redisplayRectSelection(const std::array<SelectionState, 3> &oldSelections, TextCursor pos, int64_t nRestyled);
+	bool selectionRows(const SelectionState &selection, int *firstRow, int *lastRow) const;
 	void repaintLineNumbers();
+	void repaintLineNumbers(TextCursor pos);
 	void resetAbsLineNum();
 	void selectLine();
 	void selectWord(int pointerX);
+	void showPaintStatistics();
 	void showResizeNotification();
 	void simpleInsertAtCursor(view::string_view chars, bool allowPendingDelete);
 	void redisplayRange(TextCursor start, TextCursor end);
+	void scheduleRedisplay();
 	void updateFontMetrics(const QFont &font);
+	void updateSelectionStates();
 	bool updateLineStarts(TextCursor pos, int64_t charsInserted, int64_t charsDeleted, int64_t linesInserted, int64_t linesDeleted);
 	void updateVScrollBarRange();
 	void wrappedLineCounter(const TextBuffer *buf, TextCursor startPos, TextCursor maxPos, int maxLines, bool startPosIsLineStart, TextCursor *retPos, int *retLines, TextCursor *retLineStart, TextCursor *retLineEnd) const;
@@ -366,11 +454,16 @@ private:
 	QColor matchFGColor_        = Qt::white;      // Highlight colors are used when flashing matching parens
 	QColor lineNumFGColor_          = Qt::black;      // Color for drawing line numbers
 	QColor lineNumBGColor_          = Qt::white;      // Color for drawing line numbers
+	QLabel *paintStatisticsWidget_  = nullptr;
 	QLabel *resizeWidget_           = nullptr;
 	QTimer *autoScrollTimer_        = nullptr;
 	QTimer *clickTimer_             = nullptr;
 	QTimer *cursorBlinkTimer_       = nullptr;
+	QTimer *lineCountTimer_         = nullptr;
+	QTimer *paintStatisticsTimer_   = nullptr;
+	QTimer *redisplayTimer_         = nullptr;
 	QTimer *resizeTimer_            = nullptr;
+	QTimer *wrapIndexTimer_         = nullptr;
 	QWidget *lineNumberArea_        = nullptr;
 	QPoint cursor_                  = { -100, -100 }; // X pos. of last drawn cursor Note: these are used for *drawing* and are not generally reliable for finding the insert position's x/y coordinates!
 	QVector<TextCursor> lineStarts_ = { TextCursor() };
@@ -381,6 +474,7 @@ private:
 	int absTopLineNum_              = 1;              // In continuous wrap mode, the line number of the top line if the text were not wrapped (note that this is only maintained as needed).
 	int topLineNum_                 = 1;              // Line number of top displayed line of file (first line of file is 1)
 	int lineNumCols_                = 0;
+	int hScrollOffset_              = 0;              // horizontal scroll position of the text currently displayed
 	int dragXOffset_                = 0;              // offsets between cursor location and actual insertion point in drag
 	int dragYOffset_                = 0;              // offsets between cursor location and actual insertion point in drag
 	int nLinesDeleted_              = 0;              // Number of lines deleted during buffer modification (only used when resynchronization is suppressed)
@@ -394,6 +488,9 @@ private:
 	bool showTerminalSizeHint_      = false;
 	bool autoShowInsertPos_         = true;
 	bool pendingDelete_             = true;
+	bool wrapIndexComplete_         = false;          // Whether wrapIndex_ covers the whole buffer
+	bool hScrollRangeDirty_         = false;          // Whether the text changed since the horizontal scroll range was updated
+	bool blitScrolling_             = true;           // Whether scrolling shifts the displayed text rather than repainting it all
 
 private:
 	BlockDragTypes dragType_;                       // style of block drag operation
@@ -441,6 +538,19 @@ private:
 	std::vector<QColor> bgClassColors_;             // table of colors for each BG class
 	std::vector<StyleTableEntry> styleTable_;       // Table of fonts and colors for coloring/syntax-highlighting
 	std::vector<uint8_t> bgClass_;                  // obtains index into bgClassColors_
+	WrapIndex wrapIndex_;                           // display rows of the logical lines, in continuous wrap mode
+	std::vector<uint32_t> lineStyles_;              // scratch space for the styles of the line being drawn
+	std::vector<RenderedLine> lineCache_;           // recently drawn lines, ready to be painted again
+	std::vector<bool> dirtyRows_;                   // displayed rows waiting to be repainted, see flushRedisplay
+	std::vector<DirtySpan> dirtySpans_;             // parts of displayed rows waiting to be repainted
+	std::array<SelectionState, 3> selections_;      // primary, secondary and highlight selections, as of the last buffer modification
+	std::vector<LineRun> lineRuns_;                 // scratch space for lines which can't be cached
+	std::vector<MeasuredLine> lineWidths_;          // widths of recently measured lines
+	std::vector<LongLine> longLines_;               // column checkpoints of recently displayed long lines
+	QRect lineCacheRect_;                           // the view rectangle and horizontal offset the cached lines were laid out for
+	int lineCacheOffset_ = 0;
+	uint64_t lineCacheClock_ = 0;
+	std::unique_ptr<PaintStatistics> paintStatistics_; // timings of the repaints, while the instrumentation is enabled
 	uint32_t unfinishedStyle_;                      // Style buffer entry which triggers on-the-fly reparsing of region
 	unfinishedStyleCBProcEx unfinishedHighlightCB_; // Callback to parse "unfinished" regions
 	void *highlightCBArg_;                          // Arg to unfinishedHighlightCB
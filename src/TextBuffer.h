@@ -3,6 +3,7 @@
 #define TEXT_BUFFER_H_
 
 #include "gap_buffer.h"
+#include "LineIndex.h"
 #include "TextBufferFwd.h"
 #include "TextCursor.h"
 #include "TextRange.h"
@@ -13,6 +14,8 @@
 #include <deque>
 #include <string>
 #include <cstdint>
+#include <memory>
+#include <utility>
 
 #include <boost/optional.hpp>
 
@@ -77,7 +80,7 @@ public:
 	explicit BasicTextBuffer(int64_t size);
 	BasicTextBuffer(const BasicTextBuffer &)            = delete;
 	BasicTextBuffer &operator=(const BasicTextBuffer &) = delete;
-	~BasicTextBuffer()                                  = default;
+	~BasicTextBuffer();
 
 public:
 	static int BufCharWidth(Ch ch, int64_t indent, int tabDist) noexcept;
@@ -94,13 +97,17 @@ public:
 	bool BufGetSyncXSelection() const;
 	bool BufGetUseTabs() const noexcept;
 	bool BufIsEmpty() const noexcept;
+	bool BufIsMapped() const noexcept;
+	bool BufLinesCounted() const noexcept;
 	bool BufSetSyncXSelection(bool sync);
 	boost::optional<TextCursor> searchBackward(TextCursor startPos, view_type searchChars) const noexcept;
 	boost::optional<TextCursor> searchForward(TextCursor startPos, view_type searchChars) const noexcept;
 	Ch BufGetCharacter(TextCursor pos) const noexcept;
 	int64_t BufCountDispChars(TextCursor lineStartPos, TextCursor targetPos) const noexcept;
 	int64_t BufCountLines(TextCursor startPos, TextCursor endPos) const noexcept;
+	int64_t BufEstimateLines() const noexcept;
 	int64_t length() const noexcept;
+	int64_t revision() const noexcept;
 	int compare(TextCursor pos, Ch ch) const noexcept;
 	int compare(TextCursor pos, Ch *cmpText, int64_t size) const noexcept;
 	int compare(TextCursor pos, view_type cmpText) const noexcept;
@@ -121,6 +128,7 @@ public:
 	TextCursor BufEndOfBuffer() const noexcept;
 	constexpr TextCursor BufStartOfBuffer() const noexcept { return {}; }
 	view_type BufAsStringEx() noexcept;
+	std::pair<view_type, view_type> BufGetSegments() const noexcept;
 	void BufAddHighPriorityModifyCB(modify_callback_type bufModifiedCB, void *user);
 	void BufAddModifyCB(modify_callback_type bufModifiedCB, void *user);
 	void BufAddPreDeleteCB(pre_delete_callback_type bufPreDeleteCB, void *user);
@@ -129,6 +137,7 @@ public:
 	void BufCheckDisplay(TextCursor start, TextCursor end) const noexcept;
 	void BufClearRect(TextCursor start, TextCursor end, int64_t rectStart, int64_t rectEnd) noexcept;
 	void BufCopyFromBuf(BasicTextBuffer *fromBuf, TextCursor fromStart, TextCursor fromEnd, TextCursor toPos) noexcept;
+	void BufDetach();
 	void BufHighlight(TextCursor start, TextCursor end) noexcept;
 	void BufInsertColEx(int64_t column, TextCursor startPos, view_type text, int64_t *charsInserted, int64_t *charsDeleted) noexcept;
 	void BufInsertEx(TextCursor pos, Ch ch) noexcept;
@@ -156,11 +165,19 @@ public:
 	void BufSelect(TextCursor start, TextCursor end) noexcept;	
 	void BufSelect(std::pair<TextCursor, TextCursor> range) noexcept;
 	void BufSetAll(view_type text);
+	void BufSetMapped(std::shared_ptr<const Ch> text, int64_t length);
 	void BufSetTabDistance(int distance, bool notify) noexcept;
 	void BufSetUseTabs(bool useTabs) noexcept;
 	void BufUnhighlight() noexcept;
 	void BufUnselect() noexcept;
 
+public:
+	template <class Read>
+	bool BufInsertFromEx(TextCursor pos, int64_t length, Read read);
+
+	template <class Read>
+	bool BufReplaceFromEx(TextCursor start, TextCursor end, int64_t length, Read read);
+
 public:
 	bool GetSimpleSelection(TextRange *range) const noexcept;
 
@@ -183,6 +200,10 @@ private:
 	void updateSelections(TextCursor pos, int64_t nDeleted, int64_t nInserted) noexcept;
 	void sanitizeRange(TextCursor &start, TextCursor &end) const noexcept;
 	void updatePrimarySelection() noexcept;
+	const LineIndex<Ch> *lineIndex() const noexcept;
+
+	template <class Assign>
+	void replaceAll(int64_t insertLength, Assign assign);
 
 private:
 	static string_type unexpandTabs(view_type text, int64_t startIndent, int tabDist);
@@ -207,9 +228,11 @@ private:
 	int tabDist_              = DefaultTabWidth;  // equiv. number of characters in a tab
 	bool useTabs_             = true;             // true if buffer routines are allowed to use tabs for padding in rectangular operations
 	bool syncXSelection_      = true;
+	int64_t revision_         = 0;                // incremented every time the text of the buffer changes
 
 private:
 	gap_buffer<Ch> buffer_;
+	std::shared_ptr<LineIndex<Ch>> lineIndex_; // lines of the mapped text, if the buffer is showing one
 
 private:
 	std::deque<std::pair<pre_delete_callback_type, void *>> preDeleteProcs_; // procedures to call before text is deleted from the buffer; at most one is supported.
@@ -30,21 +30,90 @@ auto BasicTextBuffer<Ch, Tr>::BufAsStringEx() noexcept -> view_type {
 	return buffer_.to_view();
 }
 
+/*
+** Get the text of the buffer as the two pieces on either side of its gap,
+** without moving any of it. Either may be empty. The views are invalidated
+** by the next modification of the buffer.
+*/
+template <class Ch, class Tr>
+auto BasicTextBuffer<Ch, Tr>::BufGetSegments() const noexcept -> std::pair<view_type, view_type> {
+	return std::make_pair(buffer_.before_gap(), buffer_.after_gap());
+}
+
 /*
 ** Replace the entire contents of the text buffer
 */
 template <class Ch, class Tr>
 void BasicTextBuffer<Ch, Tr>::BufSetAll(view_type text) {
+	replaceAll(static_cast<int64_t>(text.size()), [this, text]() {
+		buffer_.assign(text);
+	});
+}
+
+/*
+** Replace the entire contents of the text buffer with "text", a file mapped
+** into memory for example, without copying it. The buffer only reads from
+** "text", which it keeps, until it's first changed, see gap_buffer::map.
+** The lines of the text are counted in the background meanwhile, so that
+** counting them doesn't have to read all of it.
+*/
+template <class Ch, class Tr>
+void BasicTextBuffer<Ch, Tr>::BufSetMapped(std::shared_ptr<const Ch> text, int64_t length) {
+	replaceAll(length, [this, &text, length]() {
+		lineIndex_ = std::make_shared<LineIndex<Ch>>(text, length);
+		lineIndex_->start();
+		buffer_.map(std::move(text), length);
+	});
+}
+
+/*
+** Give a mapped buffer a copy of its text, so that it can be changed
+** without the cost of the copy falling on whichever change comes first.
+*/
+template <class Ch, class Tr>
+void BasicTextBuffer<Ch, Tr>::BufDetach() {
+	buffer_.detach();
+
+	if (lineIndex_) {
+		lineIndex_->cancel();
+		lineIndex_ = nullptr;
+	}
+}
 
-	const auto insertLength = static_cast<int64_t>(text.size());
+/*
+** Replace the entire contents of the text buffer by calling "assign", which
+** puts "insertLength" characters in the emptied buffer.
+*/
+template <class Ch, class Tr>
+template <class Assign>
+void BasicTextBuffer<Ch, Tr>::replaceAll(int64_t insertLength, Assign assign) {
 
 	callPreDeleteCBs(BufStartOfBuffer(), buffer_.size());
 
-	// Save information for redisplay, and get rid of the old buffer
-	const string_type deletedText = BufGetAllEx();
-	const auto deleteLength       = static_cast<int64_t>(deletedText.size());
+	/* Save information for redisplay, and get rid of the old buffer. Mapped
+	   text is passed on as it is, kept alive by "old", rather than copied */
+	gap_buffer<Ch> old;
+	string_type deletedCopy;
+	view_type deletedText;
 
-	buffer_.assign(text);
+	if (buffer_.is_mapped()) {
+		buffer_.swap(old);
+		deletedText = old.before_gap();
+	} else {
+		deletedCopy = BufGetAllEx();
+		deletedText = deletedCopy;
+		buffer_.clear();
+	}
+
+	if (lineIndex_) {
+		lineIndex_->cancel();
+		lineIndex_ = nullptr;
+	}
+
+	const auto deleteLength = static_cast<int64_t>(deletedText.size());
+
+	assign();
+	++revision_;
 
 	// Zero all of the existing selections
 	updateSelections(BufStartOfBuffer(), deleteLength, 0);
@@ -53,6 +122,56 @@ void BasicTextBuffer<Ch, Tr>::BufSetAll(view_type text) {
 	callModifyCBs(BufStartOfBuffer(), deleteLength, insertLength, 0, deletedText);
 }
 
+/**
+ * Stops counting the lines of mapped text, if that's still going on.
+ */
+template <class Ch, class Tr>
+BasicTextBuffer<Ch, Tr>::~BasicTextBuffer() {
+	if (lineIndex_) {
+		lineIndex_->cancel();
+	}
+}
+
+/*
+** Whether the buffer is showing mapped text, see BufSetMapped
+*/
+template <class Ch, class Tr>
+bool BasicTextBuffer<Ch, Tr>::BufIsMapped() const noexcept {
+	return buffer_.is_mapped();
+}
+
+/*
+** Whether the lines of the buffer can be counted without reading all of it,
+** which is only not the case while those of mapped text are being counted
+*/
+template <class Ch, class Tr>
+bool BasicTextBuffer<Ch, Tr>::BufLinesCounted() const noexcept {
+	const LineIndex<Ch> *index = lineIndex();
+	return !index || index->complete();
+}
+
+/*
+** The number of newlines in the buffer, estimated from those counted so far
+** if they are still being counted
+*/
+template <class Ch, class Tr>
+int64_t BasicTextBuffer<Ch, Tr>::BufEstimateLines() const noexcept {
+
+	if (const LineIndex<Ch> *index = lineIndex()) {
+		return index->estimateLines();
+	}
+
+	return BufCountLines(BufStartOfBuffer(), BufEndOfBuffer());
+}
+
+/*
+** The line index of the mapped text, only valid for as long as it's mapped
+*/
+template <class Ch, class Tr>
+const LineIndex<Ch> *BasicTextBuffer<Ch, Tr>::lineIndex() const noexcept {
+	return buffer_.is_mapped() ? lineIndex_.get() : nullptr;
+}
+
 /*
 ** Return a copy of the text between "start" and "end" character positions
 ** Positions start at 0, and the range does not include the character pointed to by "end"
@@ -181,6 +300,67 @@ void BasicTextBuffer<Ch, Tr>::BufReplaceEx(TextCursor start, TextCursor end, Ch
 	callModifyCBs(start, end - start, nInserted, 0, deletedText);
 }
 
+/*
+** Insert text at "pos" which "read" puts straight into the buffer. It is
+** called with where to put it and room for up to "length" characters, and
+** returns how many it put there, or -1 on failure, in which case the buffer
+** is left as it was.
+*/
+template <class Ch, class Tr>
+template <class Read>
+bool BasicTextBuffer<Ch, Tr>::BufInsertFromEx(TextCursor pos, int64_t length, Read read) {
+
+	// if pos is not contiguous to existing text, make it
+	pos = qBound(BufStartOfBuffer(), pos, BufEndOfBuffer());
+
+	const int64_t nInserted = read(buffer_.reserve_gap(to_integer(pos), length), length);
+	if (nInserted < 0) {
+		return false;
+	}
+
+	// Even if nothing is deleted, we must call these callbacks
+	callPreDeleteCBs(pos, 0);
+
+	buffer_.fill_gap(nInserted);
+	++revision_;
+
+	updateSelections(pos, 0, nInserted);
+	cursorPosHint_ = pos + nInserted;
+	callModifyCBs(pos, 0, nInserted, 0, {});
+	return true;
+}
+
+/*
+** Replace the characters between "start" and "end" with text which "read"
+** puts straight into the buffer, as for BufInsertFromEx. The new text goes
+** in ahead of the old, which is then dropped from in front of the gap, so
+** that neither has to be moved to make room for the other.
+*/
+template <class Ch, class Tr>
+template <class Read>
+bool BasicTextBuffer<Ch, Tr>::BufReplaceFromEx(TextCursor start, TextCursor end, int64_t length, Read read) {
+
+	sanitizeRange(start, end);
+
+	const int64_t nInserted = read(buffer_.reserve_gap(to_integer(start), length), length);
+	if (nInserted < 0) {
+		return false;
+	}
+
+	callPreDeleteCBs(start, end - start);
+	const string_type deletedText = BufGetRangeEx(start, end);
+
+	buffer_.fill_gap(nInserted);
+	buffer_.erase(to_integer(start) + nInserted, to_integer(end) + nInserted);
+	++revision_;
+
+	updateSelections(start, end - start, 0);
+	updateSelections(start, 0, nInserted);
+	cursorPosHint_ = start + nInserted;
+	callModifyCBs(start, end - start, nInserted, 0, deletedText);
+	return true;
+}
+
 template <class Ch, class Tr>
 void BasicTextBuffer<Ch, Tr>::BufRemove(TextCursor start, TextCursor end) noexcept {
 
@@ -202,6 +382,7 @@ void BasicTextBuffer<Ch, Tr>::BufCopyFromBuf(BasicTextBuffer<Ch, Tr> *fromBuf, T
 	const int64_t length = (fromEnd - fromStart);
 
 	buffer_.insert(to_integer(toPos), fromBuf->buffer_.to_view(to_integer(fromStart), to_integer(fromEnd)));
+	++revision_;
 
 	updateSelections(toPos, 0, length);
 }
@@ -909,6 +1090,21 @@ TextCursor BasicTextBuffer<Ch, Tr>::BufCountForwardDispChars(TextCursor lineStar
 template <class Ch, class Tr>
 int64_t BasicTextBuffer<Ch, Tr>::BufCountLines(TextCursor startPos, TextCursor endPos) const noexcept {
 
+	// the lines of the whole blocks of mapped text in between are counted already
+	if (const LineIndex<Ch> *index = lineIndex()) {
+		constexpr int64_t BlockSize = LineIndex<Ch>::BlockSize;
+
+		const int64_t end   = to_integer(std::min(endPos, BufEndOfBuffer()));
+		const int64_t first = (to_integer(startPos) + BlockSize - 1) / BlockSize;
+		const int64_t last  = end / BlockSize;
+
+		if (first < last && last <= index->blocksReady()) {
+			return BufCountLines(startPos, TextCursor(first * BlockSize)) +
+			       index->linesBefore(last) - index->linesBefore(first) +
+			       BufCountLines(TextCursor(last * BlockSize), TextCursor(end));
+		}
+	}
+
 	int64_t lineCount = 0;
 
 	TextCursor pos = startPos;
@@ -940,6 +1136,20 @@ TextCursor BasicTextBuffer<Ch, Tr>::BufCountForwardNLines(TextCursor startPos, i
 		return startPos;
 	}
 
+	/* skip to the block of mapped text the line is in, if it's counted
+	   already and far enough away for finding it to be worth it */
+	const LineIndex<Ch> *index = lineIndex();
+	if (index && nLines > 1024) {
+		constexpr int64_t BlockSize = LineIndex<Ch>::BlockSize;
+
+		const int64_t target = BufCountLines(BufStartOfBuffer(), startPos) + nLines;
+		const int64_t block  = index->findBlock(target - 1);
+
+		if (block * BlockSize > to_integer(startPos)) {
+			return BufCountForwardNLines(TextCursor(block * BlockSize), target - index->linesBefore(block));
+		}
+	}
+
 	TextCursor pos = startPos;
 	TextCursor end = BufEndOfBuffer();
 
@@ -1081,6 +1291,7 @@ int64_t BasicTextBuffer<Ch, Tr>::insertEx(TextCursor pos, view_type text) noexce
 	const auto length = static_cast<int64_t>(text.size());
 
 	buffer_.insert(to_integer(pos), text);
+	++revision_;
 
 	updateSelections(pos, 0, length);
 
@@ -1093,6 +1304,7 @@ int64_t BasicTextBuffer<Ch, Tr>::insertEx(TextCursor pos, Ch ch) noexcept {
 	const int64_t length = 1;
 
 	buffer_.insert(to_integer(pos), ch);
+	++revision_;
 
 	updateSelections(pos, 0, length);
 
@@ -1201,6 +1413,7 @@ template <class Ch, class Tr>
 void BasicTextBuffer<Ch, Tr>::deleteRange(TextCursor start, TextCursor end) noexcept {
 
 	buffer_.erase(to_integer(start), to_integer(end));
+	++revision_;
 
 	// fix up any selections which might be affected by the change
 	updateSelections(start, end - start, 0);
@@ -1552,6 +1765,16 @@ int64_t BasicTextBuffer<Ch, Tr>::length() const noexcept {
 	return buffer_.size();
 }
 
+/*
+** Returns a number which changes whenever the text of the buffer does, so
+** that anything derived from the text can tell when it has gone stale.
+** Selection and style changes do not affect it.
+*/
+template <class Ch, class Tr>
+int64_t BasicTextBuffer<Ch, Tr>::revision() const noexcept {
+	return revision_;
+}
+
 template <class Ch, class Tr>
 void BasicTextBuffer<Ch, Tr>::BufAppendEx(view_type text) noexcept {
 	BufInsertEx(TextCursor(length()), text);
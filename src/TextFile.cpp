@@ -0,0 +1,234 @@
+
+#include "TextFile.h"
+#include "Util/FileFormats.h"
+#include "Util/FileSystem.h"
+
+#include <algorithm>
+
+namespace {
+
+// most that is read from the file at a time, and converted in one go
+constexpr int64_t ChunkSize = 256 * 1024;
+
+// how much of the start of the file the line ending format is worked out from
+constexpr int64_t FormatSampleSize = 2000;
+
+}
+
+/**
+ * @brief TextFileReader::TextFileReader
+ * @param fileName
+ * @param convertLineEndings
+ */
+TextFileReader::TextFileReader(const QString &fileName, bool convertLineEndings) : file_(fileName), convert_(convertLineEndings), format_(FileFormats::Unix) {
+}
+
+/**
+ * @brief TextFileReader::open
+ * @return true on success
+ */
+bool TextFileReader::open() {
+
+	if (!file_.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+		error_ = file_.errorString();
+		return false;
+	}
+
+	// files such as those in /proc claim to be empty, so they are read until there's no more
+	const qint64 size = file_.isSequential() ? 0 : file_.size();
+	remaining_ = (size > 0) ? size : -1;
+	return true;
+}
+
+/**
+ * @brief TextFileReader::size
+ * @return the size of the file when it was opened, or -1 if it can't be told
+ * before reading it
+ */
+int64_t TextFileReader::size() const {
+	return (remaining_ < 0) ? -1 : file_.size();
+}
+
+/**
+ * @brief TextFileReader::atEnd
+ * @return true once all of the file has been read
+ */
+bool TextFileReader::atEnd() const {
+	return atEnd_ || (remaining_ == 0 && !pendingCR_);
+}
+
+/**
+ * Reads as much of the rest of the file as fits into the "length" characters
+ * at "out", converting the line endings on the way if asked to. A file which
+ * grows after it was opened is only read up to the size it had then.
+ *
+ * @brief TextFileReader::read
+ * @param out
+ * @param length
+ * @return the number of characters put in "out", or -1 on failure
+ */
+int64_t TextFileReader::read(char *out, int64_t length) {
+
+	int64_t used  = 0;
+	int64_t start = 0; // where the text which hasn't been converted yet begins
+
+	while (!atEnd_ && used < length) {
+
+		// the chunk starts with the carriage return held back from the last one, if any
+		if (pendingCR_) {
+			out[used++] = pendingCR_;
+			pendingCR_  = '\0';
+		}
+
+		int64_t wanted = std::min(ChunkSize, length - used);
+		if (remaining_ >= 0) {
+			wanted = std::min(wanted, remaining_);
+		}
+
+		// no room is left after the carriage return, so it waits for the next call
+		if (wanted == 0 && remaining_ != 0) {
+			pendingCR_ = out[start];
+			used       = start;
+			break;
+		}
+
+		const int64_t n = (wanted == 0) ? 0 : file_.read(out + used, wanted);
+		if (n < 0) {
+			error_ = file_.errorString();
+			return -1;
+		}
+
+		if (n == 0) {
+			atEnd_ = true;
+		} else if (remaining_ > 0) {
+			remaining_ -= n;
+		}
+
+		used += n;
+
+		if (!convert_) {
+			start = used;
+			continue;
+		}
+
+		// a pipe may trickle in, so wait for enough of the text to tell the format from
+		if (!detected_) {
+			if (used - start < FormatSampleSize && !atEnd_ && used < length) {
+				continue;
+			}
+
+			format_   = FormatOfFile(view::string_view(out + start, static_cast<size_t>(used - start)));
+			detected_ = true;
+		}
+
+		switch (format_) {
+		case FileFormats::Dos:
+		{
+			int64_t converted = used - start;
+			ConvertFromDos(out + start, &converted, atEnd_ ? nullptr : &pendingCR_);
+			used = start + converted;
+			break;
+		}
+		case FileFormats::Mac:
+			ConvertFromMac(out + start, used - start);
+			break;
+		case FileFormats::Unix:
+			break;
+		}
+
+		start = used;
+	}
+
+	return used;
+}
+
+/**
+ * Reads the rest of the file into "text", replacing what it held. When the
+ * size of the file is known up front, the string is sized for it once and
+ * the text is read straight into it.
+ *
+ * @brief TextFileReader::readAll
+ * @param text
+ * @return true on success
+ */
+bool TextFileReader::readAll(std::string *text) {
+
+	text->resize(static_cast<size_t>((remaining_ > 0) ? remaining_ : ChunkSize));
+
+	size_t used = 0;
+	while (!atEnd()) {
+		if (used == text->size()) {
+			text->resize(text->size() * 2);
+		}
+
+		const int64_t n = read(&(*text)[used], static_cast<int64_t>(text->size() - used));
+		if (n < 0) {
+			text->clear();
+			return false;
+		}
+
+		used += static_cast<size_t>(n);
+	}
+
+	text->resize(used);
+	return true;
+}
+
+/**
+ * @brief TextFileReader::errorString
+ * @return the reason the last operation failed
+ */
+QString TextFileReader::errorString() const {
+	return error_;
+}
+
+/**
+ * @brief TextFileReader::format
+ * @return the line ending format of the file, as far as it has been read
+ */
+FileFormats TextFileReader::format() const {
+	return format_;
+}
+
+/**
+ * Writes "text" to a file as it is, in place. When appending, the file is
+ * opened in append mode and the text added to its end, without reading or
+ * rewriting any of what is already there.
+ *
+ * @brief WriteTextFile
+ * @param fileName
+ * @param text
+ * @param append
+ * @param error
+ * @return true on success
+ */
+bool WriteTextFile(const QString &fileName, view::string_view text, bool append, QString *error) {
+
+	QFile file(fileName);
+
+	const QIODevice::OpenMode mode = append ? QIODevice::Append : QIODevice::Truncate;
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Unbuffered | mode)) {
+		if (error) {
+			*error = file.errorString();
+		}
+		return false;
+	}
+
+	const char *data = text.data();
+	auto remaining   = static_cast<int64_t>(text.size());
+
+	while (remaining > 0) {
+		const int64_t n = file.write(data, remaining);
+		if (n <= 0) {
+			if (error) {
+				*error = file.errorString();
+			}
+			return false;
+		}
+
+		data      += n;
+		remaining -= n;
+	}
+
+	return true;
+}
@@ -0,0 +1,55 @@
+
+#ifndef TEXT_FILE_H_
+#define TEXT_FILE_H_
+
+#include "Util/string_view.h"
+
+#include <QFile>
+#include <QString>
+
+#include <cstdint>
+#include <string>
+
+enum class FileFormats : int;
+
+/*
+** Reads a file straight into memory the caller provides, such as the gap of
+** a text buffer or the storage of a string, without going through a buffer
+** of its own first. The file is opened unbuffered, so the text is copied
+** just once, from the system into its destination.
+**
+** When asked to, DOS and Macintosh line endings are converted as the text
+** arrives, a chunk at a time, the format being the one of the start of the
+** file. A carriage return at the end of a chunk is held back until the next
+** one shows whether it is followed by a newline.
+*/
+class TextFileReader {
+public:
+	explicit TextFileReader(const QString &fileName, bool convertLineEndings = true);
+	TextFileReader(const TextFileReader &)            = delete;
+	TextFileReader &operator=(const TextFileReader &) = delete;
+	~TextFileReader()                                 = default;
+
+public:
+	bool open();
+	bool atEnd() const;
+	bool readAll(std::string *text);
+	int64_t read(char *out, int64_t length);
+	int64_t size() const;
+	QString errorString() const;
+	FileFormats format() const;
+
+private:
+	QFile file_;
+	QString error_;
+	int64_t remaining_ = 0;     // bytes left to read of what the file held when opened, -1 if it can't be told
+	bool convert_;
+	bool detected_     = false; // whether the format has been worked out yet
+	bool atEnd_        = false;
+	char pendingCR_    = '\0';  // carriage return held back from the end of the last chunk
+	FileFormats format_;
+};
+
+bool WriteTextFile(const QString &fileName, view::string_view text, bool append, QString *error = nullptr);
+
+#endif
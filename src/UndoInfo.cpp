@@ -1,5 +1,163 @@
 
 #include "UndoInfo.h"
 
+#include <QByteArray>
+
+#include <limits>
+
+namespace {
+
+const std::string NoText;
+
+}
+
+/**
+ * @brief UndoInfo::UndoInfo
+ * @param undoType
+ * @param start
+ * @param end
+ */
 UndoInfo::UndoInfo(UndoTypes undoType, TextCursor start, TextCursor end) : type(undoType), startPos(start), endPos(end) {
 }
+
+/**
+ * @brief UndoInfo::isCompressed
+ * @return
+ */
+bool UndoInfo::isCompressed() const {
+	return compressed_;
+}
+
+/**
+ * @brief UndoInfo::memoryUsage
+ * @return the number of bytes this record accounts for, including the record itself
+ */
+size_t UndoInfo::memoryUsage() const {
+	return sizeof(UndoInfo) + savedText().capacity() + reversedPrefix_.capacity();
+}
+
+/**
+ * @brief UndoInfo::oldText
+ * @return the text deleted by the operation
+ */
+std::string UndoInfo::oldText() const {
+
+	const std::string &saved = savedText();
+
+	if(!reversedPrefix_.empty()) {
+		std::string text(reversedPrefix_.rbegin(), reversedPrefix_.rend());
+		text.append(saved);
+		return text;
+	}
+
+	if(!compressed_) {
+		return saved;
+	}
+
+	const QByteArray text = qUncompress(reinterpret_cast<const uchar *>(saved.data()), static_cast<int>(saved.size()));
+	return std::string(text.constData(), static_cast<size_t>(text.size()));
+}
+
+/**
+ * @brief UndoInfo::setOldText
+ * @param text
+ */
+void UndoInfo::setOldText(view::string_view text) {
+	oldText_    = std::make_shared<std::string>(text.to_string());
+	compressed_ = false;
+	reversedPrefix_.clear();
+}
+
+/**
+ * @brief UndoInfo::appendOldText
+ * @param text
+ */
+void UndoInfo::appendOldText(view::string_view text) {
+	decompress();
+	unsharedText().append(text.begin(), text.end());
+}
+
+/*
+** Add text in front of the saved text. A long run of backspaces does this
+** once per character, so rather than inserting at the front each time, the
+** text is appended in reverse to a separate buffer which is only combined
+** with the rest when the whole text is needed.
+*/
+void UndoInfo::prependOldText(view::string_view text) {
+	decompress();
+	reversedPrefix_.append(text.rbegin(), text.rend());
+}
+
+/*
+** Replace large saved text with a compressed copy, if that actually saves
+** anything. This trades a little time when the operation is undone for what
+** is often a large reduction in the memory held by big deletions.
+*/
+void UndoInfo::compress() {
+
+	flatten();
+
+	const std::string &saved = savedText();
+	if(compressed_ || saved.size() < UNDO_COMPRESS_THRESHOLD || saved.size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+		return;
+	}
+
+	// favor speed, this happens while the user is editing
+	const QByteArray text = qCompress(reinterpret_cast<const uchar *>(saved.data()), static_cast<int>(saved.size()), 1);
+	if(static_cast<size_t>(text.size()) >= saved.size()) {
+		return;
+	}
+
+	oldText_    = std::make_shared<std::string>(text.constData(), static_cast<size_t>(text.size()));
+	compressed_ = true;
+}
+
+/**
+ * @brief UndoInfo::decompress
+ */
+void UndoInfo::decompress() {
+
+	if(!compressed_) {
+		return;
+	}
+
+	oldText_    = std::make_shared<std::string>(oldText());
+	compressed_ = false;
+}
+
+/**
+ * @brief UndoInfo::flatten
+ */
+void UndoInfo::flatten() {
+
+	if(reversedPrefix_.empty()) {
+		return;
+	}
+
+	oldText_        = std::make_shared<std::string>(oldText());
+	reversedPrefix_ = std::string();
+}
+
+/**
+ * @brief UndoInfo::savedText
+ * @return the saved text as it is stored, possibly compressed and without the reversed prefix
+ */
+const std::string &UndoInfo::savedText() const {
+	return oldText_ ? *oldText_ : NoText;
+}
+
+/*
+** The saved text, ready to be changed in place. If it is shared with a copy
+** of the record, such as one being written to the undo journal, it is copied
+** first so that the other record is left as it was.
+*/
+std::string &UndoInfo::unsharedText() {
+
+	if(!oldText_) {
+		oldText_ = std::make_shared<std::string>();
+	} else if(oldText_.use_count() > 1) {
+		oldText_ = std::make_shared<std::string>(*oldText_);
+	}
+
+	return *oldText_;
+}
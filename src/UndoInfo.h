@@ -3,16 +3,28 @@
 #define UNDO_INFO_H_
 
 #include "TextCursor.h"
+#include "Util/string_view.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 
 /* The accumulated list of undo operations can potentially consume huge
    amounts of memory.  These tuning parameters determine how much undo infor-
-   mation is retained.  Normally, the list is kept between UNDO_OP_LIMIT and
-   UNDO_OP_TRIMTO in length (when the list reaches UNDO_OP_LIMIT, it is
-   trimmed to UNDO_OP_TRIMTO then allowed to grow back to UNDO_OP_LIMIT). */
+   mation is retained.  Normally, the memory used by the undo list of a
+   document is kept between UNDO_MEMORY_LIMIT and UNDO_MEMORY_TRIMTO bytes
+   (when the list reaches UNDO_MEMORY_LIMIT, the oldest records are discarded
+   until it is below UNDO_MEMORY_TRIMTO, then it is allowed to grow back to
+   UNDO_MEMORY_LIMIT). The most recent operation is always retained, no matter
+   how large it is. */
+
+constexpr size_t UNDO_MEMORY_LIMIT  = 64 * 1024 * 1024;
+constexpr size_t UNDO_MEMORY_TRIMTO = 48 * 1024 * 1024;
 
-constexpr auto UNDO_OP_LIMIT  = 400u;
-constexpr auto UNDO_OP_TRIMTO = 200u;
+/* Saved text at least this large is compressed as soon as it can no longer
+   be added to by a continuing operation */
+constexpr size_t UNDO_COMPRESS_THRESHOLD = 4096;
 
 enum UndoTypes {
 	UNDO_NOOP,
@@ -26,6 +38,8 @@ enum UndoTypes {
 
 /* Record on undo list */
 class UndoInfo {
+	friend class UndoJournal;
+
 public:
 	explicit UndoInfo(UndoTypes undoType, TextCursor start, TextCursor end);
 	UndoInfo(const UndoInfo &)            = default;
@@ -35,12 +49,31 @@ public:
 	~UndoInfo()                           = default;
 
 public:
-	std::string oldText;
+	bool isCompressed() const;
+	size_t memoryUsage() const;
+	std::string oldText() const;
+	void appendOldText(view::string_view text);
+	void compress();
+	void prependOldText(view::string_view text);
+	void setOldText(view::string_view text);
+
+private:
+	const std::string &savedText() const;
+	std::string &unsharedText();
+	void decompress();
+	void flatten();
+
+public:
 	UndoTypes type;
 	TextCursor startPos;
-	TextCursor endPos;	
-	bool inUndo          = false; // flag to indicate undo command on this record in progress. Redirects SaveUndoInfo to save the next modifications on the redo list instead of the undo list.
-	bool restoresToSaved = false; // flag to indicate undoing this operation will restore file to last saved (unmodified) state
+	TextCursor endPos;
+	uint64_t serial = 0;   // identifies the record, undoing the record whose serial is DocumentInfo::savedSerial restores the file to its last saved (unmodified) state
+	bool inUndo     = false; // flag to indicate undo command on this record in progress. Redirects SaveUndoInfo to save the next modifications on the redo list instead of the undo list.
+
+private:
+	std::shared_ptr<std::string> oldText_; // text deleted by the operation, held in qCompress format when compressed_ is set. Copies of the record share it until one of them changes it
+	std::string reversedPrefix_;  // text deleted in front of oldText_ by a run of backward deletes, in reverse order
+	bool compressed_ = false;
 };
 
 #endif
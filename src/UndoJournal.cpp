@@ -0,0 +1,662 @@
+
+#include "UndoJournal.h"
+#include "FunctionTask.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QtDebug>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+/* The journal starts with a small header, followed by a sequence of frames,
+   each of which is a one byte kind and a 64-bit payload length followed by
+   the payload itself. All numbers are stored big endian (QDataStream) */
+constexpr quint32 JournalMagic   = 0x4e554a31; // "NUJ1"
+constexpr quint32 JournalVersion = 2;
+
+constexpr int64_t HeaderSize       = 8;
+constexpr int64_t FrameHeaderSize  = 9;
+constexpr int64_t RecordHeaderSize = 26; // type, start, end, serial and compression flag
+
+/* The journal is rewritten with only the records still in it once its file is
+   CompactFactor times larger than they are, and at least CompactMinimumSize */
+constexpr int64_t CompactFactor      = 4;
+constexpr int64_t CompactMinimumSize = 1024 * 1024;
+constexpr int64_t CopyChunkSize      = 1024 * 1024;
+
+enum Frame : quint8 {
+	RecordFrame     = 'R', // an undo record is pushed onto the journal
+	PopFrame        = 'P', // a number of records are removed from the top of the journal
+	CheckpointFrame = 'S', // the document was saved, with the size and time of the file written and the last serial number used
+};
+
+/**
+ * @brief writeRawData
+ * @param stream
+ * @param data
+ * @param size
+ */
+void writeRawData(QDataStream &stream, const char *data, size_t size) {
+
+	while(size != 0) {
+		const auto n = static_cast<int>(std::min<size_t>(size, std::numeric_limits<int>::max()));
+		if(stream.writeRawData(data, n) != n) {
+			stream.setStatus(QDataStream::WriteFailed);
+			return;
+		}
+
+		data += n;
+		size -= static_cast<size_t>(n);
+	}
+}
+
+/**
+ * @brief readRawData
+ * @param stream
+ * @param data
+ * @param size
+ */
+void readRawData(QDataStream &stream, char *data, size_t size) {
+
+	while(size != 0) {
+		const auto n = static_cast<int>(std::min<size_t>(size, std::numeric_limits<int>::max()));
+		if(stream.readRawData(data, n) != n) {
+			stream.setStatus(QDataStream::ReadPastEnd);
+			return;
+		}
+
+		data += n;
+		size -= static_cast<size_t>(n);
+	}
+}
+
+/**
+ * @brief popFrame
+ * @param count
+ * @return
+ */
+QByteArray popFrame(size_t count) {
+	QByteArray frame;
+	QDataStream stream(&frame, QIODevice::WriteOnly);
+	stream << static_cast<quint8>(PopFrame) << static_cast<quint64>(8) << static_cast<quint64>(count);
+	return frame;
+}
+
+/**
+ * @brief checkpointFrame
+ * @param modTime
+ * @param fileSize
+ * @param serial
+ * @return
+ */
+QByteArray checkpointFrame(int64_t modTime, int64_t fileSize, uint64_t serial) {
+	QByteArray frame;
+	QDataStream stream(&frame, QIODevice::WriteOnly);
+	stream << static_cast<quint8>(CheckpointFrame) << static_cast<quint64>(24) << static_cast<qint64>(modTime) << static_cast<qint64>(fileSize) << static_cast<quint64>(serial);
+	return frame;
+}
+
+}
+
+/**
+ * @brief UndoJournal::UndoJournal
+ */
+UndoJournal::UndoJournal() : pool_(std::make_unique<QThreadPool>()) {
+	// a single writer keeps the frames in the order they were queued
+	pool_->setMaxThreadCount(1);
+}
+
+/**
+ * @brief UndoJournal::~UndoJournal
+ */
+UndoJournal::~UndoJournal() {
+	flush();
+}
+
+/**
+ * @brief UndoJournal::empty
+ * @return true if there are no records in the journal
+ */
+bool UndoJournal::empty() const {
+	return records_.empty();
+}
+
+/**
+ * @brief UndoJournal::mirrored
+ * @return the number of the oldest records in memory which are also the newest records in the journal
+ */
+size_t UndoJournal::mirrored() const {
+	return mirrored_;
+}
+
+/**
+ * @brief UndoJournal::fileName
+ * @return
+ */
+QString UndoJournal::fileName() const {
+	return fileName_;
+}
+
+/**
+ * Moves the journal to a new file, for example when the document is saved
+ * under a different name. If the existing file can't be moved, the records
+ * in it are lost.
+ *
+ * @brief UndoJournal::setFileName
+ * @param fileName
+ */
+void UndoJournal::setFileName(const QString &fileName) {
+
+	if(fileName == fileName_) {
+		return;
+	}
+
+	if(fileSize_ != 0) {
+		flush();
+		QFile::remove(fileName);
+		if(!QFile::rename(fileName_, fileName)) {
+			qWarning("NEdit: unable to move undo journal %s", qPrintable(fileName_));
+			reset();
+		}
+	}
+
+	fileName_ = fileName;
+}
+
+/**
+ * Discards all of the records in the journal and removes its file.
+ *
+ * @brief UndoJournal::clear
+ */
+void UndoJournal::clear() {
+	reset();
+}
+
+/**
+ * Detaches the journal from its file once all pending writes are done. If
+ * keepFile is set, the file is left behind for the next time the document
+ * is opened.
+ *
+ * @brief UndoJournal::close
+ * @param keepFile
+ */
+void UndoJournal::close(bool keepFile) {
+
+	flush();
+
+	if(!keepFile || failed_) {
+		reset();
+	}
+
+	records_.clear();
+	checkpoint_.clear();
+	fileName_.clear();
+	fileSize_ = 0;
+	liveSize_ = 0;
+	mirrored_ = 0;
+	failed_   = false;
+}
+
+/**
+ * @brief UndoJournal::reset
+ */
+void UndoJournal::reset() {
+
+	flush();
+
+	if(fileSize_ != 0) {
+		QFile::remove(fileName_);
+	}
+
+	records_.clear();
+	checkpoint_.clear();
+	fileSize_ = 0;
+	liveSize_ = 0;
+	mirrored_ = 0;
+	failed_   = false;
+}
+
+/**
+ * @brief UndoJournal::flush
+ */
+void UndoJournal::flush() {
+	pool_->waitForDone();
+}
+
+/**
+ * Queues records (oldest first) followed by an optional pre-formatted frame
+ * to be appended to the journal, and updates the index of records to match.
+ *
+ * @brief UndoJournal::write
+ * @param records
+ * @param trailer
+ */
+void UndoJournal::write(std::vector<UndoInfo> records, const QByteArray &trailer) {
+
+	const bool create = (fileSize_ == 0);
+	if(create) {
+		fileSize_ = HeaderSize;
+		liveSize_ = HeaderSize;
+	}
+
+	// anything written after a checkpoint supersedes it
+	liveSize_ -= checkpoint_.size();
+	checkpoint_.clear();
+
+	for(const UndoInfo &undo : records) {
+		// the worker joins the text of a run of backward deletes back together
+		const auto length = static_cast<int64_t>(undo.savedText().size() + undo.reversedPrefix_.size());
+		records_.push_back(Entry{fileSize_, length});
+		fileSize_ += FrameHeaderSize + RecordHeaderSize + length;
+		liveSize_ += FrameHeaderSize + RecordHeaderSize + length;
+	}
+
+	fileSize_ += trailer.size();
+
+	pool_->start(new FunctionTask([this, fileName = fileName_, create, records = std::move(records), trailer]() mutable {
+
+		// once a write has failed, the index no longer describes the file
+		if(failed_) {
+			return;
+		}
+
+		QFile file(fileName);
+		if(!file.open(create ? (QIODevice::WriteOnly | QIODevice::Truncate) : (QIODevice::WriteOnly | QIODevice::Append))) {
+			failed_ = true;
+			return;
+		}
+
+		QDataStream stream(&file);
+
+		if(create) {
+			stream << JournalMagic << JournalVersion;
+		}
+
+		for(UndoInfo &undo : records) {
+			undo.flatten();
+
+			const std::string &text = undo.savedText();
+
+			stream << static_cast<quint8>(RecordFrame)
+			       << static_cast<quint64>(RecordHeaderSize + text.size())
+			       << static_cast<qint8>(undo.type)
+			       << static_cast<qint64>(to_integer(undo.startPos))
+			       << static_cast<qint64>(to_integer(undo.endPos))
+			       << static_cast<quint64>(undo.serial)
+			       << static_cast<quint8>(undo.compressed_);
+
+			writeRawData(stream, text.data(), text.size());
+		}
+
+		writeRawData(stream, trailer.constData(), static_cast<size_t>(trailer.size()));
+
+		if(stream.status() != QDataStream::Ok || !file.flush()) {
+			failed_ = true;
+		}
+	}));
+}
+
+/*
+** Once most of the journal is records which have since been paged back in or
+** unmirrored, and checkpoints which were superseded, rewrite it with only the
+** records still in it. The worker copies them after the writes queued before,
+** into a new file which only replaces the journal once it is complete.
+*/
+void UndoJournal::compact() {
+
+	if(fileSize_ < CompactMinimumSize || fileSize_ < CompactFactor * liveSize_) {
+		return;
+	}
+
+	std::vector<Entry> frames = records_;
+
+	int64_t offset = HeaderSize;
+	for(Entry &entry : records_) {
+		entry.offset = offset;
+		offset += FrameHeaderSize + RecordHeaderSize + entry.length;
+	}
+
+	fileSize_ = offset + checkpoint_.size();
+	Q_ASSERT(fileSize_ == liveSize_);
+
+	pool_->start(new FunctionTask([this, fileName = fileName_, frames = std::move(frames), trailer = checkpoint_]() {
+
+		if(failed_) {
+			return;
+		}
+
+		QFile in(fileName);
+		QSaveFile out(fileName);
+		if(!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly)) {
+			failed_ = true;
+			return;
+		}
+
+		QDataStream source(&in);
+		QDataStream stream(&out);
+		stream << JournalMagic << JournalVersion;
+
+		std::vector<char> buffer;
+		for(const Entry &entry : frames) {
+			if(!in.seek(entry.offset)) {
+				failed_ = true;
+				return;
+			}
+
+			int64_t remaining = FrameHeaderSize + RecordHeaderSize + entry.length;
+			while(remaining != 0) {
+				const auto n = static_cast<size_t>(std::min(remaining, CopyChunkSize));
+				buffer.resize(n);
+				readRawData(source, buffer.data(), n);
+				writeRawData(stream, buffer.data(), n);
+				remaining -= static_cast<int64_t>(n);
+			}
+		}
+
+		writeRawData(stream, trailer.constData(), static_cast<size_t>(trailer.size()));
+
+		// the journal is left as it was if anything went wrong
+		if(source.status() != QDataStream::Ok || stream.status() != QDataStream::Ok || !out.commit()) {
+			failed_ = true;
+		}
+	}));
+}
+
+/**
+ * Moves records trimmed from the end of the in-memory undo list (oldest
+ * first) to the journal. Records which were already copied to the journal by
+ * the last checkpoint are simply left where they are.
+ *
+ * @brief UndoJournal::evict
+ * @param records
+ */
+void UndoJournal::evict(std::vector<UndoInfo> records) {
+
+	if(failed_) {
+		qWarning("NEdit: error writing undo journal %s", qPrintable(fileName_));
+		reset();
+	}
+
+	const size_t skip = std::min(mirrored_, records.size());
+	mirrored_ -= skip;
+	records.erase(records.begin(), records.begin() + static_cast<std::ptrdiff_t>(skip));
+
+	if(records.empty() || fileName_.isEmpty()) {
+		return;
+	}
+
+	write(std::move(records));
+}
+
+/**
+ * Removes the most recent records from the journal and returns them, newest
+ * first, reading until at least maxBytes of saved text have been read or the
+ * journal is empty. Only used when nothing is left of the in-memory list.
+ *
+ * @brief UndoJournal::pageIn
+ * @param maxBytes
+ * @return
+ */
+std::vector<UndoInfo> UndoJournal::pageIn(size_t maxBytes) {
+
+	Q_ASSERT(mirrored_ == 0);
+
+	std::vector<UndoInfo> result;
+
+	flush();
+
+	QFile file(fileName_);
+	if(failed_ || !file.open(QIODevice::ReadOnly)) {
+		qWarning("NEdit: error reading undo journal %s", qPrintable(fileName_));
+		reset();
+		return result;
+	}
+
+	QDataStream stream(&file);
+
+	size_t bytes = 0;
+	while(!records_.empty() && (result.empty() || bytes < maxBytes)) {
+
+		const Entry entry = records_.back();
+
+		quint8 kind;
+		quint64 length;
+		qint8 type;
+		qint64 start;
+		qint64 end;
+		quint64 serial;
+		quint8 compressed;
+
+		file.seek(entry.offset);
+		stream >> kind >> length >> type >> start >> end >> serial >> compressed;
+
+		std::string text(static_cast<size_t>(entry.length), '\0');
+		readRawData(stream, &text[0], text.size());
+
+		if(stream.status() != QDataStream::Ok || kind != RecordFrame || static_cast<int64_t>(length) != RecordHeaderSize + entry.length) {
+			qWarning("NEdit: error reading undo journal %s", qPrintable(fileName_));
+			reset();
+			return result;
+		}
+
+		UndoInfo undo(static_cast<UndoTypes>(type), TextCursor(start), TextCursor(end));
+		undo.serial      = serial;
+		undo.oldText_    = std::make_shared<std::string>(std::move(text));
+		undo.compressed_ = (compressed != 0);
+		result.push_back(std::move(undo));
+
+		records_.pop_back();
+		liveSize_ -= FrameHeaderSize + RecordHeaderSize + entry.length;
+		bytes += static_cast<size_t>(entry.length);
+	}
+
+	if(records_.empty()) {
+		reset();
+	} else {
+		write({}, popFrame(result.size()));
+		compact();
+	}
+
+	return result;
+}
+
+/**
+ * The newest mirrored record is about to be undone or extended in memory, so
+ * the copy of it in the journal is removed.
+ *
+ * @brief UndoJournal::unmirror
+ */
+void UndoJournal::unmirror() {
+
+	Q_ASSERT(mirrored_ != 0 && !records_.empty());
+
+	--mirrored_;
+	liveSize_ -= FrameHeaderSize + RecordHeaderSize + records_.back().length;
+	records_.pop_back();
+
+	if(records_.empty()) {
+		reset();
+	} else {
+		write({}, popFrame(1));
+		compact();
+	}
+}
+
+/**
+ * Called after the document has been saved. Copies the records which exist
+ * only in memory to the journal, and marks the journal as describing the
+ * history of the file that was just written.
+ *
+ * @brief UndoJournal::checkpoint
+ * @param undo
+ * @param modTime
+ * @param fileSize
+ * @param serial
+ */
+void UndoJournal::checkpoint(const std::deque<UndoInfo> &undo, int64_t modTime, int64_t fileSize, uint64_t serial) {
+
+	if(failed_) {
+		qWarning("NEdit: error writing undo journal %s", qPrintable(fileName_));
+		reset();
+	}
+
+	if(fileName_.isEmpty() || (undo.empty() && records_.empty())) {
+		return;
+	}
+
+	Q_ASSERT(mirrored_ <= undo.size());
+
+	/* copy the unmirrored records, oldest first. The copies share their saved
+	   text with the records in memory, so this doesn't copy any text */
+	const size_t count = undo.size() - mirrored_;
+
+	std::vector<UndoInfo> records;
+	records.reserve(count);
+	for(size_t i = count; i > 0; --i) {
+		records.push_back(undo[i - 1]);
+	}
+
+	mirrored_ = undo.size();
+
+	const QByteArray frame = checkpointFrame(modTime, fileSize, serial);
+	write(std::move(records), frame);
+
+	checkpoint_ = frame;
+	liveSize_  += frame.size();
+	compact();
+}
+
+/**
+ * Replaces the contents of the journal with the journal in fileName, if it
+ * was left by a previous session and describes the history of a file which
+ * still has the given size and modification time. Otherwise, any journal in
+ * fileName is removed. Returns true if there are records to undo, in which
+ * case serial is set to the last serial number used by the previous session.
+ *
+ * @brief UndoJournal::restore
+ * @param fileName
+ * @param modTime
+ * @param fileSize
+ * @param serial
+ * @return
+ */
+bool UndoJournal::restore(const QString &fileName, int64_t modTime, int64_t fileSize, uint64_t *serial) {
+
+	reset();
+	fileName_ = fileName;
+
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	auto scan = [&file](std::vector<Entry> *records, int64_t *checkpointTime, int64_t *checkpointSize, uint64_t *checkpointSerial) {
+
+		QDataStream stream(&file);
+
+		quint32 magic;
+		quint32 version;
+		stream >> magic >> version;
+		if(stream.status() != QDataStream::Ok || magic != JournalMagic || version != JournalVersion) {
+			return false;
+		}
+
+		bool checkpointed = false;
+
+		const int64_t end = file.size();
+		int64_t offset = HeaderSize;
+
+		while(offset < end) {
+
+			quint8 kind;
+			quint64 length;
+			stream >> kind >> length;
+
+			if(stream.status() != QDataStream::Ok || length > static_cast<quint64>(end - offset - FrameHeaderSize)) {
+				return false;
+			}
+
+			switch(kind) {
+			case RecordFrame:
+				if(length < RecordHeaderSize) {
+					return false;
+				}
+
+				records->push_back(Entry{offset, static_cast<int64_t>(length) - RecordHeaderSize});
+				checkpointed = false;
+				break;
+			case PopFrame:
+			{
+				quint64 count;
+				stream >> count;
+				if(count > records->size()) {
+					return false;
+				}
+
+				records->resize(records->size() - count);
+				checkpointed = false;
+				break;
+			}
+			case CheckpointFrame:
+			{
+				qint64 time;
+				qint64 size;
+				quint64 last;
+				stream >> time >> size >> last;
+				*checkpointTime   = time;
+				*checkpointSize   = size;
+				*checkpointSerial = last;
+				checkpointed      = true;
+				break;
+			}
+			default:
+				return false;
+			}
+
+			offset += FrameHeaderSize + static_cast<int64_t>(length);
+			if(!file.seek(offset) || stream.status() != QDataStream::Ok) {
+				return false;
+			}
+		}
+
+		// anything after the last checkpoint belongs to edits which were never saved
+		return checkpointed;
+	};
+
+	std::vector<Entry> records;
+	int64_t checkpointTime = 0;
+	int64_t checkpointSize = 0;
+	uint64_t checkpointSerial = 0;
+
+	if(!scan(&records, &checkpointTime, &checkpointSize, &checkpointSerial) || checkpointTime != modTime || checkpointSize != fileSize) {
+		file.close();
+		QFile::remove(fileName);
+		return false;
+	}
+
+	records_    = std::move(records);
+	checkpoint_ = checkpointFrame(checkpointTime, checkpointSize, checkpointSerial);
+	fileSize_   = file.size();
+	liveSize_   = HeaderSize + checkpoint_.size();
+	for(const Entry &entry : records_) {
+		liveSize_ += FrameHeaderSize + RecordHeaderSize + entry.length;
+	}
+
+	file.close();
+
+	if(records_.empty()) {
+		return false;
+	}
+
+	// a journal kept over many sessions may be mostly records which were undone
+	compact();
+
+	// new records must not reuse the serial numbers of the restored ones
+	*serial = std::max(*serial, checkpointSerial);
+	return true;
+}
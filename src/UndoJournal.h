@@ -0,0 +1,85 @@
+
+#ifndef UNDO_JOURNAL_H_
+#define UNDO_JOURNAL_H_
+
+#include "UndoInfo.h"
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+class QThreadPool;
+
+/* When the in-memory undo list runs dry, records are paged back in from the
+   journal until roughly this many bytes of saved text have been read */
+constexpr size_t UNDO_JOURNAL_PAGE_SIZE = 4 * 1024 * 1024;
+
+/*
+** An append-only file which holds the undo records of a document that no
+** longer fit in memory. The journal behaves as the bottom of the undo stack:
+** the oldest records are evicted to it as the in-memory list is trimmed, and
+** are paged back in when the user undoes past what is still in memory.
+**
+** Each time the document is saved, any records which are only in memory are
+** copied to the journal as well, followed by a checkpoint recording the size
+** and modification time of the file that was written. If the journal still
+** ends with that checkpoint when the file is opened again, and the file is
+** unchanged, the history of the previous session is restored from it.
+**
+** Writes are done on a worker thread in the order they were requested, reads
+** wait for any writes still in progress. Records are handed to the worker as
+** copies which share their saved text with the ones in memory. Once the file
+** holds several times as much as the records still in it, the worker rewrites
+** it without the records which have since been removed.
+*/
+class UndoJournal {
+public:
+	UndoJournal();
+	UndoJournal(const UndoJournal &)            = delete;
+	UndoJournal &operator=(const UndoJournal &) = delete;
+	~UndoJournal();
+
+public:
+	bool empty() const;
+	size_t mirrored() const;
+	QString fileName() const;
+	void setFileName(const QString &fileName);
+	void clear();
+	void close(bool keepFile);
+
+public:
+	void evict(std::vector<UndoInfo> records);
+	std::vector<UndoInfo> pageIn(size_t maxBytes);
+	void unmirror();
+	void checkpoint(const std::deque<UndoInfo> &undo, int64_t modTime, int64_t fileSize, uint64_t serial);
+	bool restore(const QString &fileName, int64_t modTime, int64_t fileSize, uint64_t *serial);
+
+private:
+	struct Entry {
+		int64_t offset; // position of the record's frame in the file
+		int64_t length; // size of the record's saved text
+	};
+
+private:
+	void reset();
+	void write(std::vector<UndoInfo> records, const QByteArray &trailer = QByteArray());
+	void compact();
+	void flush();
+
+private:
+	std::unique_ptr<QThreadPool> pool_;
+	QString fileName_;
+	std::vector<Entry> records_; // records in the journal, oldest first
+	QByteArray checkpoint_;      // the checkpoint the journal ends with, if it does
+	int64_t fileSize_ = 0;       // size of the file once all queued writes are done
+	int64_t liveSize_ = 0;       // size the file would be if it only held records_ and checkpoint_
+	size_t mirrored_  = 0;       // how many of the newest records in the journal are also the oldest ones in memory
+	std::atomic<bool> failed_{false};
+};
+
+#endif
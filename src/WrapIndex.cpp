@@ -0,0 +1,343 @@
+
+#include "WrapIndex.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// blocks are split once they grow past twice this many lines
+constexpr size_t BlockSize = 1024;
+
+}
+
+/**
+ * @brief WrapIndex::clear
+ */
+void WrapIndex::clear() {
+	blocks_.clear();
+	lines_  = 0;
+	length_ = 0;
+	rows_   = 0;
+	offsetsValid_ = false;
+}
+
+/**
+ * @brief WrapIndex::lines
+ * @return the number of lines in the index
+ */
+int64_t WrapIndex::lines() const {
+	return lines_;
+}
+
+/**
+ * @brief WrapIndex::length
+ * @return the number of characters covered by the index
+ */
+int64_t WrapIndex::length() const {
+	return length_;
+}
+
+/**
+ * @brief WrapIndex::rows
+ * @return the number of display rows covered by the index
+ */
+int64_t WrapIndex::rows() const {
+	return rows_;
+}
+
+/**
+ * Adds the line following the last one in the index.
+ *
+ * @brief WrapIndex::append
+ * @param line
+ */
+void WrapIndex::append(const Line &line) {
+
+	if (blocks_.empty() || blocks_.back().lines.size() >= BlockSize) {
+		blocks_.emplace_back();
+	}
+
+	Block &block = blocks_.back();
+	block.lines.push_back(line);
+	block.length += line.length;
+	block.rows   += line.rows;
+
+	++lines_;
+	length_ += line.length;
+	rows_   += line.rows;
+	offsetsValid_ = false;
+}
+
+/**
+ * Replaces "count" lines of the index, beginning with line "first", with
+ * "lines".
+ *
+ * @brief WrapIndex::replace
+ * @param first
+ * @param count
+ * @param lines
+ */
+void WrapIndex::replace(int64_t first, int64_t count, const std::vector<Line> &lines) {
+
+	if (blocks_.empty()) {
+		blocks_.emplace_back();
+		offsetsValid_ = false;
+	}
+
+	int64_t firstLine;
+	size_t index = findBlock(first, &firstLine);
+	if (index == blocks_.size()) {
+		index     = blocks_.size() - 1;
+		firstLine = lines_ - static_cast<int64_t>(blocks_.back().lines.size());
+	}
+
+	Block &block        = blocks_[index];
+	const auto offset   = static_cast<size_t>(first - firstLine);
+	const auto inBlock  = static_cast<size_t>(std::min<int64_t>(count, static_cast<int64_t>(block.lines.size() - offset)));
+	int64_t remaining   = count - static_cast<int64_t>(inBlock);
+
+	block.lines.erase(block.lines.begin() + offset, block.lines.begin() + offset + inBlock);
+
+	// the removed lines may continue into the following blocks
+	for (size_t next = index + 1; remaining > 0 && next < blocks_.size(); ++next) {
+		Block &other = blocks_[next];
+		const auto n = static_cast<size_t>(std::min<int64_t>(remaining, static_cast<int64_t>(other.lines.size())));
+		other.lines.erase(other.lines.begin(), other.lines.begin() + n);
+		updateBlock(&other);
+		remaining -= static_cast<int64_t>(n);
+	}
+
+	block.lines.insert(block.lines.begin() + offset, lines.begin(), lines.end());
+	updateBlock(&block);
+
+	if (block.lines.size() > BlockSize * 2) {
+		splitBlock(index);
+	}
+
+	blocks_.erase(std::remove_if(blocks_.begin(), blocks_.end(), [](const Block &b) {
+		return b.lines.empty();
+	}), blocks_.end());
+
+	updateTotals();
+}
+
+/**
+ * Removes all but the first "count" lines from the index.
+ *
+ * @brief WrapIndex::truncate
+ * @param count
+ */
+void WrapIndex::truncate(int64_t count) {
+
+	if (count >= lines_) {
+		return;
+	}
+
+	int64_t firstLine;
+	const size_t index = findBlock(count, &firstLine);
+
+	Block &block = blocks_[index];
+	block.lines.resize(static_cast<size_t>(count - firstLine));
+	updateBlock(&block);
+
+	blocks_.erase(blocks_.begin() + static_cast<ptrdiff_t>(block.lines.empty() ? index : index + 1), blocks_.end());
+	updateTotals();
+}
+
+/**
+ * Finds the line holding buffer position "pos", returning its index along
+ * with the position where it starts and the number of display rows before
+ * it. Positions past the end of the index belong to its last line. Returns
+ * -1 if the index is empty.
+ *
+ * @brief WrapIndex::findLineByPos
+ * @param pos
+ * @param lineStart
+ * @param rowsBefore
+ * @return
+ */
+int64_t WrapIndex::findLineByPos(int64_t pos, int64_t *lineStart, int64_t *rowsBefore) const {
+
+	if (lines_ == 0) {
+		return -1;
+	}
+
+	// the last block starting at or before "pos"
+	const std::vector<Offset> &blockOffsets = offsets();
+	auto it = std::upper_bound(blockOffsets.begin(), blockOffsets.end(), pos, [](int64_t value, const Offset &offset) {
+		return value < offset.start;
+	});
+
+	const size_t index = (it == blockOffsets.begin()) ? 0 : static_cast<size_t>(it - blockOffsets.begin()) - 1;
+	return scanBlock(index, /*byRow=*/false, pos, lineStart, rowsBefore);
+}
+
+/**
+ * Finds the line holding display row "row" (counting from zero), returning
+ * its index along with the position where it starts and the number of
+ * display rows before it. Rows past the end of the index belong to its last
+ * line. Returns -1 if the index is empty.
+ *
+ * @brief WrapIndex::findLineByRow
+ * @param row
+ * @param lineStart
+ * @param rowsBefore
+ * @return
+ */
+int64_t WrapIndex::findLineByRow(int64_t row, int64_t *lineStart, int64_t *rowsBefore) const {
+
+	if (lines_ == 0) {
+		return -1;
+	}
+
+	// the last block starting at or before "row"
+	const std::vector<Offset> &blockOffsets = offsets();
+	auto it = std::upper_bound(blockOffsets.begin(), blockOffsets.end(), row, [](int64_t value, const Offset &offset) {
+		return value < offset.rows;
+	});
+
+	const size_t index = (it == blockOffsets.begin()) ? 0 : static_cast<size_t>(it - blockOffsets.begin()) - 1;
+	return scanBlock(index, /*byRow=*/true, row, lineStart, rowsBefore);
+}
+
+/**
+ * Scans block "index" for the line holding buffer position (or if "byRow"
+ * is set, display row) "value". Values past the end of the index belong to
+ * its last line.
+ *
+ * @brief WrapIndex::scanBlock
+ * @param index
+ * @param byRow
+ * @param value
+ * @param lineStart
+ * @param rowsBefore
+ * @return
+ */
+int64_t WrapIndex::scanBlock(size_t index, bool byRow, int64_t value, int64_t *lineStart, int64_t *rowsBefore) const {
+
+	const Offset &offset = offsets_[index];
+	int64_t line   = offset.line;
+	int64_t start  = offset.start;
+	int64_t before = offset.rows;
+
+	for (const Line &entry : blocks_[index].lines) {
+		const int64_t end = byRow ? before + entry.rows : start + entry.length;
+		if (value < end || line == lines_ - 1) {
+			*lineStart  = start;
+			*rowsBefore = before;
+			return line;
+		}
+
+		start  += entry.length;
+		before += entry.rows;
+		++line;
+	}
+
+	return -1;
+}
+
+/**
+ * Returns the index of the block holding "line", and the number of the first
+ * line in that block. Returns the number of blocks if "line" is past the end
+ * of the index.
+ *
+ * @brief WrapIndex::findBlock
+ * @param line
+ * @param firstLine
+ * @return
+ */
+size_t WrapIndex::findBlock(int64_t line, int64_t *firstLine) const {
+
+	const std::vector<Offset> &blockOffsets = offsets();
+	auto it = std::upper_bound(blockOffsets.begin(), blockOffsets.end(), line, [](int64_t value, const Offset &offset) {
+		return value < offset.line;
+	});
+
+	if (it == blockOffsets.begin() || line >= lines_) {
+		*firstLine = lines_;
+		return blocks_.size();
+	}
+
+	--it;
+	*firstLine = it->line;
+	return static_cast<size_t>(it - blockOffsets.begin());
+}
+
+/**
+ * Returns the totals of the blocks preceding each block, computing them again
+ * if the index changed since they were last asked for.
+ *
+ * @brief WrapIndex::offsets
+ * @return
+ */
+const std::vector<WrapIndex::Offset> &WrapIndex::offsets() const {
+
+	if (!offsetsValid_) {
+		offsets_.clear();
+		offsets_.reserve(blocks_.size());
+
+		Offset offset = {0, 0, 0};
+		for (const Block &block : blocks_) {
+			offsets_.push_back(offset);
+			offset.line  += static_cast<int64_t>(block.lines.size());
+			offset.start += block.length;
+			offset.rows  += block.rows;
+		}
+
+		offsetsValid_ = true;
+	}
+
+	return offsets_;
+}
+
+/**
+ * Splits an oversized block into blocks of BlockSize lines.
+ *
+ * @brief WrapIndex::splitBlock
+ * @param index
+ */
+void WrapIndex::splitBlock(size_t index) {
+
+	std::vector<Line> lines = std::move(blocks_[index].lines);
+
+	std::vector<Block> pieces;
+	for (size_t i = 0; i < lines.size(); i += BlockSize) {
+		Block piece;
+		const size_t n = std::min(BlockSize, lines.size() - i);
+		std::copy_n(lines.begin() + static_cast<ptrdiff_t>(i), n, std::back_inserter(piece.lines));
+		updateBlock(&piece);
+		pieces.push_back(std::move(piece));
+	}
+
+	blocks_.erase(blocks_.begin() + static_cast<ptrdiff_t>(index));
+	blocks_.insert(blocks_.begin() + static_cast<ptrdiff_t>(index), std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+}
+
+/**
+ * @brief WrapIndex::updateBlock
+ * @param block
+ */
+void WrapIndex::updateBlock(Block *block) {
+	block->length = 0;
+	block->rows   = 0;
+	for (const Line &line : block->lines) {
+		block->length += line.length;
+		block->rows   += line.rows;
+	}
+}
+
+/**
+ * @brief WrapIndex::updateTotals
+ */
+void WrapIndex::updateTotals() {
+	offsetsValid_ = false;
+	lines_  = 0;
+	length_ = 0;
+	rows_   = 0;
+	for (const Block &block : blocks_) {
+		lines_  += static_cast<int64_t>(block.lines.size());
+		length_ += block.length;
+		rows_   += block.rows;
+	}
+}
@@ -0,0 +1,79 @@
+
+#ifndef WRAP_INDEX_H_
+#define WRAP_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+** Index of the logical (newline terminated) lines of a buffer in continuous
+** wrap mode, recording the length of each line and the number of display
+** rows it wraps to. Since every logical line wraps independently of the
+** others, an edit only changes the entries of the lines it touches.
+**
+** The lines are kept in blocks of a bounded size along with the totals of
+** each block, which makes this a two level B-tree: inserting or removing
+** lines only touches the blocks holding them. The running totals of the
+** blocks are kept as well, rebuilt on the first lookup after a change, so
+** finding the line which holds a buffer position or a display row is a
+** binary search over the blocks followed by a scan of a single block,
+** rather than a count over all the text before it.
+**
+** The index may cover only the start of the buffer, it is extended at the
+** end as the lines following it are measured.
+*/
+class WrapIndex {
+public:
+	struct Line {
+		int64_t length; // characters in the line, including its newline
+		int64_t rows;   // display rows the line wraps to
+	};
+
+public:
+	void clear();
+	int64_t lines() const;
+	int64_t length() const;
+	int64_t rows() const;
+
+public:
+	void append(const Line &line);
+	void replace(int64_t first, int64_t count, const std::vector<Line> &lines);
+	void truncate(int64_t count);
+
+public:
+	int64_t findLineByPos(int64_t pos, int64_t *lineStart, int64_t *rowsBefore) const;
+	int64_t findLineByRow(int64_t row, int64_t *lineStart, int64_t *rowsBefore) const;
+
+private:
+	struct Block {
+		std::vector<Line> lines;
+		int64_t length = 0;
+		int64_t rows   = 0;
+	};
+
+	// totals of the blocks preceding a block
+	struct Offset {
+		int64_t line;
+		int64_t start;
+		int64_t rows;
+	};
+
+private:
+	size_t findBlock(int64_t line, int64_t *firstLine) const;
+	int64_t scanBlock(size_t index, bool byRow, int64_t value, int64_t *lineStart, int64_t *rowsBefore) const;
+	const std::vector<Offset> &offsets() const;
+	void splitBlock(size_t index);
+	void updateBlock(Block *block);
+	void updateTotals();
+
+private:
+	std::vector<Block> blocks_;
+	mutable std::vector<Offset> offsets_;
+	mutable bool offsetsValid_ = false;
+	int64_t lines_  = 0;
+	int64_t length_ = 0;
+	int64_t rows_   = 0;
+};
+
+#endif
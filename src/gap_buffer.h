@@ -65,7 +65,7 @@ public:
 
 public:
 	Ch operator[](size_type n) const noexcept;
-	Ch& operator[](size_type n) noexcept;
+	Ch& operator[](size_type n);
 	Ch at(size_type n) const;
 	Ch& at(size_type n);
 
@@ -78,17 +78,26 @@ public:
 	string_type to_string(size_type start, size_type end) const;
 	view_type to_view() noexcept;
 	view_type to_view(size_type start, size_type end) noexcept;
+	view_type before_gap() const noexcept;
+	view_type after_gap() const noexcept;
 
 public:
 	void append(view_type str);
 	void append(Ch ch);
 	void insert(size_type pos, view_type str);
 	void insert(size_type pos, Ch ch);
-	size_type erase(size_type start, size_type end) noexcept;
+	Ch *reserve_gap(size_type pos, size_type length);
+	void fill_gap(size_type length) noexcept;
+	size_type erase(size_type start, size_type end);
 	void replace(size_type start, size_type end, view_type str);
 	void replace(size_type start, size_type end, Ch ch);
 	void assign(view_type str);
-	void clear() noexcept;
+	void clear();
+
+public:
+	void map(std::shared_ptr<const Ch> text, size_type length) noexcept;
+	void detach();
+	bool is_mapped() const noexcept { return mapped_ != nullptr; }
 
 private:
 	void move_gap(size_type pos) noexcept;
@@ -97,6 +106,8 @@ private:
 
 private:
 	std::unique_ptr<Ch[]> buf_;        // points to the internal buffer
+	std::shared_ptr<const Ch> mapped_; // read-only text shown in place of the internal buffer, until the first change
+	const Ch             *text_;       // what is read from, either of the above
 	size_type             gap_start_;  // points to the first character of the gap
 	size_type             gap_end_;    // points to the first char after the gap
 	size_type             size_;       // length of the text in the buffer (the length of the buffer itself must be calculated: gapEnd - gapStart + length)
@@ -115,7 +126,8 @@ gap_buffer<Ch, Tr>::gap_buffer() : gap_buffer(0){
 template <class Ch, class Tr>
 gap_buffer<Ch, Tr>::gap_buffer(size_type reserve_size) : gap_start_(0), gap_end_(PreferredGapSize), size_(0) {
 
-	buf_ = std::make_unique<Ch[]>(reserve_size + PreferredGapSize);
+	buf_  = std::make_unique<Ch[]>(reserve_size + PreferredGapSize);
+	text_ = buf_.get();
 
 #ifdef PURIFY
 	std::fill(&buf_[gap_start_], &buf_[gap_end_], Ch('.'));
@@ -129,17 +141,19 @@ template <class Ch, class Tr>
 Ch gap_buffer<Ch, Tr>::operator[](size_type n) const noexcept {
 
 	if (n < gap_start_) {
-		return buf_[n];
+		return text_[n];
 	}
 
-	return buf_[n + gap_size()];
+	return text_[n + gap_size()];
 }
 
 /**
  *
  */
 template <class Ch, class Tr>
-Ch& gap_buffer<Ch, Tr>::operator[](size_type n) noexcept {
+Ch& gap_buffer<Ch, Tr>::operator[](size_type n) {
+
+	detach();
 
 	if (n < gap_start_) {
 		return buf_[n];
@@ -159,10 +173,10 @@ Ch gap_buffer<Ch, Tr>::at(size_type n) const {
 	}
 
 	if (n < gap_start_) {
-		return buf_[n];
+		return text_[n];
 	}
 
-	return buf_[n + gap_size()];
+	return text_[n + gap_size()];
 }
 
 /**
@@ -175,6 +189,8 @@ Ch& gap_buffer<Ch, Tr>::at(size_type n) {
 		Raise<std::out_of_range>("gap_buffer::at");
 	}
 
+	detach();
+
 	if (n < gap_start_) {
 		return buf_[n];
 	}
@@ -203,17 +219,17 @@ int gap_buffer<Ch, Tr>::compare(size_type pos, view_type str) const noexcept {
 	}
 
 	if (posEnd <= gap_start_) {
-		return Tr::compare(&buf_[pos], str.data(), str.size());
+		return Tr::compare(&text_[pos], str.data(), str.size());
 	} else if (pos >= gap_start_) {
-		return Tr::compare(&buf_[pos + gap_size()], str.data(), str.size());
+		return Tr::compare(&text_[pos + gap_size()], str.data(), str.size());
 	} else {
 		const auto part1Length = static_cast<size_t>(gap_start_ - pos);
-		const int result = Tr::compare(&buf_[pos], str.data(), part1Length);
+		const int result = Tr::compare(&text_[pos], str.data(), part1Length);
 		if (result != 0) {
 			return result;
 		}
 
-		return Tr::compare(&buf_[gap_end_], &str[part1Length], static_cast<size_t>(str.size() - part1Length));
+		return Tr::compare(&text_[gap_end_], &str[part1Length], static_cast<size_t>(str.size() - part1Length));
 	}
 }
 
@@ -241,8 +257,8 @@ template <class Ch, class Tr>
 auto gap_buffer<Ch, Tr>::to_string() const -> string_type {
 	string_type text;
 	text.reserve(static_cast<size_t>(size()));
-	text.append(&buf_[0], &buf_[gap_start_]);
-	text.append(&buf_[gap_end_], &buf_[gap_size() + size()]);
+	text.append(&text_[0], &text_[gap_start_]);
+	text.append(&text_[gap_end_], &text_[gap_size() + size()]);
 	return text;
 }
 
@@ -262,14 +278,14 @@ auto gap_buffer<Ch, Tr>::to_string(size_type start, size_type end) const -> stri
 
 	// Copy the text from the buffer to the returned string
 	if (end <= gap_start_) {
-		text.append(&buf_[start], &buf_[end]);
+		text.append(&text_[start], &text_[end]);
 	} else if (start >= gap_start_) {
-		text.append(&buf_[start + gap_size()], length);
+		text.append(&text_[start + gap_size()], length);
 	} else {
 		const difference_type part1Length = gap_start_ - start;
 
-		text.append(&buf_[start],    part1Length);
-		text.append(&buf_[gap_end_], length - part1Length);
+		text.append(&text_[start],    part1Length);
+		text.append(&text_[gap_end_], length - part1Length);
 	}
 
 	return text;
@@ -292,11 +308,28 @@ auto gap_buffer<Ch, Tr>::to_view() noexcept -> view_type {
 	}
 
 	// get the start position of the actual data
-	Ch *const text = &buf_[(leftLen == 0) ? gap_end_ : 0];
+	const Ch *const text = &text_[(leftLen == 0) ? gap_end_ : 0];
 
 	return view_type(text, static_cast<size_t>(bufLen));
 }
 
+/**
+ * the text before the gap, together with after_gap() this is the whole
+ * content of the buffer without moving the gap
+ */
+template <class Ch, class Tr>
+auto gap_buffer<Ch, Tr>::before_gap() const noexcept -> view_type {
+	return view_type(&text_[0], static_cast<size_t>(gap_start_));
+}
+
+/**
+ * the text after the gap
+ */
+template <class Ch, class Tr>
+auto gap_buffer<Ch, Tr>::after_gap() const noexcept -> view_type {
+	return view_type(&text_[gap_end_], static_cast<size_t>(size_ - gap_start_));
+}
+
 /**
  *
  */
@@ -318,7 +351,7 @@ auto gap_buffer<Ch, Tr>::to_view(size_type start, size_type end) noexcept -> vie
 	}
 
 	// get the start position of the actual data
-	Ch *const text = &buf_[(leftLen == 0) ? gap_end_ : 0];
+	const Ch *const text = &text_[(leftLen == 0) ? gap_end_ : 0];
 
 	return view_type(text + start, static_cast<size_t>(end - start));
 }
@@ -347,6 +380,8 @@ void gap_buffer<Ch, Tr>::insert(size_type pos, view_type str) {
 
 	assert(pos <= size() && pos >= 0);
 
+	detach();
+
 	const auto length = static_cast<size_type>(str.size());
 
 	/* Prepare the buffer to receive the new text.  If the new text fits in
@@ -375,6 +410,8 @@ void gap_buffer<Ch, Tr>::insert(size_type pos, Ch ch) {
 
 	assert(pos <= size() && pos >= 0);
 
+	detach();
+
 	const size_type length = 1;
 
 	/* Prepare the buffer to receive the new text.  If the new text fits in
@@ -395,16 +432,52 @@ void gap_buffer<Ch, Tr>::insert(size_type pos, Ch ch) {
 	size_      += length;
 }
 
+/*
+** Moves the gap to "pos", making it at least "length" long, so that the caller
+** can put text straight into it rather than passing a copy to insert. Nothing
+** is part of the text until it's handed over with fill_gap.
+*/
+template <class Ch, class Tr>
+Ch *gap_buffer<Ch, Tr>::reserve_gap(size_type pos, size_type length) {
+
+	assert(pos <= size() && pos >= 0);
+	assert(length >= 0);
+
+	detach();
+
+	if (length > gap_size()) {
+		reallocate_buffer(pos, length + PreferredGapSize);
+	} else if (pos != gap_start_) {
+		move_gap(pos);
+	}
+
+	return &buf_[gap_start_];
+}
+
+/*
+** Makes the first "length" characters of the gap, written since the call to
+** reserve_gap, part of the text.
+*/
+template <class Ch, class Tr>
+void gap_buffer<Ch, Tr>::fill_gap(size_type length) noexcept {
+
+	assert(length >= 0 && length <= gap_size());
+
+	gap_start_ += length;
+	size_      += length;
+}
+
 /**
  *
  */
 template <class Ch, class Tr>
-auto gap_buffer<Ch, Tr>::erase(size_type start, size_type end) noexcept -> size_type {
+auto gap_buffer<Ch, Tr>::erase(size_type start, size_type end) -> size_type {
 
 	assert(start <= size() && start >= 0);
 	assert(end   <= size() && end   >= 0);
 	assert(start <= end);
 
+	detach();
 	delete_range(start, end);
 	return start;
 }
@@ -437,7 +510,15 @@ void gap_buffer<Ch, Tr>::assign(view_type str) {
  *
  */
 template <class Ch, class Tr>
-void gap_buffer<Ch, Tr>::clear() noexcept {
+void gap_buffer<Ch, Tr>::clear() {
+
+	// there's no need to copy mapped text just to throw it away
+	if (mapped_) {
+		gap_buffer empty;
+		swap(empty);
+		return;
+	}
+
 	erase(0, size());
 }
 
@@ -481,6 +562,7 @@ void gap_buffer<Ch, Tr>::reallocate_buffer(size_type new_gap_start, size_type ne
 	}
 
 	buf_       = std::move(new_buffer);
+	text_      = buf_.get();
 	gap_start_ = new_gap_start;
 	gap_end_   = new_gap_end;
 
@@ -511,11 +593,56 @@ void gap_buffer<Ch, Tr>::delete_range(size_type start, size_type end) noexcept {
 	size_ -= (end - start);
 }
 
+/*
+** Show "text", which is "length" characters long, in place of the contents
+** of the buffer, without copying it. The text is only read from until the
+** buffer is first changed, when it is copied into a buffer of its own. This
+** is meant for large files mapped into memory, whose pages are then only
+** read in as they are looked at.
+*/
+template <class Ch, class Tr>
+void gap_buffer<Ch, Tr>::map(std::shared_ptr<const Ch> text, size_type length) noexcept {
+
+	buf_       = nullptr;
+	mapped_    = std::move(text);
+	text_      = mapped_.get();
+	gap_start_ = length;
+	gap_end_   = length;
+	size_      = length;
+}
+
+/*
+** Copy the text shown by a mapped buffer into a buffer of its own, so that
+** it can be changed. Does nothing if the buffer isn't mapped.
+*/
+template <class Ch, class Tr>
+void gap_buffer<Ch, Tr>::detach() {
+
+	if (!mapped_) {
+		return;
+	}
+
+	auto new_buffer = std::make_unique<Ch[]>(size_ + PreferredGapSize);
+	Tr::copy(&new_buffer[0], mapped_.get(), static_cast<size_t>(size_));
+
+	buf_       = std::move(new_buffer);
+	mapped_    = nullptr;
+	text_      = buf_.get();
+	gap_start_ = size_;
+	gap_end_   = size_ + PreferredGapSize;
+
+#ifdef PURIFY
+	std::fill(&buf_[gap_start_], &buf_[gap_end_], Ch('.'));
+#endif
+}
+
 template <class Ch, class Tr>
 void gap_buffer<Ch, Tr>::swap(gap_buffer &other) noexcept {
 	using std::swap;
 
 	swap(buf_,       other.buf_);
+	swap(mapped_,    other.mapped_);
+	swap(text_,      other.text_);
 	swap(gap_start_, other.gap_start_);
 	swap(gap_end_,   other.gap_end_);
 	swap(size_,      other.size_);
@@ -9,6 +9,7 @@
 #include "Highlight.h"
 #include "HighlightPattern.h"
 #include "MainWindow.h"
+#include "PaintStatistics.h"
 #include "Preferences.h"
 #include "RangesetTable.h"
 #include "Search.h"
@@ -17,6 +18,7 @@
 #include "SmartIndent.h"
 #include "TextArea.h"
 #include "TextBuffer.h"
+#include "TextFile.h"
 #include "WrapMode.h"
 #include "interpret.h"
 #include "parse.h"
@@ -27,7 +29,6 @@
 
 #include <boost/optional.hpp>
 #include <stack>
-#include <fstream>
 
 #include <QClipboard>
 #include <QDialogButtonBox>
@@ -66,6 +67,7 @@ static std::error_code selectMS(DocumentWidget *document, Arguments arguments, D
 static std::error_code selectRectangleMS(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code tPrintMS(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code getenvMS(DocumentWidget *document, Arguments arguments, DataValue *result);
+static std::error_code paintStatisticsMS(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code shellCmdMS(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code dialogMS(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code stringDialogMS(DocumentWidget *document, Arguments arguments, DataValue *result);
@@ -124,6 +126,7 @@ static std::error_code tabDistMV(DocumentWidget *document, Arguments arguments,
 static std::error_code emTabDistMV(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code useTabsMV(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code modifiedMV(DocumentWidget *document, Arguments arguments, DataValue *result);
+static std::error_code undoMemoryMV(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code languageModeMV(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code calltipIDMV(DocumentWidget *document, Arguments arguments, DataValue *result);
 static std::error_code rangesetListMV(DocumentWidget *document, Arguments arguments, DataValue *result);
@@ -1942,6 +1945,7 @@ static const SubRoutine MacroSubrs[] = {
 	{ "tolower",                 tolowerMS },
 	{ "list_dialog",             listDialogMS },
 	{ "getenv",                  getenvMS },
+	{ "paint_statistics",        paintStatisticsMS },
 	{ "string_compare",          stringCompareMS },
 	{ "split",                   splitMS },
 	{ "calltip",                 calltipMS },
@@ -1985,6 +1989,7 @@ static SubRoutine SpecialVars[] = {
 	{ "$use_tabs",                useTabsMV },
 	{ "$language_mode",           languageModeMV },
 	{ "$modified",                modifiedMV },
+	{ "$undo_memory",             undoMemoryMV },
 	{ "$statistics_line",         statisticsLineMV },
 	{ "$incremental_search_line", incSearchLineMV },
 	{ "$show_line_numbers",       showLineNumbersMV },
@@ -2714,20 +2719,19 @@ static std::error_code readFileMS(DocumentWidget *document, Arguments arguments,
 		return ec;
 	}
 
-	// Read the whole file into an allocated string
-	try {
-		std::ifstream file(name, std::ios::binary);
-		if(file) {
-			std::string contents(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
-
-			*result = make_value(contents);
+	// Read the whole file into the string the result will hold
+	TextFileReader file(QString::fromStdString(name), false);
+	if(file.open()) {
+		std::string contents;
+		if(file.readAll(&contents)) {
+			*result = make_value(std::move(contents));
 
 			// Return the results
 			ReturnGlobals[READ_STATUS]->value = make_value(true);
 			return MacroErrorCode::Success;
 		}
-	} catch(const std::ios_base::failure &ex) {
-		qWarning("NEdit: Error while reading file. %s", ex.what());
+
+		qWarning("NEdit: Error while reading file. %s", qPrintable(file.errorString()));
 	}
 
 	ReturnGlobals[READ_STATUS]->value = make_value(false);
@@ -2754,26 +2758,30 @@ static std::error_code writeOrAppendFile(bool append, DocumentWidget *document,
 	Q_UNUSED(document)
 
 	std::string name;
-	std::string string;
+	std::string number;
+	view::string_view string;
 
 	// Validate argument
-	if(std::error_code ec = readArguments(arguments, 0, &string, &name)) {
-		return ec;
+	if(arguments.size() < 2) {
+		return MacroErrorCode::WrongNumberOfArguments;
 	}
 
-	std::ofstream file(name, append ? std::ios::app | std::ios::out : std::ios::out);
-	if(!file) {
-		*result = make_value(false);
-		return MacroErrorCode::Success;
+	if(std::error_code ec = readArgument(arguments[1], &name)) {
+		return ec;
 	}
 
-	if(!file.write(string.data(), static_cast<std::streamsize>(string.size()))) {
-		*result = make_value(false);
-		return MacroErrorCode::Success;
+	// write strings from where the macro holds them, rather than a copy
+	if(is_string(arguments[0])) {
+		string = to_string_view(arguments[0]);
+	} else {
+		if(std::error_code ec = readArgument(arguments[0], &number)) {
+			return ec;
+		}
+		string = number;
 	}
 
 	// return the status
-	*result = make_value(true);
+	*result = make_value(WriteTextFile(QString::fromStdString(name), string, append));
 	return MacroErrorCode::Success;
 }
 
@@ -3116,6 +3124,69 @@ static std::error_code getenvMS(DocumentWidget *document, Arguments arguments, D
 	return MacroErrorCode::Success;
 }
 
+/*
+** Built-in macro subroutine for the paint instrumentation of the current
+** window's text panes. Returns the histograms of the repaints recorded so
+** far, the optional keywords "on", "off" and "reset" start, stop or restart
+** the recording. "scroll", followed by an optional number of lines, instead
+** times scrolling down through the text of each pane
+*/
+static std::error_code paintStatisticsMS(DocumentWidget *document, Arguments arguments, DataValue *result) {
+
+	if (arguments.size() > 2) {
+		return MacroErrorCode::WrongNumberOfArguments;
+	}
+
+	std::string action;
+	int lines = 1000;
+	if (!arguments.empty()) {
+		if(std::error_code ec = readArguments(arguments, 0, &action)) {
+			return ec;
+		}
+
+		if (action != "on" && action != "off" && action != "reset" && action != "scroll") {
+			return MacroErrorCode::UnrecognizedArgument;
+		}
+
+		if (arguments.size() == 2) {
+			if (action != "scroll") {
+				return MacroErrorCode::WrongNumberOfArguments;
+			}
+
+			if(std::error_code ec = readArgument(arguments[1], &lines)) {
+				return ec;
+			}
+		}
+	}
+
+	QString report;
+	const std::vector<TextArea *> panes = document->textPanes();
+	for (size_t i = 0; i < panes.size(); ++i) {
+		TextArea *area = panes[i];
+
+		if (action == "scroll") {
+			report += QString(QLatin1String("pane %1: %2")).arg(i + 1).arg(area->measureScrolling(lines));
+			continue;
+		}
+
+		if (PaintStatistics *stats = area->paintStatistics()) {
+			report += QString(QLatin1String("pane %1: %2\n")).arg(i + 1).arg(stats->report());
+			if (action == "reset") {
+				stats->reset();
+			}
+		}
+
+		if (action == "on") {
+			area->setPaintStatisticsEnabled(true);
+		} else if (action == "off") {
+			area->setPaintStatisticsEnabled(false);
+		}
+	}
+
+	*result = make_value(report);
+	return MacroErrorCode::Success;
+}
+
 static std::error_code shellCmdMS(DocumentWidget *document, Arguments arguments, DataValue *result) {
 
 	QString cmdString;
@@ -4311,6 +4382,14 @@ static std::error_code modifiedMV(DocumentWidget *document, Arguments arguments,
 	return MacroErrorCode::Success;
 }
 
+static std::error_code undoMemoryMV(DocumentWidget *document, Arguments arguments, DataValue *result) {
+
+	Q_UNUSED(arguments)
+
+	*result = make_value(static_cast<int64_t>(document->undoMemoryUsage()));
+	return MacroErrorCode::Success;
+}
+
 static std::error_code languageModeMV(DocumentWidget *document, Arguments arguments, DataValue *result) {
 
 	Q_UNUSED(arguments)
@@ -0,0 +1,118 @@
+
+#include "ProgressTask.h"
+
+#include <QApplication>
+#include <QProgressDialog>
+#include <QThread>
+#include <QTimer>
+
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// work which is over before the dialog would show up runs to completion
+int testQuickWork() {
+	ProgressTask task(nullptr, QLatin1String("quick"), 100);
+
+	bool ran = false;
+	const bool finished = task.exec([&ran](ProgressTask &progress) {
+		progress.setDone(100);
+		ran = true;
+	});
+
+	if (!finished || !ran) {
+		std::cerr << "ERROR    : quick work didn't finish" << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+// an exception thrown by the work is thrown again to the caller
+int testException() {
+	ProgressTask task(nullptr, QLatin1String("throwing"), 100);
+
+	try {
+		task.exec([](ProgressTask &) {
+			throw std::runtime_error("failed");
+		});
+	} catch (const std::runtime_error &) {
+		return 0;
+	}
+
+	std::cerr << "ERROR    : exception from the work was lost" << std::endl;
+	return -1;
+}
+
+/* work which runs long enough for the dialog to show up can be cancelled
+   from it, and exec waits for the work to notice before returning */
+int testCancel() {
+	ProgressTask task(nullptr, QLatin1String("cancelled"), 1000);
+
+	// press cancel once the dialog is up
+	QTimer timer;
+	timer.setInterval(50);
+	QObject::connect(&timer, &QTimer::timeout, [&timer]() {
+		if (auto dialog = qobject_cast<QProgressDialog *>(QApplication::activeModalWidget())) {
+			dialog->cancel();
+			timer.stop();
+		}
+	});
+	timer.start();
+
+	std::atomic<bool> stopped{false};
+	const bool finished = task.exec([&stopped](ProgressTask &progress) {
+		for (int64_t i = 0; !progress.isCanceled(); ++i) {
+			progress.setDone(i % 1000);
+			QThread::msleep(10);
+		}
+
+		stopped = true;
+	});
+
+	if (finished || !stopped) {
+		std::cerr << "ERROR    : cancelling didn't stop the work" << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+// events keep being processed while the work runs
+int testEventsProcessed() {
+	ProgressTask task(nullptr, QLatin1String("events"), 100);
+
+	int ticks = 0;
+	QTimer timer;
+	timer.setInterval(10);
+	QObject::connect(&timer, &QTimer::timeout, [&ticks]() {
+		++ticks;
+	});
+	timer.start();
+
+	task.exec([](ProgressTask &) {
+		QThread::msleep(300);
+	});
+
+	if (ticks == 0) {
+		std::cerr << "ERROR    : no events were processed during the work" << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+
+	QApplication app(argc, argv);
+
+	if (testQuickWork() != 0 || testException() != 0 || testCancel() != 0 || testEventsProcessed() != 0) {
+		return -1;
+	}
+
+	std::cout << "SUCCESS\n";
+}
@@ -0,0 +1,76 @@
+
+#include "RangesetTable.h"
+#include "TextBuffer.h"
+
+#include <iostream>
+#include <vector>
+
+namespace {
+
+struct ExpectedRun {
+	int start;
+	int end;
+	size_t index;
+};
+
+bool checkRuns(RangesetTable &table, TextBuffer &buffer, const std::vector<ExpectedRun> &expected, const char *when) {
+
+	std::vector<RangesetTable::ColorRun> runs;
+	table.colorRuns(TextCursor(), buffer.BufEndOfBuffer(), &runs);
+
+	bool ok = (runs.size() == expected.size());
+	for (size_t i = 0; ok && i < runs.size(); ++i) {
+		ok = runs[i].start == TextCursor(expected[i].start) && runs[i].end == TextCursor(expected[i].end) && runs[i].index == expected[i].index;
+	}
+
+	if (!ok) {
+		std::cerr << "ERROR    : wrong color runs " << when << ", got:";
+		for (const RangesetTable::ColorRun &run : runs) {
+			std::cerr << " [" << to_integer(run.start) << ", " << to_integer(run.end) << ") of " << run.index;
+		}
+		std::cerr << std::endl;
+	}
+
+	return ok;
+}
+
+}
+
+int main() {
+
+	TextBuffer buffer;
+	buffer.BufSetAll("hello world, hello rangesets");
+
+	RangesetTable table(&buffer);
+
+	// a single colored rangeset, the whole index being built for it
+	Rangeset *first = table.RangesetFetch(table.RangesetCreate());
+	first->RangesetAdd(TextRange{TextCursor(6), TextCursor(11)});
+	first->setColor(&buffer, QLatin1String("red"));
+
+	if (!checkRuns(table, buffer, {{6, 11, 1}}, "for one rangeset")) {
+		return -1;
+	}
+
+	// a new rangeset goes in front of the others, and colors the text it shares with them
+	Rangeset *second = table.RangesetFetch(table.RangesetCreate());
+	second->RangesetAdd(TextRange{TextCursor(0), TextCursor(8)});
+	second->setColor(&buffer, QLatin1String("blue"));
+
+	if (!checkRuns(table, buffer, {{0, 8, 1}, {8, 11, 2}}, "for overlapping rangesets")) {
+		return -1;
+	}
+
+	if (table.index1ofPos(TextCursor(9), /*needs_color=*/true) != 2) {
+		std::cerr << "ERROR    : wrong rangeset found at a position" << std::endl;
+		return -1;
+	}
+
+	// the runs move along with the text
+	buffer.BufInsertEx(TextCursor(), "ab");
+	if (!checkRuns(table, buffer, {{2, 10, 1}, {10, 13, 2}}, "after an insertion")) {
+		return -1;
+	}
+
+	std::cout << "SUCCESS\n";
+}
@@ -0,0 +1,103 @@
+
+#include "TextBuffer.h"
+#include "UndoInfo.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+long long millisecondsSince(Clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+/*
+** Types "count" characters into a buffer and deletes them again with
+** backspace, saving the deleted text the way DocumentWidget's undo records
+** do. The deletions are also timed with the text inserted at the front of a
+** string, as the undo records did before.
+*/
+void benchmark(int count) {
+
+	TextBuffer buffer;
+
+	auto start = Clock::now();
+
+	UndoInfo typing(ONE_CHAR_INSERT, TextCursor(), TextCursor());
+	for (int i = 0; i < count; ++i) {
+		buffer.BufInsertEx(typing.endPos, static_cast<char>('a' + i % 26));
+		++typing.endPos;
+	}
+
+	std::cout << "typing " << count << " characters: " << millisecondsSince(start) << "ms\n";
+
+	TextBuffer reference;
+	reference.BufSetAll(buffer.BufGetAllEx());
+
+	start = Clock::now();
+
+	UndoInfo deleting(ONE_CHAR_DELETE, buffer.BufEndOfBuffer(), buffer.BufEndOfBuffer());
+	for (TextCursor pos = buffer.BufEndOfBuffer(); pos != TextCursor(); --pos) {
+		const char ch = buffer.BufGetCharacter(pos - 1);
+		buffer.BufRemove(pos - 1, pos);
+		deleting.prependOldText(view::string_view(&ch, 1));
+		deleting.startPos = pos - 1;
+	}
+
+	const std::string deleted = deleting.oldText();
+	const long long current   = millisecondsSince(start);
+
+	start = Clock::now();
+
+	std::string oldText;
+	for (TextCursor pos = reference.BufEndOfBuffer(); pos != TextCursor(); --pos) {
+		const char ch = reference.BufGetCharacter(pos - 1);
+		reference.BufRemove(pos - 1, pos);
+		oldText.insert(0, 1, ch);
+	}
+
+	std::cout << "deleting them backwards: " << current << "ms, was " << millisecondsSince(start) << "ms" << (deleted == oldText ? "" : " (MISMATCH)") << '\n';
+}
+
+}
+
+int main(int argc, char *argv[]) {
+
+	// a run of backspaces followed by forward deletes
+	UndoInfo undo(ONE_CHAR_DELETE, TextCursor(5), TextCursor(5));
+	for (const char *ch : {"e", "d", "c", "b", "a"}) {
+		undo.prependOldText(ch);
+	}
+
+	undo.appendOldText("fgh");
+	if (undo.oldText() != "abcdefgh") {
+		std::cerr << "ERROR    : wrong text saved by a run of deletes: " << undo.oldText() << std::endl;
+		return -1;
+	}
+
+	// the text is put together before being compressed, and stays the same after
+	const std::string large(UNDO_COMPRESS_THRESHOLD * 2, 'x');
+	undo.appendOldText(large);
+	undo.prependOldText("0");
+	undo.compress();
+	if (undo.oldText() != "0abcdefgh" + large) {
+		std::cerr << "ERROR    : wrong text saved after compressing it" << std::endl;
+		return -1;
+	}
+
+	undo.prependOldText("1");
+	if (undo.oldText() != "10abcdefgh" + large) {
+		std::cerr << "ERROR    : wrong text saved when deleting after compressing" << std::endl;
+		return -1;
+	}
+
+	if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+		benchmark(1000000);
+	}
+
+	std::cout << "SUCCESS\n";
+}